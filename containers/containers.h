@@ -597,6 +597,24 @@ typedef struct VC_CONTAINER_WRITE_STATS_T
    /** This logs the length of time that we wait for a flush command to complete. */
    VC_CONTAINER_STATS_T flush;
 } VC_CONTAINER_WRITE_STATS_T;
+
+/** This type represents the read-ahead statistics saved by the io layer. */
+typedef struct VC_CONTAINER_READ_STATS_T
+{
+   /** Number of cache refills served from data which had already been read ahead. */
+   uint32_t hits;
+   /** Number of cache refills which had to wait for a read ahead still in progress. */
+   uint32_t stalls;
+   /** Number of cache refills which had to be done synchronously. */
+   uint32_t misses;
+   /** Number of times reading ahead was cancelled (e.g. because of a seek). */
+   uint32_t cancels;
+   /** This logs the number of bytes read ahead in count, and the microseconds taken to read
+    * in num. */
+   VC_CONTAINER_STATS_T read;
+   /** This logs the length of time the reader had to wait for a read ahead to complete. */
+   VC_CONTAINER_STATS_T stall;
+} VC_CONTAINER_READ_STATS_T;
    
 
 /** Control operations which can be done on containers. */
@@ -717,6 +735,16 @@ typedef enum
     *   arg2= VC_CONTAINER_FOURCC_T: codec variant to output */
    VC_CONTAINER_CONTROL_TRACK_PACKETIZE,
 
+   /** Enable reading ahead on a background thread when the i/o is read sequentially.\n
+    * Arguments:\n
+    *   arg1= uint32_t: number of cache areas to read ahead, 0 to disable */
+   VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD,
+
+   /** Collects read-ahead statistics (enabled with VC_CONTAINER_CONTROL_SET_IO_PERF_STATS).\n
+    * Arguments:\n
+    *   arg1= VC_CONTAINER_READ_STATS_T *: */
+   VC_CONTAINER_CONTROL_GET_IO_READ_STATS,
+
    /** Private user extensions must be above this number */
    VC_CONTAINER_CONTROL_USER_EXTENSIONS = 0x1000
 
@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "containers/core/containers_common.h"
 #include "containers/core/containers_utils.h"
 #include "containers/core/containers_uri.h"
+#include "vcos.h"
 
 #define MAX_NUM_CACHED_AREAS 16
 #define MAX_NUM_MEMORY_AREAS 4
@@ -43,6 +44,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MEM_CACHE_TMP_MAX_SIZE (32*1024) /* Needs to be a power of 2 */
 #define MEM_CACHE_ALIGNMENT (1*1024) /* Needs to be a power of 2 */
 #define MEM_CACHE_AREA_READ_MAX_SIZE (4*1024*1024) /* Needs to be a power of 2 */
+#define MAX_NUM_READ_AHEAD_AREAS 8
+#define READ_AHEAD_TRIGGER 2 /* Number of contiguous refills before reading ahead */
 
 typedef struct VC_CONTAINER_IO_PRIVATE_CACHE_T
 {
@@ -79,6 +82,9 @@ typedef struct VC_CONTAINER_IO_PRIVATE_T
    int64_t actual_offset;
 
    struct VC_CONTAINER_IO_ASYNC_T *async_io;
+   struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead;
+
+   VC_CONTAINER_IO_MODE_T mode;
 
 } VC_CONTAINER_IO_PRIVATE_T;
 
@@ -93,6 +99,8 @@ VC_CONTAINER_STATUS_T vc_container_io_pktfile_open( VC_CONTAINER_IO_T *p_ctx, co
                                                  VC_CONTAINER_IO_MODE_T mode );
 VC_CONTAINER_STATUS_T vc_container_io_http_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
                                                  VC_CONTAINER_IO_MODE_T mode );
+VC_CONTAINER_STATUS_T vc_container_io_file64_open( VC_CONTAINER_IO_T *p_ctx, const char *uri,
+                                                 VC_CONTAINER_IO_MODE_T mode );
 static VC_CONTAINER_STATUS_T io_seek_not_seekable(VC_CONTAINER_IO_T *p_ctx, int64_t offset);
 
 static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
@@ -114,6 +122,15 @@ static VC_CONTAINER_STATUS_T async_io_wait_complete( struct VC_CONTAINER_IO_ASYN
 static void async_io_stats_initialise( struct VC_CONTAINER_IO_ASYNC_T *ctx, int enable );
 static void async_io_stats_get( struct VC_CONTAINER_IO_ASYNC_T *ctx, VC_CONTAINER_WRITE_STATS_T *stats );
 
+static struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead_create( VC_CONTAINER_IO_T *io, unsigned int num_areas );
+static void read_ahead_delete( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx );
+static void read_ahead_cancel( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx );
+static bool read_ahead_covers( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, int64_t offset );
+static size_t read_ahead_refill( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
+static void read_ahead_update( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_IO_PRIVATE_CACHE_T *cache );
+static void read_ahead_stats_initialise( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, int enable );
+static void read_ahead_stats_get( struct VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_STATS_T *stats );
+
 /*****************************************************************************/
 static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAINER_IO_MODE_T mode,
                                                      VC_CONTAINER_IO_CAPABILITIES_T capabilities,
@@ -134,6 +151,7 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
    p_ctx->priv = private = (VC_CONTAINER_IO_PRIVATE_T *)&p_ctx[1];
    p_ctx->uri = (char *)&private[1];
    memcpy((char *)p_ctx->uri, uri, uri_length);
+   private->mode = mode;
    p_ctx->uri_parts = vc_uri_create();
    if(!p_ctx->uri_parts) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
    vc_uri_parse(p_ctx->uri_parts, uri);
@@ -146,6 +164,9 @@ static VC_CONTAINER_IO_T *vc_container_io_open_core( const char *uri, VC_CONTAIN
       if(status) status = vc_container_io_pktfile_open(p_ctx, uri, mode);
 #ifdef ENABLE_CONTAINER_IO_HTTP
       if(status) status = vc_container_io_http_open(p_ctx, uri, mode);
+#endif
+#ifdef ENABLE_CONTAINER_IO_FILE64
+      if(status) status = vc_container_io_file64_open(p_ctx, uri, mode);
 #endif
       if(status) status = vc_container_io_file_open(p_ctx, uri, mode);
       if(status != VC_CONTAINER_SUCCESS) goto error;
@@ -236,6 +257,9 @@ VC_CONTAINER_STATUS_T vc_container_io_close( VC_CONTAINER_IO_T *p_ctx )
    {
       if(p_ctx->priv)
       {
+         if(p_ctx->priv->read_ahead)
+            read_ahead_delete( p_ctx->priv->read_ahead );
+
          if(p_ctx->priv->caches_num)
          {
             if(p_ctx->priv->caches.dirty)
@@ -426,6 +450,39 @@ VC_CONTAINER_STATUS_T vc_container_io_control_list(VC_CONTAINER_IO_T *context, V
       async_io_stats_get(context->priv->async_io, va_arg(args, VC_CONTAINER_WRITE_STATS_T *));
    }
 
+   if(operation == VC_CONTAINER_CONTROL_SET_IO_PERF_STATS && context->priv->read_ahead)
+   {
+      status = VC_CONTAINER_SUCCESS;
+      read_ahead_stats_initialise(context->priv->read_ahead, va_arg(args, int));
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_GET_IO_READ_STATS && context->priv->read_ahead)
+   {
+      status = VC_CONTAINER_SUCCESS;
+      read_ahead_stats_get(context->priv->read_ahead, va_arg(args, VC_CONTAINER_READ_STATS_T *));
+   }
+
+   if(operation == VC_CONTAINER_CONTROL_IO_SET_READ_AHEAD)
+   {
+      unsigned int num_areas = va_arg(args, uint32_t);
+
+      /* Read-ahead only makes sense for seekable streams being read through our cache */
+      if(context->priv->mode != VC_CONTAINER_IO_MODE_READ || !context->priv->caches_num ||
+         (context->capabilities & VC_CONTAINER_IO_CAPS_CANT_SEEK))
+         return VC_CONTAINER_ERROR_UNSUPPORTED_OPERATION;
+
+      if(context->priv->read_ahead)
+         read_ahead_delete(context->priv->read_ahead);
+      context->priv->read_ahead = 0;
+
+      status = VC_CONTAINER_SUCCESS;
+      if(num_areas)
+      {
+         context->priv->read_ahead = read_ahead_create(context, num_areas);
+         if(!context->priv->read_ahead) status = VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      }
+   }
+
    return status;
 }
 
@@ -452,6 +509,9 @@ size_t vc_container_io_cache(VC_CONTAINER_IO_T *p_ctx, size_t size)
    /* Sanity checking */
    if(private->cached_areas_num >= MAX_NUM_CACHED_AREAS) return 0;
 
+   /* We'll be reading directly from the stream */
+   if(private->read_ahead) read_ahead_cancel(private->read_ahead);
+
    cache = &private->cached_areas[private->cached_areas_num];
    cache->start = p_ctx->offset;
    cache->end = cache->start + size;
@@ -512,10 +572,21 @@ size_t vc_container_io_cache(VC_CONTAINER_IO_T *p_ctx, size_t size)
 static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
    VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
 {
+   struct VC_CONTAINER_IO_READ_AHEAD_T *read_ahead = p_ctx->priv->read_ahead;
    size_t ret = vc_container_io_cache_flush( p_ctx, cache, 1 );
 
    if(ret) return 0; /* TODO what should we do there ? */
 
+   /* Use the data read ahead if we've got it. Otherwise stop the background reads
+    * before accessing the stream ourselves. */
+   if(read_ahead && cache == &p_ctx->priv->caches)
+   {
+      ret = read_ahead_refill( read_ahead, cache );
+      if(ret) return ret;
+   }
+   else if(read_ahead)
+      read_ahead_cancel( read_ahead );
+
    if(p_ctx->priv->actual_offset != cache->offset)
    {
       if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
@@ -526,6 +597,9 @@ static size_t vc_container_io_cache_refill( VC_CONTAINER_IO_T *p_ctx,
    cache->size = ret;
    cache->position = 0;
    cache->io->priv->actual_offset = cache->offset + ret;
+
+   if(read_ahead && cache == &p_ctx->priv->caches)
+      read_ahead_update( read_ahead, cache );
    return ret;
 }
 
@@ -537,6 +611,8 @@ static size_t vc_container_io_cache_refill_bypass( VC_CONTAINER_IO_T *p_ctx,
 
    if(ret) return 0; /* TODO what should we do there ? */
 
+   if(p_ctx->priv->read_ahead) read_ahead_cancel( p_ctx->priv->read_ahead );
+
    if(p_ctx->priv->actual_offset != cache->offset)
    {
       if(cache->io->pf_seek(cache->io, cache->offset) != VC_CONTAINER_SUCCESS)
@@ -561,8 +637,10 @@ static size_t vc_container_io_cache_read( VC_CONTAINER_IO_T *p_ctx,
       bytes = cache->size - cache->position; /* Bytes left in cache */
 
 #if 1 // FIXME Only if stream is seekable
-      /* Try to read directly from the stream if the cache just gets in the way */
-      if(!bytes && size > cache->mem_size)
+      /* Try to read directly from the stream if the cache just gets in the way.
+       * This isn't the case if the data has already been read ahead. */
+      if(!bytes && size > cache->mem_size &&
+         !(p_ctx->priv->read_ahead && read_ahead_covers(p_ctx->priv->read_ahead, cache->offset + cache->size)))
       {
          bytes = cache->mem_size;
          ret = vc_container_io_cache_refill_bypass( p_ctx, cache, data + read, bytes);
@@ -671,6 +749,18 @@ static VC_CONTAINER_STATUS_T vc_container_io_cache_seek(VC_CONTAINER_IO_T *p_ctx
       return VC_CONTAINER_SUCCESS;
    }
 
+   /* Check if the seek position is within the data being read ahead */
+   if(p_ctx->priv->read_ahead && cache == &p_ctx->priv->caches &&
+      read_ahead_covers(p_ctx->priv->read_ahead, offset))
+   {
+      vc_container_io_cache_flush( p_ctx, cache, 1 );
+      cache->offset = offset;
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   /* Anything else means accessing the stream directly */
+   if(p_ctx->priv->read_ahead) read_ahead_cancel( p_ctx->priv->read_ahead );
+
    shift = cache->buffer - cache->mem;
    if(!cache->dirty && shift && cache->size &&
       offset >= cache->offset - (int64_t)shift && offset < cache->offset)
@@ -748,15 +838,10 @@ static size_t vc_container_io_cache_flush( VC_CONTAINER_IO_T *p_ctx,
 }
 
 /*****************************************************************************
- * Asynchronous I/O.
- * This is here to keep the I/O as busy as possible by allowing the writer
- * to continue its work while the I/O is taking place in the background.
+ * Performance statistics, shared by the asynchronous writes and the read-ahead.
  *****************************************************************************/
 
-#ifdef ENABLE_CONTAINERS_ASYNC_IO
-#include "vcos.h"
-
-#define NUMPC(c,n,s) ((c) < (1<<(s)) ? (n) : ((n) / (c >> (s))))
+#define NUMPC(c,n,s) ((uint32_t)(c) < ((uint32_t)1 << (s)) ? (n) : ((n) / ((uint32_t)(c) >> (s))))
 
 static void stats_initialise(VC_CONTAINER_STATS_T *st, uint32_t shift)
 {
@@ -829,6 +914,14 @@ static void stats_add_value(VC_CONTAINER_STATS_T *st, uint32_t count, uint32_t n
    }
 }
 
+/*****************************************************************************
+ * Asynchronous I/O.
+ * This is here to keep the I/O as busy as possible by allowing the writer
+ * to continue its work while the I/O is taking place in the background.
+ *****************************************************************************/
+
+#ifdef ENABLE_CONTAINERS_ASYNC_IO
+
 typedef struct VC_CONTAINER_IO_ASYNC_T
 {
    VC_CONTAINER_IO_T *io;
@@ -1086,3 +1179,373 @@ static void async_io_stats_get( struct VC_CONTAINER_IO_ASYNC_T *ctx, VC_CONTAINE
 
 
 #endif
+
+/*****************************************************************************
+ * Read-ahead.
+ * Once the cache is seen being refilled sequentially, the next cache areas
+ * are read on a background thread so the reader doesn't have to wait for the
+ * i/o when it runs out of cached data. Any access to the stream which doesn't
+ * follow the data being read ahead cancels it.
+ *****************************************************************************/
+
+typedef struct VC_CONTAINER_IO_READ_AHEAD_AREA_T
+{
+   uint8_t *mem;        /**< Memory area (swapped with the cache memory when consumed) */
+   int64_t offset;      /**< Offset of the area in the stream */
+   size_t size;         /**< Number of bytes requested */
+   size_t bytes;        /**< Number of bytes actually read */
+   bool ready;          /**< Whether the read has completed */
+
+} VC_CONTAINER_IO_READ_AHEAD_AREA_T;
+
+typedef struct VC_CONTAINER_IO_READ_AHEAD_T
+{
+   VC_CONTAINER_IO_T *io;
+   VCOS_THREAD_T thread;
+   VCOS_MUTEX_T lock;
+   VCOS_EVENT_T wake_event;   /**< Signalled when areas are queued or on exit */
+   VCOS_EVENT_T done_event;   /**< Signalled when a background read completes */
+   bool thread_started;
+   bool quit;
+   bool busy;                 /**< Background thread is reading from the stream */
+   bool active;               /**< Background thread owns the stream position */
+
+   unsigned int num_areas;
+   VC_CONTAINER_IO_READ_AHEAD_AREA_T area[MAX_NUM_READ_AHEAD_AREAS];
+   unsigned int head;         /**< Index of the oldest queued area */
+   unsigned int queued;       /**< Number of queued areas. Only modified by the reader */
+   unsigned int fetched;      /**< Number of queued areas which have been read */
+   int64_t next_offset;       /**< Offset of the next area to queue */
+   int64_t io_offset;         /**< Offset of the stream after the background reads */
+   bool error;                /**< A background read came back short */
+
+   int64_t last_end;          /**< End of the last synchronous refill */
+   unsigned int sequential;   /**< Number of contiguous synchronous refills */
+
+   int stats_enable;
+   VC_CONTAINER_READ_STATS_T stats;
+
+} VC_CONTAINER_IO_READ_AHEAD_T;
+
+/*****************************************************************************/
+static void *read_ahead_thread(void *argv)
+{
+   VC_CONTAINER_IO_READ_AHEAD_T *ctx = argv;
+
+   while (1)
+   {
+      vcos_event_wait(&ctx->wake_event);
+
+      vcos_mutex_lock(&ctx->lock);
+      while(!ctx->quit && !ctx->error && ctx->fetched < ctx->queued)
+      {
+         VC_CONTAINER_IO_READ_AHEAD_AREA_T *area =
+            &ctx->area[(ctx->head + ctx->fetched) % ctx->num_areas];
+         unsigned long time = 0;
+         size_t ret;
+
+         ctx->busy = 1;
+         vcos_mutex_unlock(&ctx->lock);
+
+         if(ctx->stats_enable)
+            time = vcos_getmicrosecs();
+
+         ret = ctx->io->pf_read(ctx->io, area->mem, area->size);
+
+         vcos_mutex_lock(&ctx->lock);
+         if(ctx->stats_enable)
+            stats_add_value(&ctx->stats.read, ret, vcos_getmicrosecs() - time);
+
+         ctx->busy = 0;
+         ctx->io_offset += ret;
+
+         /* The area might have been cancelled while we were reading it */
+         if(ctx->queued)
+         {
+            area->bytes = ret;
+            area->ready = 1;
+            ctx->fetched++;
+            if(ret != area->size) ctx->error = 1;
+         }
+         vcos_event_signal(&ctx->done_event);
+      }
+      if(ctx->quit) break;
+      vcos_mutex_unlock(&ctx->lock);
+   }
+   vcos_mutex_unlock(&ctx->lock);
+
+   return NULL;
+}
+
+/*****************************************************************************/
+static void read_ahead_queue( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   VC_CONTAINER_IO_T *io = ctx->io;
+   bool queued = 0;
+
+   /* Don't read past the known end of the stream. This keeps the background
+    * thread from ever hitting the end of stream. */
+   while(!ctx->error && ctx->queued < ctx->num_areas && ctx->next_offset < io->size)
+   {
+      VC_CONTAINER_IO_READ_AHEAD_AREA_T *area =
+         &ctx->area[(ctx->head + ctx->queued) % ctx->num_areas];
+
+      area->offset = ctx->next_offset;
+      area->size = io->priv->caches.mem_size;
+      if((int64_t)area->size > io->size - area->offset) area->size = io->size - area->offset;
+      area->bytes = 0;
+      area->ready = 0;
+      ctx->next_offset += area->size;
+      ctx->queued++;
+      queued = 1;
+   }
+
+   if(queued) vcos_event_signal(&ctx->wake_event);
+}
+
+/*****************************************************************************/
+static void read_ahead_cancel( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   vcos_mutex_lock(&ctx->lock);
+   if(!ctx->active)
+   {
+      vcos_mutex_unlock(&ctx->lock);
+      return;
+   }
+
+   /* Wait for sequential access again before restarting */
+   ctx->sequential = 0;
+   ctx->last_end = -1;
+
+   if(ctx->queued && ctx->stats_enable) ctx->stats.cancels++;
+   ctx->queued = ctx->fetched = 0;
+
+   /* Wait for any read in progress */
+   while(ctx->busy)
+   {
+      vcos_mutex_unlock(&ctx->lock);
+      vcos_event_wait(&ctx->done_event);
+      vcos_mutex_lock(&ctx->lock);
+   }
+
+   /* The stream is now wherever the background reads left it */
+   ctx->io->priv->actual_offset = ctx->io_offset;
+   ctx->active = 0;
+   ctx->error = 0;
+   vcos_mutex_unlock(&ctx->lock);
+}
+
+/*****************************************************************************/
+static bool read_ahead_covers( VC_CONTAINER_IO_READ_AHEAD_T *ctx, int64_t offset )
+{
+   /* queued and next_offset are only modified by the reader so no locking needed */
+   return ctx->queued && offset >= ctx->area[ctx->head].offset && offset < ctx->next_offset;
+}
+
+/*****************************************************************************/
+static size_t read_ahead_refill( VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_IO_READ_AHEAD_AREA_T *area;
+   unsigned long time = 0;
+   bool stalled = 0;
+   uint8_t *mem;
+
+   if(!read_ahead_covers(ctx, cache->offset))
+   {
+      read_ahead_cancel(ctx);
+      return 0;
+   }
+
+   vcos_mutex_lock(&ctx->lock);
+   while(1)
+   {
+      area = &ctx->area[ctx->head];
+
+      /* Wait for the read of this area to complete */
+      if(!area->ready)
+      {
+         /* The background thread stops fetching after a short read, this area
+          * will never be ready. Go back to reading synchronously. */
+         if(ctx->error || ctx->quit || !ctx->thread_started)
+         {
+            vcos_mutex_unlock(&ctx->lock);
+            read_ahead_cancel(ctx);
+            return 0;
+         }
+
+         if(!stalled && ctx->stats_enable) time = vcos_getmicrosecs();
+         stalled = 1;
+         vcos_mutex_unlock(&ctx->lock);
+         vcos_event_wait(&ctx->done_event);
+         vcos_mutex_lock(&ctx->lock);
+         continue;
+      }
+
+      if(cache->offset < area->offset + (int64_t)area->bytes)
+         break;
+
+      /* The data we want is further on */
+      if(cache->offset >= area->offset + (int64_t)area->size && ctx->queued > 1)
+      {
+         ctx->head = (ctx->head + 1) % ctx->num_areas;
+         ctx->queued--;
+         ctx->fetched--;
+         continue;
+      }
+
+      /* We didn't get the data (error or end of stream) */
+      vcos_mutex_unlock(&ctx->lock);
+      read_ahead_cancel(ctx);
+      return 0;
+   }
+
+   /* Swap the memory of the area with the cache one */
+   mem = cache->mem;
+   cache->mem = area->mem;
+   area->mem = mem;
+
+   cache->buffer = cache->mem;
+   cache->buffer_end = cache->mem + cache->mem_size;
+   cache->position = cache->offset - area->offset;
+   cache->offset = area->offset;
+   cache->size = area->bytes;
+
+   ctx->head = (ctx->head + 1) % ctx->num_areas;
+   ctx->queued--;
+   ctx->fetched--;
+
+   if(ctx->stats_enable)
+   {
+      if(stalled)
+      {
+         ctx->stats.stalls++;
+         stats_add_value(&ctx->stats.stall, 1, vcos_getmicrosecs() - time);
+      }
+      else ctx->stats.hits++;
+   }
+
+   /* Keep reading ahead */
+   read_ahead_queue(ctx);
+   vcos_mutex_unlock(&ctx->lock);
+
+   return cache->size - cache->position;
+}
+
+/*****************************************************************************/
+static void read_ahead_update( VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_IO_PRIVATE_CACHE_T *cache )
+{
+   VC_CONTAINER_IO_T *io = ctx->io;
+
+   if(ctx->stats_enable) ctx->stats.misses++;
+
+   if(cache->offset == ctx->last_end) ctx->sequential++;
+   else ctx->sequential = 0;
+   ctx->last_end = cache->offset + cache->size;
+
+   /* Only start reading ahead once the access looks sequential, and
+    * not when we've just hit the end of the stream */
+   if(ctx->sequential < READ_AHEAD_TRIGGER || !cache->size ||
+      cache->size != (size_t)(cache->buffer_end - cache->buffer) ||
+      ctx->last_end >= io->size)
+      return;
+
+   if(!ctx->thread_started)
+   {
+      if(vcos_thread_create(&ctx->thread, "read_ahead", NULL, read_ahead_thread, ctx) != VCOS_SUCCESS)
+         return;
+      ctx->thread_started = 1;
+   }
+
+   vcos_mutex_lock(&ctx->lock);
+   ctx->next_offset = ctx->last_end;
+   ctx->io_offset = io->priv->actual_offset;
+   ctx->active = 1;
+   ctx->error = 0;
+   read_ahead_queue(ctx);
+   vcos_mutex_unlock(&ctx->lock);
+}
+
+/*****************************************************************************/
+static void read_ahead_stats_initialise( VC_CONTAINER_IO_READ_AHEAD_T *ctx, int enable )
+{
+   vcos_mutex_lock(&ctx->lock);
+   ctx->stats_enable = enable;
+   memset(&ctx->stats, 0, sizeof(ctx->stats));
+   stats_initialise(&ctx->stats.read, 8);
+   stats_initialise(&ctx->stats.stall, 0);
+   vcos_mutex_unlock(&ctx->lock);
+}
+
+static void read_ahead_stats_get( VC_CONTAINER_IO_READ_AHEAD_T *ctx, VC_CONTAINER_READ_STATS_T *stats )
+{
+   vcos_mutex_lock(&ctx->lock);
+   *stats = ctx->stats;
+   vcos_mutex_unlock(&ctx->lock);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_IO_READ_AHEAD_T *read_ahead_create( VC_CONTAINER_IO_T *io, unsigned int num_areas )
+{
+   VC_CONTAINER_IO_READ_AHEAD_T *ctx;
+
+   if(num_areas > MAX_NUM_READ_AHEAD_AREAS) num_areas = MAX_NUM_READ_AHEAD_AREAS;
+
+   ctx = malloc(sizeof(*ctx));
+   if(!ctx) return 0;
+   memset(ctx, 0, sizeof(*ctx));
+   ctx->io = io;
+   ctx->last_end = -1;
+
+   for(ctx->num_areas = 0; ctx->num_areas < num_areas; ctx->num_areas++)
+   {
+      ctx->area[ctx->num_areas].mem = malloc(io->priv->caches.mem_size);
+      if(!ctx->area[ctx->num_areas].mem)
+         break;
+   }
+   if(!ctx->num_areas)
+      goto error_mem;
+
+   if(vcos_mutex_create(&ctx->lock, "read_ahead_lock") != VCOS_SUCCESS)
+      goto error_mem;
+   if(vcos_event_create(&ctx->wake_event, "read_ahead_wake") != VCOS_SUCCESS)
+      goto error_wake_event;
+   if(vcos_event_create(&ctx->done_event, "read_ahead_done") != VCOS_SUCCESS)
+      goto error_done_event;
+
+   read_ahead_stats_initialise(ctx, 0);
+
+   /* The thread is only started once we see sequential access */
+   return ctx;
+
+ error_done_event:
+   vcos_event_delete(&ctx->wake_event);
+ error_wake_event:
+   vcos_mutex_delete(&ctx->lock);
+ error_mem:
+   while(ctx->num_areas > 0)
+      free(ctx->area[--ctx->num_areas].mem);
+   free(ctx);
+   return 0;
+}
+
+static void read_ahead_delete( VC_CONTAINER_IO_READ_AHEAD_T *ctx )
+{
+   read_ahead_cancel(ctx);
+
+   if(ctx->thread_started)
+   {
+      vcos_mutex_lock(&ctx->lock);
+      ctx->quit = 1;
+      vcos_mutex_unlock(&ctx->lock);
+      vcos_event_signal(&ctx->wake_event);
+      vcos_thread_join(&ctx->thread, NULL);
+   }
+
+   vcos_event_delete(&ctx->done_event);
+   vcos_event_delete(&ctx->wake_event);
+   vcos_mutex_delete(&ctx->lock);
+
+   while(ctx->num_areas > 0)
+      free(ctx->area[--ctx->num_areas].mem);
+   free(ctx);
+}
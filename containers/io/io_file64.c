@@ -0,0 +1,335 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/** \file
+ * 64-bit file i/o module.
+ *
+ * This module uses pread / pwrite with 64-bit offsets so there is no limit on
+ * the size of the files which can be read or written. It is selected with the
+ * "file64" URI scheme (e.g. file64:///data/recording.mp4), or for all plain
+ * file paths when built with ENABLE_CONTAINER_IO_FILE64_DEFAULT.
+ *
+ * The "mmap" URI scheme (e.g. mmap:///data/archive.mkv) will map read-only
+ * inputs into memory so that reads become a simple memcpy from the page cache.
+ * If the mapping fails (e.g. not enough address space for the file) the module
+ * falls back to pread.
+ *
+ * The "access" URI query (sequential, random or normal) can be used to hint the
+ * kernel about the expected access pattern. By default the access pattern is
+ * tracked by the module and the hint updated when it changes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "containers/containers.h"
+#include "containers/core/containers_common.h"
+#include "containers/core/containers_io.h"
+#include "containers/core/containers_uri.h"
+
+/** Number of consecutive contiguous (or non-contiguous) reads after which
+ * the access pattern hint is changed */
+#define IO_FILE64_PATTERN_THRESHOLD 4
+
+typedef enum {
+   IO_FILE64_ACCESS_AUTO = 0,
+   IO_FILE64_ACCESS_NORMAL,
+   IO_FILE64_ACCESS_SEQUENTIAL,
+   IO_FILE64_ACCESS_RANDOM
+} IO_FILE64_ACCESS_T;
+
+typedef struct VC_CONTAINER_IO_MODULE_T
+{
+   int fd;
+   int64_t position;          /**< Offset of the next read / write */
+
+   uint8_t *map;              /**< Mapping of the whole file (read-only inputs only) */
+   size_t map_size;
+
+   IO_FILE64_ACCESS_T access; /**< Access pattern requested by the client */
+   IO_FILE64_ACCESS_T hint;   /**< Access pattern currently advised to the kernel */
+   int64_t last_end;          /**< End offset of the last read */
+   int contiguous;            /**< Positive count of contiguous reads, negative count of
+                                   non-contiguous ones */
+
+} VC_CONTAINER_IO_MODULE_T;
+
+VC_CONTAINER_STATUS_T vc_container_io_file64_open( VC_CONTAINER_IO_T *, const char *,
+   VC_CONTAINER_IO_MODE_T );
+
+/*****************************************************************************/
+static void io_file64_advise(VC_CONTAINER_IO_MODULE_T *module, IO_FILE64_ACCESS_T hint)
+{
+   int fadvice = POSIX_FADV_NORMAL, madvice = POSIX_MADV_NORMAL;
+
+   if(module->hint == hint)
+      return;
+   module->hint = hint;
+
+   if(hint == IO_FILE64_ACCESS_SEQUENTIAL)
+   {
+      fadvice = POSIX_FADV_SEQUENTIAL;
+      madvice = POSIX_MADV_SEQUENTIAL;
+   }
+   else if(hint == IO_FILE64_ACCESS_RANDOM)
+   {
+      fadvice = POSIX_FADV_RANDOM;
+      madvice = POSIX_MADV_RANDOM;
+   }
+
+   /* These are only hints so failures are ignored */
+   if(module->map)
+      posix_madvise(module->map, module->map_size, madvice);
+   else
+      posix_fadvise(module->fd, 0, 0, fadvice);
+}
+
+/*****************************************************************************/
+static void io_file64_track_access(VC_CONTAINER_IO_MODULE_T *module, int64_t offset, size_t size)
+{
+   if(module->access != IO_FILE64_ACCESS_AUTO)
+      return;
+
+   if(offset == module->last_end)
+   {
+      if(module->contiguous < 0) module->contiguous = 0;
+      if(++module->contiguous >= IO_FILE64_PATTERN_THRESHOLD)
+         io_file64_advise(module, IO_FILE64_ACCESS_SEQUENTIAL);
+   }
+   else
+   {
+      if(module->contiguous > 0) module->contiguous = 0;
+      if(--module->contiguous <= -IO_FILE64_PATTERN_THRESHOLD)
+         io_file64_advise(module, IO_FILE64_ACCESS_RANDOM);
+   }
+   if(module->contiguous > IO_FILE64_PATTERN_THRESHOLD) module->contiguous = IO_FILE64_PATTERN_THRESHOLD;
+   if(module->contiguous < -IO_FILE64_PATTERN_THRESHOLD) module->contiguous = -IO_FILE64_PATTERN_THRESHOLD;
+
+   module->last_end = offset + size;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_file64_close( VC_CONTAINER_IO_T *p_ctx )
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   if(module->map) munmap(module->map, module->map_size);
+   close(module->fd);
+   free(module);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static size_t io_file64_read_mmap(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t ret = size;
+
+   io_file64_track_access(module, module->position, size);
+
+   if(module->position >= (int64_t)module->map_size)
+      ret = 0;
+   else if((int64_t)size > (int64_t)module->map_size - module->position)
+      ret = module->map_size - (size_t)module->position;
+
+   memcpy(buffer, module->map + module->position, ret);
+   module->position += ret;
+
+   if(ret != size) p_ctx->status = VC_CONTAINER_ERROR_EOS;
+   return ret;
+}
+
+/*****************************************************************************/
+static size_t io_file64_read(VC_CONTAINER_IO_T *p_ctx, void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t ret = 0;
+
+   io_file64_track_access(module, module->position, size);
+
+   while(ret < size)
+   {
+      ssize_t bytes = pread(module->fd, (uint8_t *)buffer + ret, size - ret,
+                            (off_t)(module->position + ret));
+      if(bytes < 0 && errno == EINTR)
+         continue;
+      if(bytes <= 0)
+      {
+         p_ctx->status = bytes ? VC_CONTAINER_ERROR_FAILED : VC_CONTAINER_ERROR_EOS;
+         break;
+      }
+      ret += bytes;
+   }
+
+   module->position += ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static size_t io_file64_write(VC_CONTAINER_IO_T *p_ctx, const void *buffer, size_t size)
+{
+   VC_CONTAINER_IO_MODULE_T *module = p_ctx->module;
+   size_t ret = 0;
+
+   while(ret < size)
+   {
+      ssize_t bytes = pwrite(module->fd, (const uint8_t *)buffer + ret, size - ret,
+                             (off_t)(module->position + ret));
+      if(bytes < 0 && errno == EINTR)
+         continue;
+      if(bytes <= 0)
+      {
+         p_ctx->status = VC_CONTAINER_ERROR_FAILED;
+         break;
+      }
+      ret += bytes;
+   }
+
+   module->position += ret;
+   return ret;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T io_file64_seek(VC_CONTAINER_IO_T *p_ctx, int64_t offset)
+{
+   /* pread / pwrite take an explicit offset so there is nothing to do
+    * apart from keeping track of the new position */
+   if(offset < 0)
+   {
+      p_ctx->status = VC_CONTAINER_ERROR_EOS;
+      return p_ctx->status;
+   }
+
+   p_ctx->module->position = offset;
+   p_ctx->status = VC_CONTAINER_SUCCESS;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static IO_FILE64_ACCESS_T io_file64_access_from_uri(VC_CONTAINER_IO_T *p_ctx)
+{
+   const char *value = 0;
+
+   if(!vc_uri_find_query(p_ctx->uri_parts, 0, "access", &value) || !value)
+      return IO_FILE64_ACCESS_AUTO;
+
+   if(!strcasecmp(value, "sequential")) return IO_FILE64_ACCESS_SEQUENTIAL;
+   if(!strcasecmp(value, "random")) return IO_FILE64_ACCESS_RANDOM;
+   if(!strcasecmp(value, "normal")) return IO_FILE64_ACCESS_NORMAL;
+   return IO_FILE64_ACCESS_AUTO;
+}
+
+/*****************************************************************************/
+VC_CONTAINER_STATUS_T vc_container_io_file64_open( VC_CONTAINER_IO_T *p_ctx,
+   const char *unused, VC_CONTAINER_IO_MODE_T mode )
+{
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   VC_CONTAINER_IO_MODULE_T *module = 0;
+   const char *scheme = vc_uri_scheme(p_ctx->uri_parts);
+   const char *uri = p_ctx->uri;
+   bool use_mmap = false;
+   struct stat st;
+   int fd = -1;
+   VC_CONTAINER_PARAM_UNUSED(unused);
+
+   /* Check the URI */
+   if(scheme && !strcasecmp(scheme, "mmap"))
+      use_mmap = mode == VC_CONTAINER_IO_MODE_READ;
+   else if(!scheme || strcasecmp(scheme, "file64"))
+   {
+#ifdef ENABLE_CONTAINER_IO_FILE64_DEFAULT
+      if(scheme && strcasecmp(scheme, "file"))
+         return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+#else
+      return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
+#endif
+   }
+
+   if(vc_uri_path(p_ctx->uri_parts))
+      uri = vc_uri_path(p_ctx->uri_parts);
+
+   if(mode == VC_CONTAINER_IO_MODE_WRITE)
+      fd = open(uri, O_RDWR | O_CREAT | O_TRUNC, 0666);
+   else
+      fd = open(uri, O_RDONLY);
+   if(fd < 0) { status = VC_CONTAINER_ERROR_URI_NOT_FOUND; goto error; }
+
+   module = malloc( sizeof(*module) );
+   if(!module) { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+   memset(module, 0, sizeof(*module));
+   module->fd = fd;
+   module->hint = IO_FILE64_ACCESS_NORMAL;
+   module->access = io_file64_access_from_uri(p_ctx);
+
+   p_ctx->module = module;
+   p_ctx->pf_close = io_file64_close;
+   p_ctx->pf_read = io_file64_read;
+   p_ctx->pf_write = io_file64_write;
+   p_ctx->pf_seek = io_file64_seek;
+   p_ctx->capabilities = VC_CONTAINER_IO_CAPS_NO_CACHING;
+
+   if(mode == VC_CONTAINER_IO_MODE_WRITE)
+   {
+      p_ctx->max_size = 0; /* No limit */
+      return VC_CONTAINER_SUCCESS;
+   }
+
+   if(fstat(fd, &st) == 0)
+      p_ctx->size = st.st_size;
+
+   /* Map the whole file if requested. This will fail for files larger than
+    * the available address space, in which case we just use pread. */
+   if(use_mmap && p_ctx->size > 0 && (uint64_t)p_ctx->size <= (size_t)~0)
+   {
+      void *map = mmap(NULL, (size_t)p_ctx->size, PROT_READ, MAP_SHARED, fd, 0);
+      if(map != MAP_FAILED)
+      {
+         module->map = map;
+         module->map_size = (size_t)p_ctx->size;
+         p_ctx->pf_read = io_file64_read_mmap;
+         /* Reads are served straight from the mapping so an extra cache
+          * would only add a copy */
+         p_ctx->capabilities = 0;
+      }
+   }
+
+   /* Most containers are read sequentially so start with that hint */
+   io_file64_advise(module, module->access == IO_FILE64_ACCESS_AUTO ?
+                    IO_FILE64_ACCESS_SEQUENTIAL : module->access);
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   if(fd >= 0) close(fd);
+   return status;
+}
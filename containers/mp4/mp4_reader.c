@@ -61,6 +61,19 @@ Defines.
 
 #define MP4_MAX_SAMPLES_BATCH_SIZE (16*1024)
 
+/* Maximum amount of memory used by the in-memory sample indexes of all the tracks.
+ * Tracks which don't fit within this budget read their sample tables from the stream
+ * as they go. Define to 0 to disable the indexes. */
+#ifndef MP4_INDEX_MAX_SIZE
+# define MP4_INDEX_MAX_SIZE (8*1024*1024)
+#endif
+
+/* Amount of memory above which we stop loading fragments in advance of the
+ * track which is furthest behind. Fragmented files always use the indexes. */
+#ifndef MP4_FRAGMENT_INDEX_MAX_SIZE
+# define MP4_FRAGMENT_INDEX_MAX_SIZE (8*1024*1024)
+#endif
+
 #define MP4_SKIP_U8(ctx,n)   (size -= 1, SKIP_U8(ctx,n))
 #define MP4_SKIP_U16(ctx,n)  (size -= 2, SKIP_U16(ctx,n))
 #define MP4_SKIP_U24(ctx,n)  (size -= 3, SKIP_U24(ctx,n))
@@ -127,6 +140,27 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
 
    uint32_t samples_batch_size;
 
+   uint32_t track_id;
+
+   /* Fragmented files */
+   uint32_t default_sample_duration; /**< Defaults from the trex box */
+   uint32_t default_sample_size;
+   uint32_t default_sample_flags;
+   int64_t fragment_dts;            /**< Decoding time at the end of the last fragment loaded */
+
+   /* In-memory sample index, decoded from the sample tables at open time.
+    * For fragmented files, this is a window over the fragments loaded so far. */
+   struct {
+      uint32_t samples;             /**< Number of samples in the index */
+      uint32_t allocated;           /**< Number of samples the arrays can hold */
+      int64_t *offset;              /**< Offset of each sample in the stream */
+      int64_t *dts;                 /**< Decoding time of each sample (in timescale units) */
+      uint32_t *size;               /**< Size of each sample (0 if constant sample size) */
+      int32_t *composition_offset;  /**< Composition offset of each sample (0 if no ctts) */
+      uint32_t *sync;               /**< Sorted list of sync samples (0 based) */
+      uint32_t sync_entries;
+   } index;
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
 typedef struct VC_CONTAINER_MODULE_T
@@ -145,6 +179,29 @@ typedef struct VC_CONTAINER_MODULE_T
    int64_t data_offset;
    int64_t data_size;
 
+   size_t index_size; /**< Memory used by the sample indexes of all the tracks */
+
+   /* Fragmented files */
+   bool fragmented;                 /**< The moov box has an mvex box */
+   unsigned int reference_track;    /**< Track used to find random access points */
+   int64_t fragment_first;          /**< Offset of the first moof box */
+   int64_t fragment_next;           /**< Offset at which to look for the next moof box */
+   struct {
+      int64_t moof_offset;
+      int64_t data_end;             /**< End of the data of the last run parsed */
+      int track;                    /**< Track of the traf being parsed (-1 if unknown) */
+      int64_t dts;
+      uint32_t default_sample_duration;
+      uint32_t default_sample_size;
+      uint32_t default_sample_flags;
+   } fragment;
+   struct {
+      int64_t time;                 /**< Time of the random access point (us) */
+      int64_t offset;               /**< Offset of the moof (or segment) containing it */
+   } *random_access;                /**< Random access points, from tfra, sidx or loaded fragments */
+   unsigned int random_access_num;
+   unsigned int random_access_size;
+
 } VC_CONTAINER_MODULE_T;
 
 /******************************************************************************
@@ -186,6 +243,17 @@ static VC_CONTAINER_STATUS_T mp4_read_box_soun_dawp( VC_CONTAINER_T *p_ctx, int6
 static VC_CONTAINER_STATUS_T mp4_read_box_soun_devc( VC_CONTAINER_T *p_ctx, int64_t size );
 static VC_CONTAINER_STATUS_T mp4_read_box_soun_wave( VC_CONTAINER_T *p_ctx, int64_t size );
 
+static VC_CONTAINER_STATUS_T mp4_read_box_mvex( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_trex( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_moof( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_traf( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfhd( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfdt( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_trun( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_sidx( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_mfra( VC_CONTAINER_T *p_ctx, int64_t size );
+static VC_CONTAINER_STATUS_T mp4_read_box_tfra( VC_CONTAINER_T *p_ctx, int64_t size );
+
 static struct {
   const MP4_BOX_TYPE_T type;
   VC_CONTAINER_STATUS_T (*pf_func)( VC_CONTAINER_T *, int64_t );
@@ -219,6 +287,20 @@ static struct {
    {MP4_BOX_TYPE_SOUN, mp4_read_box_soun, MP4_BOX_TYPE_STSD},
    {MP4_BOX_TYPE_TEXT, mp4_read_box_text, MP4_BOX_TYPE_STSD},
 
+   /* Movie fragments */
+   {MP4_BOX_TYPE_MVEX, mp4_read_box_mvex, MP4_BOX_TYPE_MOOV},
+   {MP4_BOX_TYPE_TREX, mp4_read_box_trex, MP4_BOX_TYPE_MVEX},
+   {MP4_BOX_TYPE_MOOF, mp4_read_box_moof, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_MFHD, 0,                 MP4_BOX_TYPE_MOOF},
+   {MP4_BOX_TYPE_TRAF, mp4_read_box_traf, MP4_BOX_TYPE_MOOF},
+   {MP4_BOX_TYPE_TFHD, mp4_read_box_tfhd, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_TFDT, mp4_read_box_tfdt, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_TRUN, mp4_read_box_trun, MP4_BOX_TYPE_TRAF},
+   {MP4_BOX_TYPE_SIDX, mp4_read_box_sidx, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_MFRA, mp4_read_box_mfra, MP4_BOX_TYPE_ROOT},
+   {MP4_BOX_TYPE_TFRA, mp4_read_box_tfra, MP4_BOX_TYPE_MFRA},
+   {MP4_BOX_TYPE_MFRO, 0,                 MP4_BOX_TYPE_MFRA},
+
    /* Codec specific boxes */
    {MP4_BOX_TYPE_AVCC, mp4_read_box_vide_avcC, MP4_BOX_TYPE_VIDE},
    {MP4_BOX_TYPE_D263, mp4_read_box_vide_d263, MP4_BOX_TYPE_VIDE},
@@ -528,6 +610,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_trak( VC_CONTAINER_T *p_ctx, int64_t s
 static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t size )
 {
    VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
    uint32_t i, version;
    int64_t duration;
 
@@ -538,7 +621,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t s
    {
       MP4_SKIP_U64(p_ctx, "creation_time");
       MP4_SKIP_U64(p_ctx, "modification_time");
-      MP4_SKIP_U32(p_ctx, "track_ID");
+      track_module->track_id = MP4_READ_U32(p_ctx, "track_ID");
       MP4_SKIP_U32(p_ctx, "reserved");
       duration = MP4_READ_U64(p_ctx, "duration");
    }
@@ -546,7 +629,7 @@ static VC_CONTAINER_STATUS_T mp4_read_box_tkhd( VC_CONTAINER_T *p_ctx, int64_t s
    {
       MP4_SKIP_U32(p_ctx, "creation_time");
       MP4_SKIP_U32(p_ctx, "modification_time");
-      MP4_SKIP_U32(p_ctx, "track_ID");
+      track_module->track_id = MP4_READ_U32(p_ctx, "track_ID");
       MP4_SKIP_U32(p_ctx, "reserved");
       duration = MP4_READ_U32(p_ctx, "duration");
    }
@@ -1197,6 +1280,806 @@ static VC_CONTAINER_STATUS_T mp4_read_box_text( VC_CONTAINER_T *p_ctx, int64_t s
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static void mp4_index_free( VC_CONTAINER_TRACK_MODULE_T *track_module )
+{
+   free(track_module->index.offset);
+   free(track_module->index.dts);
+   free(track_module->index.size);
+   free(track_module->index.composition_offset);
+   free(track_module->index.sync);
+   memset(&track_module->index, 0, sizeof(track_module->index));
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_index_build( VC_CONTAINER_T *p_ctx, uint32_t track )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   MP4_SAMPLE_TABLE_T chunk_table = MP4_SAMPLE_TABLE_STCO;
+   uint32_t i, j, samples = 0, stsc_entries, chunk, sample, count, *stsc = 0;
+   int64_t dts = 0, offset;
+   size_t size;
+
+   if(!track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries)
+      return VC_CONTAINER_ERROR_FORMAT_INVALID;
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries)
+      chunk_table = MP4_SAMPLE_TABLE_CO64;
+
+   /* Count the samples */
+   status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
+   for(i = 0; status == VC_CONTAINER_SUCCESS &&
+       i < track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries; i++)
+   {
+      count = _READ_U32(p_ctx);
+      _SKIP_U32(p_ctx);
+      status = STREAM_STATUS(p_ctx);
+      if(count > UINT32_MAX - samples) status = VC_CONTAINER_ERROR_CORRUPTED;
+      samples += count;
+   }
+   if(status != VC_CONTAINER_SUCCESS) return status;
+   if(!track_module->sample_size &&
+      track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries < samples)
+      samples = track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries;
+   if(!samples) return VC_CONTAINER_ERROR_FORMAT_INVALID;
+
+   /* Check it all fits within our memory budget */
+   size = (size_t)samples * (sizeof(*track_module->index.offset) + sizeof(*track_module->index.dts)) +
+      sizeof(*track_module->index.dts);
+   if(!track_module->sample_size)
+      size += (size_t)samples * sizeof(*track_module->index.size);
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries)
+      size += (size_t)samples * sizeof(*track_module->index.composition_offset);
+   size += (size_t)track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries *
+      sizeof(*track_module->index.sync);
+   if(size > MP4_INDEX_MAX_SIZE - module->index_size)
+   {
+      LOG_DEBUG(p_ctx, "track %u: index too big (%u samples)", track, samples);
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   }
+
+   track_module->index.offset = malloc(samples * sizeof(*track_module->index.offset));
+   track_module->index.dts = malloc((samples + 1) * sizeof(*track_module->index.dts));
+   if(!track_module->sample_size)
+      track_module->index.size = malloc(samples * sizeof(*track_module->index.size));
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries)
+      track_module->index.composition_offset =
+         calloc(samples, sizeof(*track_module->index.composition_offset));
+   if(track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries)
+      track_module->index.sync = malloc(track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries *
+                                        sizeof(*track_module->index.sync));
+   stsc_entries = track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries;
+   stsc = malloc((stsc_entries + 1) * 2 * sizeof(*stsc));
+   if(!track_module->index.offset || !track_module->index.dts || !stsc ||
+      (!track_module->sample_size && !track_module->index.size) ||
+      (track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries &&
+       !track_module->index.composition_offset) ||
+      (track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries && !track_module->index.sync))
+   { status = VC_CONTAINER_ERROR_OUT_OF_MEMORY; goto error; }
+
+   /* Decoding times */
+   status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
+   for(i = 0, sample = 0; status == VC_CONTAINER_SUCCESS && sample < samples; i++)
+   {
+      uint32_t delta;
+      count = _READ_U32(p_ctx);
+      delta = _READ_U32(p_ctx);
+      status = STREAM_STATUS(p_ctx);
+      for(j = 0; j < count && sample < samples; j++, dts += delta)
+         track_module->index.dts[sample++] = dts;
+   }
+   track_module->index.dts[sample] = dts; /* End of the last sample */
+   if(status != VC_CONTAINER_SUCCESS) goto error;
+
+   /* Composition offsets */
+   if(track_module->index.composition_offset)
+      status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].offset);
+   for(i = 0, sample = 0; track_module->index.composition_offset && status == VC_CONTAINER_SUCCESS &&
+       i < track_module->sample_table[MP4_SAMPLE_TABLE_CTTS].entries && sample < samples; i++)
+   {
+      int32_t composition_offset;
+      count = _READ_U32(p_ctx);
+      composition_offset = _READ_U32(p_ctx); /* Converted to signed */
+      status = STREAM_STATUS(p_ctx);
+      for(j = 0; j < count && sample < samples; j++)
+         track_module->index.composition_offset[sample++] = composition_offset;
+   }
+   if(status != VC_CONTAINER_SUCCESS) goto error;
+
+   /* Sample sizes */
+   if(track_module->index.size)
+   {
+      status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].offset);
+      for(sample = 0; sample < samples; sample++)
+         track_module->index.size[sample] = _READ_U32(p_ctx);
+      if(status == VC_CONTAINER_SUCCESS) status = STREAM_STATUS(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+   }
+
+   /* Sample to chunk table, as pairs of first_chunk / samples_per_chunk */
+   status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].offset);
+   for(i = 0; i < stsc_entries; i++)
+   {
+      stsc[2*i] = _READ_U32(p_ctx);
+      stsc[2*i+1] = _READ_U32(p_ctx);
+      _SKIP_U32(p_ctx);
+   }
+   stsc[2*i] = UINT32_MAX;
+   stsc[2*i+1] = 0;
+   if(status == VC_CONTAINER_SUCCESS) status = STREAM_STATUS(p_ctx);
+   if(status != VC_CONTAINER_SUCCESS) goto error;
+
+   /* Sample offsets */
+   status = SEEK(p_ctx, track_module->sample_table[chunk_table].offset);
+   for(chunk = 0, i = 0, sample = 0; status == VC_CONTAINER_SUCCESS && sample < samples &&
+       chunk < track_module->sample_table[chunk_table].entries; chunk++)
+   {
+      while(i < stsc_entries && chunk + 1 >= stsc[2*(i+1)]) i++;
+      if(i >= stsc_entries || !stsc[2*i+1] || chunk + 1 < stsc[2*i]) break;
+
+      offset = chunk_table == MP4_SAMPLE_TABLE_STCO ? _READ_U32(p_ctx) : _READ_U64(p_ctx);
+      status = STREAM_STATUS(p_ctx);
+      for(j = 0; j < stsc[2*i+1] && sample < samples; j++, sample++)
+      {
+         track_module->index.offset[sample] = offset;
+         offset += track_module->index.size ? track_module->index.size[sample] : track_module->sample_size;
+      }
+   }
+   if(status != VC_CONTAINER_SUCCESS) goto error;
+   if(sample < samples)
+   {
+      LOG_DEBUG(p_ctx, "track %u: chunk table only covers %u/%u samples", track, sample, samples);
+      samples = sample;
+   }
+
+   /* Sync samples. These are 1 based in the table and should be sorted. */
+   if(track_module->index.sync)
+      status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSS].offset);
+   for(i = 0; track_module->index.sync && status == VC_CONTAINER_SUCCESS &&
+       i < track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries; i++)
+   {
+      sample = _READ_U32(p_ctx);
+      status = STREAM_STATUS(p_ctx);
+      if(!sample || (track_module->index.sync_entries &&
+         sample - 1 <= track_module->index.sync[track_module->index.sync_entries - 1]))
+         continue;
+      track_module->index.sync[track_module->index.sync_entries++] = sample - 1;
+   }
+   if(status != VC_CONTAINER_SUCCESS) goto error;
+
+   free(stsc);
+   track_module->index.samples = samples;
+   track_module->index.allocated = samples;
+   module->index_size += size;
+   return VC_CONTAINER_SUCCESS;
+
+ error:
+   LOG_DEBUG(p_ctx, "track %u: failed to build index (%i)", track, status);
+   free(stsc);
+   mp4_index_free(track_module);
+   return status;
+}
+
+/*****************************************************************************/
+static uint32_t mp4_index_find_sync( VC_CONTAINER_TRACK_MODULE_T *track_module, uint32_t sample )
+{
+   uint32_t low = 0, high = track_module->index.sync_entries;
+
+   /* Returns the number of sync samples up to and including sample */
+   while(low < high)
+   {
+      uint32_t mid = low + (high - low) / 2;
+      if(track_module->index.sync[mid] <= sample) low = mid + 1;
+      else high = mid;
+   }
+   return low;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_index_grow( VC_CONTAINER_TRACK_MODULE_T *track_module, uint32_t samples )
+{
+   uint32_t allocated = track_module->index.allocated, i;
+   bool fill_size = !track_module->index.size;
+   bool fill_composition = !track_module->index.composition_offset;
+   bool empty = !track_module->index.offset;
+   void *array;
+
+   if(samples <= allocated && !fill_size && !fill_composition)
+      return VC_CONTAINER_SUCCESS;
+   if(samples > UINT32_MAX / 2)
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+   if(samples > allocated)
+      allocated = MAX(samples, MAX(allocated * 2, 256));
+
+#define MP4_INDEX_REALLOC(array_name, count) \
+   array = realloc(track_module->index.array_name, (count) * sizeof(*track_module->index.array_name)); \
+   if(!array) return VC_CONTAINER_ERROR_OUT_OF_MEMORY; \
+   track_module->index.array_name = array
+   MP4_INDEX_REALLOC(offset, allocated);
+   MP4_INDEX_REALLOC(dts, allocated + 1);
+   MP4_INDEX_REALLOC(size, allocated);
+   MP4_INDEX_REALLOC(composition_offset, allocated);
+   MP4_INDEX_REALLOC(sync, allocated);
+#undef MP4_INDEX_REALLOC
+   track_module->index.allocated = allocated;
+
+   /* Entries might not have been stored for the samples we already have */
+   if(empty) track_module->index.dts[0] = 0;
+   for(i = 0; fill_size && i < track_module->index.samples; i++)
+      track_module->index.size[i] = track_module->sample_size;
+   if(fill_composition)
+      memset(track_module->index.composition_offset, 0,
+             track_module->index.samples * sizeof(*track_module->index.composition_offset));
+
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static void mp4_index_drop( VC_CONTAINER_TRACK_MODULE_T *track_module, uint32_t samples )
+{
+   uint32_t i, j, remaining;
+
+   if(samples > track_module->index.samples) samples = track_module->index.samples;
+   if(!samples) return;
+   remaining = track_module->index.samples - samples;
+
+   memmove(track_module->index.offset, track_module->index.offset + samples,
+           remaining * sizeof(*track_module->index.offset));
+   memmove(track_module->index.dts, track_module->index.dts + samples,
+           (remaining + 1) * sizeof(*track_module->index.dts));
+   memmove(track_module->index.size, track_module->index.size + samples,
+           remaining * sizeof(*track_module->index.size));
+   memmove(track_module->index.composition_offset, track_module->index.composition_offset + samples,
+           remaining * sizeof(*track_module->index.composition_offset));
+   for(i = 0, j = 0; i < track_module->index.sync_entries; i++)
+      if(track_module->index.sync[i] >= samples)
+         track_module->index.sync[j++] = track_module->index.sync[i] - samples;
+   track_module->index.sync_entries = j;
+   track_module->index.samples = remaining;
+
+   track_module->state.sample = track_module->state.sample > samples ?
+      track_module->state.sample - samples : 0;
+}
+
+/*****************************************************************************/
+static int mp4_find_track( VC_CONTAINER_T *p_ctx, uint32_t track_id )
+{
+   unsigned int i;
+
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      if(p_ctx->tracks[i]->priv->module->track_id == track_id) return i;
+   return -1;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_random_access_add( VC_CONTAINER_T *p_ctx, int64_t time, int64_t offset )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   /* We only keep the entries sorted by offset, which should also be sorted by time */
+   if(module->random_access_num &&
+      (offset <= module->random_access[module->random_access_num - 1].offset ||
+       time < module->random_access[module->random_access_num - 1].time))
+      return VC_CONTAINER_SUCCESS;
+
+   if(module->random_access_num >= module->random_access_size)
+   {
+      unsigned int size = module->random_access_size ? module->random_access_size * 2 : 64;
+      void *random_access = realloc(module->random_access, size * sizeof(*module->random_access));
+      if(!random_access) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      module->random_access = random_access;
+      module->random_access_size = size;
+   }
+
+   module->random_access[module->random_access_num].time = time;
+   module->random_access[module->random_access_num].offset = offset;
+   module->random_access_num++;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_mvex( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   module->fragmented = true;
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MVEX);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_trex( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   uint32_t track_id, duration, sample_size, flags;
+   int track;
+
+   MP4_SKIP_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   track_id = MP4_READ_U32(p_ctx, "track_ID");
+   MP4_SKIP_U32(p_ctx, "default_sample_description_index");
+   duration = MP4_READ_U32(p_ctx, "default_sample_duration");
+   sample_size = MP4_READ_U32(p_ctx, "default_sample_size");
+   flags = MP4_READ_U32(p_ctx, "default_sample_flags");
+
+   track = mp4_find_track(p_ctx, track_id);
+   if(track >= 0)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+      track_module->default_sample_duration = duration;
+      track_module->default_sample_size = sample_size;
+      track_module->default_sample_flags = flags;
+   }
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_moof( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   module->fragment.moof_offset = module->box_offset;
+   module->fragment.data_end = module->box_offset;
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MOOF);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_traf( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   module->fragment.track = -1;
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_TRAF);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfhd( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   uint32_t flags;
+   int64_t base_data_offset;
+   int track;
+
+   MP4_SKIP_U8(p_ctx, "version");
+   flags = MP4_READ_U24(p_ctx, "flags");
+   track = mp4_find_track(p_ctx, MP4_READ_U32(p_ctx, "track_ID"));
+   if(track < 0) return STREAM_STATUS(p_ctx); /* Not a track we know about */
+   track_module = p_ctx->tracks[track]->priv->module;
+
+   /* By default the data of the first track fragment starts at the moof box and
+    * the data of the following ones after the data of the previous one */
+   base_data_offset = (flags & MP4_TFHD_FLAG_DEFAULT_BASE_IS_MOOF) ?
+      module->fragment.moof_offset : module->fragment.data_end;
+   if(flags & MP4_TFHD_FLAG_BASE_DATA_OFFSET)
+      base_data_offset = MP4_READ_U64(p_ctx, "base_data_offset");
+   if(flags & MP4_TFHD_FLAG_SAMPLE_DESCRIPTION)
+      MP4_SKIP_U32(p_ctx, "sample_description_index");
+
+   module->fragment.default_sample_duration = (flags & MP4_TFHD_FLAG_DEFAULT_DURATION) ?
+      MP4_READ_U32(p_ctx, "default_sample_duration") : track_module->default_sample_duration;
+   module->fragment.default_sample_size = (flags & MP4_TFHD_FLAG_DEFAULT_SIZE) ?
+      MP4_READ_U32(p_ctx, "default_sample_size") : track_module->default_sample_size;
+   module->fragment.default_sample_flags = (flags & MP4_TFHD_FLAG_DEFAULT_FLAGS) ?
+      MP4_READ_U32(p_ctx, "default_sample_flags") : track_module->default_sample_flags;
+
+   module->fragment.track = track;
+   module->fragment.data_end = base_data_offset;
+   module->fragment.dts = track_module->fragment_dts;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfdt( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   uint32_t version;
+   int64_t dts;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   if(version)
+      dts = MP4_READ_U64(p_ctx, "base_media_decode_time");
+   else
+      dts = MP4_READ_U32(p_ctx, "base_media_decode_time");
+
+   if(module->fragment.track >= 0)
+      module->fragment.dts = dts;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_trun( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   VC_CONTAINER_STATUS_T status;
+   uint32_t flags, first_sample_flags, count, entry_size, sample, i;
+   uint32_t duration, sample_size, sample_flags;
+   int32_t composition_offset;
+   int64_t offset;
+
+   if(module->fragment.track < 0) return VC_CONTAINER_SUCCESS;
+   track_module = p_ctx->tracks[module->fragment.track]->priv->module;
+
+   MP4_SKIP_U8(p_ctx, "version");
+   flags = MP4_READ_U24(p_ctx, "flags");
+   count = MP4_READ_U32(p_ctx, "sample_count");
+
+   offset = module->fragment.data_end;
+   if(flags & MP4_TRUN_FLAG_DATA_OFFSET)
+      offset = module->fragment.moof_offset + (int32_t)MP4_READ_U32(p_ctx, "data_offset");
+   first_sample_flags = (flags & MP4_TRUN_FLAG_FIRST_SAMPLE_FLAGS) ?
+      MP4_READ_U32(p_ctx, "first_sample_flags") : module->fragment.default_sample_flags;
+
+   /* Sanity check the number of entries against the size of the box */
+   entry_size = ((flags & MP4_TRUN_FLAG_SAMPLE_DURATION) ? 4 : 0) +
+      ((flags & MP4_TRUN_FLAG_SAMPLE_SIZE) ? 4 : 0) + ((flags & MP4_TRUN_FLAG_SAMPLE_FLAGS) ? 4 : 0) +
+      ((flags & MP4_TRUN_FLAG_SAMPLE_COMPOSITION) ? 4 : 0);
+   if(entry_size && count > size / entry_size) return VC_CONTAINER_ERROR_CORRUPTED;
+   if(count > MP4_FRAGMENT_INDEX_MAX_SIZE / (sizeof(int64_t) * 2 + sizeof(uint32_t) * 3))
+      return VC_CONTAINER_ERROR_OUT_OF_RESOURCES;
+
+   status = mp4_index_grow(track_module, track_module->index.samples + count);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   for(i = 0, sample = track_module->index.samples; i < count; i++, sample++)
+   {
+      duration = (flags & MP4_TRUN_FLAG_SAMPLE_DURATION) ?
+         _READ_U32(p_ctx) : module->fragment.default_sample_duration;
+      sample_size = (flags & MP4_TRUN_FLAG_SAMPLE_SIZE) ?
+         _READ_U32(p_ctx) : module->fragment.default_sample_size;
+      sample_flags = (flags & MP4_TRUN_FLAG_SAMPLE_FLAGS) ? _READ_U32(p_ctx) :
+         i ? module->fragment.default_sample_flags : first_sample_flags;
+      composition_offset = (flags & MP4_TRUN_FLAG_SAMPLE_COMPOSITION) ? (int32_t)_READ_U32(p_ctx) : 0;
+
+      track_module->index.offset[sample] = offset;
+      track_module->index.dts[sample] = module->fragment.dts;
+      track_module->index.size[sample] = sample_size;
+      track_module->index.composition_offset[sample] = composition_offset;
+      if(!(sample_flags & MP4_SAMPLE_FLAG_NON_SYNC))
+         track_module->index.sync[track_module->index.sync_entries++] = sample;
+
+      offset += sample_size;
+      module->fragment.dts += duration;
+   }
+   size -= count * entry_size;
+
+   status = STREAM_STATUS(p_ctx);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   track_module->index.samples = sample;
+   track_module->index.dts[sample] = module->fragment.dts;
+   track_module->fragment_dts = module->fragment.dts;
+   module->fragment.data_end = offset;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_sidx( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   int64_t offset = STREAM_POSITION(p_ctx) + size; /* Offsets are relative to the end of the box */
+   uint32_t version, reference_id, timescale, count, reference, duration, sap, i;
+   int64_t time;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   reference_id = MP4_READ_U32(p_ctx, "reference_ID");
+   timescale = MP4_READ_U32(p_ctx, "timescale");
+   if(version)
+   {
+      time = MP4_READ_U64(p_ctx, "earliest_presentation_time");
+      offset += MP4_READ_U64(p_ctx, "first_offset");
+   }
+   else
+   {
+      time = MP4_READ_U32(p_ctx, "earliest_presentation_time");
+      offset += MP4_READ_U32(p_ctx, "first_offset");
+   }
+   MP4_SKIP_U16(p_ctx, "reserved");
+   count = MP4_READ_U16(p_ctx, "reference_count");
+
+   /* We only use the index of our reference track */
+   if(!timescale || module->reference_track >= p_ctx->tracks_num ||
+      reference_id != p_ctx->tracks[module->reference_track]->priv->module->track_id)
+      return STREAM_STATUS(p_ctx);
+   if(count > size / 12) return VC_CONTAINER_ERROR_CORRUPTED;
+
+   for(i = 0; i < count && status == VC_CONTAINER_SUCCESS; i++)
+   {
+      reference = MP4_READ_U32(p_ctx, "reference");
+      duration = MP4_READ_U32(p_ctx, "subsegment_duration");
+      sap = MP4_READ_U32(p_ctx, "sap");
+
+      /* We're only interested in media subsegments starting with a random access point */
+      if(!(reference & 0x80000000) && (sap & 0x80000000))
+         status = mp4_random_access_add(p_ctx, time * 1000000 / timescale, offset);
+
+      offset += reference & 0x7FFFFFFF;
+      time += duration;
+   }
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_mfra( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   return mp4_read_boxes( p_ctx, size, MP4_BOX_TYPE_MFRA);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_read_box_tfra( VC_CONTAINER_T *p_ctx, int64_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   uint32_t version, track_id, length_size, count, entry_size, i;
+   int64_t time, offset;
+
+   version = MP4_READ_U8(p_ctx, "version");
+   MP4_SKIP_U24(p_ctx, "flags");
+   track_id = MP4_READ_U32(p_ctx, "track_ID");
+   length_size = MP4_READ_U32(p_ctx, "length_size");
+   count = MP4_READ_U32(p_ctx, "number_of_entry");
+
+   /* We only use the index of our reference track */
+   if(module->reference_track >= p_ctx->tracks_num ||
+      track_id != p_ctx->tracks[module->reference_track]->priv->module->track_id)
+      return STREAM_STATUS(p_ctx);
+   track_module = p_ctx->tracks[module->reference_track]->priv->module;
+   if(!track_module->timescale) return STREAM_STATUS(p_ctx);
+
+   entry_size = (version ? 16 : 8) + ((length_size >> 4) & 3) + ((length_size >> 2) & 3) +
+      (length_size & 3) + 3;
+   if(count > size / entry_size) return VC_CONTAINER_ERROR_CORRUPTED;
+
+   /* This is more accurate than any other index we might have found */
+   module->random_access_num = 0;
+
+   for(i = 0; i < count && status == VC_CONTAINER_SUCCESS; i++)
+   {
+      time = version ? MP4_READ_U64(p_ctx, "time") : MP4_READ_U32(p_ctx, "time");
+      offset = version ? MP4_READ_U64(p_ctx, "moof_offset") : MP4_READ_U32(p_ctx, "moof_offset");
+      MP4_SKIP_BYTES(p_ctx, entry_size - (version ? 16 : 8));
+      status = mp4_random_access_add(p_ctx, time * 1000000 / track_module->timescale, offset);
+   }
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static size_t mp4_fragment_index_size( VC_CONTAINER_T *p_ctx )
+{
+   size_t size = 0;
+   unsigned int i;
+
+   /* Only count the samples which will survive the next mp4_index_drop(),
+    * the allocation itself never shrinks */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      if(track_module->state.sample < track_module->index.samples)
+         size += (track_module->index.samples - track_module->state.sample) *
+            (sizeof(int64_t) * 2 + sizeof(uint32_t) * 3);
+   }
+   return size;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_fragment_read_next( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *reference = p_ctx->tracks[module->reference_track]->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   MP4_BOX_TYPE_T box_type = MP4_BOX_TYPE_UNKNOWN;
+   int64_t box_size;
+   uint32_t i, first;
+
+   /* Drop the samples which have already been read */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      mp4_index_drop(p_ctx->tracks[i]->priv->module, p_ctx->tracks[i]->priv->module->state.sample);
+
+   /* Find the next moof box, skipping everything else */
+   status = SEEK(p_ctx, module->fragment_next);
+   while(status == VC_CONTAINER_SUCCESS)
+   {
+      status = mp4_read_box_header(p_ctx, INT64_C(-1), &box_type, &box_size);
+      if(status != VC_CONTAINER_SUCCESS || box_type == MP4_BOX_TYPE_MOOF) break;
+      status = SEEK(p_ctx, STREAM_POSITION(p_ctx) + box_size);
+   }
+   if(status != VC_CONTAINER_SUCCESS) return VC_CONTAINER_ERROR_EOS;
+
+   first = reference->index.samples;
+   status = mp4_read_box_data(p_ctx, box_type, box_size, MP4_BOX_TYPE_ROOT);
+   module->fragment_next = STREAM_POSITION(p_ctx);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   /* Keep track of the fragments which start with a sync sample so we can seek back to them */
+   i = mp4_index_find_sync(reference, first);
+   if(reference->index.samples > first && i && reference->index.sync[i - 1] == first &&
+      reference->timescale)
+      status = mp4_random_access_add(p_ctx, reference->index.dts[first] * 1000000 / reference->timescale,
+                                     module->fragment.moof_offset);
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_fragment_seek( VC_CONTAINER_T *p_ctx, int64_t seek_time )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *reference = p_ctx->tracks[module->reference_track]->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   uint32_t i, low = 0, high = module->random_access_num, first[MP4_TRACKS_MAX];
+   int64_t offset = module->fragment_first, time = 0;
+
+   /* Binary search for the last random access point before the requested time */
+   while(low < high)
+   {
+      uint32_t mid = low + (high - low) / 2;
+      if(module->random_access[mid].time <= seek_time) low = mid + 1;
+      else high = mid;
+   }
+   if(low)
+   {
+      offset = module->random_access[low - 1].offset;
+      time = module->random_access[low - 1].time;
+   }
+
+   /* Start again from there with empty indexes */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      track_module->index.samples = 0;
+      track_module->index.sync_entries = 0;
+      track_module->fragment_dts = time * track_module->timescale / 1000000;
+      track_module->index.dts[0] = track_module->fragment_dts;
+   }
+   module->fragment_next = offset;
+
+   /* Load fragments until the requested time is covered */
+   while(status == VC_CONTAINER_SUCCESS && (!reference->index.samples || (reference->timescale &&
+         reference->index.dts[reference->index.samples] * 1000000 / reference->timescale <= seek_time)))
+   {
+      for(i = 0; i < p_ctx->tracks_num; i++)
+         first[i] = p_ctx->tracks[i]->priv->module->index.samples;
+
+      status = mp4_fragment_read_next(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS) break;
+
+      /* Forget about the previous fragments if this one starts with a sync
+       * sample which is still before the requested time */
+      i = mp4_index_find_sync(reference, first[module->reference_track]);
+      if(!first[module->reference_track] || !i ||
+         reference->index.sync[i - 1] != first[module->reference_track] ||
+         reference->index.dts[first[module->reference_track]] * 1000000 / reference->timescale > seek_time)
+         continue;
+
+      for(i = 0; i < p_ctx->tracks_num; i++)
+         mp4_index_drop(p_ctx->tracks[i]->priv->module, first[i]);
+   }
+
+   return status == VC_CONTAINER_ERROR_EOS ? VC_CONTAINER_SUCCESS : status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_fragment_open( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_IO_T *io = p_ctx->priv->io;
+   VC_CONTAINER_STATUS_T status;
+   uint32_t box_size, box_type, mfra_size;
+   unsigned int i;
+
+   if(!p_ctx->tracks_num) return VC_CONTAINER_ERROR_FORMAT_INVALID;
+   for(i = 0; i < p_ctx->tracks_num; i++)
+      if(!p_ctx->tracks[i]->priv->module->index.offset &&
+         p_ctx->tracks[i]->priv->module->sample_table[MP4_SAMPLE_TABLE_STTS].entries)
+         return VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED; /* Samples in the moov but no index */
+
+   /* Fragments start after the data described by the moov box, if any */
+   if(!module->fragment_first)
+      module->fragment_first = module->data_offset + module->data_size;
+   module->fragment_next = module->fragment_first;
+
+   /* Samples are found through the indexes, which will be extended as fragments are loaded */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      status = mp4_index_grow(track_module, track_module->index.samples + 1);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+      track_module->fragment_dts = track_module->index.dts[track_module->index.samples];
+   }
+
+   /* Random access points are given for the first video track if there is one */
+   for(module->reference_track = 0; module->reference_track < p_ctx->tracks_num; module->reference_track++)
+      if(p_ctx->tracks[module->reference_track]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) break;
+   if(module->reference_track == p_ctx->tracks_num) module->reference_track = 0;
+
+   /* Use the movie fragment random access box if there is one. It is found through
+    * the mfro box at the very end of the stream. */
+   if(STREAM_SEEKABLE(p_ctx) && io->size > 16 && SEEK(p_ctx, io->size - 16) == VC_CONTAINER_SUCCESS)
+   {
+      box_size = _READ_U32(p_ctx);
+      box_type = _READ_FOURCC(p_ctx);
+      _SKIP_U32(p_ctx);
+      mfra_size = _READ_U32(p_ctx);
+      if(STREAM_STATUS(p_ctx) == VC_CONTAINER_SUCCESS && box_size == 16 &&
+         box_type == MP4_BOX_TYPE_MFRO && mfra_size > 16 && mfra_size <= io->size &&
+         SEEK(p_ctx, io->size - mfra_size) == VC_CONTAINER_SUCCESS)
+         mp4_read_box(p_ctx, mfra_size, MP4_BOX_TYPE_ROOT); /* Failure isn't fatal */
+   }
+
+   LOG_DEBUG(p_ctx, "fragmented file, %u random access points", module->random_access_num);
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_index_read_sample_header( VC_CONTAINER_T *p_ctx, uint32_t track,
+   MP4_READER_STATE_T *state )
+{
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+   uint32_t sample, sync;
+
+   /* Load more fragments once we've gone through the ones we have. Loading
+    * a fragment drops the samples which have already been read. */
+   while(p_ctx->priv->module->fragmented && state->sample >= track_module->index.samples &&
+         mp4_fragment_index_size(p_ctx) <= MP4_FRAGMENT_INDEX_MAX_SIZE &&
+         mp4_fragment_read_next(p_ctx) == VC_CONTAINER_SUCCESS);
+
+   /* state->sample is the 1 based number of the current sample so also
+    * the index of the next one */
+   sample = state->sample;
+   if(sample >= track_module->index.samples)
+   {
+      state->offset += state->sample_size;
+      state->sample_offset = 0;
+      state->sample_size = 0;
+      return state->status = VC_CONTAINER_ERROR_EOS;
+   }
+
+   state->offset = track_module->index.offset[sample];
+   state->sample_offset = 0;
+   state->sample_size = track_module->index.size ?
+      track_module->index.size[sample] : track_module->sample_size;
+
+   if(track_module->timescale)
+   {
+      state->pts = state->dts = track_module->index.dts[sample] * 1000000 / track_module->timescale;
+      if(track_module->index.composition_offset)
+         state->pts = (track_module->index.dts[sample] + track_module->index.composition_offset[sample]) *
+            1000000 / track_module->timescale;
+   }
+
+   sync = mp4_index_find_sync(track_module, sample);
+   state->keyframe = sync && track_module->index.sync[sync - 1] == sample;
+   state->sample = ++sample;
+
+   /* Try to batch several contiguous samples together if requested */
+   if(track_module->samples_batch_size)
+   {
+      uint32_t size = state->sample_size;
+      while(sample < track_module->index.samples && size < track_module->samples_batch_size &&
+            track_module->index.offset[sample] == state->offset + size)
+      {
+         size += track_module->index.size ? track_module->index.size[sample] : track_module->sample_size;
+         sample++;
+      }
+      state->sample_size = size;
+      state->sample = sample;
+   }
+
+   state->duration = track_module->index.dts[sample];
+   return state->status;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_reader_close( VC_CONTAINER_T *p_ctx )
 {
@@ -1204,7 +2087,11 @@ static VC_CONTAINER_STATUS_T mp4_reader_close( VC_CONTAINER_T *p_ctx )
    unsigned int i;
 
    for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      mp4_index_free(p_ctx->tracks[i]->priv->module);
       vc_container_free_track(p_ctx, p_ctx->tracks[i]);
+   }
+   free(module->random_access);
    free(module);
    return VC_CONTAINER_SUCCESS;
 }
@@ -1352,6 +2239,9 @@ static VC_CONTAINER_STATUS_T mp4_read_sample_header( VC_CONTAINER_T *p_ctx, uint
    if(state->sample_offset < state->sample_size)
       return state->status; /* We still have data left from the current sample */
 
+   if(track_module->index.offset)
+      return mp4_index_read_sample_header(p_ctx, track, state);
+
    /* Switch to the next sample */
    state->offset += state->sample_size;
    state->sample_offset = 0;
@@ -1569,6 +2459,21 @@ static uint32_t mp4_find_sample( VC_CONTAINER_T *p_ctx, uint32_t track,
     * rounding errors in the timestamp (because of the timescale conversion) */
    seek_time_up = seek_time_up * track_module->timescale / 1000000;
 
+   /* Binary search for the last sample starting at or before the requested time.
+    * This returns the number of samples when seeking past the end. */
+   if(track_module->index.offset)
+   {
+      uint32_t low = 0, high = track_module->index.samples + 1;
+      while(low < high)
+      {
+         uint32_t mid = low + (high - low) / 2;
+         if(track_module->index.dts[mid] <= seek_time_up) low = mid + 1;
+         else high = mid;
+      }
+      sample = low ? low - 1 : 0;
+      goto end;
+   }
+
    status = SEEK(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].offset);
    if(status != VC_CONTAINER_SUCCESS) goto end;
 
@@ -1610,6 +2515,12 @@ static VC_CONTAINER_STATUS_T mp4_seek_track( VC_CONTAINER_T *p_ctx, uint32_t tra
 
    memset(state, 0, sizeof(*state));
 
+   if(track_module->index.offset)
+   {
+      state->sample = sample;
+      return mp4_read_sample_header(p_ctx, track, state);
+   }
+
    /* Find the right chunk */
    for(i = 0, samples = sample; i < track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries; i++)
    {
@@ -1717,6 +2628,13 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    for(i = 0; i < p_ctx->tracks_num; i++)
       memset(&p_ctx->tracks[i]->priv->module->state, 0, sizeof(p_ctx->tracks[i]->priv->module->state));
 
+   /* Load the fragments covering the requested time */
+   if(module->fragmented)
+   {
+      status = mp4_fragment_seek(p_ctx, seek_time);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
    /* Deal with the easy case first */
    if(!*offset)
    {
@@ -1741,18 +2659,37 @@ static VC_CONTAINER_STATUS_T mp4_reader_seek(VC_CONTAINER_T *p_ctx,
    if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
 
    /* Find the closest sync sample */
-   status = mp4_seek_sample_table( p_ctx, track_module, &track_module->state, MP4_SAMPLE_TABLE_STSS );
-   if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
-   for(i = 0, prev_sample = 0, next_sample = 0;
-       i < track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries; i++)
+   if(track_module->index.offset && track_module->index.sync_entries)
+   {
+      i = mp4_index_find_sync(track_module, sample);
+
+      /* The next sync sample might be in a fragment we haven't loaded yet */
+      while(module->fragmented && (flags & VC_CONTAINER_SEEK_FLAG_FORWARD) &&
+            i == track_module->index.sync_entries && track_module->index.sync[i - 1] != sample &&
+            mp4_fragment_read_next(p_ctx) == VC_CONTAINER_SUCCESS)
+         i = mp4_index_find_sync(track_module, sample);
+      if(i && track_module->index.sync[i - 1] == sample)
+         ; /* Already a sync sample */
+      else if((flags & VC_CONTAINER_SEEK_FLAG_FORWARD) && i < track_module->index.sync_entries)
+         sample = track_module->index.sync[i];
+      else
+         sample = i ? track_module->index.sync[i - 1] : 0;
+   }
+   else if(!track_module->index.offset)
    {
-      next_sample = _READ_U32(p_ctx) - 1;
-      if(next_sample > sample)
+      status = mp4_seek_sample_table( p_ctx, track_module, &track_module->state, MP4_SAMPLE_TABLE_STSS );
+      if(status != VC_CONTAINER_SUCCESS) goto seek_time_found;
+      for(i = 0, prev_sample = 0, next_sample = 0;
+          i < track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries; i++)
       {
-         sample = (flags & VC_CONTAINER_SEEK_FLAG_FORWARD) ? next_sample : prev_sample;
-         break;
+         next_sample = _READ_U32(p_ctx) - 1;
+         if(next_sample > sample)
+         {
+            sample = (flags & VC_CONTAINER_SEEK_FLAG_FORWARD) ? next_sample : prev_sample;
+            break;
+         }
+         prev_sample = next_sample;
       }
-      prev_sample = next_sample;
    }
 
    /* Do the seek on this track and use its timestamp as the new seek point */
@@ -1830,7 +2767,14 @@ VC_CONTAINER_STATUS_T mp4_reader_open( VC_CONTAINER_T *p_ctx )
       status = mp4_read_box_header( p_ctx, INT64_C(-1), &box_type, &box_size );
       if(status != VC_CONTAINER_SUCCESS) goto error;
 
-      if(box_type == MP4_BOX_TYPE_MDAT)
+      if(box_type == MP4_BOX_TYPE_MOOF && module->found_moov)
+      {
+         /* Fragments are loaded as we go */
+         module->fragment_first = module->box_offset;
+         if(!module->data_offset) module->data_offset = module->box_offset;
+         break;
+      }
+      else if(box_type == MP4_BOX_TYPE_MDAT)
       {
          module->data_offset = STREAM_POSITION(p_ctx);
          module->data_size = box_size;
@@ -1845,6 +2789,16 @@ VC_CONTAINER_STATUS_T mp4_reader_open( VC_CONTAINER_T *p_ctx )
       if(module->found_moov && module->data_offset) break; /* We've got everything we want */
    }
 
+   /* Decode the sample tables into in-memory indexes, if they fit */
+   for(i = 0; MP4_INDEX_MAX_SIZE && i < p_ctx->tracks_num; i++)
+      mp4_index_build(p_ctx, i); /* Failure isn't fatal, we'll read the tables as we go */
+
+   if(module->fragmented)
+   {
+      status = mp4_fragment_open(p_ctx);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+   }
+
    /* Initialise tracks */
    for(i = 0; i < p_ctx->tracks_num; i++)
    {
@@ -47,6 +47,10 @@ Defines.
 
 #define MP4_64BITS_TIME 0 /* 0 to disable / 1 to enable */
 
+/* Amount of sample data after which a fragment is flushed even if we haven't
+ * reached a suitable keyframe yet. This bounds the memory used in fragmented mode. */
+#define MP4_FRAGMENT_MAX_SIZE (8*1024*1024)
+
 /******************************************************************************
 Type definitions.
 ******************************************************************************/
@@ -69,8 +73,30 @@ typedef struct VC_CONTAINER_TRACK_MODULE_T
    int64_t first_pts;
    int64_t last_pts;
 
+   /* Fragmented mode */
+   uint32_t fragment_samples;       /**< Number of samples in the current fragment */
+   uint32_t fragment_data_offset;   /**< Offset of the samples of this track in the mdat */
+   uint32_t last_duration;          /**< Duration of the last sample written */
+   struct {
+      int64_t time;
+      int64_t moof_offset;
+      uint32_t traf;
+      uint32_t sample;
+   } *random_access;                /**< Random access points for the tfra box */
+   unsigned int random_access_num;
+   unsigned int random_access_size;
+
 } VC_CONTAINER_TRACK_MODULE_T;
 
+typedef struct MP4_WRITER_FRAGMENT_SAMPLE_T
+{
+   int64_t dts;
+   uint32_t offset;   /**< Offset of the sample data in the fragment buffer */
+   uint32_t size;
+   uint8_t track;
+   bool keyframe;
+} MP4_WRITER_FRAGMENT_SAMPLE_T;
+
 typedef struct VC_CONTAINER_MODULE_T
 {
    int box_level;
@@ -94,7 +120,26 @@ typedef struct VC_CONTAINER_MODULE_T
    int64_t prev_sample_dts;
 
    int64_t duration;
-   /**/
+
+   /* Fragmented mode */
+   int64_t fragment_duration;       /**< Target duration of the fragments (0 if not fragmented) */
+   unsigned int reference_track;    /**< Track whose keyframes start the fragments */
+   int64_t moov_offset;
+   int64_t mfra_offset;
+   struct {
+      uint32_t sequence;
+      int64_t start;                /**< Presentation timestamp of the first sample in the fragment */
+      int64_t end;                  /**< Timestamp of the sample following the fragment */
+      int64_t offset;               /**< Offset of the moof box */
+      uint32_t moof_size;
+      unsigned int traf;
+      MP4_WRITER_FRAGMENT_SAMPLE_T *samples;
+      unsigned int samples_num;
+      unsigned int samples_size;
+      uint8_t *data;
+      uint32_t data_size;
+      uint32_t data_allocated;
+   } fragment;
 
 } VC_CONTAINER_MODULE_T;
 
@@ -128,6 +173,17 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stss( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_vide( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_soun( VC_CONTAINER_T *p_ctx );
 static VC_CONTAINER_STATUS_T mp4_write_box_esds( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mvex( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_trex( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_moof( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mfhd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_traf( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfhd( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfdt( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_trun( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mfra( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_tfra( VC_CONTAINER_T *p_ctx );
+static VC_CONTAINER_STATUS_T mp4_write_box_mfro( VC_CONTAINER_T *p_ctx );
 
 static struct {
   const MP4_BOX_TYPE_T type;
@@ -159,6 +215,17 @@ static struct {
    {MP4_BOX_TYPE_VIDE, mp4_write_box_vide},
    {MP4_BOX_TYPE_SOUN, mp4_write_box_soun},
    {MP4_BOX_TYPE_ESDS, mp4_write_box_esds},
+   {MP4_BOX_TYPE_MVEX, mp4_write_box_mvex},
+   {MP4_BOX_TYPE_TREX, mp4_write_box_trex},
+   {MP4_BOX_TYPE_MOOF, mp4_write_box_moof},
+   {MP4_BOX_TYPE_MFHD, mp4_write_box_mfhd},
+   {MP4_BOX_TYPE_TRAF, mp4_write_box_traf},
+   {MP4_BOX_TYPE_TFHD, mp4_write_box_tfhd},
+   {MP4_BOX_TYPE_TFDT, mp4_write_box_tfdt},
+   {MP4_BOX_TYPE_TRUN, mp4_write_box_trun},
+   {MP4_BOX_TYPE_MFRA, mp4_write_box_mfra},
+   {MP4_BOX_TYPE_TFRA, mp4_write_box_tfra},
+   {MP4_BOX_TYPE_MFRO, mp4_write_box_mfro},
    {MP4_BOX_TYPE_UNKNOWN, 0}
 };
 
@@ -252,6 +319,9 @@ static VC_CONTAINER_STATUS_T mp4_write_box_moov( VC_CONTAINER_T *p_ctx )
       if(status != VC_CONTAINER_SUCCESS) return status;
    }
 
+   if(module->fragment_duration)
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MVEX);
+
    return status;
 }
 
@@ -651,7 +721,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stts( VC_CONTAINER_T *p_ctx )
 
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragment_duration)
    {
       /* We're not actually writing the data, we just want the size */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STTS].entries * 8);
@@ -710,7 +780,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsc( VC_CONTAINER_T *p_ctx )
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragment_duration)
    {
       /* We're not actually writing the data, we just want the size */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STSC].entries * 12);
@@ -777,7 +847,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stsz( VC_CONTAINER_T *p_ctx )
    WRITE_U32(p_ctx, 0, "sample_size");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries, "sample_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragment_duration)
    {
       /* We're not actually writing the data, we just want the size */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STSZ].entries * 4);
@@ -819,7 +889,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stco( VC_CONTAINER_T *p_ctx )
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragment_duration)
    {
       /* We're not actually writing the data, we just want the size */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STCO].entries * 4);
@@ -861,7 +931,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_co64( VC_CONTAINER_T *p_ctx )
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragment_duration)
    {
       /* We're not actually writing the data, we just want the size */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_CO64].entries * 8);
@@ -886,7 +956,7 @@ static VC_CONTAINER_STATUS_T mp4_write_box_stss( VC_CONTAINER_T *p_ctx )
    WRITE_U24(p_ctx, 0, "flags");
    WRITE_U32(p_ctx, track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries, "entry_count");
 
-   if(module->null.refcount)
+   if(module->null.refcount || module->fragment_duration)
    {
       /* We're not actually writing the data, we just want the size */
       WRITE_BYTES(p_ctx, 0, track_module->sample_table[MP4_SAMPLE_TABLE_STSS].entries * 4);
@@ -1138,6 +1208,399 @@ static VC_CONTAINER_STATUS_T mp4_write_box_esds( VC_CONTAINER_T *p_ctx )
    return STREAM_STATUS(p_ctx);
 }
 
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mvex( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int i;
+
+   for(i = 0; i < p_ctx->tracks_num && status == VC_CONTAINER_SUCCESS; i++)
+   {
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TREX);
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_trex( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+   WRITE_U32(p_ctx, 1, "default_sample_description_index");
+   WRITE_U32(p_ctx, 0, "default_sample_duration");
+   WRITE_U32(p_ctx, 0, "default_sample_size");
+   WRITE_U32(p_ctx, 0, "default_sample_flags");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_moof( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status;
+   unsigned int i;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MFHD);
+
+   for(i = 0; i < p_ctx->tracks_num && status == VC_CONTAINER_SUCCESS; i++)
+   {
+      if(!p_ctx->tracks[i]->priv->module->fragment_samples) continue;
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TRAF);
+   }
+
+   return status;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mfhd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U32(p_ctx, module->fragment.sequence, "sequence_number");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_traf( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_STATUS_T status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFHD);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFDT);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   return mp4_write_box(p_ctx, MP4_BOX_TYPE_TRUN);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfhd( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, MP4_TFHD_FLAG_DEFAULT_BASE_IS_MOOF, "flags");
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfdt( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   int64_t dts = 0;
+   unsigned int i;
+
+   /* Find the first sample of this track in the fragment */
+   for(i = 0; i < module->fragment.samples_num; i++)
+      if(module->fragment.samples[i].track == module->current_track) break;
+   if(i < module->fragment.samples_num)
+      dts = module->fragment.samples[i].dts * MP4_TIMESCALE / 1000000;
+
+   WRITE_U8(p_ctx,  1, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U64(p_ctx, dts < 0 ? 0 : dts, "base_media_decode_time");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_trun( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_T *track = p_ctx->tracks[module->current_track];
+   VC_CONTAINER_TRACK_MODULE_T *track_module = track->priv->module;
+   MP4_WRITER_FRAGMENT_SAMPLE_T *sample = 0, *next;
+   unsigned int i, entries = 0;
+   int64_t duration;
+   uint32_t flags;
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, MP4_TRUN_FLAG_DATA_OFFSET | MP4_TRUN_FLAG_SAMPLE_DURATION |
+             MP4_TRUN_FLAG_SAMPLE_SIZE | MP4_TRUN_FLAG_SAMPLE_FLAGS, "flags");
+   WRITE_U32(p_ctx, track_module->fragment_samples, "sample_count");
+   WRITE_U32(p_ctx, module->fragment.moof_size + 8 + track_module->fragment_data_offset, "data_offset");
+
+   if(module->null.refcount)
+   {
+      /* We're not actually writing the data, we just want the size */
+      WRITE_BYTES(p_ctx, 0, track_module->fragment_samples * 12);
+      return STREAM_STATUS(p_ctx);
+   }
+
+   /* Go through all the samples of the fragment. The duration of a sample is only
+    * known once we've found the next one for the same track. */
+   for(i = 0; i <= module->fragment.samples_num; i++)
+   {
+      next = i < module->fragment.samples_num ? &module->fragment.samples[i] : 0;
+      if(next && next->track != module->current_track) continue;
+
+      if(sample)
+      {
+         duration = -1;
+         if(next)
+            duration = next->dts * MP4_TIMESCALE / 1000000 - sample->dts * MP4_TIMESCALE / 1000000;
+         else if(module->fragment.end != VC_CONTAINER_TIME_UNKNOWN)
+            duration = module->fragment.end * MP4_TIMESCALE / 1000000 -
+               sample->dts * MP4_TIMESCALE / 1000000;
+         if(duration < 0 || (!next && !duration)) duration = track_module->last_duration;
+         track_module->last_duration = duration;
+
+         flags = MP4_SAMPLE_FLAG_DEPENDS_ON_NONE;
+         if(track->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO && !sample->keyframe)
+            flags = MP4_SAMPLE_FLAG_DEPENDS_ON_OTHERS | MP4_SAMPLE_FLAG_NON_SYNC;
+
+         WRITE_U32(p_ctx, duration, "sample_duration");
+         WRITE_U32(p_ctx, sample->size, "sample_size");
+         WRITE_U32(p_ctx, flags, "sample_flags");
+         entries++;
+      }
+      sample = next;
+   }
+   vc_container_assert(entries == track_module->fragment_samples);
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mfra( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   unsigned int i;
+
+   for(i = 0; i < p_ctx->tracks_num && status == VC_CONTAINER_SUCCESS; i++)
+   {
+      module->current_track = i;
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_TFRA);
+   }
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   return mp4_write_box(p_ctx, MP4_BOX_TYPE_MFRO);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_tfra( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[module->current_track]->priv->module;
+   unsigned int i;
+
+   WRITE_U8(p_ctx,  1, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U32(p_ctx, module->current_track + 1, "track_ID");
+   WRITE_U32(p_ctx, 0x3F, "length_size"); /* 4 bytes traf, trun and sample numbers */
+   WRITE_U32(p_ctx, track_module->random_access_num, "number_of_entry");
+
+   if(module->null.refcount)
+   {
+      /* We're not actually writing the data, we just want the size */
+      WRITE_BYTES(p_ctx, 0, track_module->random_access_num * 28);
+      return STREAM_STATUS(p_ctx);
+   }
+
+   for(i = 0; i < track_module->random_access_num; i++)
+   {
+      WRITE_U64(p_ctx, track_module->random_access[i].time, "time");
+      WRITE_U64(p_ctx, track_module->random_access[i].moof_offset, "moof_offset");
+      WRITE_U32(p_ctx, track_module->random_access[i].traf, "traf_number");
+      WRITE_U32(p_ctx, 1, "trun_number");
+      WRITE_U32(p_ctx, track_module->random_access[i].sample, "sample_number");
+   }
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_write_box_mfro( VC_CONTAINER_T *p_ctx )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   /* The mfra box ends right after this one */
+   uint32_t size = (uint32_t)(STREAM_POSITION(p_ctx) + 8 - module->mfra_offset);
+
+   WRITE_U8(p_ctx,  0, "version");
+   WRITE_U24(p_ctx, 0, "flags");
+   WRITE_U32(p_ctx, size, "size");
+
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_fragment_add_random_access( VC_CONTAINER_T *p_ctx,
+   unsigned int track, uint32_t traf, uint32_t sample, int64_t time )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[track]->priv->module;
+
+   if(track_module->random_access_num >= track_module->random_access_size)
+   {
+      unsigned int size = track_module->random_access_size ? track_module->random_access_size * 2 : 64;
+      void *random_access = realloc(track_module->random_access,
+                                    size * sizeof(*track_module->random_access));
+      if(!random_access) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      track_module->random_access = random_access;
+      track_module->random_access_size = size;
+   }
+
+   track_module->random_access[track_module->random_access_num].time = time < 0 ? 0 : time;
+   track_module->random_access[track_module->random_access_num].moof_offset = module->fragment.offset;
+   track_module->random_access[track_module->random_access_num].traf = traf;
+   track_module->random_access[track_module->random_access_num].sample = sample;
+   track_module->random_access_num++;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_fragment_flush( VC_CONTAINER_T *p_ctx, int64_t end )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_STATUS_T status = VC_CONTAINER_SUCCESS;
+   MP4_WRITER_FRAGMENT_SAMPLE_T *sample;
+   uint32_t offset, traf, count;
+   unsigned int i, j;
+
+   if(!module->fragment.samples_num) return VC_CONTAINER_SUCCESS;
+
+   module->fragment.sequence++;
+   module->fragment.offset = STREAM_POSITION(p_ctx);
+   module->fragment.end = end;
+
+   /* Find out where the samples of each track will go in the mdat. Each track gets
+    * a single contiguous run. */
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      p_ctx->tracks[i]->priv->module->fragment_samples = 0;
+      p_ctx->tracks[i]->priv->module->fragment_data_offset = 0;
+   }
+   for(i = 0; i < module->fragment.samples_num; i++)
+   {
+      sample = &module->fragment.samples[i];
+      p_ctx->tracks[sample->track]->priv->module->fragment_samples++;
+      p_ctx->tracks[sample->track]->priv->module->fragment_data_offset += sample->size;
+   }
+   for(i = 0, offset = 0, traf = 0; i < p_ctx->tracks_num; i++)
+   {
+      VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[i]->priv->module;
+      uint32_t size = track_module->fragment_data_offset;
+      track_module->fragment_data_offset = offset;
+      offset += size;
+      if(!track_module->fragment_samples) continue;
+      traf++;
+
+      /* Keep track of the first random access point of each track in this fragment */
+      for(j = 0, count = 0; j < module->fragment.samples_num; j++)
+      {
+         sample = &module->fragment.samples[j];
+         if(sample->track != i) continue;
+         count++;
+         if(sample->keyframe || p_ctx->tracks[i]->format->es_type != VC_CONTAINER_ES_TYPE_VIDEO)
+            break;
+      }
+      if(j < module->fragment.samples_num)
+         status = mp4_writer_fragment_add_random_access(p_ctx, i, traf, count,
+            sample->dts * MP4_TIMESCALE / 1000000);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+
+   /* We need the size of the moof box to calculate the data offsets */
+   if(!vc_container_writer_extraio_enable(p_ctx, &module->null))
+   {
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOF);
+      module->fragment.moof_size = STREAM_POSITION(p_ctx);
+   }
+   vc_container_writer_extraio_disable(p_ctx, &module->null);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOF);
+   if(status != VC_CONTAINER_SUCCESS) return status;
+
+   /* Write the mdat box with the data of each track grouped together */
+   WRITE_U32(p_ctx, 8 + module->fragment.data_size, "size");
+   WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+   for(i = 0; i < p_ctx->tracks_num; i++)
+   {
+      if(!p_ctx->tracks[i]->priv->module->fragment_samples) continue;
+      for(j = 0; j < module->fragment.samples_num; j++)
+      {
+         sample = &module->fragment.samples[j];
+         if(sample->track != i) continue;
+         WRITE_BYTES(p_ctx, module->fragment.data + sample->offset, sample->size);
+      }
+   }
+
+   module->fragment.samples_num = 0;
+   module->fragment.data_size = 0;
+   return STREAM_STATUS(p_ctx);
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_fragment_write_data( VC_CONTAINER_T *p_ctx,
+   const uint8_t *data, uint32_t size )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+
+   if(size > module->fragment.data_allocated - module->fragment.data_size)
+   {
+      uint32_t allocated = MAX(module->fragment.data_allocated * 2, module->fragment.data_size + size);
+      uint8_t *buffer = realloc(module->fragment.data, MAX(allocated, 64*1024));
+      if(!buffer) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      module->fragment.data = buffer;
+      module->fragment.data_allocated = MAX(allocated, 64*1024);
+   }
+
+   memcpy(module->fragment.data + module->fragment.data_size, data, size);
+   module->fragment.data_size += size;
+   return VC_CONTAINER_SUCCESS;
+}
+
+/*****************************************************************************/
+static VC_CONTAINER_STATUS_T mp4_writer_fragment_add_sample( VC_CONTAINER_T *p_ctx,
+   VC_CONTAINER_PACKET_T *packet )
+{
+   VC_CONTAINER_MODULE_T *module = p_ctx->priv->module;
+   VC_CONTAINER_TRACK_MODULE_T *track_module = p_ctx->tracks[packet->track]->priv->module;
+   MP4_WRITER_FRAGMENT_SAMPLE_T *sample;
+
+   if(module->fragment.samples_num >= module->fragment.samples_size)
+   {
+      unsigned int size = module->fragment.samples_size ? module->fragment.samples_size * 2 : 256;
+      sample = realloc(module->fragment.samples, size * sizeof(*sample));
+      if(!sample) return VC_CONTAINER_ERROR_OUT_OF_MEMORY;
+      module->fragment.samples = sample;
+      module->fragment.samples_size = size;
+   }
+
+   /* The fragment duration check in mp4_writer_write() works on pts */
+   if(!module->fragment.samples_num) module->fragment.start = packet->pts;
+   sample = &module->fragment.samples[module->fragment.samples_num++];
+   sample->dts = packet->dts;
+   sample->offset = (uint32_t)module->sample_offset;
+   sample->size = packet->size;
+   sample->track = packet->track;
+   sample->keyframe = !!(packet->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME);
+
+   track_module->last_pts = packet->pts;
+   if(!track_module->samples) track_module->first_pts = packet->pts;
+   track_module->samples++;
+
+   return VC_CONTAINER_SUCCESS;
+}
+
 /*****************************************************************************/
 static VC_CONTAINER_STATUS_T mp4_writer_close( VC_CONTAINER_T *p_ctx )
 {
@@ -1145,20 +1608,47 @@ static VC_CONTAINER_STATUS_T mp4_writer_close( VC_CONTAINER_T *p_ctx )
    VC_CONTAINER_STATUS_T status;
    int64_t mdat_size;
 
-   mdat_size = STREAM_POSITION(p_ctx) - module->mdat_offset;
+   if(module->fragment_duration)
+   {
+      /* Flush the last fragment and write the random access index */
+      status = mp4_writer_fragment_flush(p_ctx, VC_CONTAINER_TIME_UNKNOWN);
+      if(status == VC_CONTAINER_SUCCESS && module->tracks_add_done)
+      {
+         module->mfra_offset = STREAM_POSITION(p_ctx);
+         status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MFRA);
+      }
 
-   /* Write the moov box */
-   status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+      /* Rewrite the moov box now that we know the durations. Its size doesn't
+       * change since the sample tables are empty. */
+      if(status == VC_CONTAINER_SUCCESS && module->tracks_add_done)
+      {
+         SEEK(p_ctx, module->moov_offset);
+         status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+         vc_container_assert(STREAM_POSITION(p_ctx) == module->moov_offset + module->moov_size);
+      }
+   }
+   else
+   {
+      mdat_size = STREAM_POSITION(p_ctx) - module->mdat_offset;
+
+      /* Write the moov box */
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
 
-   /* Finalise the mdat box */
-   SEEK(p_ctx, module->mdat_offset);
-   WRITE_U32(p_ctx, (uint32_t)mdat_size, "mdat size" );
+      /* Finalise the mdat box */
+      SEEK(p_ctx, module->mdat_offset);
+      WRITE_U32(p_ctx, (uint32_t)mdat_size, "mdat size" );
+   }
 
    for(; p_ctx->tracks_num > 0; p_ctx->tracks_num--)
+   {
+      free(p_ctx->tracks[p_ctx->tracks_num-1]->priv->module->random_access);
       vc_container_free_track(p_ctx, p_ctx->tracks[p_ctx->tracks_num-1]);
+   }
 
-   vc_container_writer_extraio_delete(p_ctx, &module->temp);
+   if(module->temp.io) vc_container_writer_extraio_delete(p_ctx, &module->temp);
    vc_container_writer_extraio_delete(p_ctx, &module->null);
+   free(module->fragment.samples);
+   free(module->fragment.data);
    free(module);
 
    return status;
@@ -1247,6 +1737,18 @@ static VC_CONTAINER_STATUS_T mp4_writer_add_track_done( VC_CONTAINER_T *p_ctx )
    }
    vc_container_writer_extraio_disable(p_ctx, &module->null);
 
+   /* In fragmented mode the moov box goes first, followed by the fragments */
+   if(status == VC_CONTAINER_SUCCESS && module->fragment_duration)
+   {
+      /* Fragments start on a keyframe of the first video track if there is one */
+      for(module->reference_track = 0; module->reference_track < p_ctx->tracks_num; module->reference_track++)
+         if(p_ctx->tracks[module->reference_track]->format->es_type == VC_CONTAINER_ES_TYPE_VIDEO) break;
+      if(module->reference_track == p_ctx->tracks_num) module->reference_track = 0;
+
+      module->moov_offset = STREAM_POSITION(p_ctx);
+      status = mp4_write_box(p_ctx, MP4_BOX_TYPE_MOOV);
+   }
+
    if(status == VC_CONTAINER_SUCCESS) module->tracks_add_done = true;
    return status;
 }
@@ -1335,9 +1837,27 @@ static VC_CONTAINER_STATUS_T mp4_writer_write( VC_CONTAINER_T *p_ctx,
    if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)
       ++module->samples; /* Switching to a new sample */
 
+   /* Check if it is time to start a new fragment */
+   if(module->fragment_duration && module->fragment.samples_num &&
+      (packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START))
+   {
+      VC_CONTAINER_TRACK_T *reference = p_ctx->tracks[module->reference_track];
+      bool boundary = packet->track == module->reference_track &&
+         ((packet->flags & VC_CONTAINER_PACKET_FLAG_KEYFRAME) ||
+          reference->format->es_type != VC_CONTAINER_ES_TYPE_VIDEO);
+
+      if((boundary && packet->pts - module->fragment.start >= module->fragment_duration) ||
+         module->fragment.data_size >= MP4_FRAGMENT_MAX_SIZE)
+      {
+         status = mp4_writer_fragment_flush(p_ctx, packet->pts);
+         if(status != VC_CONTAINER_SUCCESS) return status;
+      }
+   }
+
    if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_START)
    {
-      module->sample_offset = STREAM_POSITION(p_ctx);
+      module->sample_offset = module->fragment_duration ?
+         module->fragment.data_size : STREAM_POSITION(p_ctx);
       sample->size = packet->size;
       sample->pts = packet->pts;
       sample->dts = packet->pts;
@@ -1350,13 +1870,21 @@ static VC_CONTAINER_STATUS_T mp4_writer_write( VC_CONTAINER_T *p_ctx,
       sample->flags |= packet->flags;
    }
 
-   if(WRITE_BYTES(p_ctx, packet->data, packet->size) != packet->size)
+   if(module->fragment_duration)
+   {
+      status = mp4_writer_fragment_write_data(p_ctx, packet->data, packet->size);
+      if(status != VC_CONTAINER_SUCCESS) return status;
+   }
+   else if(WRITE_BYTES(p_ctx, packet->data, packet->size) != packet->size)
       return STREAM_STATUS(p_ctx); // TODO do something
    p_ctx->size += packet->size;
 
    //
    if(packet->flags & VC_CONTAINER_PACKET_FLAG_FRAME_END)
    {
+      if(module->fragment_duration)
+         return mp4_writer_fragment_add_sample(p_ctx, sample);
+
       status = mp4_writer_write_sample_to_temp(p_ctx, sample);
       status = mp4_writer_add_sample(p_ctx, sample);
    }
@@ -1373,6 +1901,7 @@ VC_CONTAINER_STATUS_T mp4_writer_open( VC_CONTAINER_T *p_ctx )
    VC_CONTAINER_STATUS_T status = VC_CONTAINER_ERROR_FORMAT_NOT_SUPPORTED;
    const char *extension = vc_uri_path_extension(p_ctx->priv->uri);
    VC_CONTAINER_MODULE_T *module = 0;
+   const char *fragment = 0;
    MP4_BRAND_T brand;
 
    /* Check if the user has specified a container */
@@ -1400,22 +1929,36 @@ VC_CONTAINER_STATUS_T mp4_writer_open( VC_CONTAINER_T *p_ctx )
    else brand = MP4_BRAND_ISOM;
    module->brand = brand;
 
+   /* Check if fragmented output was requested. The value is the duration
+    * of the fragments in milliseconds. */
+   if(vc_uri_find_query(p_ctx->priv->uri, 0, "fragment", &fragment) && fragment)
+      module->fragment_duration = INT64_C(1000) * strtoul(fragment, 0, 0);
+   if(module->fragment_duration && brand == MP4_BRAND_QT)
+      module->fragment_duration = 0; /* Not supported by quicktime */
+
    /* Create a null i/o writer to help us out in writing our data */
    status = vc_container_writer_extraio_create_null(p_ctx, &module->null);
    if(status != VC_CONTAINER_SUCCESS) goto error;
 
-   /* Create a temporary i/o writer to help us out in writing our data */
-   status = vc_container_writer_extraio_create_temp(p_ctx, &module->temp);
-   if(status != VC_CONTAINER_SUCCESS) goto error;
+   /* Create a temporary i/o writer to help us out in writing our data.
+    * In fragmented mode the samples are described by each fragment so we don't need it. */
+   if(!module->fragment_duration)
+   {
+      status = vc_container_writer_extraio_create_temp(p_ctx, &module->temp);
+      if(status != VC_CONTAINER_SUCCESS) goto error;
+   }
 
    status = mp4_write_box(p_ctx, MP4_BOX_TYPE_FTYP);
    if(status != VC_CONTAINER_SUCCESS) goto error;
 
-   /* Start the mdat box */
-   module->mdat_offset = STREAM_POSITION(p_ctx);
-   WRITE_U32(p_ctx, 0, "size");
-   WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
-   module->data_offset = STREAM_POSITION(p_ctx);
+   /* Start the mdat box. In fragmented mode each fragment has its own. */
+   if(!module->fragment_duration)
+   {
+      module->mdat_offset = STREAM_POSITION(p_ctx);
+      WRITE_U32(p_ctx, 0, "size");
+      WRITE_FOURCC(p_ctx, VC_FOURCC('m','d','a','t'), "type");
+      module->data_offset = STREAM_POSITION(p_ctx);
+   }
 
    p_ctx->priv->pf_close = mp4_writer_close;
    p_ctx->priv->pf_write = mp4_writer_write;
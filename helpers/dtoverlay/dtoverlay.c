@@ -60,6 +60,13 @@ static int dtoverlay_set_node_name(DTBLOB_T *dtb, int node_off,
 static void dtoverlay_stdio_logging(dtoverlay_logging_type_t type,
                                     const char *fmt, va_list args);
 
+static int dtoverlay_index_path(DTBLOB_T *dtb, const char *path, int path_len);
+static const char *dtoverlay_index_symbol(DTBLOB_T *dtb, const char *name,
+                                          int *len);
+static int dtoverlay_index_prepare(DTBLOB_T *dtb, int node_off, int subtree);
+static void dtoverlay_index_patch(DTBLOB_T *dtb, int node_off, int end_off,
+                                  int subtree);
+
 #define phandle_debug if (0) dtoverlay_debug
 
 static DTOVERLAY_LOGGING_FUNC *dtoverlay_logging_func = dtoverlay_stdio_logging;
@@ -187,9 +194,10 @@ int dtoverlay_delete_node(DTBLOB_T *dtb, const char *node_path, int path_len)
       path_len = strlen(node_path);
 
    dtoverlay_debug("delete_node(%.*s)", path_len, node_path);
-   node_off = fdt_path_offset_namelen(dtb->fdt, node_path, path_len);
+   node_off = dtoverlay_index_path(dtb, node_path, path_len);
    if (node_off < 0)
       return node_off;
+   dtoverlay_invalidate_index(dtb);
    return fdt_del_node(dtb->fdt, node_off);
 }
 
@@ -199,7 +207,7 @@ int dtoverlay_find_node(DTBLOB_T *dtb, const char *node_path, int path_len)
 {
    if (!path_len)
       path_len = strlen(node_path);
-   return fdt_path_offset_namelen(dtb->fdt, node_path, path_len);
+   return dtoverlay_index_path(dtb, node_path, path_len);
 }
 
 // Returns 0 on success, otherwise <0 error code
@@ -848,7 +856,7 @@ static int dtoverlay_resolve_fixups(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
       if (fixup_off >= 0)
       {
          // Find the symbols, which will be needed to resolve the fixups
-         symbols_off = fdt_path_offset(base_dtb->fdt, "/__symbols__");
+         symbols_off = dtoverlay_index_path(base_dtb, "/__symbols__", 12);
 
          if (symbols_off < 0)
          {
@@ -886,8 +894,7 @@ static int dtoverlay_resolve_fixups(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
          }
          else
          {
-            target_path = fdt_getprop(base_dtb->fdt, symbols_off, symbol_name,
-                                      &err);
+            target_path = dtoverlay_index_symbol(base_dtb, symbol_name, &err);
             if (!target_path)
             {
                dtoverlay_error("can't find symbol '%s'", symbol_name);
@@ -897,7 +904,8 @@ static int dtoverlay_resolve_fixups(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
             ref_type = "symbol";
          }
 
-         target_off = fdt_path_offset(base_dtb->fdt, target_path);
+         target_off = dtoverlay_index_path(base_dtb, target_path,
+                                           strlen(target_path));
          if (target_off < 0)
          {
             dtoverlay_error("%s '%s' is invalid", ref_type, symbol_name);
@@ -911,11 +919,14 @@ static int dtoverlay_resolve_fixups(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
          {
             // It doesn't, so give it one
             fdt32_t temp;
+            int end_off;
             target_phandle = ++base_dtb->max_phandle;
             temp = cpu_to_fdt32(target_phandle);
 
+            end_off = dtoverlay_index_prepare(base_dtb, target_off, 0);
             err = fdt_setprop(base_dtb->fdt, target_off, "phandle",
                               &temp, 4);
+            dtoverlay_index_patch(base_dtb, target_off, end_off, 0);
 
             if (err != 0)
             {
@@ -923,9 +934,6 @@ static int dtoverlay_resolve_fixups(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
                break;
             }
             phandle_debug("  phandle '%s'->%d", target_path, target_phandle);
-
-            // The symbols may have moved, so recalculate
-            symbols_off = fdt_path_offset(base_dtb->fdt, "/__symbols__");
          }
 
          // Now apply the valid target_phandle to the items in the fixup string
@@ -952,7 +960,7 @@ int dtoverlay_merge_overlay(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
    {
       const char *node_name, *target_path;
       const char *frag_name;
-      int target_off, overlay_off;
+      int target_off, overlay_off, end_off;
       int len, err;
 
       node_name = fdt_get_name(overlay_dtb->fdt, frag_off, NULL);
@@ -980,7 +988,7 @@ int dtoverlay_merge_overlay(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
       {
          if (len && (target_path[len - 1] == '\0'))
             len--;
-         target_off = fdt_path_offset_namelen(base_dtb->fdt, target_path, len);
+         target_off = dtoverlay_index_path(base_dtb, target_path, len);
          if (target_off < 0)
          {
             dtoverlay_error("invalid target-path '%.*s'", len, target_path);
@@ -1001,8 +1009,8 @@ int dtoverlay_merge_overlay(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
             return NON_FATAL(FDT_ERR_BADSTRUCTURE);
 
          target_off =
-            fdt_node_offset_by_phandle(base_dtb->fdt,
-                                       fdt32_to_cpu(*(fdt32_t *)target_prop));
+            dtoverlay_find_phandle(base_dtb,
+                                   fdt32_to_cpu(*(fdt32_t *)target_prop));
          if (target_off < 0)
          {
             dtoverlay_error("invalid target");
@@ -1011,13 +1019,16 @@ int dtoverlay_merge_overlay(DTBLOB_T *base_dtb, DTBLOB_T *overlay_dtb)
       }
 
       // Now do the merge
+      end_off = dtoverlay_index_prepare(base_dtb, target_off, 1);
       err = dtoverlay_merge_fragment(base_dtb, target_off, overlay_dtb,
                                      overlay_off, 0);
       if (err != 0)
       {
+         dtoverlay_invalidate_index(base_dtb);
          dtoverlay_error("merge failed");
          return err;
       }
+      dtoverlay_index_patch(base_dtb, target_off, end_off, 1);
    }
 
    base_dtb->max_phandle = overlay_dtb->max_phandle;
@@ -1395,7 +1406,7 @@ int dtoverlay_foreach_override_target(DTBLOB_T *dtb, const char *override_name,
 
       if (target_phandle != 0)
       {
-         node_off = fdt_node_offset_by_phandle(dtb->fdt, target_phandle);
+         node_off = dtoverlay_find_phandle(dtb, target_phandle);
          if (node_off < 0)
          {
             dtoverlay_error("  phandle %d not found", target_phandle);
@@ -1828,6 +1839,7 @@ int dtoverlay_extend_dtb(DTBLOB_T *dtb, int new_size)
       fdt = malloc(new_size);
       if (fdt)
       {
+         // Offsets are relative to the struct block, so an index survives
          memcpy(fdt, dtb->fdt, size);
          fdt_set_totalsize(fdt, new_size);
 
@@ -1861,10 +1873,641 @@ void dtoverlay_pack_dtb(DTBLOB_T *dtb)
    fdt_pack(dtb->fdt);
 }
 
+// The index is a set of hash tables over the nodes of a DTB, mapping
+// phandles and paths to node offsets and symbols to __symbols__ properties,
+// so that lookups don't have to scan the blob. It is only an accelerator -
+// every hit is checked against the blob, and anything not found falls back
+// to libfdt. Offsets are relative to the struct block, so extending or
+// packing the blob leaves the index valid, but any edit that resizes the
+// struct block must either be described to it (dtoverlay_index_patch) or
+// cause it to be rebuilt on the next lookup.
+
+#define INDEX_MIN_BUCKETS 64
+#define INDEX_MAX_DEPTH   32
+
+#define FNV_OFFSET_BASIS  0x811c9dc5
+#define FNV_PRIME         0x01000193
+
+typedef struct
+{
+   int offset;       // -1 once the node has gone
+   int parent;       // Entry index of the parent, -1 for the root
+   uint32_t phandle;
+   uint32_t path_hash;
+   int next_phandle;
+   int next_path;
+} dtoverlay_index_node_t;
+
+typedef struct
+{
+   int prop_off;
+   uint32_t hash;
+   int next;
+} dtoverlay_index_symbol_t;
+
+struct dtoverlay_index_struct
+{
+   int valid;
+   int struct_size;  // fdt_size_dt_struct when last brought up to date
+   dtoverlay_index_node_t *nodes;
+   int num_nodes;
+   int max_nodes;
+   int dead_nodes;
+   dtoverlay_index_symbol_t *symbols;
+   int num_symbols;
+   int max_symbols;
+   int symbols_node; // Entry index of /__symbols__, or -1
+   int *phandle_buckets;
+   int *path_buckets;
+   int num_buckets;  // Always a power of two
+   int *symbol_buckets;
+   int num_symbol_buckets;
+};
+
+static uint32_t dtoverlay_hash_bytes(uint32_t hash, const char *p, int len)
+{
+   while (len--)
+      hash = (hash ^ (unsigned char)*(p++)) * FNV_PRIME;
+   return hash;
+}
+
+static uint32_t dtoverlay_hash_phandle(uint32_t phandle)
+{
+   return phandle * 0x9e3779b1;
+}
+
+static int dtoverlay_index_buckets(int **buckets, int *num_buckets, int entries)
+{
+   int num = INDEX_MIN_BUCKETS;
+   int *new_buckets;
+   int i;
+
+   while (num < entries * 2)
+      num <<= 1;
+
+   new_buckets = realloc(*buckets, num * sizeof(int));
+   if (!new_buckets)
+      return -FDT_ERR_NOSPACE;
+
+   for (i = 0; i < num; i++)
+      new_buckets[i] = -1;
+
+   *buckets = new_buckets;
+   *num_buckets = num;
+
+   return 0;
+}
+
+// Returns 0 on success, otherwise <0 error code
+static int dtoverlay_index_rehash(struct dtoverlay_index_struct *index)
+{
+   int num_buckets;
+   int i;
+
+   // The phandle and path tables are the same size
+   if ((dtoverlay_index_buckets(&index->phandle_buckets, &num_buckets,
+                                index->num_nodes) != 0) ||
+       (dtoverlay_index_buckets(&index->path_buckets, &index->num_buckets,
+                                index->num_nodes) != 0))
+      return -FDT_ERR_NOSPACE;
+
+   for (i = 0; i < index->num_nodes; i++)
+   {
+      dtoverlay_index_node_t *node = &index->nodes[i];
+      int bucket;
+
+      if (node->offset < 0)
+         continue;
+
+      if (node->phandle)
+      {
+         bucket = dtoverlay_hash_phandle(node->phandle) & (index->num_buckets - 1);
+         node->next_phandle = index->phandle_buckets[bucket];
+         index->phandle_buckets[bucket] = i;
+      }
+
+      bucket = node->path_hash & (index->num_buckets - 1);
+      node->next_path = index->path_buckets[bucket];
+      index->path_buckets[bucket] = i;
+   }
+
+   if (dtoverlay_index_buckets(&index->symbol_buckets,
+                               &index->num_symbol_buckets,
+                               index->num_symbols) != 0)
+      return -FDT_ERR_NOSPACE;
+
+   for (i = 0; i < index->num_symbols; i++)
+   {
+      dtoverlay_index_symbol_t *symbol = &index->symbols[i];
+      int bucket;
+
+      bucket = symbol->hash & (index->num_symbol_buckets - 1);
+      symbol->next = index->symbol_buckets[bucket];
+      index->symbol_buckets[bucket] = i;
+   }
+
+   return 0;
+}
+
+// Returns 0 on success, otherwise <0 error code
+static int dtoverlay_index_add_symbols(struct dtoverlay_index_struct *index,
+                                       const void *fdt, int node_off,
+                                       int hashed)
+{
+   int prop_off;
+
+   for (prop_off = fdt_first_property_offset(fdt, node_off);
+        prop_off >= 0;
+        prop_off = fdt_next_property_offset(fdt, prop_off))
+   {
+      dtoverlay_index_symbol_t *symbol;
+      const char *name;
+
+      if (!fdt_getprop_by_offset(fdt, prop_off, &name, NULL))
+         continue;
+
+      if (index->num_symbols == index->max_symbols)
+      {
+         int max = index->max_symbols ? (index->max_symbols * 2) : 64;
+         symbol = realloc(index->symbols, max * sizeof(*symbol));
+         if (!symbol)
+            return -FDT_ERR_NOSPACE;
+         index->symbols = symbol;
+         index->max_symbols = max;
+      }
+
+      symbol = &index->symbols[index->num_symbols];
+      symbol->prop_off = prop_off;
+      symbol->hash = dtoverlay_hash_bytes(FNV_OFFSET_BASIS, name, strlen(name));
+      symbol->next = -1;
+
+      if (hashed)
+      {
+         int bucket = symbol->hash & (index->num_symbol_buckets - 1);
+         symbol->next = index->symbol_buckets[bucket];
+         index->symbol_buckets[bucket] = index->num_symbols;
+      }
+
+      index->num_symbols++;
+   }
+
+   return 0;
+}
+
+// Returns the new entry index, otherwise <0 error code
+static int dtoverlay_index_add_node(struct dtoverlay_index_struct *index,
+                                    const void *fdt, int node_off,
+                                    int parent, int hashed)
+{
+   dtoverlay_index_node_t *node;
+   const char *name;
+   int name_len;
+
+   name = fdt_get_name(fdt, node_off, &name_len);
+   if (!name)
+      return name_len;
+
+   if (index->num_nodes == index->max_nodes)
+   {
+      int max = index->max_nodes ? (index->max_nodes * 2) : 256;
+      node = realloc(index->nodes, max * sizeof(*node));
+      if (!node)
+         return -FDT_ERR_NOSPACE;
+      index->nodes = node;
+      index->max_nodes = max;
+   }
+
+   node = &index->nodes[index->num_nodes];
+   node->offset = node_off;
+   node->parent = parent;
+   node->phandle = fdt_get_phandle(fdt, node_off);
+   node->next_phandle = -1;
+   node->next_path = -1;
+
+   // The hash of a path is built up from that of its parent, so the root
+   // (whose name is empty) hashes as the empty string.
+   if (parent < 0)
+      node->path_hash = FNV_OFFSET_BASIS;
+   else
+      node->path_hash =
+         dtoverlay_hash_bytes(dtoverlay_hash_bytes(index->nodes[parent].path_hash,
+                                                   "/", 1),
+                              name, name_len);
+
+   if (hashed)
+   {
+      int bucket;
+      if (node->phandle)
+      {
+         bucket = dtoverlay_hash_phandle(node->phandle) & (index->num_buckets - 1);
+         node->next_phandle = index->phandle_buckets[bucket];
+         index->phandle_buckets[bucket] = index->num_nodes;
+      }
+      bucket = node->path_hash & (index->num_buckets - 1);
+      node->next_path = index->path_buckets[bucket];
+      index->path_buckets[bucket] = index->num_nodes;
+   }
+
+   if ((parent >= 0) && (index->nodes[parent].parent < 0) &&
+       (name_len == 11) && (memcmp(name, "__symbols__", 11) == 0))
+   {
+      int err;
+      index->symbols_node = index->num_nodes;
+      err = dtoverlay_index_add_symbols(index, fdt, node_off, hashed);
+      if (err)
+         return err;
+   }
+
+   return index->num_nodes++;
+}
+
+// Adds the descendants of the node with entry index 'entry', stopping at
+// the end of its subtree. Returns 0 on success, otherwise <0 error code
+static int dtoverlay_index_add_subtree(struct dtoverlay_index_struct *index,
+                                       const void *fdt, int entry, int hashed)
+{
+   int parents[INDEX_MAX_DEPTH];
+   int node_off = index->nodes[entry].offset;
+   int depth = 0;
+
+   parents[0] = entry;
+
+   while (1)
+   {
+      int err;
+
+      node_off = fdt_next_node(fdt, node_off, &depth);
+      if ((node_off < 0) || (depth <= 0))
+         break;
+      if (depth >= INDEX_MAX_DEPTH)
+         return -FDT_ERR_BADSTRUCTURE;
+
+      err = dtoverlay_index_add_node(index, fdt, node_off,
+                                     parents[depth - 1], hashed);
+      if (err < 0)
+         return err;
+      parents[depth] = err;
+   }
+
+   if ((node_off < 0) && (node_off != -FDT_ERR_NOTFOUND))
+      return node_off;
+
+   return 0;
+}
+
+static void dtoverlay_index_reset(struct dtoverlay_index_struct *index)
+{
+   index->valid = 0;
+   index->num_nodes = 0;
+   index->dead_nodes = 0;
+   index->num_symbols = 0;
+   index->symbols_node = -1;
+}
+
+// Returns 0 on success, otherwise <0 error code
+static int dtoverlay_index_build(DTBLOB_T *dtb)
+{
+   struct dtoverlay_index_struct *index = dtb->index;
+   int err;
+
+   dtoverlay_index_reset(index);
+
+   err = dtoverlay_index_add_node(index, dtb->fdt, 0, -1, 0);
+   if (err >= 0)
+      err = dtoverlay_index_add_subtree(index, dtb->fdt, 0, 0);
+   if (err >= 0)
+      err = dtoverlay_index_rehash(index);
+
+   if (err < 0)
+   {
+      dtoverlay_debug("failed to index dtb - err %d", err);
+      return err;
+   }
+
+   index->struct_size = fdt_size_dt_struct(dtb->fdt);
+   index->valid = 1;
+
+   return 0;
+}
+
+// Returns the index if it can be used, rebuilding it if necessary
+static struct dtoverlay_index_struct *dtoverlay_index_get(DTBLOB_T *dtb)
+{
+   struct dtoverlay_index_struct *index = dtb->index;
+
+   if (!index)
+      return NULL;
+
+   if ((!index->valid ||
+        (index->struct_size != fdt_size_dt_struct(dtb->fdt))) &&
+       (dtoverlay_index_build(dtb) != 0))
+      return NULL;
+
+   return index;
+}
+
+// Checks that the indexed node really has the given path, working back up
+// through the parents one component at a time.
+static int dtoverlay_index_node_has_path(struct dtoverlay_index_struct *index,
+                                         const void *fdt, int entry,
+                                         const char *path, int path_len)
+{
+   while (path_len > 0)
+   {
+      const char *name;
+      int name_len;
+      int start = path_len;
+
+      while ((start > 0) && (path[start - 1] != '/'))
+         start--;
+      if ((start == 0) || (entry < 0))
+         return 0;
+
+      name = fdt_get_name(fdt, index->nodes[entry].offset, &name_len);
+      if (!name || (name_len != path_len - start) ||
+          (memcmp(name, path + start, name_len) != 0))
+         return 0;
+
+      path_len = start - 1;
+      entry = index->nodes[entry].parent;
+   }
+
+   return (entry >= 0) && (index->nodes[entry].parent < 0);
+}
+
+// Returns the offset of the node with the given absolute path, or a negative
+// error code. Falls back to libfdt for anything the index can't answer,
+// including aliases and paths which omit unit addresses.
+static int dtoverlay_index_path(DTBLOB_T *dtb, const char *path, int path_len)
+{
+   struct dtoverlay_index_struct *index = dtoverlay_index_get(dtb);
+
+   if (index && (path_len > 0) && (path[0] == '/'))
+   {
+      int len = path_len;
+      uint32_t hash;
+      int entry;
+
+      if (path[len - 1] == '/')
+         len--;
+
+      hash = dtoverlay_hash_bytes(FNV_OFFSET_BASIS, path, len);
+      for (entry = index->path_buckets[hash & (index->num_buckets - 1)];
+           entry >= 0;
+           entry = index->nodes[entry].next_path)
+      {
+         dtoverlay_index_node_t *node = &index->nodes[entry];
+         if ((node->path_hash == hash) && (node->offset >= 0) &&
+             dtoverlay_index_node_has_path(index, dtb->fdt, entry, path, len))
+            return node->offset;
+      }
+   }
+
+   return fdt_path_offset_namelen(dtb->fdt, path, path_len);
+}
+
+// Returns the path for the symbol, or NULL if there isn't one (with the
+// reason in *len).
+static const char *dtoverlay_index_symbol(DTBLOB_T *dtb, const char *name,
+                                          int *len)
+{
+   struct dtoverlay_index_struct *index = dtoverlay_index_get(dtb);
+   int symbols_off;
+
+   if (index && (index->symbols_node >= 0))
+   {
+      uint32_t hash = dtoverlay_hash_bytes(FNV_OFFSET_BASIS, name, strlen(name));
+      int entry;
+
+      for (entry = index->symbol_buckets[hash & (index->num_symbol_buckets - 1)];
+           entry >= 0;
+           entry = index->symbols[entry].next)
+      {
+         dtoverlay_index_symbol_t *symbol = &index->symbols[entry];
+         const char *prop_name;
+         const char *value;
+
+         if (symbol->hash != hash)
+            continue;
+
+         value = fdt_getprop_by_offset(dtb->fdt, symbol->prop_off,
+                                       &prop_name, len);
+         if (value && (strcmp(prop_name, name) == 0))
+            return value;
+      }
+   }
+
+   symbols_off = dtoverlay_index_path(dtb, "/__symbols__", 12);
+   if (symbols_off < 0)
+   {
+      *len = symbols_off;
+      return NULL;
+   }
+
+   return fdt_getprop(dtb->fdt, symbols_off, name, len);
+}
+
+// Returns the offset beyond the node's own properties or, if 'subtree' is
+// set, beyond all of its descendants. This is the extent of an edit that is
+// about to be made to the node, to be passed to dtoverlay_index_patch, or
+// -1 if there is no usable index.
+static int dtoverlay_index_prepare(DTBLOB_T *dtb, int node_off, int subtree)
+{
+   struct dtoverlay_index_struct *index = dtb->index;
+   int depth = 0;
+   int end_off;
+
+   if (!index || !index->valid ||
+       (index->struct_size != fdt_size_dt_struct(dtb->fdt)))
+      return -1;
+
+   end_off = node_off;
+   do
+      end_off = fdt_next_node(dtb->fdt, end_off, &depth);
+   while (subtree && (end_off >= 0) && (depth > 0));
+
+   if (end_off < 0)
+      end_off = fdt_size_dt_struct(dtb->fdt);
+
+   return end_off;
+}
+
+// Drops the entries of nodes which have gone, renumbering the rest. Parents
+// always come before their children, so one pass is enough. The hash chains
+// are left stale - the caller must rehash.
+// Returns 0 on success, otherwise <0 error code
+static int dtoverlay_index_compact(struct dtoverlay_index_struct *index)
+{
+   int *renumber;
+   int i, j;
+
+   renumber = malloc(index->num_nodes * sizeof(int));
+   if (!renumber)
+      return -FDT_ERR_NOSPACE;
+
+   for (i = 0, j = 0; i < index->num_nodes; i++)
+   {
+      dtoverlay_index_node_t *node = &index->nodes[i];
+
+      renumber[i] = -1;
+      if (node->offset < 0)
+         continue;
+
+      if (node->parent >= 0)
+         node->parent = renumber[node->parent];
+      renumber[i] = j;
+      index->nodes[j++] = *node;
+   }
+
+   if (index->symbols_node >= 0)
+      index->symbols_node = renumber[index->symbols_node];
+   index->num_nodes = j;
+   index->dead_nodes = 0;
+
+   free(renumber);
+
+   return 0;
+}
+
+// Brings the index up to date after an edit confined to the node at
+// node_off, which before the edit extended as far as end_off. Nodes after
+// the edit are moved. If 'subtree' is set the edit covered the descendants
+// too, so they are dropped and rescanned, otherwise only the node's own
+// properties changed and its descendants just move with everything else.
+static void dtoverlay_index_patch(DTBLOB_T *dtb, int node_off, int end_off,
+                                  int subtree)
+{
+   struct dtoverlay_index_struct *index = dtb->index;
+   int delta, entry, i;
+   int err = 0;
+
+   if (!index || (end_off < 0))
+      return;
+
+   delta = fdt_size_dt_struct(dtb->fdt) - index->struct_size;
+   entry = -1;
+
+   for (i = 0; i < index->num_nodes; i++)
+   {
+      dtoverlay_index_node_t *node = &index->nodes[i];
+
+      if (node->offset >= end_off)
+      {
+         node->offset += delta;
+      }
+      else if (node->offset == node_off)
+      {
+         entry = i;
+      }
+      else if (node->offset > node_off)
+      {
+         node->offset = -1;
+         index->dead_nodes++;
+      }
+   }
+
+   if ((entry < 0) || (index->dead_nodes > (index->num_nodes / 2)))
+   {
+      index->valid = 0;
+      return;
+   }
+
+   if ((index->symbols_node >= 0) &&
+       ((index->symbols_node == entry) ||
+        (index->nodes[index->symbols_node].offset < 0)))
+   {
+      // The symbols were within the edit, so start them again
+      index->num_symbols = 0;
+      for (i = 0; i < index->num_symbol_buckets; i++)
+         index->symbol_buckets[i] = -1;
+      if (index->symbols_node == entry)
+         err = dtoverlay_index_add_symbols(index, dtb->fdt, node_off, 1);
+      else
+         index->symbols_node = -1;
+   }
+   else
+   {
+      for (i = 0; i < index->num_symbols; i++)
+      {
+         if (index->symbols[i].prop_off >= end_off)
+            index->symbols[i].prop_off += delta;
+      }
+   }
+
+   index->struct_size += delta;
+
+   // The node itself stays put, but it may have gained a phandle
+   if (!err && (index->nodes[entry].phandle !=
+                fdt_get_phandle(dtb->fdt, node_off)))
+   {
+      index->nodes[entry].phandle = fdt_get_phandle(dtb->fdt, node_off);
+      err = dtoverlay_index_rehash(index);
+   }
+
+   if (!err && subtree)
+      err = dtoverlay_index_add_subtree(index, dtb->fdt, entry, 1);
+
+   // Don't let the entries of the replaced nodes pile up
+   if (!err && index->dead_nodes)
+   {
+      err = dtoverlay_index_compact(index);
+      if (!err)
+         err = dtoverlay_index_rehash(index);
+   }
+   else if (!err && ((index->num_nodes * 2 > index->num_buckets) ||
+                     (index->num_symbols * 2 > index->num_symbol_buckets)))
+   {
+      err = dtoverlay_index_rehash(index);
+   }
+
+   if (err)
+      index->valid = 0;
+}
+
+// Returns 0 on success, otherwise <0 error code
+int dtoverlay_enable_index(DTBLOB_T *dtb)
+{
+   if (!dtb->index)
+   {
+      dtb->index = calloc(1, sizeof(*dtb->index));
+      if (!dtb->index)
+      {
+         dtoverlay_error("out of memory");
+         return -FDT_ERR_NOSPACE;
+      }
+      dtoverlay_index_reset(dtb->index);
+   }
+
+   return dtoverlay_index_build(dtb);
+}
+
+void dtoverlay_invalidate_index(DTBLOB_T *dtb)
+{
+   if (dtb->index)
+      dtb->index->valid = 0;
+}
+
+static void dtoverlay_index_free(DTBLOB_T *dtb)
+{
+   struct dtoverlay_index_struct *index = dtb->index;
+
+   if (index)
+   {
+      free(index->nodes);
+      free(index->symbols);
+      free(index->phandle_buckets);
+      free(index->path_buckets);
+      free(index->symbol_buckets);
+      free(index);
+      dtb->index = NULL;
+   }
+}
+
 void dtoverlay_free_dtb(DTBLOB_T *dtb)
 {
    if (dtb)
    {
+      dtoverlay_index_free(dtb);
       if (dtb->fdt_is_malloced)
          free(dtb->fdt);
       if (dtb->trailer_is_malloced)
@@ -1875,6 +2518,24 @@ void dtoverlay_free_dtb(DTBLOB_T *dtb)
 
 int dtoverlay_find_phandle(DTBLOB_T *dtb, int phandle)
 {
+   struct dtoverlay_index_struct *index = dtoverlay_index_get(dtb);
+
+   if (index && (phandle != 0) && (phandle != -1))
+   {
+      int entry;
+
+      for (entry = index->phandle_buckets[dtoverlay_hash_phandle(phandle) &
+                                          (index->num_buckets - 1)];
+           entry >= 0;
+           entry = index->nodes[entry].next_phandle)
+      {
+         dtoverlay_index_node_t *node = &index->nodes[entry];
+         if ((node->phandle == (uint32_t)phandle) && (node->offset >= 0) &&
+             (fdt_get_phandle(dtb->fdt, node->offset) == (uint32_t)phandle))
+            return node->offset;
+      }
+   }
+
    return fdt_node_offset_by_phandle(dtb->fdt, phandle);
 }
 
@@ -1891,7 +2552,7 @@ int dtoverlay_find_symbol(DTBLOB_T *dtb, const char *symbol_name)
    }
    else
    {
-      symbols_off = fdt_path_offset(dtb->fdt, "/__symbols__");
+      symbols_off = dtoverlay_index_path(dtb, "/__symbols__", 12);
 
       if (symbols_off < 0)
       {
@@ -1899,11 +2560,11 @@ int dtoverlay_find_symbol(DTBLOB_T *dtb, const char *symbol_name)
          return -FDT_ERR_NOTFOUND;
       }
 
-      node_path = fdt_getprop(dtb->fdt, symbols_off, symbol_name, &path_len);
+      node_path = dtoverlay_index_symbol(dtb, symbol_name, &path_len);
       if (path_len < 0)
          return -FDT_ERR_NOTFOUND;
    }
-   return fdt_path_offset_namelen(dtb->fdt, node_path, path_len);
+   return dtoverlay_index_path(dtb, node_path, path_len);
 }
 
 int dtoverlay_find_matching_node(DTBLOB_T *dtb, const char **node_names,
@@ -1966,7 +2627,7 @@ const char *dtoverlay_get_alias(DTBLOB_T *dtb, const char *alias_name)
    int prop_len;
    const char *alias;
 
-   node_off = fdt_path_offset(dtb->fdt, "/aliases");
+   node_off = dtoverlay_index_path(dtb, "/aliases", 8);
 
    alias = fdt_getprop(dtb->fdt, node_off, alias_name, &prop_len);
    if (alias && !prop_len)
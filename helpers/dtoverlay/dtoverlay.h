@@ -69,6 +69,7 @@ typedef struct dtblob_struct
    int max_phandle;
    void *trailer;
    int trailer_len;
+   struct dtoverlay_index_struct *index;
 } DTBLOB_T;
 
 
@@ -159,6 +160,10 @@ void dtoverlay_pack_dtb(DTBLOB_T *dtb);
 
 void dtoverlay_free_dtb(DTBLOB_T *dtb);
 
+int dtoverlay_enable_index(DTBLOB_T *dtb);
+
+void dtoverlay_invalidate_index(DTBLOB_T *dtb);
+
 static inline void *dtoverlay_dtb_trailer(DTBLOB_T *dtb)
 {
     return dtb->trailer;
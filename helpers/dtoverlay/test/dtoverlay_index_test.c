@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// Applies overlays one by one to a base with a bus per overlay, and after
+// each fixup and merge checks that every node can be found by path and by
+// phandle at its current offset, that no node is indexed twice or left dead,
+// and that the index was neither dropped nor left stale. Each overlay makes
+// the fixup give its target bus a new phandle, then adds nodes both under a
+// labelled target and under a target-path.
+//
+//    dtoverlay_index_test [overlays]
+
+#include "../dtoverlay.c"
+#include "interface/vcos/test/vcos_test_check.h"
+
+static int count_nodes(const void *fdt)
+{
+   int node_off = 0, depth = 0, count = 0;
+
+   while ((node_off >= 0) && (depth >= 0))
+   {
+      count++;
+      node_off = fdt_next_node(fdt, node_off, &depth);
+   }
+
+   return count;
+}
+
+// Every node in the blob must be found at its own offset, both by path and
+// (if it has one) by phandle, and the index must hold nothing else.
+static void check_index(DTBLOB_T *dtb, const char *when, int n)
+{
+   struct dtoverlay_index_struct *index = dtb->index;
+   int nodes = count_nodes(dtb->fdt);
+   int node_off = 0, depth = 0;
+   char path[256];
+
+   CHECK(index->valid, "%s %d: index was dropped", when, n);
+   CHECK(index->struct_size == fdt_size_dt_struct(dtb->fdt),
+         "%s %d: index is out of date", when, n);
+   CHECK(index->num_nodes == nodes,
+         "%s %d: %d nodes indexed, %d in the blob", when, n,
+         index->num_nodes, nodes);
+   CHECK(index->dead_nodes == 0, "%s %d: %d dead nodes", when, n,
+         index->dead_nodes);
+
+   while ((node_off >= 0) && (depth >= 0))
+   {
+      uint32_t phandle = fdt_get_phandle(dtb->fdt, node_off);
+
+      if (fdt_get_path(dtb->fdt, node_off, path, sizeof(path)) == 0)
+         CHECK(dtoverlay_index_path(dtb, path, strlen(path)) == node_off,
+               "%s %d: '%s' not found by path", when, n, path);
+      if (phandle)
+         CHECK(dtoverlay_find_phandle(dtb, phandle) == node_off,
+               "%s %d: phandle %u not found", when, n, phandle);
+
+      node_off = fdt_next_node(dtb->fdt, node_off, &depth);
+   }
+}
+
+// A bus per overlay, each with a device which has a child of its own
+static DTBLOB_T *create_base(int buses)
+{
+   DTBLOB_T *dtb = dtoverlay_create_dtb(64 * 1024);
+   char path[64], symbol[16];
+   int i;
+
+   if (!dtb)
+      return NULL;
+   dtb->fdt_is_malloced = 1;
+
+   dtoverlay_create_node(dtb, "/__symbols__", 0);
+   for (i = 0; i < buses; i++)
+   {
+      snprintf(path, sizeof(path), "/soc/i2c@%x/dev@%x/port", i, 0x50 + i);
+      dtoverlay_create_node(dtb, path, 0);
+      snprintf(path, sizeof(path), "/soc/i2c@%x", i);
+      snprintf(symbol, sizeof(symbol), "i2c%d", i);
+      fdt_setprop_string(dtb->fdt, fdt_path_offset(dtb->fdt, "/__symbols__"),
+                         symbol, path);
+   }
+
+   return dtb;
+}
+
+// Two fragments: one targets a bus by label, so the bus has to be given a
+// phandle first, and adds a device to it, the other adds a node to /soc.
+static DTBLOB_T *create_overlay(int bus)
+{
+   DTBLOB_T *dtb = dtoverlay_create_dtb(4 * 1024);
+   char path[64], symbol[16];
+   int off;
+
+   if (!dtb)
+      return NULL;
+   dtb->fdt_is_malloced = 1;
+
+   dtoverlay_create_node(dtb, "/fragment@0/__overlay__", 0);
+   off = fdt_path_offset(dtb->fdt, "/fragment@0");
+   fdt_setprop_u32(dtb->fdt, off, "target", 0xffffffff);
+   snprintf(path, sizeof(path), "/fragment@0/__overlay__/dev@%x/port", 0x60 + bus);
+   dtoverlay_create_node(dtb, path, 0);
+   off = fdt_path_offset(dtb->fdt, "/fragment@0/__overlay__");
+   fdt_setprop_string(dtb->fdt, off, "status", "okay");
+
+   dtoverlay_create_node(dtb, "/fragment@1/__overlay__", 0);
+   off = fdt_path_offset(dtb->fdt, "/fragment@1");
+   fdt_setprop_string(dtb->fdt, off, "target-path", "/soc");
+   snprintf(path, sizeof(path), "/fragment@1/__overlay__/gpio@%x", bus);
+   dtoverlay_create_node(dtb, path, 0);
+
+   // The fixups are read up to an empty string, which dtc gets from the
+   // padding before the next tag, but fdt_setprop doesn't clear the padding
+   dtoverlay_create_node(dtb, "/__fixups__", 0);
+   snprintf(symbol, sizeof(symbol), "i2c%d", bus);
+   memset(path, 0, sizeof(path));
+   strcpy(path, "/fragment@0:target:0");
+   fdt_setprop(dtb->fdt, fdt_path_offset(dtb->fdt, "/__fixups__"),
+               symbol, path, (strlen(path) + 4) & ~3);
+
+   return dtb;
+}
+
+int main(int argc, char **argv)
+{
+   int overlays = (argc > 1) ? atoi(argv[1]) : 16;
+   DTBLOB_T *base;
+   int i;
+
+   if (overlays <= 0)
+      overlays = 16;
+
+   base = create_base(overlays);
+   if (!base || (dtoverlay_enable_index(base) != 0))
+   {
+      printf("FAIL: couldn't create the base dtb\n");
+      return 1;
+   }
+   check_index(base, "initial", 0);
+
+   for (i = 0; i < overlays; i++)
+   {
+      DTBLOB_T *overlay = create_overlay(i);
+      int err;
+
+      if (!overlay)
+      {
+         printf("FAIL: couldn't create overlay %d\n", i);
+         return 1;
+      }
+
+      err = dtoverlay_fixup_overlay(base, overlay);
+      CHECK(err == 0, "fixup %d failed (%d)", i, err);
+      check_index(base, "fixup", i);
+
+      err = dtoverlay_merge_overlay(base, overlay);
+      CHECK(err == 0, "merge %d failed (%d)", i, err);
+      check_index(base, "merge", i);
+
+      dtoverlay_free_dtb(overlay);
+   }
+
+   printf("%d overlays, %d nodes: %s\n", overlays, count_nodes(base->fdt),
+          check_errors ? "FAILED" : "ok");
+   dtoverlay_free_dtb(base);
+
+   return check_errors ? 1 : 0;
+}
@@ -87,6 +87,9 @@ int main(int argc, char **argv)
        return -1;
    }
 
+   /* Not fatal - without the index the lookups are just slower */
+   dtoverlay_enable_index(base_dtb);
+
    err = dtoverlay_set_synonym(base_dtb, "i2c", "i2c0");
    err = dtoverlay_set_synonym(base_dtb, "i2c_arm", "i2c0");
    err = dtoverlay_set_synonym(base_dtb, "i2c_vc", "i2c1");
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "RaspiTex.h"
 #include <bcm_host.h>
 #include <GLES2/gl2.h>
+#include "interface/mmal/util/mmal_util_convert.h"
 
 VCOS_LOG_CAT_T raspitex_log_category;
 
@@ -438,16 +439,8 @@ void raspitexutil_close(RASPITEX_STATE* raspitex_state)
  */
 void raspitexutil_brga_to_rgba(uint8_t *buffer, size_t size)
 {
-   uint8_t* out = buffer;
-   uint8_t* end = buffer + size;
-
-   while (out < end)
-   {
-      uint8_t tmp = out[0];
-      out[0] = out[2];
-      out[2] = tmp;
-      out += 4;
-   }
+   unsigned int width = size / 4;
+   mmal_convert_bgra_to_rgba(buffer, width * 4, buffer, width * 4, width, 1);
 }
 
 /**
@@ -492,6 +485,46 @@ error:
 }
 
 
+/**
+ * Uses glReadPixels to grab only some regions of the current frame-buffer
+ * into a packed buffer laid out by vcsm_roi_set_init, instead of reading
+ * back the whole frame. The rectangles are in frame-buffer coordinates and
+ * the rows of each region are returned in glReadPixels order, as with
+ * raspitexutil_capture_bgra.
+ * @param state Pointer to the GL preview state.
+ * @param set The regions, initialised for 4 bytes per pixel. Their
+ * timestamps are set on return.
+ * @param buffer Packed buffer of at least set->size bytes.
+ * @return Zero if successful.
+ */
+int raspitexutil_capture_roi(RASPITEX_STATE *state, VCSM_ROI_SET_T *set,
+                             uint8_t *buffer)
+{
+   int64_t timestamp = vcos_getmicrosecs64();
+   unsigned int i;
+
+   vcos_log_trace("%s: %dx%d %u regions, %u bytes", VCOS_FUNCTION,
+                  state->width, state->height, set->num, (unsigned) set->size);
+
+   if (set->bytes_per_pixel != 4)
+      return -1;
+
+   for (i = 0; i < set->num; i++)
+   {
+      VCSM_ROI_INFO_T *roi = &set->roi[i];
+
+      roi->sequence = 0;
+      roi->timestamp = timestamp;
+      if (!roi->rect.width || !roi->rect.height)
+         continue;
+
+      glReadPixels(roi->rect.x, roi->rect.y, roi->rect.width, roi->rect.height,
+                   GL_RGBA, GL_UNSIGNED_BYTE, buffer + roi->offset);
+   }
+
+   return glGetError() == GL_NO_ERROR ? 0 : -1;
+}
+
 /**
  * Takes a description of shader program, compiles it and gets the locations
  * of uniforms and attributes.
@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include "RaspiTex.h"
+#include "gl_scenes/vcsm_roi.h"
 #include "interface/vcos/vcos.h"
 
 extern VCOS_LOG_CAT_T raspitex_log_category;
@@ -107,6 +108,8 @@ int raspitexutil_update_v_texture(RASPITEX_STATE *raspitex_state,
                                   EGLClientBuffer mm_buf);
 int raspitexutil_capture_bgra(struct RASPITEX_STATE *state,
                               uint8_t **buffer, size_t *buffer_size);
+int raspitexutil_capture_roi(struct RASPITEX_STATE *state, VCSM_ROI_SET_T *set,
+                             uint8_t *buffer);
 void raspitexutil_close(RASPITEX_STATE* raspitex_state);
 
 /* Utility functions */
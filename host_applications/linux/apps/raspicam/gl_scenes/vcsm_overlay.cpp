@@ -0,0 +1,620 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Overlay of rectangles, lines and labels. See vcsm_overlay.h.
+ *
+ * Three lists rotate: one being built by the submitting threads, one ready
+ * (the latest submitted) and one being drawn by the GL thread. Submitting
+ * swaps the built and ready lists, drawing swaps the ready and drawn lists if
+ * something new was submitted. The lock is only held for these swaps and
+ * while adding primitives, never while the renderer runs.
+ */
+
+#define VCOS_LOG_CATEGORY (&vcsm_overlay_log_category)
+#include <stdlib.h>
+#include <string.h>
+#include "vcsm_overlay.h"
+
+static VCOS_LOG_CAT_T vcsm_overlay_log_category;
+
+typedef struct OVERLAY_LIST_T
+{
+   VCSM_OVERLAY_VERTEX_T *vertex[VCSM_OVERLAY_TYPES];
+   unsigned int count[VCSM_OVERLAY_TYPES];
+   unsigned int capacity[VCSM_OVERLAY_TYPES];
+} OVERLAY_LIST_T;
+
+typedef struct OVERLAY_RETAINED_T
+{
+   float x, y, width, height;
+   uint32_t colour;
+   int in_use;
+} OVERLAY_RETAINED_T;
+
+struct VCSM_OVERLAY_T
+{
+   VCOS_MUTEX_T lock;
+   VCSM_OVERLAY_RENDERER_T renderer;
+   int renderer_ready;
+
+   OVERLAY_LIST_T list[3];
+   OVERLAY_LIST_T *building;     /* Being built by the submitting threads */
+   OVERLAY_LIST_T *ready;        /* Latest submitted */
+   OVERLAY_LIST_T *drawn;        /* Being drawn by the GL thread */
+   int ready_new;                /* The ready list hasn't been drawn yet */
+
+   OVERLAY_RETAINED_T *retained;
+   unsigned int retained_num;
+   int retained_dirty;
+   OVERLAY_LIST_T retained_list; /* Vertices of the retained rectangles, GL thread only */
+
+   VCSM_OVERLAY_VERTEX_T *upload;/* Vertices of a whole frame, GL thread only */
+   unsigned int upload_capacity;
+   unsigned int drawn_count[VCSM_OVERLAY_TYPES];
+
+   VCSM_OVERLAY_STATS_T stats;
+};
+
+/* Make room for more vertices of a type. Returns NULL if out of memory. */
+static VCSM_OVERLAY_VERTEX_T *overlay_list_add(OVERLAY_LIST_T *list, VCSM_OVERLAY_TYPE_T type,
+   unsigned int count)
+{
+   VCSM_OVERLAY_VERTEX_T *vertex;
+
+   if (list->count[type] + count > list->capacity[type])
+   {
+      unsigned int capacity = list->capacity[type] ? list->capacity[type] * 2 : 256;
+      while (capacity < list->count[type] + count)
+         capacity *= 2;
+      vertex = (VCSM_OVERLAY_VERTEX_T *) realloc(list->vertex[type], capacity * sizeof(*vertex));
+      if (!vertex)
+         return NULL;
+      list->vertex[type] = vertex;
+      list->capacity[type] = capacity;
+   }
+
+   vertex = list->vertex[type] + list->count[type];
+   list->count[type] += count;
+   return vertex;
+}
+
+static void overlay_list_clear(OVERLAY_LIST_T *list)
+{
+   unsigned int i;
+   for (i = 0; i < VCSM_OVERLAY_TYPES; i++)
+      list->count[i] = 0;
+}
+
+static void overlay_list_free(OVERLAY_LIST_T *list)
+{
+   unsigned int i;
+   for (i = 0; i < VCSM_OVERLAY_TYPES; i++)
+      free(list->vertex[i]);
+   memset(list, 0, sizeof(*list));
+}
+
+static inline void overlay_vertex(VCSM_OVERLAY_VERTEX_T *vertex, float x, float y, uint32_t colour)
+{
+   vertex->x = x;
+   vertex->y = y;
+   vertex->colour = colour;
+}
+
+static void overlay_list_line(OVERLAY_LIST_T *list, float x0, float y0, float x1, float y1,
+   uint32_t colour)
+{
+   VCSM_OVERLAY_VERTEX_T *v = overlay_list_add(list, VCSM_OVERLAY_LINES, 2);
+   if (!v)
+      return;
+   overlay_vertex(&v[0], x0, y0, colour);
+   overlay_vertex(&v[1], x1, y1, colour);
+}
+
+static void overlay_list_rect(OVERLAY_LIST_T *list, float x, float y, float width, float height,
+   uint32_t colour)
+{
+   VCSM_OVERLAY_VERTEX_T *v = overlay_list_add(list, VCSM_OVERLAY_LINES, 8);
+   float x1 = x + width, y1 = y + height;
+   if (!v)
+      return;
+   overlay_vertex(&v[0], x, y, colour);
+   overlay_vertex(&v[1], x1, y, colour);
+   overlay_vertex(&v[2], x1, y, colour);
+   overlay_vertex(&v[3], x1, y1, colour);
+   overlay_vertex(&v[4], x1, y1, colour);
+   overlay_vertex(&v[5], x, y1, colour);
+   overlay_vertex(&v[6], x, y1, colour);
+   overlay_vertex(&v[7], x, y, colour);
+}
+
+/* Labels are drawn with segments joining the points of a 3x3 grid */
+static const float segment_points[][4] =
+{
+   /* a */ {0, 0, .5, 0},   /* b */ {.5, 0, 1, 0},  /* c */ {1, 0, 1, .5},
+   /* d */ {1, .5, 1, 1},   /* e */ {1, 1, .5, 1},  /* f */ {.5, 1, 0, 1},
+   /* g */ {0, 1, 0, .5},   /* h */ {0, .5, 0, 0},  /* i */ {0, .5, .5, .5},
+   /* j */ {.5, .5, 1, .5}, /* k */ {0, 0, .5, .5}, /* l */ {.5, 0, .5, .5},
+   /* m */ {1, 0, .5, .5},  /* n */ {.5, .5, 1, 1}, /* o */ {.5, .5, .5, 1},
+   /* p */ {.5, .5, 0, 1},  /* q */ {0, .5, .5, 1}, /* r */ {1, .5, .5, 1},
+};
+
+static const char *overlay_glyph(char c)
+{
+   static const char *digits[] =
+   {
+      "abcdefghmp", "cdm", "abcijgef", "abcdefj", "hcdij",
+      "abhijdef", "abhgfedij", "abcd", "abcdefghij", "abcdefhij",
+   };
+   static const char *letters[] =
+   {
+      "abcdghij", "abcdefjlo", "abefgh", "abcdeflo", "abefghi", "abghi", "abghfedj",
+      "ghcdij", "abeflo", "cdefg", "ghimn", "efgh", "ghcdkm", "ghcdkn", "abcdefgh",
+      "abcghij", "abcdefghn", "abcghijn", "abhijdef", "ablo", "cdefgh", "hcqr",
+      "ghcdpn", "kmnp", "kmo", "abmpfe",
+   };
+
+   if (c >= '0' && c <= '9')
+      return digits[c - '0'];
+   if (c >= 'a' && c <= 'z')
+      c -= 'a' - 'A';
+   if (c >= 'A' && c <= 'Z')
+      return letters[c - 'A'];
+   switch (c)
+   {
+   case '-': return "ij";
+   case '+': return "ijlo";
+   case '=': return "ijef";
+   case '.': return "e";
+   case ',': return "p";
+   case ':': return "lo";
+   case '/': return "mp";
+   case '_': return "ef";
+   case '%': return "mpahde";
+   default:  return "";
+   }
+}
+
+static void overlay_list_label(OVERLAY_LIST_T *list, float x, float y, float size,
+   const char *text, uint32_t colour)
+{
+   float width = size * 0.6f, advance = size * 0.8f;
+
+   for (; text && *text; text++, x += advance)
+   {
+      const char *glyph = overlay_glyph(*text);
+      VCSM_OVERLAY_VERTEX_T *v = overlay_list_add(list, VCSM_OVERLAY_LINES, 2 * strlen(glyph));
+      if (!v)
+         return;
+      for (; *glyph; glyph++, v += 2)
+      {
+         const float *p = segment_points[*glyph - 'a'];
+         overlay_vertex(&v[0], x + p[0] * width, y + p[1] * size, colour);
+         overlay_vertex(&v[1], x + p[2] * width, y + p[3] * size, colour);
+      }
+   }
+}
+
+VCSM_OVERLAY_T *vcsm_overlay_create(const VCSM_OVERLAY_RENDERER_T *renderer)
+{
+   VCSM_OVERLAY_T *overlay;
+
+   if (!vcsm_overlay_log_category.name)
+      vcos_log_register("vcsm_overlay", VCOS_LOG_CATEGORY);
+
+   if (!renderer || !renderer->upload || !renderer->draw)
+   {
+      vcos_log_error("%s: invalid renderer", VCOS_FUNCTION);
+      return NULL;
+   }
+
+   overlay = (VCSM_OVERLAY_T *) calloc(1, sizeof(*overlay));
+   if (!overlay)
+      return NULL;
+   if (vcos_mutex_create(&overlay->lock, "vcsm_overlay") != VCOS_SUCCESS)
+   {
+      free(overlay);
+      return NULL;
+   }
+
+   overlay->renderer = *renderer;
+   overlay->building = &overlay->list[0];
+   overlay->ready = &overlay->list[1];
+   overlay->drawn = &overlay->list[2];
+   return overlay;
+}
+
+void vcsm_overlay_destroy(VCSM_OVERLAY_T *overlay)
+{
+   unsigned int i;
+
+   if (!overlay)
+      return;
+   if (overlay->renderer_ready && overlay->renderer.term)
+      overlay->renderer.term(overlay->renderer.context);
+   for (i = 0; i < 3; i++)
+      overlay_list_free(&overlay->list[i]);
+   overlay_list_free(&overlay->retained_list);
+   free(overlay->retained);
+   free(overlay->upload);
+   vcos_mutex_delete(&overlay->lock);
+   free(overlay);
+}
+
+void vcsm_overlay_begin(VCSM_OVERLAY_T *overlay)
+{
+   vcos_mutex_lock(&overlay->lock);
+   overlay_list_clear(overlay->building);
+   vcos_mutex_unlock(&overlay->lock);
+}
+
+void vcsm_overlay_rect(VCSM_OVERLAY_T *overlay, float x, float y, float width, float height,
+   uint32_t colour)
+{
+   vcos_mutex_lock(&overlay->lock);
+   overlay_list_rect(overlay->building, x, y, width, height, colour);
+   vcos_mutex_unlock(&overlay->lock);
+}
+
+void vcsm_overlay_fill(VCSM_OVERLAY_T *overlay, float x, float y, float width, float height,
+   uint32_t colour)
+{
+   VCSM_OVERLAY_VERTEX_T *v;
+   float x1 = x + width, y1 = y + height;
+
+   vcos_mutex_lock(&overlay->lock);
+   v = overlay_list_add(overlay->building, VCSM_OVERLAY_FILLS, 6);
+   if (v)
+   {
+      overlay_vertex(&v[0], x, y, colour);
+      overlay_vertex(&v[1], x1, y, colour);
+      overlay_vertex(&v[2], x, y1, colour);
+      overlay_vertex(&v[3], x1, y, colour);
+      overlay_vertex(&v[4], x1, y1, colour);
+      overlay_vertex(&v[5], x, y1, colour);
+   }
+   vcos_mutex_unlock(&overlay->lock);
+}
+
+void vcsm_overlay_line(VCSM_OVERLAY_T *overlay, float x0, float y0, float x1, float y1,
+   uint32_t colour)
+{
+   vcos_mutex_lock(&overlay->lock);
+   overlay_list_line(overlay->building, x0, y0, x1, y1, colour);
+   vcos_mutex_unlock(&overlay->lock);
+}
+
+void vcsm_overlay_label(VCSM_OVERLAY_T *overlay, float x, float y, float size, const char *text,
+   uint32_t colour)
+{
+   vcos_mutex_lock(&overlay->lock);
+   overlay_list_label(overlay->building, x, y, size, text, colour);
+   vcos_mutex_unlock(&overlay->lock);
+}
+
+void vcsm_overlay_submit(VCSM_OVERLAY_T *overlay)
+{
+   OVERLAY_LIST_T *list;
+
+   vcos_mutex_lock(&overlay->lock);
+   list = overlay->ready;
+   overlay->ready = overlay->building;
+   overlay->building = list;
+   overlay_list_clear(overlay->building);
+   if (overlay->ready_new)
+      overlay->stats.replaced++;
+   overlay->ready_new = 1;
+   overlay->stats.submitted++;
+   vcos_mutex_unlock(&overlay->lock);
+}
+
+int vcsm_overlay_retain_rect(VCSM_OVERLAY_T *overlay, float x, float y, float width, float height,
+   uint32_t colour)
+{
+   OVERLAY_RETAINED_T *retained;
+   unsigned int i;
+   int id = -1;
+
+   vcos_mutex_lock(&overlay->lock);
+   for (i = 0; i < overlay->retained_num; i++)
+      if (!overlay->retained[i].in_use)
+         break;
+   if (i == overlay->retained_num)
+   {
+      retained = (OVERLAY_RETAINED_T *) realloc(overlay->retained,
+         (overlay->retained_num + 16) * sizeof(*retained));
+      if (retained)
+      {
+         memset(retained + overlay->retained_num, 0, 16 * sizeof(*retained));
+         overlay->retained = retained;
+         overlay->retained_num += 16;
+      }
+   }
+   if (i < overlay->retained_num)
+   {
+      retained = &overlay->retained[i];
+      retained->x = x;
+      retained->y = y;
+      retained->width = width;
+      retained->height = height;
+      retained->colour = colour;
+      retained->in_use = 1;
+      overlay->retained_dirty = 1;
+      id = i;
+   }
+   vcos_mutex_unlock(&overlay->lock);
+
+   return id;
+}
+
+void vcsm_overlay_remove(VCSM_OVERLAY_T *overlay, int id)
+{
+   vcos_mutex_lock(&overlay->lock);
+   if (id >= 0 && (unsigned int) id < overlay->retained_num && overlay->retained[id].in_use)
+   {
+      overlay->retained[id].in_use = 0;
+      overlay->retained_dirty = 1;
+   }
+   vcos_mutex_unlock(&overlay->lock);
+}
+
+/* Put the retained rectangles and the drawn list together in the upload
+ * buffer, all the fills first then all the lines */
+static int overlay_gather(VCSM_OVERLAY_T *overlay)
+{
+   const OVERLAY_LIST_T *lists[2] = { &overlay->retained_list, overlay->drawn };
+   unsigned int total = 0, i, t;
+   VCSM_OVERLAY_VERTEX_T *out;
+
+   for (t = 0; t < VCSM_OVERLAY_TYPES; t++)
+   {
+      overlay->drawn_count[t] = lists[0]->count[t] + lists[1]->count[t];
+      total += overlay->drawn_count[t];
+   }
+
+   if (total > overlay->upload_capacity)
+   {
+      out = (VCSM_OVERLAY_VERTEX_T *) realloc(overlay->upload, total * sizeof(*out));
+      if (!out)
+      {
+         memset(overlay->drawn_count, 0, sizeof(overlay->drawn_count));
+         return -1;
+      }
+      overlay->upload = out;
+      overlay->upload_capacity = total;
+   }
+
+   out = overlay->upload;
+   for (t = 0; t < VCSM_OVERLAY_TYPES; t++)
+   {
+      for (i = 0; i < 2; i++)
+      {
+         memcpy(out, lists[i]->vertex[t], lists[i]->count[t] * sizeof(*out));
+         out += lists[i]->count[t];
+      }
+   }
+
+   overlay->renderer.upload(overlay->renderer.context, overlay->upload, total);
+   return 0;
+}
+
+int vcsm_overlay_draw(VCSM_OVERLAY_T *overlay, int width, int height)
+{
+   int64_t start = vcos_getmicrosecs64();
+   unsigned int first = 0, draw_calls = 0, t;
+   int changed = 0;
+   uint32_t cpu_time;
+
+   if (!overlay->renderer_ready)
+   {
+      if (overlay->renderer.init && overlay->renderer.init(overlay->renderer.context))
+      {
+         vcos_log_error("%s: failed to initialise the renderer", VCOS_FUNCTION);
+         return -1;
+      }
+      overlay->renderer_ready = 1;
+   }
+
+   vcos_mutex_lock(&overlay->lock);
+   if (overlay->ready_new)
+   {
+      OVERLAY_LIST_T *list = overlay->drawn;
+      overlay->drawn = overlay->ready;
+      overlay->ready = list;
+      overlay->ready_new = 0;
+      changed = 1;
+   }
+   if (overlay->retained_dirty)
+   {
+      unsigned int i;
+
+      overlay_list_clear(&overlay->retained_list);
+      for (i = 0; i < overlay->retained_num; i++)
+      {
+         const OVERLAY_RETAINED_T *r = &overlay->retained[i];
+         if (r->in_use)
+            overlay_list_rect(&overlay->retained_list, r->x, r->y, r->width, r->height, r->colour);
+      }
+      overlay->retained_dirty = 0;
+      changed = 1;
+   }
+   vcos_mutex_unlock(&overlay->lock);
+
+   /* The vertex buffer keeps its content until something changes */
+   if (changed && !overlay_gather(overlay))
+      overlay->stats.uploads++;
+
+   for (t = 0; t < VCSM_OVERLAY_TYPES; t++)
+   {
+      if (overlay->drawn_count[t])
+      {
+         overlay->renderer.draw(overlay->renderer.context, (VCSM_OVERLAY_TYPE_T) t,
+            first, overlay->drawn_count[t], width, height);
+         draw_calls++;
+      }
+      first += overlay->drawn_count[t];
+   }
+
+   cpu_time = (uint32_t)(vcos_getmicrosecs64() - start);
+   vcos_mutex_lock(&overlay->lock);
+   overlay->stats.frames++;
+   overlay->stats.draw_calls += draw_calls;
+   overlay->stats.vertices = first;
+   overlay->stats.last_cpu_time = cpu_time;
+   if (cpu_time > overlay->stats.max_cpu_time)
+      overlay->stats.max_cpu_time = cpu_time;
+   vcos_mutex_unlock(&overlay->lock);
+   return 0;
+}
+
+void vcsm_overlay_get_stats(VCSM_OVERLAY_T *overlay, VCSM_OVERLAY_STATS_T *stats, int reset)
+{
+   vcos_mutex_lock(&overlay->lock);
+   *stats = overlay->stats;
+   if (reset)
+      memset(&overlay->stats, 0, sizeof(overlay->stats));
+   vcos_mutex_unlock(&overlay->lock);
+}
+
+/* Software renderer */
+
+typedef struct SOFT_RENDERER_T
+{
+   unsigned char *buffer;
+   int width, height;
+   VCSM_OVERLAY_VERTEX_T *vertex;
+   unsigned int count, capacity;
+} SOFT_RENDERER_T;
+
+static void soft_plot(SOFT_RENDERER_T *soft, int x, int y, uint32_t colour)
+{
+   unsigned int alpha = colour >> 24, i;
+   unsigned char *pixel;
+
+   if (x < 0 || y < 0 || x >= soft->width || y >= soft->height)
+      return;
+   pixel = soft->buffer + ((size_t) y * soft->width + x) * 4;
+   for (i = 0; i < 3; i++)
+   {
+      unsigned int c = (colour >> (i * 8)) & 0xff;
+      pixel[i] = (unsigned char)((c * alpha + pixel[i] * (255 - alpha)) / 255);
+   }
+   pixel[3] = 0xff;
+}
+
+static void soft_upload(void *context, const VCSM_OVERLAY_VERTEX_T *vertices, unsigned int count)
+{
+   SOFT_RENDERER_T *soft = (SOFT_RENDERER_T *) context;
+
+   if (count > soft->capacity)
+   {
+      VCSM_OVERLAY_VERTEX_T *vertex = (VCSM_OVERLAY_VERTEX_T *)
+         realloc(soft->vertex, count * sizeof(*vertex));
+      if (!vertex)
+      {
+         soft->count = 0;
+         return;
+      }
+      soft->vertex = vertex;
+      soft->capacity = count;
+   }
+   memcpy(soft->vertex, vertices, count * sizeof(*vertices));
+   soft->count = count;
+}
+
+static void soft_draw(void *context, VCSM_OVERLAY_TYPE_T type, unsigned int first,
+   unsigned int count, int width, int height)
+{
+   SOFT_RENDERER_T *soft = (SOFT_RENDERER_T *) context;
+   const VCSM_OVERLAY_VERTEX_T *v;
+   unsigned int i;
+
+   (void) width;
+   (void) height;
+   if (!soft->buffer || first + count > soft->count)
+      return;
+
+   v = soft->vertex + first;
+   if (type == VCSM_OVERLAY_FILLS)
+   {
+      /* The overlay only makes rectangles out of triangles, fill the bounds
+       * of each pair */
+      for (i = 0; i + 6 <= count; i += 6, v += 6)
+      {
+         int x0 = (int) v[0].x, y0 = (int) v[0].y, x1 = (int) v[4].x, y1 = (int) v[4].y, x, y;
+         for (y = y0; y < y1; y++)
+            for (x = x0; x < x1; x++)
+               soft_plot(soft, x, y, v[0].colour);
+      }
+      return;
+   }
+
+   for (i = 0; i + 2 <= count; i += 2, v += 2)
+   {
+      int x0 = (int) v[0].x, y0 = (int) v[0].y, x1 = (int) v[1].x, y1 = (int) v[1].y;
+      int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+      int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1, err = dx + dy;
+
+      while (1)
+      {
+         soft_plot(soft, x0, y0, v[0].colour);
+         if (x0 == x1 && y0 == y1)
+            break;
+         if (2 * err >= dy) { err += dy; x0 += sx; }
+         if (2 * err <= dx) { err += dx; y0 += sy; }
+      }
+   }
+}
+
+int vcsm_overlay_soft_renderer_create(VCSM_OVERLAY_RENDERER_T *renderer, unsigned char *buffer,
+   int width, int height)
+{
+   SOFT_RENDERER_T *soft = (SOFT_RENDERER_T *) calloc(1, sizeof(*soft));
+   if (!soft)
+      return -1;
+
+   soft->buffer = buffer;
+   soft->width = width;
+   soft->height = height;
+
+   memset(renderer, 0, sizeof(*renderer));
+   renderer->upload = soft_upload;
+   renderer->draw = soft_draw;
+   renderer->context = soft;
+   return 0;
+}
+
+void vcsm_overlay_soft_renderer_destroy(VCSM_OVERLAY_RENDERER_T *renderer)
+{
+   SOFT_RENDERER_T *soft = (SOFT_RENDERER_T *) renderer->context;
+
+   if (!soft)
+      return;
+   free(soft->vertex);
+   free(soft);
+   renderer->context = NULL;
+}
@@ -0,0 +1,142 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VCSM_OVERLAY_H
+#define VCSM_OVERLAY_H
+
+#include "interface/vcos/vcos.h"
+
+/* Overlay of rectangles, lines and labels drawn on top of a GL scene.
+ *
+ * Any thread can build a list of primitives and submit it. The list is double
+ * buffered: the GL thread draws the latest submitted list, which replaces the
+ * previous one, while the next one is being built. Rectangles can also be
+ * retained, in which case they are drawn on every frame until removed.
+ *
+ * All the primitives end up in a single vertex buffer, uploaded only when
+ * something changed, and are drawn with one call per primitive type (filled
+ * rectangles, then lines, which include rectangle outlines and labels).
+ * Drawing goes through a renderer so that the overlay can be run without a GPU
+ * by using the software renderer.
+ *
+ * Coordinates are in pixels, with the origin at the top left of the viewport.
+ */
+
+typedef struct VCSM_OVERLAY_T VCSM_OVERLAY_T;
+
+/* Colours are packed as 0xAABBGGRR, i.e. R, G, B, A in memory */
+#define VCSM_OVERLAY_RGBA(r, g, b, a) \
+   ((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | ((uint32_t)(a) << 24))
+
+typedef struct VCSM_OVERLAY_VERTEX_T
+{
+   float x, y;
+   uint32_t colour;
+} VCSM_OVERLAY_VERTEX_T;
+
+typedef enum
+{
+   VCSM_OVERLAY_FILLS,     /* Triangles, 6 vertices per filled rectangle */
+   VCSM_OVERLAY_LINES,     /* Line segments, 2 vertices each */
+   VCSM_OVERLAY_TYPES
+} VCSM_OVERLAY_TYPE_T;
+
+/* Draws the vertices. All the calls are made from the GL thread. */
+typedef struct VCSM_OVERLAY_RENDERER_T
+{
+   int (*init)(void *context);
+   void (*term)(void *context);
+   /* Replace the content of the vertex buffer */
+   void (*upload)(void *context, const VCSM_OVERLAY_VERTEX_T *vertices, unsigned int count);
+   /* Draw part of the vertex buffer in a viewport of the given size */
+   void (*draw)(void *context, VCSM_OVERLAY_TYPE_T type, unsigned int first, unsigned int count,
+      int width, int height);
+   void *context;
+} VCSM_OVERLAY_RENDERER_T;
+
+typedef struct VCSM_OVERLAY_STATS_T
+{
+   uint32_t frames;        /* Calls to vcsm_overlay_draw */
+   uint32_t submitted;     /* Lists submitted */
+   uint32_t replaced;      /* Lists replaced before they were drawn */
+   uint32_t uploads;       /* Vertex buffer uploads */
+   uint32_t draw_calls;    /* Draw calls made, in total */
+   uint32_t vertices;      /* Vertices in the last frame drawn */
+   uint32_t last_cpu_time; /* Time (us) spent in the last vcsm_overlay_draw */
+   uint32_t max_cpu_time;
+} VCSM_OVERLAY_STATS_T;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+VCSM_OVERLAY_T *vcsm_overlay_create(const VCSM_OVERLAY_RENDERER_T *renderer);
+/* Must be called from the GL thread */
+void vcsm_overlay_destroy(VCSM_OVERLAY_T *overlay);
+
+/* Build and submit a list of primitives. The list being built is private to
+ * the overlay, calls from several threads are serialised. */
+void vcsm_overlay_begin(VCSM_OVERLAY_T *overlay);
+void vcsm_overlay_rect(VCSM_OVERLAY_T *overlay, float x, float y, float width, float height,
+   uint32_t colour);
+void vcsm_overlay_fill(VCSM_OVERLAY_T *overlay, float x, float y, float width, float height,
+   uint32_t colour);
+void vcsm_overlay_line(VCSM_OVERLAY_T *overlay, float x0, float y0, float x1, float y1,
+   uint32_t colour);
+/* Text drawn with line segments, 'size' pixels high. Supports digits, letters
+ * (as capitals) and a few symbols. */
+void vcsm_overlay_label(VCSM_OVERLAY_T *overlay, float x, float y, float size, const char *text,
+   uint32_t colour);
+void vcsm_overlay_submit(VCSM_OVERLAY_T *overlay);
+
+/* Rectangle outlines drawn on every frame. Returns an id for
+ * vcsm_overlay_remove, or -1 on error. */
+int vcsm_overlay_retain_rect(VCSM_OVERLAY_T *overlay, float x, float y, float width, float height,
+   uint32_t colour);
+void vcsm_overlay_remove(VCSM_OVERLAY_T *overlay, int id);
+
+/* Draw the retained rectangles and the latest list. Called from the GL thread. */
+int vcsm_overlay_draw(VCSM_OVERLAY_T *overlay, int width, int height);
+
+void vcsm_overlay_get_stats(VCSM_OVERLAY_T *overlay, VCSM_OVERLAY_STATS_T *stats, int reset);
+
+/* Renderer drawing with GLES 2, through a single dynamic vertex buffer */
+int vcsm_overlay_gl_renderer_create(VCSM_OVERLAY_RENDERER_T *renderer);
+void vcsm_overlay_gl_renderer_destroy(VCSM_OVERLAY_RENDERER_T *renderer);
+
+/* Renderer drawing into an RGBA buffer in memory (or nowhere if buffer is
+ * NULL), for running without a GPU */
+int vcsm_overlay_soft_renderer_create(VCSM_OVERLAY_RENDERER_T *renderer, unsigned char *buffer,
+   int width, int height);
+void vcsm_overlay_soft_renderer_destroy(VCSM_OVERLAY_RENDERER_T *renderer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VCSM_OVERLAY_H */
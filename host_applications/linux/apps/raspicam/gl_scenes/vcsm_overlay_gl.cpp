@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* GLES 2 renderer for vcsm_overlay.
+ *
+ * GLES 2 has no instanced drawing so each primitive type is drawn with a
+ * single glDrawArrays over the part of the vertex buffer that holds it. The
+ * vertex buffer is created once and kept: it is only reallocated when it has
+ * to grow, otherwise its storage is orphaned and refilled so that an upload
+ * doesn't wait for the previous frame to finish with it.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GLES2/gl2.h>
+#include "RaspiTex.h"
+#include "RaspiTexUtil.h"
+#include "vcsm_overlay.h"
+
+static const RASPITEXUTIL_SHADER_PROGRAM_T overlay_shader =
+{
+    .vertex_source =
+    "attribute vec2 vertex;\n"
+    "attribute vec4 colour;\n"
+    "uniform vec2 scale;\n"
+    "varying vec4 v_colour;\n"
+    "void main(void) {\n"
+    "   gl_Position = vec4(vertex.x * scale.x - 1.0, 1.0 - vertex.y * scale.y, 0.9, 1.0);\n"
+    "   v_colour = colour;\n"
+    "}\n",
+    .fragment_source =
+    "precision mediump float;\n"
+    "varying vec4 v_colour;\n"
+    "void main(void) {\n"
+    "   gl_FragColor = v_colour;\n"
+    "}\n",
+    .uniform_names = {"scale"},
+    .attribute_names = {"vertex", "colour"},
+};
+
+typedef struct GL_RENDERER_T
+{
+    RASPITEXUTIL_SHADER_PROGRAM_T shader;
+    GLuint vbo;
+    GLsizeiptr capacity;    /* Bytes allocated for the vertex buffer */
+} GL_RENDERER_T;
+
+static int gl_renderer_init(void *context)
+{
+    GL_RENDERER_T *gl = (GL_RENDERER_T *) context;
+
+    gl->shader = overlay_shader;
+    if (raspitexutil_build_shader_program(&gl->shader) != 0)
+        return -1;
+    GLCHK(glGenBuffers(1, &gl->vbo));
+    gl->capacity = 0;
+    return 0;
+}
+
+static void gl_renderer_term(void *context)
+{
+    GL_RENDERER_T *gl = (GL_RENDERER_T *) context;
+
+    if (gl->vbo)
+        glDeleteBuffers(1, &gl->vbo);
+    if (gl->shader.program)
+        glDeleteProgram(gl->shader.program);
+    gl->vbo = 0;
+    gl->shader.program = 0;
+}
+
+static void gl_renderer_upload(void *context, const VCSM_OVERLAY_VERTEX_T *vertices,
+        unsigned int count)
+{
+    GL_RENDERER_T *gl = (GL_RENDERER_T *) context;
+    GLsizeiptr size = count * sizeof(*vertices);
+
+    if (!size)
+        return;
+
+    GLCHK(glBindBuffer(GL_ARRAY_BUFFER, gl->vbo));
+    if (size > gl->capacity)
+    {
+        gl->capacity = gl->capacity ? gl->capacity * 2 : 4096;
+        while (gl->capacity < size)
+            gl->capacity *= 2;
+    }
+    // Give the driver new storage rather than waiting for the old one to be free
+    GLCHK(glBufferData(GL_ARRAY_BUFFER, gl->capacity, NULL, GL_DYNAMIC_DRAW));
+    GLCHK(glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices));
+}
+
+static void gl_renderer_draw(void *context, VCSM_OVERLAY_TYPE_T type, unsigned int first,
+        unsigned int count, int width, int height)
+{
+    GL_RENDERER_T *gl = (GL_RENDERER_T *) context;
+    GLint vertex = gl->shader.attribute_locations[0];
+    GLint colour = gl->shader.attribute_locations[1];
+
+    GLCHK(glUseProgram(gl->shader.program));
+    GLCHK(glUniform2f(gl->shader.uniform_locations[0], 2.0f / width, 2.0f / height));
+    GLCHK(glBindBuffer(GL_ARRAY_BUFFER, gl->vbo));
+    GLCHK(glEnableVertexAttribArray(vertex));
+    GLCHK(glVertexAttribPointer(vertex, 2, GL_FLOAT, GL_FALSE, sizeof(VCSM_OVERLAY_VERTEX_T),
+                (const GLvoid *) offsetof(VCSM_OVERLAY_VERTEX_T, x)));
+    GLCHK(glEnableVertexAttribArray(colour));
+    GLCHK(glVertexAttribPointer(colour, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(VCSM_OVERLAY_VERTEX_T),
+                (const GLvoid *) offsetof(VCSM_OVERLAY_VERTEX_T, colour)));
+    GLCHK(glEnable(GL_BLEND));
+    GLCHK(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+
+    GLCHK(glDrawArrays(type == VCSM_OVERLAY_FILLS ? GL_TRIANGLES : GL_LINES, first, count));
+
+    GLCHK(glDisable(GL_BLEND));
+    GLCHK(glDisableVertexAttribArray(colour));
+    GLCHK(glDisableVertexAttribArray(vertex));
+}
+
+int vcsm_overlay_gl_renderer_create(VCSM_OVERLAY_RENDERER_T *renderer)
+{
+    GL_RENDERER_T *gl = (GL_RENDERER_T *) calloc(1, sizeof(*gl));
+    if (!gl)
+        return -1;
+
+    memset(renderer, 0, sizeof(*renderer));
+    renderer->init = gl_renderer_init;
+    renderer->term = gl_renderer_term;
+    renderer->upload = gl_renderer_upload;
+    renderer->draw = gl_renderer_draw;
+    renderer->context = gl;
+    return 0;
+}
+
+void vcsm_overlay_gl_renderer_destroy(VCSM_OVERLAY_RENDERER_T *renderer)
+{
+    free(renderer->context);
+    renderer->context = NULL;
+}
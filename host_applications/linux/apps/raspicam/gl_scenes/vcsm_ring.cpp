@@ -0,0 +1,395 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* Ring of CPU readable frame buffers for the GL scenes. See vcsm_ring.h.
+ *
+ * Each slot goes through FREE -> RENDERING -> READY -> CONSUMING -> FREE. The
+ * GL thread owns the RENDERING slot and the consumer thread the CONSUMING one.
+ * The last slot released by the consumer can be taken back by the GL thread
+ * as DISPLAYING, it stays there until another consumed slot replaces it.
+ * Slot states are only changed with the ring lock held, but the lock is never
+ * held while rendering or while the consumer callback runs.
+ */
+
+#define VCOS_LOG_CATEGORY (&vcsm_ring_log_category)
+#include <stdlib.h>
+#include <string.h>
+#include "vcsm_ring.h"
+
+static VCOS_LOG_CAT_T vcsm_ring_log_category;
+
+typedef enum
+{
+   SLOT_FREE,
+   SLOT_RENDERING,
+   SLOT_READY,
+   SLOT_CONSUMING,
+   SLOT_DISPLAYING,
+} SLOT_STATE_T;
+
+struct VCSM_RING_T
+{
+   VCOS_MUTEX_T lock;
+   VCOS_SEMAPHORE_T ready_sem;   /* Posted for every frame published */
+   VCOS_SEMAPHORE_T free_sem;    /* Posted when a slot is released and the GL thread is waiting */
+   VCOS_THREAD_T thread;
+
+   unsigned int slots;
+   VCSM_RING_POLICY_T policy;
+   VCSM_RING_BACKEND_T backend;
+   VCSM_RING_CONSUMER_T consumer;
+   void *userdata;
+
+   struct {
+      SLOT_STATE_T state;
+      VCSM_RING_FRAME_T frame;
+   } slot[VCSM_RING_MAX_SLOTS];
+
+   uint32_t sequence;
+   int consumed;                 /* Last slot released by the consumer, -1 if none */
+   int displayed;                /* Slot held by the GL thread for display, -1 if none */
+   int waiting;
+   int quit;
+   VCSM_RING_STATS_T stats;
+};
+
+/* Find the READY slot holding the oldest frame. Called with the lock held. */
+static int vcsm_ring_oldest_ready(VCSM_RING_T *ring)
+{
+   unsigned int i;
+   int oldest = -1;
+
+   for (i = 0; i < ring->slots; i++)
+   {
+      if (ring->slot[i].state != SLOT_READY)
+         continue;
+      if (oldest < 0 ||
+          (int32_t)(ring->slot[i].frame.sequence - ring->slot[oldest].frame.sequence) < 0)
+         oldest = i;
+   }
+   return oldest;
+}
+
+static void *vcsm_ring_consumer_thread(void *arg)
+{
+   VCSM_RING_T *ring = (VCSM_RING_T *) arg;
+
+   while (1)
+   {
+      VCSM_RING_FRAME_T frame;
+      unsigned char *buffer;
+      uint32_t latency;
+      int slot;
+
+      vcos_semaphore_wait(&ring->ready_sem);
+
+      vcos_mutex_lock(&ring->lock);
+      if (ring->quit)
+      {
+         vcos_mutex_unlock(&ring->lock);
+         break;
+      }
+      /* The frame this was posted for might have been dropped since */
+      slot = vcsm_ring_oldest_ready(ring);
+      if (slot < 0)
+      {
+         vcos_mutex_unlock(&ring->lock);
+         continue;
+      }
+      ring->slot[slot].state = SLOT_CONSUMING;
+      frame = ring->slot[slot].frame;
+      vcos_mutex_unlock(&ring->lock);
+
+      latency = (uint32_t)(vcos_getmicrosecs64() - frame.timestamp);
+
+      buffer = ring->backend.lock(ring->backend.context, slot);
+      if (buffer)
+      {
+         ring->consumer(buffer, &frame, ring->userdata);
+         ring->backend.unlock(ring->backend.context, slot, buffer);
+      }
+      else
+      {
+         vcos_log_error("%s: failed to lock slot %d", VCOS_FUNCTION, slot);
+      }
+
+      vcos_mutex_lock(&ring->lock);
+      ring->slot[slot].state = SLOT_FREE;
+      ring->consumed = slot;
+      ring->stats.consumed++;
+      ring->stats.last_latency = latency;
+      if (latency > ring->stats.max_latency)
+         ring->stats.max_latency = latency;
+      if (ring->waiting)
+      {
+         ring->waiting = 0;
+         vcos_semaphore_post(&ring->free_sem);
+      }
+      vcos_mutex_unlock(&ring->lock);
+   }
+
+   return NULL;
+}
+
+VCSM_RING_T *vcsm_ring_create(unsigned int slots, VCSM_RING_POLICY_T policy,
+   const VCSM_RING_BACKEND_T *backend, VCSM_RING_CONSUMER_T consumer, void *userdata)
+{
+   VCSM_RING_T *ring;
+
+   /* We need at least one slot for each thread. The GL thread only never has
+    * to wait with the drop-oldest policy if there's another one for
+    * vcsm_ring_display(). */
+   if (!vcsm_ring_log_category.name)
+      vcos_log_register("vcsm_ring", VCOS_LOG_CATEGORY);
+
+   if (slots < 2 || slots > VCSM_RING_MAX_SLOTS || !backend || !consumer)
+   {
+      vcos_log_error("%s: invalid parameters (%u slots)", VCOS_FUNCTION, slots);
+      return NULL;
+   }
+
+   ring = (VCSM_RING_T *) calloc(1, sizeof(*ring));
+   if (!ring)
+      return NULL;
+
+   ring->slots = slots;
+   ring->policy = policy;
+   ring->backend = *backend;
+   ring->consumer = consumer;
+   ring->userdata = userdata;
+   ring->consumed = -1;
+   ring->displayed = -1;
+
+   if (vcos_mutex_create(&ring->lock, "vcsm_ring") != VCOS_SUCCESS)
+      goto error_mutex;
+   if (vcos_semaphore_create(&ring->ready_sem, "vcsm_ring_ready", 0) != VCOS_SUCCESS)
+      goto error_ready_sem;
+   if (vcos_semaphore_create(&ring->free_sem, "vcsm_ring_free", 0) != VCOS_SUCCESS)
+      goto error_free_sem;
+   if (vcos_thread_create(&ring->thread, "vcsm-ring-consumer", NULL,
+                          vcsm_ring_consumer_thread, ring) != VCOS_SUCCESS)
+      goto error_thread;
+
+   return ring;
+
+error_thread:
+   vcos_semaphore_delete(&ring->free_sem);
+error_free_sem:
+   vcos_semaphore_delete(&ring->ready_sem);
+error_ready_sem:
+   vcos_mutex_delete(&ring->lock);
+error_mutex:
+   free(ring);
+   return NULL;
+}
+
+void vcsm_ring_destroy(VCSM_RING_T *ring)
+{
+   if (!ring)
+      return;
+
+   vcos_mutex_lock(&ring->lock);
+   ring->quit = 1;
+   if (ring->waiting)
+   {
+      ring->waiting = 0;
+      vcos_semaphore_post(&ring->free_sem);
+   }
+   vcos_mutex_unlock(&ring->lock);
+   vcos_semaphore_post(&ring->ready_sem);
+
+   vcos_thread_join(&ring->thread, NULL);
+
+   vcos_semaphore_delete(&ring->free_sem);
+   vcos_semaphore_delete(&ring->ready_sem);
+   vcos_mutex_delete(&ring->lock);
+   free(ring);
+}
+
+int vcsm_ring_acquire(VCSM_RING_T *ring)
+{
+   unsigned int i;
+   int slot = -1;
+
+   vcos_mutex_lock(&ring->lock);
+   while (!ring->quit)
+   {
+      for (i = 0; i < ring->slots; i++)
+         if (ring->slot[i].state == SLOT_FREE)
+            break;
+      if (i < ring->slots)
+      {
+         slot = i;
+         break;
+      }
+
+      if (ring->policy == VCSM_RING_POLICY_DROP_OLDEST)
+      {
+         slot = vcsm_ring_oldest_ready(ring);
+         if (slot >= 0)
+         {
+            ring->stats.dropped++;
+            break;
+         }
+      }
+
+      /* Wait for the consumer to release a slot */
+      ring->stats.blocked++;
+      ring->waiting = 1;
+      vcos_mutex_unlock(&ring->lock);
+      vcos_semaphore_wait(&ring->free_sem);
+      vcos_mutex_lock(&ring->lock);
+   }
+   if (slot >= 0)
+      ring->slot[slot].state = SLOT_RENDERING;
+   vcos_mutex_unlock(&ring->lock);
+
+   return slot;
+}
+
+void vcsm_ring_publish(VCSM_RING_T *ring, unsigned int slot)
+{
+   vcos_assert(slot < ring->slots);
+
+   vcos_mutex_lock(&ring->lock);
+   vcos_assert(ring->slot[slot].state == SLOT_RENDERING);
+   ring->slot[slot].frame.sequence = ring->sequence++;
+   ring->slot[slot].frame.timestamp = vcos_getmicrosecs64();
+   ring->slot[slot].frame.slot = slot;
+   ring->slot[slot].state = SLOT_READY;
+   ring->stats.published++;
+   vcos_mutex_unlock(&ring->lock);
+
+   vcos_semaphore_post(&ring->ready_sem);
+}
+
+int vcsm_ring_display(VCSM_RING_T *ring)
+{
+   int slot;
+
+   vcos_mutex_lock(&ring->lock);
+   /* Swap the displayed slot for a more recent one if the consumer has
+    * released one since and it hasn't been re-used for rendering yet */
+   if (ring->consumed >= 0 && ring->consumed != ring->displayed &&
+       ring->slot[ring->consumed].state == SLOT_FREE)
+   {
+      if (ring->displayed >= 0)
+         ring->slot[ring->displayed].state = SLOT_FREE;
+      ring->displayed = ring->consumed;
+      ring->slot[ring->displayed].state = SLOT_DISPLAYING;
+   }
+   slot = ring->displayed;
+   vcos_mutex_unlock(&ring->lock);
+
+   return slot;
+}
+
+void vcsm_ring_set_policy(VCSM_RING_T *ring, VCSM_RING_POLICY_T policy)
+{
+   vcos_mutex_lock(&ring->lock);
+   ring->policy = policy;
+   /* Let a blocked GL thread re-evaluate with the new policy */
+   if (ring->waiting)
+   {
+      ring->waiting = 0;
+      vcos_semaphore_post(&ring->free_sem);
+   }
+   vcos_mutex_unlock(&ring->lock);
+}
+
+void vcsm_ring_get_stats(VCSM_RING_T *ring, VCSM_RING_STATS_T *stats)
+{
+   vcos_mutex_lock(&ring->lock);
+   *stats = ring->stats;
+   stats->lag = ring->stats.published - ring->stats.consumed - ring->stats.dropped;
+   vcos_mutex_unlock(&ring->lock);
+}
+
+/* Emulated backend: each slot is a plain malloc'ed buffer */
+typedef struct
+{
+   unsigned int slots;
+   unsigned char *buffer[VCSM_RING_MAX_SLOTS];
+} EMULATED_BACKEND_T;
+
+static unsigned char *emulated_backend_lock(void *context, unsigned int slot)
+{
+   EMULATED_BACKEND_T *emulated = (EMULATED_BACKEND_T *) context;
+   return slot < emulated->slots ? emulated->buffer[slot] : NULL;
+}
+
+static void emulated_backend_unlock(void *context, unsigned int slot, unsigned char *buffer)
+{
+   (void) context;
+   (void) slot;
+   (void) buffer;
+}
+
+int vcsm_ring_emulated_backend_create(VCSM_RING_BACKEND_T *backend, unsigned int slots, size_t size)
+{
+   EMULATED_BACKEND_T *emulated;
+   unsigned int i;
+
+   if (slots > VCSM_RING_MAX_SLOTS)
+      return -1;
+
+   emulated = (EMULATED_BACKEND_T *) calloc(1, sizeof(*emulated));
+   if (!emulated)
+      return -1;
+
+   emulated->slots = slots;
+   for (i = 0; i < slots; i++)
+   {
+      emulated->buffer[i] = (unsigned char *) calloc(1, size);
+      if (!emulated->buffer[i])
+      {
+         backend->context = emulated;
+         vcsm_ring_emulated_backend_destroy(backend);
+         return -1;
+      }
+   }
+
+   backend->lock = emulated_backend_lock;
+   backend->unlock = emulated_backend_unlock;
+   backend->context = emulated;
+   return 0;
+}
+
+void vcsm_ring_emulated_backend_destroy(VCSM_RING_BACKEND_T *backend)
+{
+   EMULATED_BACKEND_T *emulated = (EMULATED_BACKEND_T *) backend->context;
+   unsigned int i;
+
+   if (!emulated)
+      return;
+   for (i = 0; i < emulated->slots; i++)
+      free(emulated->buffer[i]);
+   free(emulated);
+   backend->context = NULL;
+}
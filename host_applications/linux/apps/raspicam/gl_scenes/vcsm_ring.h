@@ -0,0 +1,122 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VCSM_RING_H
+#define VCSM_RING_H
+
+#include "interface/vcos/vcos.h"
+
+/* Ring of CPU readable frame buffers shared between the GL thread (producer)
+ * and a dedicated consumer thread.
+ *
+ * The GL thread acquires a free slot, renders into it and publishes it. The
+ * consumer thread locks published slots in order, hands them to the consumer
+ * callback and then releases them. The ring doesn't know anything about GL or
+ * VCSM, the memory behind each slot is provided by a backend. This allows the
+ * ring to be exercised without a GPU by using the emulated backend.
+ */
+
+#define VCSM_RING_MAX_SLOTS 8
+
+/* What to do when the GL thread wants a slot and they're all in use */
+typedef enum
+{
+   VCSM_RING_POLICY_DROP_OLDEST, /* Re-use the oldest frame the consumer hasn't started on */
+   VCSM_RING_POLICY_BLOCK,       /* Wait for the consumer to release a slot */
+} VCSM_RING_POLICY_T;
+
+/* Provides the memory behind the slots */
+typedef struct VCSM_RING_BACKEND_T
+{
+   /* Make the slot CPU addressable. Called from the consumer thread. */
+   unsigned char *(*lock)(void *context, unsigned int slot);
+   /* Release the CPU mapping so the GPU can use the slot again */
+   void (*unlock)(void *context, unsigned int slot, unsigned char *buffer);
+   void *context;
+} VCSM_RING_BACKEND_T;
+
+typedef struct VCSM_RING_FRAME_T
+{
+   uint32_t sequence;      /* Incremented for every frame published, dropped ones included */
+   int64_t timestamp;      /* Time (us) at which the frame was published */
+   unsigned int slot;
+} VCSM_RING_FRAME_T;
+
+typedef int (*VCSM_RING_CONSUMER_T)(unsigned char *buffer, const VCSM_RING_FRAME_T *frame,
+   void *userdata);
+
+typedef struct VCSM_RING_STATS_T
+{
+   uint32_t published;     /* Frames published by the GL thread */
+   uint32_t consumed;      /* Frames handed to the consumer */
+   uint32_t dropped;       /* Frames re-used before the consumer got to them */
+   uint32_t blocked;       /* Times the GL thread had to wait for a slot */
+   uint32_t lag;           /* Frames published but not consumed yet */
+   uint32_t last_latency;  /* Time (us) between publishing and consuming the last frame */
+   uint32_t max_latency;
+} VCSM_RING_STATS_T;
+
+typedef struct VCSM_RING_T VCSM_RING_T;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Create a ring and start its consumer thread */
+VCSM_RING_T *vcsm_ring_create(unsigned int slots, VCSM_RING_POLICY_T policy,
+   const VCSM_RING_BACKEND_T *backend, VCSM_RING_CONSUMER_T consumer, void *userdata);
+
+/* Stop the consumer thread and free the ring. Frames which haven't been
+ * consumed yet are discarded. */
+void vcsm_ring_destroy(VCSM_RING_T *ring);
+
+/* Get a slot to render the next frame into. Returns -1 if the ring is being
+ * destroyed. Only waits with VCSM_RING_POLICY_BLOCK. */
+int vcsm_ring_acquire(VCSM_RING_T *ring);
+
+/* Hand a rendered slot over to the consumer thread */
+void vcsm_ring_publish(VCSM_RING_T *ring, unsigned int slot);
+
+/* Get the most recently consumed slot for the GL thread to display. The slot
+ * belongs to the GL thread until the next call returns a different one, so
+ * neither the consumer nor vcsm_ring_acquire() touch it meanwhile. Returns -1
+ * until the consumer has released its first frame. */
+int vcsm_ring_display(VCSM_RING_T *ring);
+
+void vcsm_ring_set_policy(VCSM_RING_T *ring, VCSM_RING_POLICY_T policy);
+void vcsm_ring_get_stats(VCSM_RING_T *ring, VCSM_RING_STATS_T *stats);
+
+/* Backend using plain memory instead of VCSM, for running without a GPU */
+int vcsm_ring_emulated_backend_create(VCSM_RING_BACKEND_T *backend, unsigned int slots, size_t size);
+void vcsm_ring_emulated_backend_destroy(VCSM_RING_BACKEND_T *backend);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VCSM_RING_H */
@@ -0,0 +1,145 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Readback of regions of interest. See vcsm_roi.h. */
+
+#include <string.h>
+#include "vcsm_roi.h"
+
+int vcsm_roi_set_init(VCSM_ROI_SET_T *set, const VCSM_ROI_RECT_T *rects, unsigned int num,
+   int frame_width, int frame_height, unsigned int bytes_per_pixel)
+{
+   size_t offset = 0;
+   unsigned int i;
+
+   memset(set, 0, sizeof(*set));
+   if (num > VCSM_ROI_MAX || (num && !rects) || !bytes_per_pixel)
+      return -1;
+
+   set->num = num;
+   set->bytes_per_pixel = bytes_per_pixel;
+   for (i = 0; i < num; i++)
+   {
+      VCSM_ROI_INFO_T *roi = &set->roi[i];
+      int x0 = rects[i].x, y0 = rects[i].y;
+      int x1 = rects[i].x + rects[i].width, y1 = rects[i].y + rects[i].height;
+
+      if (x0 < 0) x0 = 0;
+      if (y0 < 0) y0 = 0;
+      if (x1 > frame_width) x1 = frame_width;
+      if (y1 > frame_height) y1 = frame_height;
+      if (x1 <= x0 || y1 <= y0)
+         x1 = x0 = y1 = y0 = 0;
+
+      roi->rect.x = x0;
+      roi->rect.y = y0;
+      roi->rect.width = x1 - x0;
+      roi->rect.height = y1 - y0;
+      roi->stride = roi->rect.width * bytes_per_pixel;
+      roi->offset = offset;
+      offset = (offset + (size_t)roi->stride * roi->rect.height + 3) & ~(size_t)3;
+   }
+   set->size = offset;
+   return 0;
+}
+
+unsigned int vcsm_roi_set_rows(const VCSM_ROI_SET_T *set, int *first, int *count,
+   unsigned int max)
+{
+   int start[VCSM_ROI_MAX], end[VCSM_ROI_MAX];
+   unsigned int i, j, num = 0, ranges = 0;
+
+   if (!max)
+      return 0;
+
+   /* Sort the row ranges by their first row */
+   for (i = 0; i < set->num; i++)
+   {
+      const VCSM_ROI_RECT_T *rect = &set->roi[i].rect;
+
+      if (!rect->height)
+         continue;
+      for (j = num; j > 0 && start[j - 1] > rect->y; j--)
+      {
+         start[j] = start[j - 1];
+         end[j] = end[j - 1];
+      }
+      start[j] = rect->y;
+      end[j] = rect->y + rect->height;
+      num++;
+   }
+
+   /* Merge the ones which overlap or touch */
+   for (i = 0; i < num; i++)
+   {
+      if (ranges && start[i] <= first[ranges - 1] + count[ranges - 1])
+      {
+         if (end[i] > first[ranges - 1] + count[ranges - 1])
+            count[ranges - 1] = end[i] - first[ranges - 1];
+         continue;
+      }
+      if (ranges == max)
+      {
+         /* Out of room, extend the last range to cover the rest. The ranges
+          * are sorted by their first row only, so look for the furthest end. */
+         for (j = i; j < num; j++)
+            if (end[j] > first[ranges - 1] + count[ranges - 1])
+               count[ranges - 1] = end[j] - first[ranges - 1];
+         break;
+      }
+      first[ranges] = start[i];
+      count[ranges] = end[i] - start[i];
+      ranges++;
+   }
+
+   return ranges;
+}
+
+void vcsm_roi_copy(VCSM_ROI_SET_T *set, const unsigned char *frame, size_t frame_stride,
+   unsigned char *out, uint32_t sequence, int64_t timestamp)
+{
+   unsigned int i;
+   int row;
+
+   for (i = 0; i < set->num; i++)
+   {
+      VCSM_ROI_INFO_T *roi = &set->roi[i];
+      const unsigned char *src = frame + roi->rect.y * frame_stride +
+         roi->rect.x * set->bytes_per_pixel;
+      unsigned char *dst = out + roi->offset;
+
+      for (row = 0; row < roi->rect.height; row++)
+      {
+         memcpy(dst, src, roi->stride);
+         src += frame_stride;
+         dst += roi->stride;
+      }
+      roi->sequence = sequence;
+      roi->timestamp = timestamp;
+   }
+}
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VCSM_ROI_H
+#define VCSM_ROI_H
+
+#include "interface/vcos/vcos.h"
+
+/* Readback of regions of interest.
+ *
+ * Instead of reading back whole frames, a consumer gives a list of rectangles
+ * and gets only those, packed one after the other in a compact buffer along
+ * with where each one landed. This part doesn't know anything about GL or
+ * VCSM: it works out the layout of the packed buffer and the rows of the
+ * frame which are needed, and provides the software copy used when the frame
+ * is CPU addressable (VCSM frame buffers, or plain memory without a GPU).
+ */
+
+#define VCSM_ROI_MAX 16
+
+typedef struct VCSM_ROI_RECT_T
+{
+   int x, y;               /* Top left corner, in pixels */
+   int width, height;
+} VCSM_ROI_RECT_T;
+
+typedef struct VCSM_ROI_INFO_T
+{
+   VCSM_ROI_RECT_T rect;   /* Rectangle read back, clipped to the frame. May be empty. */
+   size_t offset;          /* Offset of its first row in the packed buffer */
+   unsigned int stride;    /* Bytes between its rows in the packed buffer */
+   uint32_t sequence;      /* Frame it was read from */
+   int64_t timestamp;      /* Time (us) of that frame */
+} VCSM_ROI_INFO_T;
+
+typedef struct VCSM_ROI_SET_T
+{
+   unsigned int num;
+   VCSM_ROI_INFO_T roi[VCSM_ROI_MAX];
+   unsigned int bytes_per_pixel;
+   size_t size;            /* Size of the packed buffer */
+} VCSM_ROI_SET_T;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Clip the rectangles to the frame and lay them out in a packed buffer. Each
+ * region starts on a 4 byte boundary and its rows are contiguous.
+ * Returns 0 on success, -1 if there are too many rectangles. */
+int vcsm_roi_set_init(VCSM_ROI_SET_T *set, const VCSM_ROI_RECT_T *rects, unsigned int num,
+   int frame_width, int frame_height, unsigned int bytes_per_pixel);
+
+/* Get the ranges of rows of the frame covered by the regions, merged and in
+ * order, so that only those need to be made CPU visible.
+ * Returns the number of ranges, at most max. */
+unsigned int vcsm_roi_set_rows(const VCSM_ROI_SET_T *set, int *first, int *count,
+   unsigned int max);
+
+/* Copy the regions from a CPU addressable frame into the packed buffer and
+ * stamp them with the frame they come from. */
+void vcsm_roi_copy(VCSM_ROI_SET_T *set, const unsigned char *frame, size_t frame_stride,
+   unsigned char *out, uint32_t sequence, int64_t timestamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VCSM_ROI_H */
@@ -8,6 +8,11 @@
  * the buffer to OpenCV. There may be some benefit in using multiple GL contexts
  * to reduce the impact of serializing operations with a glFlush.
  *
+ * The frame buffers are kept in a small ring which is read back by a dedicated
+ * consumer thread (see vcsm_ring.h), so a slow consumer callback doesn't stall
+ * rendering. By default the oldest unread frame is dropped when the consumer
+ * falls behind, set_glbuff_policy() can make the GL thread wait instead.
+ *
  * N.B VCSM textures are raster scan order textures. This makes it very
  * convenient to read and modify VCSM frame-buffer textures from the CPU.
  * However, if the output of the CPU stage is drawn again as a texture that
@@ -34,6 +39,9 @@
 #include "RaspiTex.h"
 #include "RaspiTexUtil.h"
 #include "user-vcsm.h"
+#include "vcsm_ring.h"
+#include "vcsm_roi.h"
+#include "vcsm_overlay.h"
 
 /* Draw a scaled quad showing the entire texture with the
  * origin defined as an attribute */
@@ -118,44 +126,25 @@ static RASPITEXUTIL_SHADER_PROGRAM_T vcsm_square_shader =
     .attribute_names = {"vertex"},
 };
 #endif
-static RASPITEXUTIL_SHADER_PROGRAM_T line_shader =
-{
-    .vertex_source =
-    "attribute vec2 vertex; \n"
-    "varying vec3 color;\n"
-   "void main() \n"
-   "{ \n"
-    "   gl_Position = vec4(vertex, 0.9, 1.0);\n"
-    "   color = vec3(1.0, 0.0, 0.0);"
-    "   if (vertex.x > 0.0) {"
-         "   color = vec3(1.0, 0.0, 1.0);"
-        "}"
-   "} \n",
-    
-    .fragment_source =
-    "precision mediump float; \n"
-    "varying vec3 color;\n"
-    "void main() \n"
-    "{ \n"
-    " gl_FragColor = vec4(color, 1.0); \n"
-    "}\n",
-    .attribute_names = {"vertex"},
-};
-
-    
-
 static GLfloat quad_varray[] = {
    -1.0f, -1.0f, 1.0f, 1.0f, 1.0f, -1.0f,
    -1.0f, 1.0f, 1.0f, 1.0f, -1.0f, -1.0f,
 };
 
 static GLuint quad_vbo;
-static GLuint line_vbo;
 
-static struct egl_image_brcm_vcsm_info vcsm_info;
-static EGLImageKHR eglFbImage;
-static GLuint fb_tex_name;
-static GLuint fb_name;
+// Number of frame buffers in the readback ring. One is being rendered, one
+// is being read by the consumer, one holds the latest complete frame and one
+// is on screen.
+#define VCSM_SQUARE_SLOTS 4
+
+static struct egl_image_brcm_vcsm_info vcsm_info[VCSM_SQUARE_SLOTS];
+static EGLImageKHR eglFbImage[VCSM_SQUARE_SLOTS];
+static GLuint fb_tex_name[VCSM_SQUARE_SLOTS];
+static GLuint fb_name[VCSM_SQUARE_SLOTS];
+
+static VCSM_RING_T *readback_ring;
+static VCSM_RING_POLICY_T readback_policy = VCSM_RING_POLICY_DROP_OLDEST;
 
 
 // VCSM buffer dimensions must be a power of two. Use glViewPort to draw NPOT
@@ -173,59 +162,62 @@ static const EGLint vcsm_square_egl_config_attribs[] =
     EGL_NONE
 };
 
-static int square_idx = 0;
-GLfloat line_varray[8*10];
+// Rectangles and labels drawn over the preview. Created on first use, which
+// may come before the GL thread is up, and drawn by the GL thread.
+static VCOS_ONCE_T overlay_once = VCOS_ONCE_INIT;
+static VCOS_MUTEX_T overlay_lock;
+static VCSM_OVERLAY_RENDERER_T overlay_renderer;
+static VCSM_OVERLAY_T *overlay;
 
-int set_rectangle(RASPITEX_STATE *state, int x, int y, int width, int height)
+static void overlay_init_once(void)
 {
-  // convert from screen coordinates to NDC
-  GLfloat ndcx1 =  2*((GLfloat)x/(GLfloat)state->width) - 1;
-  GLfloat ndcy1 = -2*((GLfloat)y/(GLfloat)state->height) +1;
+    vcos_mutex_create(&overlay_lock, "vcsm_square_overlay");
+}
 
-  GLfloat ndcx2 =  2*(((GLfloat)x+(GLfloat)width)/(GLfloat)state->width) - 1;
-  GLfloat ndcy2 = -2*((GLfloat)(y+height)/(GLfloat)state->height) +1;
+static VCSM_OVERLAY_T *get_overlay(void)
+{
+    vcos_once(&overlay_once, overlay_init_once);
+    vcos_mutex_lock(&overlay_lock);
+    if (!overlay && vcsm_overlay_gl_renderer_create(&overlay_renderer) == 0) {
+        overlay = vcsm_overlay_create(&overlay_renderer);
+        if (!overlay)
+            vcsm_overlay_gl_renderer_destroy(&overlay_renderer);
+    }
+    vcos_mutex_unlock(&overlay_lock);
+    return overlay;
+}
 
-  int idx = square_idx * 8;
-    
-  line_varray[idx+0] = ndcx1;
-  line_varray[idx+1] = ndcy2;
-
-  line_varray[idx+2] = ndcx1;
-  line_varray[idx+3] = ndcy1;
-
-  line_varray[idx+4] = ndcx2;
-  line_varray[idx+5] = ndcy1;
-
-  line_varray[idx+6] = ndcx2;
-  line_varray[idx+7] = ndcy2;
-  int lidx = square_idx;
-  square_idx++;
-  
-  //  for(int x=0; x< 8; x+=2) {
-  //  printf("%f, %f  ", line_varray[x], line_varray[x+1]);
-  //}
-  //printf("\n");
-  return lidx;
+int set_rectangle(RASPITEX_STATE *state, int x, int y, int width, int height)
+{
+    VCSM_OVERLAY_T *o = get_overlay();
+    (void) state;
+    if (!o)
+        return -1;
+    // Window coordinates, the overlay is drawn in the preview viewport
+    return vcsm_overlay_retain_rect(o, x, y, width, height, VCSM_OVERLAY_RGBA(255, 0, 0, 255));
 }
 
-static void init_vcsm_rectangle()
+void remove_rectangle(int id)
 {
-    GLCHK(glGenBuffers(1, &line_vbo));
+    VCSM_OVERLAY_T *o = get_overlay();
+    if (o)
+        vcsm_overlay_remove(o, id);
 }
 
-static void draw_vcsm_rectangle(int idx)
+VCSM_OVERLAY_T *get_preview_overlay(void)
 {
-    GLCHK(glBindBuffer(GL_ARRAY_BUFFER, line_vbo));
-    GLCHK(glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*8, &line_varray[idx*8], GL_STATIC_DRAW));
-    GLCHK(glUseProgram(line_shader.program));
-    GLCHK(glEnableVertexAttribArray(line_shader.attribute_locations[0]));
-    GLCHK(glVertexAttribPointer(line_shader.attribute_locations[0], 2, GL_FLOAT, GL_FALSE, 0, 0));
-    GLCHK(glDrawArrays(GL_LINE_LOOP, 0, 4));
-    GLCHK(glDisableVertexAttribArray(line_shader.attribute_locations[0]));
+    return get_overlay();
+}
+
+int get_overlay_stats(VCSM_OVERLAY_STATS_T *stats, int reset)
+{
+    VCSM_OVERLAY_T *o = get_overlay();
+    if (!o)
+        return -1;
+    vcsm_overlay_get_stats(o, stats, reset);
+    return 0;
 }
 
-// Write the shared memory texture writing something to each line. This is
-// just to show that the buffer really is CPU modifiable.
 static int vcsm_square_draw_pattern(unsigned char *buffer)
 {
     static unsigned x_offset;
@@ -258,15 +250,111 @@ int set_glbuff_cb(buffer_cb_type callback_fn)
   return 0;
 }
 
+buffer_frame_cb_type glbuff_frame_cb = NULL;
+int set_glbuff_frame_cb(buffer_frame_cb_type callback_fn)
+{
+  glbuff_frame_cb = callback_fn;
+  return 0;
+}
+
+int set_glbuff_policy(int block)
+{
+  readback_policy = block ? VCSM_RING_POLICY_BLOCK : VCSM_RING_POLICY_DROP_OLDEST;
+  if (readback_ring)
+    vcsm_ring_set_policy(readback_ring, readback_policy);
+  return 0;
+}
+
+int get_glbuff_stats(VCSM_RING_STATS_T *stats)
+{
+  if (!readback_ring)
+    return -1;
+  vcsm_ring_get_stats(readback_ring, stats);
+  return 0;
+}
+
+// Regions of interest requested by the application, picked up by the
+// consumer thread when it locks the next frame.
+static VCOS_ONCE_T roi_once = VCOS_ONCE_INIT;
+static VCOS_MUTEX_T roi_lock;
+static VCSM_ROI_RECT_T roi_rects[VCSM_ROI_MAX];
+static unsigned int roi_num;
+static buffer_roi_cb_type roi_cb;
+
+// Regions of the frame being consumed. Only used by the consumer thread.
+static VCSM_ROI_SET_T roi_active;
+static buffer_roi_cb_type roi_active_cb;
+static unsigned char *roi_buffer;
+static size_t roi_buffer_size;
+
+static void roi_init_once(void)
+{
+  vcos_mutex_create(&roi_lock, "vcsm_square_roi");
+}
+
+int set_glbuff_roi(const VCSM_ROI_RECT_T *rects, unsigned int num,
+                   buffer_roi_cb_type callback_fn)
+{
+  if (num > VCSM_ROI_MAX || (num && !rects))
+    return -1;
+
+  vcos_once(&roi_once, roi_init_once);
+  vcos_mutex_lock(&roi_lock);
+  memcpy(roi_rects, rects, num * sizeof(*rects));
+  roi_num = num;
+  roi_cb = callback_fn;
+  vcos_mutex_unlock(&roi_lock);
+  return 0;
+}
+
+// Pick up the regions for the next frame. Returns non-zero if the frame
+// should be read back by regions.
+static int roi_update(void)
+{
+  VCSM_ROI_RECT_T rects[VCSM_ROI_MAX];
+  unsigned int num;
+
+  vcos_once(&roi_once, roi_init_once);
+  vcos_mutex_lock(&roi_lock);
+  memcpy(rects, roi_rects, sizeof(rects));
+  num = roi_num;
+  roi_active_cb = num ? roi_cb : NULL;
+  vcos_mutex_unlock(&roi_lock);
+
+  if (!roi_active_cb)
+    return 0;
+
+  // Each texel of the frame buffer packs 4 luma pixels
+  vcsm_roi_set_init(&roi_active, rects, num, fb_width * 4, fb_height, 1);
+  if (roi_active.size > roi_buffer_size) {
+    free(roi_buffer);
+    roi_buffer_size = 0;
+    roi_buffer = (unsigned char *) malloc(roi_active.size);
+    if (!roi_buffer) {
+      vcos_log_error("%s: no memory for %u bytes of regions", VCOS_FUNCTION, (unsigned) roi_active.size);
+      roi_active_cb = NULL;
+      return 0;
+    }
+    roi_buffer_size = roi_active.size;
+  }
+  return 1;
+}
+
 //
 #define superw 8
 #define superh 8
 unsigned char buffer[superw * superh];
 
 
-void publish_buffer(unsigned char *vcsm_buffer)
+// Called from the ring's consumer thread with the buffer locked
+static int publish_buffer(unsigned char *vcsm_buffer, const VCSM_RING_FRAME_T *frame, void *userdata)
 {
-    if(glbuff_cb == NULL) {
+    if(roi_active_cb != NULL) {
+      vcsm_roi_copy(&roi_active, vcsm_buffer, fb_width * 4, roi_buffer, frame->sequence, frame->timestamp);
+      roi_active_cb(roi_buffer, roi_active.roi, roi_active.num);
+    } else if(glbuff_frame_cb != NULL) {
+      glbuff_frame_cb(vcsm_buffer, frame->sequence, frame->timestamp);
+    } else if(glbuff_cb == NULL) {
       //vcsm_square_draw_pattern(vcsm_buffer);
     } else {
       glbuff_cb(vcsm_buffer);
@@ -277,6 +365,60 @@ void publish_buffer(unsigned char *vcsm_buffer)
       glbuff_cb(buffer);
       */
     }
+    return 0;
+}
+
+// Ring backend making the VCSM frame buffers CPU addressable
+static unsigned char *vcsm_square_lock(void *context, unsigned int slot)
+{
+    VCSM_CACHE_TYPE_T cache_type;
+    unsigned char *vcsm_buffer;
+
+    if (roi_update()) {
+        // Lock the buffer once, then invalidate only the rows holding regions, all in one go
+        VCSM_SG_ENTRY_T lock, entries[VCSM_ROI_MAX];
+        int first[VCSM_ROI_MAX], count[VCSM_ROI_MAX];
+        unsigned int stride = fb_width * 4;
+        unsigned int i, n;
+
+        memset(&lock, 0, sizeof(lock));
+        lock.handle = vcsm_info[slot].vcsm_handle;
+        if (vcsm_lock_sg(&lock, 1)) { vcos_log_error("Failed to lock VCSM buffer for handle %d\n", vcsm_info[slot].vcsm_handle); return NULL;}
+
+        n = vcsm_roi_set_rows(&roi_active, first, count, VCSM_ROI_MAX);
+        memset(entries, 0, sizeof(entries));
+        for (i = 0; i < n; i++) {
+            entries[i].handle = vcsm_info[slot].vcsm_handle;
+            entries[i].offset = first[i] * stride;
+            entries[i].length = count[i] * stride;
+            entries[i].op = VCSM_SG_OP_INVALIDATE;
+        }
+        if (n && vcsm_clean_invalid_sg(entries, n)) {
+            vcos_log_error("Failed to invalidate VCSM regions for handle %d\n", vcsm_info[slot].vcsm_handle);
+            vcsm_unlock_sg(&lock, 1);
+            return NULL;
+        }
+        return (unsigned char *) lock.usr_ptr;
+    }
+
+    // Lock with the host cache enabled
+    vcsm_buffer = (unsigned char *) vcsm_lock_cache(vcsm_info[slot].vcsm_handle, VCSM_CACHE_TYPE_HOST, &cache_type);
+    if (! vcsm_buffer) { vcos_log_error("Failed to lock VCSM buffer for handle %d\n", vcsm_info[slot].vcsm_handle); return NULL;}
+    vcos_log_trace("Locked vcsm handle %d at %p\n", vcsm_info[slot].vcsm_handle, vcsm_buffer);
+    return vcsm_buffer;
+}
+
+static void vcsm_square_unlock(void *context, unsigned int slot, unsigned char *vcsm_buffer)
+{
+    if (roi_active_cb) {
+        // The regions were only read, there is nothing to clean
+        VCSM_SG_ENTRY_T entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.handle = vcsm_info[slot].vcsm_handle;
+        vcsm_unlock_sg(&entry, 1);
+        return;
+    }
+    vcsm_unlock_ptr(vcsm_buffer); // Release the locked texture memory to flush the CPU cache and allow GPU to read it
 }
 
 static int vcsm_square_init(RASPITEX_STATE *raspitex_state)
@@ -293,31 +435,41 @@ static int vcsm_square_init(RASPITEX_STATE *raspitex_state)
     rc = raspitexutil_build_shader_program(&vcsm_square_shader); // Shader for drawing VCSM sampler2D texture
     GLCHK(glUseProgram(vcsm_square_shader.program));
     GLCHK(glUniform1i(vcsm_square_shader.uniform_locations[0], 0)); // tex unit
-    rc = raspitexutil_build_shader_program(&line_shader);      // Shader for lines
-    GLCHK(glUseProgram(line_shader.program));
     
-    // --------- Create a Virtual Frame Buffer using CPU accessable memory  -----------
-    GLCHK(glGenFramebuffers(1, &fb_name));              // Create a new FBO object
-    GLCHK(glBindFramebuffer(GL_FRAMEBUFFER, fb_name));  // Make it active
-    GLCHK(glGenTextures(1, &fb_tex_name));              // Create a new OpenGL Texture object
-    GLCHK(glBindTexture(GL_TEXTURE_2D, fb_tex_name));   // Make it active
-    GLCHK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-    GLCHK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-
     fb_width = raspitex_state->width / 4;   // rwm
     fb_height = raspitex_state->height;
-    
-    vcsm_info.width = fb_width;
-    vcsm_info.height = fb_height;
 
-    eglFbImage = eglCreateImageKHR(raspitex_state->display, EGL_NO_CONTEXT, EGL_IMAGE_BRCM_VCSM, &vcsm_info, NULL);
-    if (eglFbImage == EGL_NO_IMAGE_KHR || vcsm_info.vcsm_handle == 0) {
-        vcos_log_error("%s: Failed to create EGL VCSM image\n", VCOS_FUNCTION);  return -1;
+    // --------- Create the Virtual Frame Buffers using CPU accessable memory  -----------
+    GLCHK(glGenFramebuffers(VCSM_SQUARE_SLOTS, fb_name));  // Create new FBO objects
+    GLCHK(glGenTextures(VCSM_SQUARE_SLOTS, fb_tex_name));  // Create new OpenGL Texture objects
+    for (int i = 0; i < VCSM_SQUARE_SLOTS; i++) {
+        GLCHK(glBindFramebuffer(GL_FRAMEBUFFER, fb_name[i]));  // Make it active
+        GLCHK(glBindTexture(GL_TEXTURE_2D, fb_tex_name[i]));   // Make it active
+        GLCHK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+        GLCHK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+
+        vcsm_info[i].width = fb_width;
+        vcsm_info[i].height = fb_height;
+
+        eglFbImage[i] = eglCreateImageKHR(raspitex_state->display, EGL_NO_CONTEXT, EGL_IMAGE_BRCM_VCSM, &vcsm_info[i], NULL);
+        if (eglFbImage[i] == EGL_NO_IMAGE_KHR || vcsm_info[i].vcsm_handle == 0) {
+            vcos_log_error("%s: Failed to create EGL VCSM image\n", VCOS_FUNCTION);  return -1;
+        }
+        GLCHK(glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, eglFbImage[i]));
+        GLCHK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fb_tex_name[i], 0));
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            vcos_log_error("GL_FRAMEBUFFER is not complete\n");	return -1;
+        }
     }
-    GLCHK(glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, eglFbImage));
-    GLCHK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fb_tex_name, 0));
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        vcos_log_error("GL_FRAMEBUFFER is not complete\n");	return -1;
+
+    // --------- Readback ring and its consumer thread -----------
+    VCSM_RING_BACKEND_T backend;
+    backend.lock = vcsm_square_lock;
+    backend.unlock = vcsm_square_unlock;
+    backend.context = NULL;
+    readback_ring = vcsm_ring_create(VCSM_SQUARE_SLOTS, readback_policy, &backend, publish_buffer, NULL);
+    if (!readback_ring) {
+        vcos_log_error("%s: Failed to create readback ring\n", VCOS_FUNCTION);  return -1;
     }
 
     // --------- QUAD VBO stuff -----------
@@ -325,8 +477,10 @@ static int vcsm_square_init(RASPITEX_STATE *raspitex_state)
     GLCHK(glBindBuffer(GL_ARRAY_BUFFER, quad_vbo));
     GLCHK(glBufferData(GL_ARRAY_BUFFER, sizeof(quad_varray), quad_varray, GL_STATIC_DRAW));
 
-    // --------- LINE VBO stuff -----------
-    init_vcsm_rectangle();
+    // --------- Overlay, its vertex buffer is set up on the first draw -----------
+    if (!get_overlay()) {
+        vcos_log_error("%s: Failed to create the overlay\n", VCOS_FUNCTION);  return -1;
+    }
     GLCHK(glClearColor(0.1f, 0.1f, 0.1f, 0.5));
 
     //set_glbuff_cb(do_nothing);
@@ -335,12 +489,14 @@ static int vcsm_square_init(RASPITEX_STATE *raspitex_state)
 
 static int vcsm_square_redraw(RASPITEX_STATE *raspitex_state)
 {
-    unsigned char *vcsm_buffer = NULL;
-    VCSM_CACHE_TYPE_T cache_type;
     vcos_log_trace("%s", VCOS_FUNCTION);
+    // Get a free frame buffer from the ring. This only waits on the consumer
+    // if the blocking policy was requested.
+    int slot = vcsm_ring_acquire(readback_ring);
+    if (slot < 0) { vcos_log_error("Failed to get a VCSM frame buffer\n"); return -1;}
     //glClearColor(255, 0, 0, 255);   Clear screen frame buffer which is currently bound 
     // --------------  Bind our Virtual FBO and clear it out.  Fill the viewport with the camera image
-    GLCHK(glBindFramebuffer(GL_FRAMEBUFFER, fb_name));
+    GLCHK(glBindFramebuffer(GL_FRAMEBUFFER, fb_name[slot]));
     GLCHK(glViewport(0, 0, fb_width, fb_height));
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     GLCHK(glUseProgram(vcsm_square_oes_shader.program));
@@ -352,13 +508,8 @@ static int vcsm_square_redraw(RASPITEX_STATE *raspitex_state)
     GLCHK(glDrawArrays(GL_TRIANGLES, 0, 6));
     GLCHK(glFinish());
 
-    // Make the buffer CPU addressable with host cache enabled and Modify it
-    vcsm_buffer = (unsigned char *) vcsm_lock_cache(vcsm_info.vcsm_handle, VCSM_CACHE_TYPE_HOST, &cache_type);
-    if (! vcsm_buffer) { vcos_log_error("Failed to lock VCSM buffer for handle %d\n", vcsm_info.vcsm_handle); return -1;}
-    vcos_log_trace("Locked vcsm handle %d at %p\n", vcsm_info.vcsm_handle, vcsm_buffer);
-    //vcsm_square_draw_pattern(vcsm_buffer);
-    publish_buffer(vcsm_buffer);
-    vcsm_unlock_ptr(vcsm_buffer); // Release the locked texture memory to flush the CPU cache and allow GPU to read it
+    // The frame is complete, hand it over to the consumer thread
+    vcsm_ring_publish(readback_ring, slot);
 
 
 #ifdef DRAW_RGBA_TEXTURE
@@ -374,30 +525,63 @@ static int vcsm_square_redraw(RASPITEX_STATE *raspitex_state)
     //GLCHK(glVertexAttrib2f(yuv_shader.attribute_locations[1], -1.0f, 0.0f));
     //GLCHK(glDrawArrays(GL_TRIANGLES, 0, 6));
 #else
-    // Draw the modified texture buffer to the screen
+    // Draw the modified texture buffer to the screen. The slot we just
+    // published belongs to the consumer now, show the last one it finished.
     GLCHK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    GLCHK(glViewport(raspitex_state->x, raspitex_state->y, raspitex_state->width, raspitex_state->height));
-    GLCHK(glUseProgram(vcsm_square_shader.program));
-    GLCHK(glBindTexture(GL_TEXTURE_2D, fb_tex_name));
-    GLCHK(glEnableVertexAttribArray(vcsm_square_shader.attribute_locations[0]));
-    GLCHK(glVertexAttribPointer(vcsm_square_shader.attribute_locations[0], 2, GL_FLOAT, GL_FALSE, 0, 0));
-    GLCHK(glDrawArrays(GL_TRIANGLES, 0, 6));
-    GLCHK(glDisableVertexAttribArray(vcsm_square_shader.attribute_locations[0]));
+    int shown = vcsm_ring_display(readback_ring);
+    if (shown >= 0) {
+        GLCHK(glViewport(raspitex_state->x, raspitex_state->y, raspitex_state->width, raspitex_state->height));
+        GLCHK(glUseProgram(vcsm_square_shader.program));
+        GLCHK(glBindTexture(GL_TEXTURE_2D, fb_tex_name[shown]));
+        GLCHK(glEnableVertexAttribArray(vcsm_square_shader.attribute_locations[0]));
+        GLCHK(glVertexAttribPointer(vcsm_square_shader.attribute_locations[0], 2, GL_FLOAT, GL_FALSE, 0, 0));
+        GLCHK(glDrawArrays(GL_TRIANGLES, 0, 6));
+        GLCHK(glDisableVertexAttribArray(vcsm_square_shader.attribute_locations[0]));
+    }
 #endif
     
-    for(int x =0; x < square_idx; x++) {
-        draw_vcsm_rectangle(x);
-    }
+    // Rectangles and labels, one draw call per primitive type
+    vcsm_overlay_draw(overlay, raspitex_state->width, raspitex_state->height);
     GLCHK(glUseProgram(0));
     return 0;
 }
 
+static void vcsm_square_gl_term(RASPITEX_STATE *raspitex_state)
+{
+    vcos_log_trace("%s", VCOS_FUNCTION);
+
+    // Stop the consumer before the buffers go away
+    vcsm_ring_destroy(readback_ring);
+    readback_ring = NULL;
+    free(roi_buffer);
+    roi_buffer = NULL;
+    roi_buffer_size = 0;
+
+    for (int i = 0; i < VCSM_SQUARE_SLOTS; i++) {
+        if (eglFbImage[i] != EGL_NO_IMAGE_KHR) {
+            eglDestroyImageKHR(raspitex_state->display, eglFbImage[i]);
+            eglFbImage[i] = EGL_NO_IMAGE_KHR;
+        }
+    }
+    glDeleteFramebuffers(VCSM_SQUARE_SLOTS, fb_name);
+    glDeleteTextures(VCSM_SQUARE_SLOTS, fb_tex_name);
+
+    vcos_mutex_lock(&overlay_lock);
+    vcsm_overlay_destroy(overlay);
+    vcsm_overlay_gl_renderer_destroy(&overlay_renderer);
+    overlay = NULL;
+    vcos_mutex_unlock(&overlay_lock);
+
+    raspitexutil_gl_term(raspitex_state);
+}
+
 int vcsm_square_open(RASPITEX_STATE *raspitex_state)
 {
     vcos_log_trace("%s", VCOS_FUNCTION);
     raspitex_state->ops.gl_init = vcsm_square_init;
     raspitex_state->ops.redraw = vcsm_square_redraw;
+    raspitex_state->ops.gl_term = vcsm_square_gl_term;
     raspitex_state->ops.update_y_texture = raspitexutil_update_y_texture;
     raspitex_state->ops.update_texture = raspitexutil_update_texture;
     return 0;
@@ -31,12 +31,37 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define VCSM_SQUARE_H
 
 #include "RaspiTex.h"
+#include "vcsm_ring.h"
+#include "vcsm_roi.h"
+#include "vcsm_overlay.h"
 
 int vcsm_square_open(RASPITEX_STATE *state);
+/* Red rectangle outline drawn on every frame, in window coordinates. Returns
+ * an id for remove_rectangle. */
 int set_rectangle(RASPITEX_STATE *state, int x, int y, int width, int height);
 extern "C" {
    typedef int (*buffer_cb_type)(unsigned char *);
    extern   int set_glbuff_cb(buffer_cb_type callback_fn);
+   /* Same as above but also gets the sequence number and timestamp (us) of the frame */
+   typedef int (*buffer_frame_cb_type)(unsigned char *, uint32_t, int64_t);
+   extern   int set_glbuff_frame_cb(buffer_frame_cb_type callback_fn);
+   /* Make the GL thread wait for the consumer instead of dropping frames */
+   extern   int set_glbuff_policy(int block);
+   /* Frames dropped, consumer lag, etc. */
+   extern   int get_glbuff_stats(VCSM_RING_STATS_T *stats);
+   /* Only read back these regions of the luma frame, packed one after the
+    * other, instead of handing over the whole frame. The rectangles are in
+    * pixels of the camera frame. No rectangles or no callback goes back to
+    * whole frames. */
+   typedef int (*buffer_roi_cb_type)(const unsigned char *, const VCSM_ROI_INFO_T *, unsigned int);
+   extern   int set_glbuff_roi(const VCSM_ROI_RECT_T *rects, unsigned int num,
+                               buffer_roi_cb_type callback_fn);
+   extern   void remove_rectangle(int id);
+   /* Overlay drawn over the preview. Any thread can build and submit lists of
+    * rectangles, lines and labels with the vcsm_overlay_* calls; the latest
+    * one is drawn. Valid until the GL scene terminates. */
+   extern   VCSM_OVERLAY_T *get_preview_overlay(void);
+   extern   int get_overlay_stats(VCSM_OVERLAY_STATS_T *stats, int reset);
 }
 
 #endif /* VCSM_SQUARE_H */
@@ -11,7 +11,7 @@ LIBS="-lvcsm -lmmal_core -lmmal_util -lmmal_vc_client -lvcos -lbcm_host -lbrcmGL
 
 CFLAGS="-g -fpermissive"
 
-g++  $CFLAGS $INCS $LIBS -shared gl_scenes/vcsm_square.cpp RaspiCamControl.cpp RaspiCLI.cpp RaspiHelpers.cpp RaspiStill.cpp RaspiTex.cpp RaspiTexUtil.cpp  -o libtq84.so
+g++  $CFLAGS $INCS $LIBS -shared gl_scenes/vcsm_square.cpp gl_scenes/vcsm_ring.cpp gl_scenes/vcsm_roi.cpp gl_scenes/vcsm_overlay.cpp gl_scenes/vcsm_overlay_gl.cpp RaspiCamControl.cpp RaspiCLI.cpp RaspiHelpers.cpp RaspiStill.cpp RaspiTex.cpp RaspiTexUtil.cpp  -o libtq84.so
 
 
 g++   main.cpp -ltq84 $CFLAGS $INCS $LIBS -L.
@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Times the overlay with the software renderer: draw calls and CPU time per
+ * frame for a number of boxes, each with a label, rebuilt and submitted on
+ * every frame as a tracker would.
+ *
+ *    overlay_bench [frames] [raster]
+ *
+ * With "raster" the software renderer also draws into a frame in memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gl_scenes/vcsm_overlay.h"
+
+#define BENCH_WIDTH  1280
+#define BENCH_HEIGHT 720
+
+static int64_t cpu_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench(int boxes, int frames, unsigned char *buffer)
+{
+    VCSM_OVERLAY_RENDERER_T renderer;
+    VCSM_OVERLAY_STATS_T stats;
+    VCSM_OVERLAY_T *overlay;
+    int64_t start, submit = 0, draw = 0;
+    char label[16];
+
+    if (vcsm_overlay_soft_renderer_create(&renderer, buffer, BENCH_WIDTH, BENCH_HEIGHT) ||
+            !(overlay = vcsm_overlay_create(&renderer))) {
+        fprintf(stderr, "Failed to create the overlay\n");
+        exit(1);
+    }
+
+    for (int f = 0; f < frames; f++) {
+        start = cpu_time_ns();
+        vcsm_overlay_begin(overlay);
+        for (int i = 0; i < boxes; i++) {
+            float x = (float) ((i * 37 + f) % (BENCH_WIDTH - 64));
+            float y = (float) ((i * 53) % (BENCH_HEIGHT - 64));
+            snprintf(label, sizeof(label), "ID%d", i);
+            vcsm_overlay_rect(overlay, x, y, 48, 48, VCSM_OVERLAY_RGBA(255, 0, 0, 255));
+            vcsm_overlay_label(overlay, x, y + 50, 8, label, VCSM_OVERLAY_RGBA(255, 255, 0, 255));
+        }
+        vcsm_overlay_submit(overlay);
+        submit += cpu_time_ns() - start;
+
+        start = cpu_time_ns();
+        vcsm_overlay_draw(overlay, BENCH_WIDTH, BENCH_HEIGHT);
+        draw += cpu_time_ns() - start;
+    }
+
+    vcsm_overlay_get_stats(overlay, &stats, 0);
+    printf("%5d boxes: %.1f draw calls/frame, %u vertices, %.1f us build+submit, %.1f us draw per frame\n",
+            boxes, (double) stats.draw_calls / stats.frames, stats.vertices,
+            submit / 1000.0 / frames, draw / 1000.0 / frames);
+
+    vcsm_overlay_destroy(overlay);
+    vcsm_overlay_soft_renderer_destroy(&renderer);
+}
+
+int main(int argc, char **argv)
+{
+    static const int boxes[] = { 10, 100, 1000 };
+    int frames = argc > 1 ? atoi(argv[1]) : 300;
+    unsigned char *buffer = NULL;
+
+    if (frames <= 0)
+        frames = 300;
+    if (argc > 2 && !strcmp(argv[2], "raster"))
+        buffer = (unsigned char *) calloc(BENCH_WIDTH * BENCH_HEIGHT, 4);
+
+    vcos_init();
+    printf("%d frames of %dx%d%s\n", frames, BENCH_WIDTH, BENCH_HEIGHT,
+            buffer ? ", rasterised" : "");
+    for (unsigned int i = 0; i < sizeof(boxes) / sizeof(boxes[0]); i++)
+        bench(boxes[i], frames, buffer);
+
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Exercises the readback ring with the emulated backend, no GPU needed.
+ * The main thread plays the GL thread: it fills each slot with the frame
+ * number, publishes it and takes back the last consumed slot for display.
+ *
+ *    vcsm_ring_test [frames]
+ *
+ * Returns 0 if the consumer saw every frame intact and in order, and never
+ * got hold of a slot the GL thread was rendering into or displaying.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interface/vcos/vcos.h"
+#include "gl_scenes/vcsm_ring.h"
+
+#define TEST_SLOTS       4
+#define TEST_FRAME_SIZE  4096
+#define TEST_YIELD_FRAMES 16   // Frames rendered between yields to the consumer
+
+typedef struct
+{
+    VCSM_RING_BACKEND_T *backend;
+    int displayed;          // Slot the GL thread holds for display, -1 if none
+    int rendering;          // Slot the GL thread is filling, -1 if none
+    uint32_t last_sequence;
+    uint32_t frames;
+    uint32_t delay_ms;
+    int errors;
+} TEST_STATE_T;
+
+static int test_consumer(unsigned char *buffer, const VCSM_RING_FRAME_T *frame, void *userdata)
+{
+    TEST_STATE_T *state = (TEST_STATE_T *) userdata;
+    int displayed = __atomic_load_n(&state->displayed, __ATOMIC_ACQUIRE);
+    int rendering = __atomic_load_n(&state->rendering, __ATOMIC_ACQUIRE);
+    uint32_t value;
+
+    if ((int) frame->slot == displayed || (int) frame->slot == rendering) {
+        fprintf(stderr, "frame %u: consumer got slot %u owned by the GL thread\n",
+                frame->sequence, frame->slot);
+        state->errors++;
+    }
+    if (state->frames && (int32_t) (frame->sequence - state->last_sequence) <= 0) {
+        fprintf(stderr, "frame %u: out of order, previous was %u\n",
+                frame->sequence, state->last_sequence);
+        state->errors++;
+    }
+    for (unsigned int i = 0; i < TEST_FRAME_SIZE; i += sizeof(value)) {
+        memcpy(&value, buffer + i, sizeof(value));
+        if (value != frame->sequence) {
+            fprintf(stderr, "frame %u: corrupted at byte %u (%u)\n", frame->sequence, i, value);
+            state->errors++;
+            break;
+        }
+    }
+    // Scribble over it the way a real consumer edits the frame in place
+    memset(buffer, 0xff, TEST_FRAME_SIZE);
+
+    state->last_sequence = frame->sequence;
+    state->frames++;
+    if (state->delay_ms)
+        vcos_sleep(state->delay_ms);
+    return 0;
+}
+
+static int run(const char *name, VCSM_RING_POLICY_T policy, uint32_t delay_ms, int frames)
+{
+    VCSM_RING_BACKEND_T backend;
+    VCSM_RING_STATS_T stats;
+    TEST_STATE_T state;
+    VCSM_RING_T *ring;
+    int errors = 0;
+
+    memset(&state, 0, sizeof(state));
+    state.backend = &backend;
+    state.displayed = -1;
+    state.rendering = -1;
+    state.delay_ms = delay_ms;
+
+    if (vcsm_ring_emulated_backend_create(&backend, TEST_SLOTS, TEST_FRAME_SIZE) ||
+            !(ring = vcsm_ring_create(TEST_SLOTS, policy, &backend, test_consumer, &state))) {
+        fprintf(stderr, "%s: failed to create the ring\n", name);
+        return 1;
+    }
+
+    for (int f = 0; f < frames; f++) {
+        int slot = vcsm_ring_acquire(ring);
+        if (slot < 0) {
+            fprintf(stderr, "%s: acquire failed\n", name);
+            errors++;
+            break;
+        }
+        if (slot == __atomic_load_n(&state.displayed, __ATOMIC_RELAXED)) {
+            fprintf(stderr, "%s: acquired slot %d which is on screen\n", name, slot);
+            errors++;
+        }
+        __atomic_store_n(&state.rendering, slot, __ATOMIC_RELEASE);
+
+        // The emulated backend hands out the same memory to both threads
+        unsigned char *buffer = backend.lock(backend.context, slot);
+        uint32_t value = (uint32_t) f;
+        for (unsigned int i = 0; i < TEST_FRAME_SIZE; i += sizeof(value))
+            memcpy(buffer + i, &value, sizeof(value));
+        backend.unlock(backend.context, slot, buffer);
+
+        __atomic_store_n(&state.rendering, -1, __ATOMIC_RELEASE);
+        vcsm_ring_publish(ring, slot);
+
+        // Taking the slot for display is what redraw does after publishing
+        __atomic_store_n(&state.displayed, vcsm_ring_display(ring), __ATOMIC_RELEASE);
+
+        // Give the consumer a chance to run on a single CPU, as a real GL
+        // thread would while waiting for the next frame
+        if (f % TEST_YIELD_FRAMES == TEST_YIELD_FRAMES - 1)
+            vcos_sleep(0);
+    }
+
+    // Let the consumer catch up with whatever is left in the ring
+    for (int i = 0; i < 1000; i++) {
+        vcsm_ring_get_stats(ring, &stats);
+        if (!stats.lag)
+            break;
+        vcos_sleep(1);
+    }
+    vcsm_ring_get_stats(ring, &stats);
+    vcsm_ring_destroy(ring);
+    vcsm_ring_emulated_backend_destroy(&backend);
+
+    errors += state.errors;
+    if (stats.published != (uint32_t) frames) {
+        fprintf(stderr, "%s: %u frames published, expected %d\n", name, stats.published, frames);
+        errors++;
+    }
+    if (policy == VCSM_RING_POLICY_BLOCK && (stats.dropped || stats.consumed != (uint32_t) frames)) {
+        fprintf(stderr, "%s: %u consumed, %u dropped with the blocking policy\n",
+                name, stats.consumed, stats.dropped);
+        errors++;
+    }
+    if (policy == VCSM_RING_POLICY_DROP_OLDEST && stats.blocked) {
+        fprintf(stderr, "%s: GL thread blocked %u times with the drop-oldest policy\n",
+                name, stats.blocked);
+        errors++;
+    }
+    // Otherwise the checks in the consumer never ran
+    if (!stats.consumed || state.frames != stats.consumed) {
+        fprintf(stderr, "%s: consumer saw %u frames, %u consumed\n", name, state.frames, stats.consumed);
+        errors++;
+    }
+    if (stats.published != stats.consumed + stats.dropped + stats.lag) {
+        fprintf(stderr, "%s: %u published but %u consumed, %u dropped and %u pending\n",
+                name, stats.published, stats.consumed, stats.dropped, stats.lag);
+        errors++;
+    }
+
+    printf("%-12s %s: %u published, %u consumed, %u dropped, %u blocked\n", name,
+            errors ? "FAILED" : "ok", stats.published, stats.consumed, stats.dropped, stats.blocked);
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    int errors = 0;
+
+    if (frames <= 0)
+        frames = 2000;
+
+    vcos_init();
+    errors += run("block", VCSM_RING_POLICY_BLOCK, 0, frames);
+    errors += run("block-slow", VCSM_RING_POLICY_BLOCK, 1, frames / 10);
+    errors += run("drop", VCSM_RING_POLICY_DROP_OLDEST, 0, frames);
+    errors += run("drop-slow", VCSM_RING_POLICY_DROP_OLDEST, 1, frames);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,203 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Checks the region of interest layout, row ranges and copy, no GPU needed.
+ *
+ *    vcsm_roi_test
+ *
+ * Returns 0 if every check passed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gl_scenes/vcsm_roi.h"
+
+#define TEST_WIDTH   64
+#define TEST_HEIGHT  48
+#define TEST_BPP     4
+
+static int errors;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); errors++; } \
+} while (0)
+
+static void test_init(void)
+{
+    VCSM_ROI_RECT_T rects[VCSM_ROI_MAX + 1];
+    VCSM_ROI_SET_T set;
+
+    memset(rects, 0, sizeof(rects));
+    rects[0].x = 2; rects[0].y = 3; rects[0].width = 5; rects[0].height = 2;        // Inside
+    rects[1].x = -4; rects[1].y = -2; rects[1].width = 10; rects[1].height = 6;     // Top left clipped
+    rects[2].x = TEST_WIDTH - 3; rects[2].y = TEST_HEIGHT - 1; rects[2].width = 8; rects[2].height = 8; // Bottom right clipped
+    rects[3].x = TEST_WIDTH; rects[3].y = 0; rects[3].width = 4; rects[3].height = 4; // Outside
+    rects[4].x = 1; rects[4].y = 1; rects[4].width = 3; rects[4].height = 1;        // Odd size, 1 byte per pixel below
+
+    CHECK(vcsm_roi_set_init(&set, rects, 4, TEST_WIDTH, TEST_HEIGHT, TEST_BPP) == 0);
+    CHECK(set.num == 4);
+
+    CHECK(set.roi[0].rect.x == 2 && set.roi[0].rect.y == 3);
+    CHECK(set.roi[0].rect.width == 5 && set.roi[0].rect.height == 2);
+    CHECK(set.roi[0].stride == 5 * TEST_BPP && set.roi[0].offset == 0);
+
+    CHECK(set.roi[1].rect.x == 0 && set.roi[1].rect.y == 0);
+    CHECK(set.roi[1].rect.width == 6 && set.roi[1].rect.height == 4);
+    CHECK(set.roi[1].offset == 5 * TEST_BPP * 2);
+
+    CHECK(set.roi[2].rect.x == TEST_WIDTH - 3 && set.roi[2].rect.y == TEST_HEIGHT - 1);
+    CHECK(set.roi[2].rect.width == 3 && set.roi[2].rect.height == 1);
+    CHECK(set.roi[2].offset == set.roi[1].offset + 6 * TEST_BPP * 4);
+
+    CHECK(set.roi[3].rect.width == 0 && set.roi[3].rect.height == 0 && set.roi[3].stride == 0);
+    CHECK(set.roi[3].offset == set.roi[2].offset + 3 * TEST_BPP);
+    CHECK(set.size == set.roi[3].offset);
+
+    // Regions start on a 4 byte boundary whatever their size
+    CHECK(vcsm_roi_set_init(&set, &rects[4], 2, TEST_WIDTH, TEST_HEIGHT, 1) == 0);
+    CHECK(set.roi[0].stride == 3 && set.roi[1].offset == 4);
+    CHECK(set.size == 4);
+
+    CHECK(vcsm_roi_set_init(&set, rects, VCSM_ROI_MAX + 1, TEST_WIDTH, TEST_HEIGHT, TEST_BPP) == -1);
+    CHECK(vcsm_roi_set_init(&set, NULL, 1, TEST_WIDTH, TEST_HEIGHT, TEST_BPP) == -1);
+    CHECK(vcsm_roi_set_init(&set, rects, 1, TEST_WIDTH, TEST_HEIGHT, 0) == -1);
+    CHECK(vcsm_roi_set_init(&set, NULL, 0, TEST_WIDTH, TEST_HEIGHT, TEST_BPP) == 0);
+    CHECK(set.num == 0 && set.size == 0);
+}
+
+static void test_rows(void)
+{
+    VCSM_ROI_RECT_T rects[VCSM_ROI_MAX];
+    int first[VCSM_ROI_MAX], count[VCSM_ROI_MAX];
+    VCSM_ROI_SET_T set;
+    unsigned int n, i;
+
+    // Out of order, overlapping, touching, apart and empty
+    memset(rects, 0, sizeof(rects));
+    rects[0].y = 30; rects[0].height = 5;  rects[0].width = 1;
+    rects[1].y = 2;  rects[1].height = 4;  rects[1].width = 1;
+    rects[2].y = 4;  rects[2].height = 10; rects[2].width = 1;  // Overlaps 2..6
+    rects[3].y = 14; rects[3].height = 2;  rects[3].width = 1;  // Touches 4..14
+    rects[4].y = 20; rects[4].height = 0;  rects[4].width = 1;  // Empty
+    rects[5].y = 31; rects[5].height = 1;  rects[5].width = 1;  // Inside 30..35
+
+    CHECK(vcsm_roi_set_init(&set, rects, 6, TEST_WIDTH, TEST_HEIGHT, TEST_BPP) == 0);
+    n = vcsm_roi_set_rows(&set, first, count, VCSM_ROI_MAX);
+    CHECK(n == 2);
+    CHECK(first[0] == 2 && count[0] == 14);
+    CHECK(first[1] == 30 && count[1] == 5);
+
+    // Running out of ranges extends the last one to cover the rest
+    n = vcsm_roi_set_rows(&set, first, count, 1);
+    CHECK(n == 1);
+    CHECK(first[0] == 2 && count[0] == 33);
+    CHECK(vcsm_roi_set_rows(&set, first, count, 0) == 0);
+
+    // One range per region when they are all apart
+    for (i = 0; i < VCSM_ROI_MAX; i++) {
+        rects[i].x = 0; rects[i].width = 1;
+        rects[i].y = (VCSM_ROI_MAX - 1 - i) * 3; rects[i].height = 1;
+    }
+    CHECK(vcsm_roi_set_init(&set, rects, VCSM_ROI_MAX, TEST_WIDTH, TEST_HEIGHT, TEST_BPP) == 0);
+    n = vcsm_roi_set_rows(&set, first, count, VCSM_ROI_MAX);
+    CHECK(n == VCSM_ROI_MAX);
+    for (i = 0; i < n; i++)
+        CHECK(first[i] == (int) i * 3 && count[i] == 1);
+
+    CHECK(vcsm_roi_set_init(&set, NULL, 0, TEST_WIDTH, TEST_HEIGHT, TEST_BPP) == 0);
+    CHECK(vcsm_roi_set_rows(&set, first, count, VCSM_ROI_MAX) == 0);
+}
+
+static void test_copy(void)
+{
+    const size_t stride = TEST_WIDTH * TEST_BPP + 16;   // Padded rows
+    VCSM_ROI_RECT_T rects[3];
+    VCSM_ROI_SET_T set;
+    unsigned char *frame, *out;
+    unsigned int i;
+    int x, y, b;
+
+    frame = (unsigned char *) malloc(stride * TEST_HEIGHT);
+    if (!frame) {
+        CHECK(frame != NULL);
+        return;
+    }
+    for (y = 0; y < TEST_HEIGHT; y++)
+        for (x = 0; x < (int) stride; x++)
+            frame[y * stride + x] = (unsigned char) (y * 7 + x);
+
+    memset(rects, 0, sizeof(rects));
+    rects[0].x = 3; rects[0].y = 5; rects[0].width = 7; rects[0].height = 3;
+    rects[1].x = TEST_WIDTH - 2; rects[1].y = TEST_HEIGHT - 2; rects[1].width = 4; rects[1].height = 4;
+    rects[2].x = -10; rects[2].y = -10; rects[2].width = 5; rects[2].height = 5;  // Clipped away
+    CHECK(vcsm_roi_set_init(&set, rects, 3, TEST_WIDTH, TEST_HEIGHT, TEST_BPP) == 0);
+
+    // Guard bytes catch writes past the packed buffer
+    out = (unsigned char *) malloc(set.size + 16);
+    if (!out) {
+        CHECK(out != NULL);
+        free(frame);
+        return;
+    }
+    memset(out, 0xa5, set.size + 16);
+
+    vcsm_roi_copy(&set, frame, stride, out, 42, 1234567);
+
+    for (i = 0; i < set.num; i++) {
+        const VCSM_ROI_INFO_T *roi = &set.roi[i];
+
+        CHECK(roi->sequence == 42 && roi->timestamp == 1234567);
+        for (y = 0; y < roi->rect.height; y++)
+            for (b = 0; b < roi->rect.width * TEST_BPP; b++) {
+                unsigned char expected = frame[(roi->rect.y + y) * stride + roi->rect.x * TEST_BPP + b];
+                if (out[roi->offset + y * roi->stride + b] != expected) {
+                    fprintf(stderr, "region %u: byte %d of row %d is %u, expected %u\n", i, b, y,
+                            out[roi->offset + y * roi->stride + b], expected);
+                    errors++;
+                    y = roi->rect.height;
+                    break;
+                }
+            }
+    }
+    for (i = 0; i < 16; i++)
+        CHECK(out[set.size + i] == 0xa5);
+
+    free(out);
+    free(frame);
+}
+
+int main(void)
+{
+    test_init();
+    test_rows();
+    test_copy();
+
+    printf("vcsm_roi_test %s\n", errors ? "FAILED" : "ok");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* Microbenchmark of the user-vcsm payload lookups, by handle and by user
+ * address, with a number of buffers allocated and several threads looking
+ * them up at once. Runs against the anonymous memory backend unless
+ * VCSM_BACKEND says otherwise, so no VideoCore is needed.
+ *
+ * Usage: vcsm_bench_lookup [lookups per thread] [buffers] */
+
+#include "interface/vcos/vcos.h"
+#include "host_applications/linux/libs/sm/user-vcsm.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_BUFFER_SIZE 4096
+#define BENCH_THREADS_MAX 8
+
+typedef struct BENCH_T
+{
+   unsigned int *handles;
+   void **ptrs;
+   unsigned int buffers;
+   unsigned int per_thread;
+   int by_address;
+   uint32_t failed;
+} BENCH_T;
+
+static void *bench_thread(void *arg)
+{
+   BENCH_T *bench = (BENCH_T *)arg;
+   unsigned int seed = (unsigned int)(uintptr_t)&seed, i, j;
+
+   for (i = 0; i < bench->per_thread; i++)
+   {
+      seed = seed * 1103515245 + 12345;
+      j = (seed >> 8) % bench->buffers;
+      if (bench->by_address ? vcsm_usr_handle(bench->ptrs[j]) != bench->handles[j] :
+                              vcsm_usr_address(bench->handles[j]) != bench->ptrs[j])
+         __atomic_fetch_add(&bench->failed, 1, __ATOMIC_RELAXED);
+   }
+   return NULL;
+}
+
+static void bench_run(BENCH_T *bench, unsigned int threads, int by_address)
+{
+   VCOS_THREAD_T thread[BENCH_THREADS_MAX];
+   uint64_t start, elapsed;
+   unsigned int i;
+   void *ret;
+
+   bench->by_address = by_address;
+   bench->failed = 0;
+
+   start = vcos_getmicrosecs64();
+   for (i = 0; i < threads; i++)
+      vcos_thread_create(&thread[i], "bench", NULL, bench_thread, bench);
+   for (i = 0; i < threads; i++)
+      vcos_thread_join(&thread[i], &ret);
+   elapsed = vcos_getmicrosecs64() - start;
+
+   printf("by %-7s %u threads: %10.0f lookups/s (%u failed)\n",
+          by_address ? "address" : "handle", threads,
+          elapsed ? bench->per_thread * threads * 1000000.0 / elapsed : 0.0,
+          bench->failed);
+}
+
+int main(int argc, char **argv)
+{
+   static const unsigned int threads[] = {1, 2, 4, 8};
+   BENCH_T bench;
+   unsigned int i;
+
+   bench.per_thread = argc > 1 ? atoi(argv[1]) : 1000000;
+   bench.buffers = argc > 2 ? atoi(argv[2]) : 1024;
+   if (!bench.per_thread || !bench.buffers)
+   {
+      fprintf(stderr, "usage: %s [lookups per thread] [buffers]\n", argv[0]);
+      return -1;
+   }
+
+   setenv("VCSM_BACKEND", "anon", 0);
+   vcos_init();
+   if (vcsm_init())
+   {
+      fprintf(stderr, "failed to initialise vcsm\n");
+      return -1;
+   }
+
+   bench.handles = calloc(bench.buffers, sizeof(*bench.handles));
+   bench.ptrs = calloc(bench.buffers, sizeof(*bench.ptrs));
+   if (!bench.handles || !bench.ptrs)
+      return -1;
+   for (i = 0; i < bench.buffers; i++)
+   {
+      bench.handles[i] = vcsm_malloc(BENCH_BUFFER_SIZE, "bench");
+      bench.ptrs[i] = bench.handles[i] ? vcsm_usr_address(bench.handles[i]) : NULL;
+      if (!bench.ptrs[i])
+      {
+         fprintf(stderr, "failed to allocate buffer %u\n", i);
+         return -1;
+      }
+   }
+   printf("%u buffers\n", bench.buffers);
+
+   for (i = 0; i < vcos_countof(threads); i++)
+   {
+      bench_run(&bench, threads[i], 0);
+      bench_run(&bench, threads[i], 1);
+   }
+
+   for (i = 0; i < bench.buffers; i++)
+      vcsm_free(bench.handles[i]);
+   free(bench.handles);
+   free(bench.ptrs);
+   vcsm_exit();
+   vcos_deinit();
+   return 0;
+}
@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Test of the user-vcsm payload tables mapping handles to user addresses and
+ * back, on the anonymous memory backend. Lookups are made while no stripe has
+ * a table yet, then the first allocation is made with bucket allocations
+ * failing, which must fail rather than link the buffer into a stripe it
+ * couldn't reserve. Enough buffers are then allocated for the tables to grow
+ * a few times, and half of them are reallocated with bucket allocations
+ * failing again, which must only make the chains longer.
+ *
+ * Usage: vcsm_payload_test [buffers] */
+
+#include "interface/vcos/vcos.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int fail_buckets;
+
+static void *test_calloc(size_t num, size_t size, const char *description)
+{
+   if (fail_buckets && !strcmp(description, "vcsm_payload_buckets"))
+      return NULL;
+   return vcos_calloc(num, size, description);
+}
+
+#undef vcos_calloc
+#define vcos_calloc test_calloc
+#include "host_applications/linux/libs/sm/user-vcsm.c"
+#include "interface/vcos/test/vcos_test_check.h"
+
+static void check_found(unsigned int handle, void *ptr)
+{
+   CHECK(vcsm_usr_address(handle) == ptr, "handle %u doesn't map to %p", handle, ptr);
+   CHECK(vcsm_usr_handle(ptr) == handle, "%p doesn't map to handle %u", ptr, handle);
+   CHECK(vcsm_vc_hdl_from_ptr(ptr) == vcsm_vc_hdl_from_hdl(handle),
+         "VC handles of %u and %p differ", handle, ptr);
+   CHECK(vcsm_vc_hdl_from_hdl(handle) != 0, "handle %u has no VC handle", handle);
+}
+
+int main(int argc, char **argv)
+{
+   unsigned int buffers = argc > 1 ? atoi(argv[1]) : 1000;
+   unsigned int *handles;
+   void **ptrs;
+   unsigned int i;
+
+   if (!buffers)
+   {
+      fprintf(stderr, "usage: %s [buffers]\n", argv[0]);
+      return -1;
+   }
+
+   setenv("VCSM_BACKEND", "anon", 1);
+   vcos_init();
+   if (vcsm_init())
+   {
+      printf("FAIL: couldn't initialise vcsm\n");
+      return 1;
+   }
+
+   handles = calloc(buffers, sizeof(*handles));
+   ptrs = calloc(buffers, sizeof(*ptrs));
+   if (!handles || !ptrs)
+      return 1;
+
+   /* Lookups have to cope with stripes which have no table at all */
+   CHECK(vcsm_usr_handle(&handles) == 0, "address found before any allocation");
+   CHECK(vcsm_usr_address(1) == NULL, "handle found before any allocation");
+
+   /* Without any tables the allocation has to fail cleanly */
+   fail_buckets = 1;
+   handles[0] = vcsm_malloc(4096, "test");
+   CHECK(!handles[0], "allocation succeeded without a table to track it");
+   fail_buckets = 0;
+   CHECK(vcsm_usr_address(1) == NULL, "handle found after a failed allocation");
+
+   /* Enough buffers for every stripe's tables to grow a few times */
+   for (i = 0; i < buffers; i++)
+   {
+      handles[i] = vcsm_malloc(4096 * (1 + i % 3), "test");
+      ptrs[i] = handles[i] ? vcsm_usr_address(handles[i]) : NULL;
+      CHECK(handles[i] && ptrs[i], "couldn't allocate buffer %u", i);
+      if (!ptrs[i])
+         return 1;
+   }
+   for (i = 0; i < buffers; i++)
+      check_found(handles[i], ptrs[i]);
+
+   /* Once the tables exist, failing to grow them only makes chains longer */
+   fail_buckets = 1;
+   for (i = 0; i < buffers; i += 2)
+   {
+      vcsm_free(handles[i]);
+      CHECK(vcsm_usr_address(handles[i]) == NULL, "freed handle %u still found", handles[i]);
+      handles[i] = vcsm_malloc(4096, "test");
+      ptrs[i] = handles[i] ? vcsm_usr_address(handles[i]) : NULL;
+      CHECK(ptrs[i], "couldn't reallocate buffer %u without growing", i);
+      if (!ptrs[i])
+         return 1;
+   }
+   fail_buckets = 0;
+   for (i = 0; i < buffers; i++)
+      check_found(handles[i], ptrs[i]);
+
+   /* Lookups of things which were never allocated */
+   CHECK(vcsm_usr_handle(&handles) == 0, "stack address has a handle");
+   CHECK(vcsm_usr_address(0x7fffffff) == NULL, "made up handle has an address");
+
+   for (i = 0; i < buffers; i++)
+      vcsm_free(handles[i]);
+   for (i = 0; i < buffers; i++)
+      CHECK(vcsm_usr_handle(ptrs[i]) == 0, "%p still found after free", ptrs[i]);
+
+   free(handles);
+   free(ptrs);
+   vcsm_exit();
+
+   printf("%u buffers: %s\n", buffers, check_errors ? "FAILED" : "ok");
+   return check_errors ? 1 : 0;
+}
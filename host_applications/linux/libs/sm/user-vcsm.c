@@ -34,6 +34,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 
 #include <vmcs_sm_ioctl.h>
@@ -66,119 +68,392 @@ static unsigned int vcsm_page_size = 0;
 static VCOS_ONCE_T vcsm_once = VCOS_ONCE_INIT;
 static VCOS_MUTEX_T vcsm_mutex;
 
-#define VCSM_PAYLOAD_ELEM_MAX 512
+/* Payloads allocated through vc-sm-cma are tracked in hash tables keyed both
+** by user handle and by user address. The tables are split into stripes, each
+** with its own lock, so that lookups on different buffers don't contend.
+** The dmabuf fd of a payload is always its handle minus one, so the handle
+** table also serves lookups by fd.
+**
+** Elements are never given back to the heap, only recycled, as the lookups
+** hand them out without holding any lock.
+*/
+#define VCSM_PAYLOAD_STRIPES 16      /* Must be a power of 2 */
+#define VCSM_PAYLOAD_MIN_BUCKETS 16  /* Per stripe, must be a power of 2 */
 
 typedef struct VCSM_PAYLOAD_ELEM_T
 {
+   struct VCSM_PAYLOAD_ELEM_T *next_mem;     // Next in the user address chain
+   struct VCSM_PAYLOAD_ELEM_T *next_handle;  // Next in the handle chain, also
+                                             // used for the free list
    unsigned int handle;    // User handle
    int fd;                 // vcsm-cma / dmabuf fd (= user handle-1)
    uint32_t vc_handle;     // VPU reloc heap handle
    uint8_t *mem;           // mmap'ed address
    unsigned int size;      // size of mmap
-   int in_use;
 } VCSM_PAYLOAD_ELEM_T;
 
-typedef struct VCSM_PAYLOAD_LIST_T
+typedef struct VCSM_PAYLOAD_STRIPE_T
 {
-   VCSM_PAYLOAD_ELEM_T list[VCSM_PAYLOAD_ELEM_MAX];
    VCOS_MUTEX_T lock;
-   struct VCSM_PAYLOAD_LIST_T *next;
+   VCSM_PAYLOAD_ELEM_T **by_mem;
+   VCSM_PAYLOAD_ELEM_T **by_handle;
+   unsigned int mem_buckets, mem_count;
+   unsigned int handle_buckets, handle_count;
+} VCSM_PAYLOAD_STRIPE_T;
+
+typedef struct VCSM_PAYLOAD_LIST_T
+{
+   VCSM_PAYLOAD_STRIPE_T stripe[VCSM_PAYLOAD_STRIPES];
+   VCOS_MUTEX_T lock;               // Protects the free list
+   VCSM_PAYLOAD_ELEM_T *free;
 } VCSM_PAYLOAD_LIST_T;
 
 static VCSM_PAYLOAD_LIST_T vcsm_payload_list;
 
+static inline unsigned int vcsm_payload_hash(uintptr_t key)
+{
+   uint64_t k = key;
+   /* Fold in the high bits so that both page aligned addresses and small
+   ** handle values spread out.
+   */
+   k = (k ^ (k >> 29)) * UINT64_C(0x9e3779b97f4a7c15);
+   return (unsigned int)(k >> 32);
+}
+
+static VCSM_PAYLOAD_STRIPE_T *vcsm_payload_stripe(unsigned int hash)
+{
+   return &vcsm_payload_list.stripe[hash & (VCSM_PAYLOAD_STRIPES - 1)];
+}
+
 static void vcsm_payload_list_init(void)
 {
+   unsigned int i;
+
    vcos_mutex_create(&vcsm_payload_list.lock, "vcsm_payload_list");
+   for (i = 0; i < VCSM_PAYLOAD_STRIPES; i++)
+      vcos_mutex_create(&vcsm_payload_list.stripe[i].lock, "vcsm_payload_stripe");
 }
 
 static VCSM_PAYLOAD_ELEM_T *vcsm_payload_list_get()
 {
-   VCSM_PAYLOAD_ELEM_T *elem = 0;
-   unsigned int i;
+   VCSM_PAYLOAD_ELEM_T *elem;
 
    vcos_mutex_lock(&vcsm_payload_list.lock);
-   for (i = 0; i < VCSM_PAYLOAD_ELEM_MAX; i++)
-   {
-      if (vcsm_payload_list.list[i].in_use)
-         continue;
-      elem = &vcsm_payload_list.list[i];
-      elem->in_use = 1;
-      break;
-   }
+   elem = vcsm_payload_list.free;
+   if (elem)
+      vcsm_payload_list.free = elem->next_handle;
    vcos_mutex_unlock(&vcsm_payload_list.lock);
 
+   if (!elem)
+      elem = vcos_malloc(sizeof(*elem), "vcsm_payload_elem");
+   if (elem)
+      memset(elem, 0, sizeof(*elem));
    return elem;
 }
 
-static void vcsm_payload_list_release(VCSM_PAYLOAD_ELEM_T *elem)
+static void vcsm_payload_list_put(VCSM_PAYLOAD_ELEM_T *elem)
 {
    vcos_mutex_lock(&vcsm_payload_list.lock);
-   elem->handle = elem->vc_handle = elem->fd = 0;
-   elem->mem = NULL;
-   elem->in_use = 0;
+   elem->next_handle = vcsm_payload_list.free;
+   vcsm_payload_list.free = elem;
    vcos_mutex_unlock(&vcsm_payload_list.lock);
 }
 
-static VCSM_PAYLOAD_ELEM_T *vcsm_payload_list_find_mem(void *mem)
+/* Resize one of a stripe's tables to twice its size, or to the minimum size
+** if it hasn't got one yet. Called with the stripe locked. On allocation
+** failure the table is left as it was, which may mean still without any
+** buckets, so callers have to check before indexing it.
+*/
+static void vcsm_payload_stripe_grow(VCSM_PAYLOAD_ELEM_T ***table,
+   unsigned int *num_buckets, int by_mem)
 {
-   VCSM_PAYLOAD_ELEM_T *elem = 0;
+   unsigned int new_num = *num_buckets ? *num_buckets * 2 : VCSM_PAYLOAD_MIN_BUCKETS;
+   VCSM_PAYLOAD_ELEM_T **new_table;
    unsigned int i;
 
-   vcos_mutex_lock(&vcsm_payload_list.lock);
-   for (i = 0; i < VCSM_PAYLOAD_ELEM_MAX; i++)
+   new_table = vcos_calloc(new_num, sizeof(*new_table), "vcsm_payload_buckets");
+   if (!new_table)
+      return;
+
+   for (i = 0; i < *num_buckets; i++)
    {
-      if (!vcsm_payload_list.list[i].in_use)
-         continue;
-      if (vcsm_payload_list.list[i].mem != mem)
+      VCSM_PAYLOAD_ELEM_T *elem = (*table)[i], *next;
+      for (; elem; elem = next)
+      {
+         unsigned int bucket;
+         if (by_mem)
+         {
+            next = elem->next_mem;
+            bucket = (vcsm_payload_hash((uintptr_t)elem->mem) / VCSM_PAYLOAD_STRIPES) & (new_num - 1);
+            elem->next_mem = new_table[bucket];
+         }
+         else
+         {
+            next = elem->next_handle;
+            bucket = (vcsm_payload_hash(elem->handle) / VCSM_PAYLOAD_STRIPES) & (new_num - 1);
+            elem->next_handle = new_table[bucket];
+         }
+         new_table[bucket] = elem;
+      }
+   }
+
+   vcos_free(*table);
+   *table = new_table;
+   *num_buckets = new_num;
+}
+
+/* Make sure the stripe has both its tables. They never shrink, so once this
+** has succeeded for a stripe the element can always be linked in. Returns 0
+** on success, -1 if there wasn't the memory.
+**
+** Unlike mmal_vc_shm, whose tables are allocated when it is initialised and
+** whose init fails without them, the tables here are only allocated when the
+** first buffer needs them: they are only used with vc-sm-cma, which isn't
+** known until vcsm_init_ex has opened a device, and vcsm_payload_list_init
+** runs under vcos_once where it can't report a failure. A process on the
+** older driver never pays for them, and running out of memory fails the
+** allocation needing the table rather than vcsm_init.
+*/
+static int vcsm_payload_stripe_reserve(VCSM_PAYLOAD_STRIPE_T *stripe)
+{
+   int ret;
+
+   vcos_mutex_lock(&stripe->lock);
+   if (!stripe->mem_buckets)
+      vcsm_payload_stripe_grow(&stripe->by_mem, &stripe->mem_buckets, 1);
+   if (!stripe->handle_buckets)
+      vcsm_payload_stripe_grow(&stripe->by_handle, &stripe->handle_buckets, 0);
+   ret = stripe->mem_buckets && stripe->handle_buckets ? 0 : -1;
+   vcos_mutex_unlock(&stripe->lock);
+
+   return ret;
+}
+
+/* Make an element with its handle and address filled in findable. Returns 0
+** on success, -1 if the tables couldn't be allocated.
+*/
+static int vcsm_payload_list_add(VCSM_PAYLOAD_ELEM_T *elem)
+{
+   unsigned int hash = vcsm_payload_hash((uintptr_t)elem->mem);
+   VCSM_PAYLOAD_STRIPE_T *stripe = vcsm_payload_stripe(hash);
+   unsigned int bucket;
+
+   if (vcsm_payload_stripe_reserve(stripe) ||
+       vcsm_payload_stripe_reserve(vcsm_payload_stripe(vcsm_payload_hash(elem->handle))))
+      return -1;
+
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->mem_count >= stripe->mem_buckets)
+      vcsm_payload_stripe_grow(&stripe->by_mem, &stripe->mem_buckets, 1);
+   bucket = (hash / VCSM_PAYLOAD_STRIPES) & (stripe->mem_buckets - 1);
+   elem->next_mem = stripe->by_mem[bucket];
+   stripe->by_mem[bucket] = elem;
+   stripe->mem_count++;
+   vcos_mutex_unlock(&stripe->lock);
+
+   hash = vcsm_payload_hash(elem->handle);
+   stripe = vcsm_payload_stripe(hash);
+
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->handle_count >= stripe->handle_buckets)
+      vcsm_payload_stripe_grow(&stripe->by_handle, &stripe->handle_buckets, 0);
+   bucket = (hash / VCSM_PAYLOAD_STRIPES) & (stripe->handle_buckets - 1);
+   elem->next_handle = stripe->by_handle[bucket];
+   stripe->by_handle[bucket] = elem;
+   stripe->handle_count++;
+   vcos_mutex_unlock(&stripe->lock);
+
+   return 0;
+}
+
+/* Find the element for a handle and take it out of both tables. Only one
+** caller can remove a given element.
+*/
+static VCSM_PAYLOAD_ELEM_T *vcsm_payload_list_remove(unsigned int handle)
+{
+   unsigned int hash = vcsm_payload_hash(handle);
+   VCSM_PAYLOAD_STRIPE_T *stripe = vcsm_payload_stripe(hash);
+   VCSM_PAYLOAD_ELEM_T *elem = NULL, **link;
+
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->handle_buckets)
+   {
+      link = &stripe->by_handle[(hash / VCSM_PAYLOAD_STRIPES) & (stripe->handle_buckets - 1)];
+      for (; *link; link = &(*link)->next_handle)
+      {
+         if ((*link)->handle != handle)
+            continue;
+         elem = *link;
+         *link = elem->next_handle;
+         stripe->handle_count--;
+         break;
+      }
+   }
+   vcos_mutex_unlock(&stripe->lock);
+
+   if (!elem)
+      return NULL;
+
+   hash = vcsm_payload_hash((uintptr_t)elem->mem);
+   stripe = vcsm_payload_stripe(hash);
+
+   vcos_mutex_lock(&stripe->lock);
+   link = &stripe->by_mem[(hash / VCSM_PAYLOAD_STRIPES) & (stripe->mem_buckets - 1)];
+   for (; *link; link = &(*link)->next_mem)
+   {
+      if (*link != elem)
          continue;
-      elem = &vcsm_payload_list.list[i];
+      *link = elem->next_mem;
+      stripe->mem_count--;
       break;
    }
-   vcos_mutex_unlock(&vcsm_payload_list.lock);
+   vcos_mutex_unlock(&stripe->lock);
 
    return elem;
 }
 
-static VCSM_PAYLOAD_ELEM_T *vcsm_payload_list_find_handle(unsigned int handle)
+static VCSM_PAYLOAD_ELEM_T *vcsm_payload_list_find_mem(void *mem)
 {
-   VCSM_PAYLOAD_ELEM_T *elem = 0;
-   unsigned int i;
+   unsigned int hash = vcsm_payload_hash((uintptr_t)mem);
+   VCSM_PAYLOAD_STRIPE_T *stripe = vcsm_payload_stripe(hash);
+   VCSM_PAYLOAD_ELEM_T *elem = NULL;
 
-   vcos_mutex_lock(&vcsm_payload_list.lock);
-   for (i = 0; i < VCSM_PAYLOAD_ELEM_MAX; i++)
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->mem_buckets)
    {
-      if (!vcsm_payload_list.list[i].in_use)
-         continue;
-      if (vcsm_payload_list.list[i].handle != handle)
-         continue;
-      elem = &vcsm_payload_list.list[i];
-      break;
+      elem = stripe->by_mem[(hash / VCSM_PAYLOAD_STRIPES) & (stripe->mem_buckets - 1)];
+      while (elem && elem->mem != mem)
+         elem = elem->next_mem;
    }
-   vcos_mutex_unlock(&vcsm_payload_list.lock);
+   vcos_mutex_unlock(&stripe->lock);
 
    return elem;
 }
 
-/*static VCSM_PAYLOAD_ELEM_T *vcsm_payload_list_find_vc_handle(uint32_t vc_handle)
+static VCSM_PAYLOAD_ELEM_T *vcsm_payload_list_find_handle(unsigned int handle)
 {
-   VCSM_PAYLOAD_ELEM_T *elem = 0;
-   unsigned int i;
+   unsigned int hash = vcsm_payload_hash(handle);
+   VCSM_PAYLOAD_STRIPE_T *stripe = vcsm_payload_stripe(hash);
+   VCSM_PAYLOAD_ELEM_T *elem = NULL;
 
-   vcos_mutex_lock(&vcsm_payload_list.lock);
-   for (i = 0; i < VCSM_PAYLOAD_ELEM_MAX; i++)
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->handle_buckets)
    {
-      if (!vcsm_payload_list.list[i].in_use)
-         continue;
-      if (vcsm_payload_list.list[i].vc_handle != vc_handle)
-         continue;
-      elem = &vcsm_payload_list.list[i];
-      break;
+      elem = stripe->by_handle[(hash / VCSM_PAYLOAD_STRIPES) & (stripe->handle_buckets - 1)];
+      while (elem && elem->handle != handle)
+         elem = elem->next_handle;
    }
-   vcos_mutex_unlock(&vcsm_payload_list.lock);
+   vcos_mutex_unlock(&stripe->lock);
 
    return elem;
-}*/
+}
+
+/* Backend used to reach vc-sm-cma. Besides the kernel driver, payloads can be
+** backed by anonymous memory (memfd) so that the library can be exercised and
+** timed on any Linux machine. Setting VCSM_BACKEND=anon in the environment
+** selects the latter, which always behaves as vc-sm-cma.
+*/
+typedef struct VCSM_BACKEND_T
+{
+   const char *name;
+   int emulated;
+   int (*open)(void);
+   int (*ioctl)(int fd, unsigned long request, void *arg);
+} VCSM_BACKEND_T;
+
+static int vcsm_cma_open(void)
+{
+   return open( VCSM_CMA_DEVICE_NAME, O_RDWR, 0 );
+}
+
+static int vcsm_cma_ioctl(int fd, unsigned long request, void *arg)
+{
+   return ioctl( fd, request, arg );
+}
+
+static const VCSM_BACKEND_T vcsm_cma_backend =
+{
+   "vc-sm-cma", 0, vcsm_cma_open, vcsm_cma_ioctl
+};
+
+static uint32_t vcsm_anon_vc_handle;
+
+static int vcsm_anon_open(void)
+{
+   return open( "/dev/null", O_RDWR, 0 );
+}
+
+static int vcsm_anon_ioctl(int fd, unsigned long request, void *arg)
+{
+   if (request == VC_SM_CMA_IOCTL_MEM_ALLOC)
+   {
+      struct vc_sm_cma_ioctl_alloc *alloc = arg;
+#ifdef SYS_memfd_create
+      alloc->handle = syscall( SYS_memfd_create, "vcsm", 0 );
+#else
+      alloc->handle = -1;
+      errno = ENOSYS;
+#endif
+      if (alloc->handle < 0)
+         return -1;
+      if (ftruncate( alloc->handle, alloc->size ) < 0)
+      {
+         close( alloc->handle );
+         alloc->handle = -1;
+         return -1;
+      }
+      alloc->vc_handle = __sync_add_and_fetch( &vcsm_anon_vc_handle, 1 );
+      alloc->dma_addr = 0;
+      return 0;
+   }
+   else if (request == VC_SM_CMA_IOCTL_MEM_IMPORT_DMABUF)
+   {
+      struct vc_sm_cma_ioctl_import_dmabuf *import = arg;
+      struct stat st;
+
+      if (fstat( import->dmabuf_fd, &st ) < 0)
+         return -1;
+      import->handle = dup( import->dmabuf_fd );
+      if (import->handle < 0)
+         return -1;
+      import->size = st.st_size;
+      import->vc_handle = __sync_add_and_fetch( &vcsm_anon_vc_handle, 1 );
+      import->dma_addr = 0;
+      return 0;
+   }
+   else if (request == VC_SM_CMA_IOCTL_MEM_CLEAN_INVALID2)
+   {
+      struct vc_sm_cma_ioctl_clean_invalid2 *ops = arg;
+      unsigned int i;
+
+      /* Anonymous memory is always coherent, only check the operations */
+      for (i = 0; i < ops->op_count; i++)
+      {
+         if (ops->s[i].invalidate_mode > VC_SM_CACHE_OP_FLUSH || !ops->s[i].start_address)
+         {
+            errno = EINVAL;
+            return -1;
+         }
+      }
+      return 0;
+   }
+   else if (request == DMA_BUF_IOCTL_SYNC)
+   {
+      /* Anonymous memory is always coherent */
+      return 0;
+   }
+
+   vcos_unused(fd);
+   errno = ENOTTY;
+   return -1;
+}
+
+static const VCSM_BACKEND_T vcsm_anon_backend =
+{
+   "anon", 1, vcsm_anon_open, vcsm_anon_ioctl
+};
+
+static const VCSM_BACKEND_T *vcsm_backend = &vcsm_cma_backend;
 
 
 /* Cache [(current, new) -> outcome] mapping table, ignoring identity.
@@ -236,11 +511,16 @@ static VCSM_CACHE_TYPE_T vcsm_cache_table_lookup( VCSM_CACHE_TYPE_T current,
 */
 static void vcsm_init_once(void)
 {
+   const char *backend = getenv( "VCSM_BACKEND" );
+
    vcos_mutex_create(&vcsm_mutex, VCOS_FUNCTION);
    vcos_log_set_level(&usrvcsm_log_category, VCOS_LOG_ERROR);
    usrvcsm_log_category.flags.want_prefix = 0;
    vcos_log_register( "usrvcsm", &usrvcsm_log_category );
    vcsm_payload_list_init();
+
+   if ( backend && !strcmp( backend, vcsm_anon_backend.name ) )
+      vcsm_backend = &vcsm_anon_backend;
 }
 
 
@@ -272,10 +552,10 @@ int vcsm_init_ex( int want_export, int fd )
       goto out; /* VCSM already opened. Nothing to do. */
    }
 
-   if (want_export)
+   if (want_export || vcsm_backend->emulated)
    {
       if (fd == -1)
-         vcsm_handle = open( VCSM_CMA_DEVICE_NAME, O_RDWR, 0 );
+         vcsm_handle = vcsm_backend->open();
       else
          // FIXME: Sanity check that the fd really is to vcsm-cma.
          vcsm_handle = dup(fd);
@@ -283,12 +563,12 @@ int vcsm_init_ex( int want_export, int fd )
       if (vcsm_handle >= 0)
       {
          using_vc_sm_cma = 1;
-         vcos_log_trace( "[%s]: Using vc-sm-cma, handle %d",
-                        __func__, vcsm_handle);
+         vcos_log_trace( "[%s]: Using %s, handle %d",
+                        __func__, vcsm_backend->name, vcsm_handle);
       }
    }
 
-   if (vcsm_handle < 0)
+   if (vcsm_handle < 0 && !vcsm_backend->emulated)
    {
       vcos_log_trace( "[%s]: NOT using vc-sm-cma as handle was %d",
                       __func__, vcsm_handle);
@@ -417,7 +697,7 @@ unsigned int vcsm_malloc_cache( unsigned int size, VCSM_CACHE_TYPE_T cache, cons
       {
          memcpy ( alloc.name, name, 32 );
       }
-      rc = ioctl( vcsm_handle,
+      rc = vcsm_backend->ioctl( vcsm_handle,
                   VC_SM_CMA_IOCTL_MEM_ALLOC,
                   &alloc );
 
@@ -454,7 +734,7 @@ unsigned int vcsm_malloc_cache( unsigned int size, VCSM_CACHE_TYPE_T cache, cons
                       __func__,
                       getpid(),
                       alloc.handle );
-         vcsm_free( alloc.handle );
+         close( alloc.handle );
          return 0;
       }
 
@@ -469,11 +749,32 @@ unsigned int vcsm_malloc_cache( unsigned int size, VCSM_CACHE_TYPE_T cache, cons
                       );
 
       payload = vcsm_payload_list_get();
+      if (!payload)
+      {
+         vcos_log_error( "[%s]: [%d]: no memory to track hdl %x",
+                      __func__,
+                      getpid(),
+                      alloc.handle );
+         munmap( usr_ptr, size_aligned );
+         close( alloc.handle );
+         return 0;
+      }
       payload->handle = handle;
       payload->fd = alloc.handle;
       payload->vc_handle = alloc.vc_handle;
       payload->mem = usr_ptr;
       payload->size = size_aligned;
+      if (vcsm_payload_list_add(payload))
+      {
+         vcos_log_error( "[%s]: [%d]: no memory to track hdl %x",
+                      __func__,
+                      getpid(),
+                      alloc.handle );
+         vcsm_payload_list_put(payload);
+         munmap( usr_ptr, size_aligned );
+         close( alloc.handle );
+         return 0;
+      }
    }
    else
    {
@@ -659,7 +960,7 @@ void vcsm_free( unsigned int handle )
    {
       VCSM_PAYLOAD_ELEM_T *elem;
 
-      elem = vcsm_payload_list_find_handle(handle);
+      elem = vcsm_payload_list_remove(handle);
 
       if (!elem)
       {
@@ -680,7 +981,7 @@ void vcsm_free( unsigned int handle )
 
       close(elem->fd);
 
-      vcsm_payload_list_release(elem);
+      vcsm_payload_list_put(elem);
    }
    else
    {
@@ -1257,7 +1558,7 @@ void *vcsm_lock( unsigned int handle )
 
          //Now sync the buffer
          sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW;
-         rc = ioctl( elem->fd,
+         rc = vcsm_backend->ioctl( elem->fd,
                      DMA_BUF_IOCTL_SYNC,
                      &sync );
          if ( rc < 0 )
@@ -1672,7 +1973,7 @@ int vcsm_unlock_ptr_sp( void *usr_ptr, int cache_no_flush )
       if (!cache_no_flush)
       {
          sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW;
-         rc = ioctl( elem->fd,
+         rc = vcsm_backend->ioctl( elem->fd,
                      DMA_BUF_IOCTL_SYNC,
                      &sync );
          if ( rc < 0 )
@@ -1837,7 +2138,7 @@ int vcsm_unlock_hdl_sp( unsigned int handle, int cache_no_flush )
          sync.flags |= DMA_BUF_SYNC_RW;
       }
 
-      rc = ioctl( elem->fd, DMA_BUF_IOCTL_SYNC, &sync );
+      rc = vcsm_backend->ioctl( elem->fd, DMA_BUF_IOCTL_SYNC, &sync );
       if ( rc < 0 )
       {
          vcos_log_trace( "[%s]: [%d]: ioctl DMA_BUF_IOCTL_SYNC failed, rc %d",
@@ -2147,11 +2448,29 @@ int vcsm_clean_invalid2( struct vcsm_user_clean_invalid2_s *s )
 
    if (using_vc_sm_cma)
    {
-/*    FIXME: What's the best way of doing this?
-      rc = ioctl( vcsm_handle,
+      struct vc_sm_cma_ioctl_clean_invalid2 *ops;
+      unsigned int i;
+
+      /* vc-sm-cma uses wider fields for the same operations */
+      ops = vcos_malloc( sizeof(*ops) + s->op_count * sizeof(ops->s[0]), "vcsm_clean_invalid2" );
+      if (!ops)
+         return -1;
+
+      memset( ops, 0, sizeof(*ops) );
+      ops->op_count = s->op_count;
+      for ( i = 0; i < s->op_count; i++ )
+      {
+         ops->s[i].invalidate_mode = s->s[i].invalidate_mode;
+         ops->s[i].block_count = s->s[i].block_count;
+         ops->s[i].start_address = s->s[i].start_address;
+         ops->s[i].block_size = s->s[i].block_size;
+         ops->s[i].inter_block_stride = s->s[i].inter_block_stride;
+      }
+
+      rc = vcsm_backend->ioctl( vcsm_handle,
                    VC_SM_CMA_IOCTL_MEM_CLEAN_INVALID2,
-                   s ); */
-      rc = -1;
+                   ops );
+      vcos_free( ops );
    }
    else
    {
@@ -2163,6 +2482,266 @@ int vcsm_clean_invalid2( struct vcsm_user_clean_invalid2_s *s )
    return rc;
 }
 
+/* Scatter-gather cache maintenance.
+**
+** The cache operations of all the entries of a request are gathered into a
+** single clean/invalidate ioctl. With vc-sm-cma nothing else is needed, while
+** the older vcsm driver still takes one call per buffer to lock or unlock it.
+*/
+typedef enum
+{
+   VCSM_SG_LOCK,
+   VCSM_SG_UNLOCK,
+   VCSM_SG_CLEAN_INVALID,
+} VCSM_SG_MODE_T;
+
+static VCSM_SG_STATS_T vcsm_sg_stats_data;
+
+/* Resolve an entry into the address of its buffer, checking its range.
+** With the older driver the buffer also gets locked if requested.
+*/
+static int vcsm_sg_resolve( VCSM_SG_ENTRY_T *entry, int lock,
+                            uint8_t **mem, unsigned int *length )
+{
+   unsigned int size;
+
+   if ( entry->handle == 0 || (unsigned int)entry->op > VCSM_SG_OP_FLUSH )
+      return -EINVAL;
+
+   if (using_vc_sm_cma)
+   {
+      VCSM_PAYLOAD_ELEM_T *elem = vcsm_payload_list_find_handle(entry->handle);
+
+      if (!elem || !elem->mem)
+         return -EINVAL;
+      *mem = elem->mem;
+      size = elem->size;
+   }
+   else
+   {
+      struct vmcs_sm_ioctl_size sz;
+
+      memset( &sz, 0, sizeof(sz) );
+      sz.handle = entry->handle;
+      if ( ioctl( vcsm_handle, VMCS_SM_IOCTL_SIZE_USR_HDL, &sz ) < 0 || sz.size == 0 )
+         return -EINVAL;
+      size = sz.size;
+      *mem = NULL;
+   }
+
+   if ( entry->offset > size || entry->length > size - entry->offset )
+      return -EINVAL;
+   *length = entry->length ? entry->length : size - entry->offset;
+
+   if (!using_vc_sm_cma)
+   {
+      if (lock)
+      {
+         struct vmcs_sm_ioctl_lock_unlock lock_unlock;
+
+         memset( &lock_unlock, 0, sizeof(lock_unlock) );
+         lock_unlock.handle = entry->handle;
+         if ( ioctl( vcsm_handle, VMCS_SM_IOCTL_MEM_LOCK, &lock_unlock ) < 0 )
+            return -errno;
+         *mem = (uint8_t *)(uintptr_t)lock_unlock.addr;
+      }
+      else
+         *mem = vcsm_usr_address( entry->handle );
+      if (!*mem)
+         return -EINVAL;
+   }
+
+   return 0;
+}
+
+/* Submit the gathered cache operations in as few ioctls as the driver allows.
+*/
+static int vcsm_sg_submit( struct vc_sm_cma_ioctl_clean_invalid2 *ops )
+{
+   struct vcsm_user_clean_invalid2_s *legacy;
+   unsigned int i, j, n;
+   int rc = 0;
+
+   if (!ops->op_count)
+      return 0;
+
+   if (using_vc_sm_cma)
+   {
+      rc = vcsm_backend->ioctl( vcsm_handle, VC_SM_CMA_IOCTL_MEM_CLEAN_INVALID2, ops );
+      return rc < 0 ? -errno : 0;
+   }
+
+   /* The older driver takes at most 255 operations per call */
+   n = ops->op_count < 255 ? ops->op_count : 255;
+   legacy = vcos_malloc( sizeof(*legacy) + n * sizeof(legacy->s[0]), "vcsm_sg_legacy" );
+   if (!legacy)
+      return -ENOMEM;
+
+   for ( i = 0; i < ops->op_count && !rc; i += n )
+   {
+      memset( legacy, 0, sizeof(*legacy) );
+      legacy->op_count = ops->op_count - i < n ? ops->op_count - i : n;
+      for ( j = 0; j < legacy->op_count; j++ )
+      {
+         legacy->s[j].invalidate_mode = ops->s[i + j].invalidate_mode;
+         legacy->s[j].block_count = ops->s[i + j].block_count;
+         legacy->s[j].start_address = ops->s[i + j].start_address;
+         legacy->s[j].block_size = ops->s[i + j].block_size;
+         legacy->s[j].inter_block_stride = ops->s[i + j].inter_block_stride;
+      }
+      if ( ioctl( vcsm_handle, VMCS_SM_IOCTL_MEM_CLEAN_INVALID2, legacy ) < 0 )
+         rc = -errno;
+   }
+
+   vcos_free( legacy );
+   return rc;
+}
+
+static int vcsm_sg_run( VCSM_SG_ENTRY_T *entries, unsigned int count, VCSM_SG_MODE_T mode )
+{
+   struct vc_sm_cma_ioctl_clean_invalid2 *ops;
+   unsigned long long cleaned = 0, invalidated = 0;
+   unsigned int i, failed = 0;
+   int rc;
+
+   if ( (vcsm_handle == VCSM_INVALID_HANDLE) || (!entries && count) )
+   {
+      vcos_log_error( "[%s]: [%d]: invalid device or invalid entries!",
+                      __func__,
+                      getpid() );
+      return -EIO;
+   }
+
+   ops = vcos_malloc( sizeof(*ops) + count * sizeof(ops->s[0]), "vcsm_sg_ops" );
+   if (!ops)
+      return -ENOMEM;
+   memset( ops, 0, sizeof(*ops) );
+
+   for ( i = 0; i < count; i++ )
+   {
+      VCSM_SG_ENTRY_T *entry = &entries[i];
+      unsigned int length = 0;
+      uint8_t *mem = NULL;
+
+      entry->status = vcsm_sg_resolve( entry, mode == VCSM_SG_LOCK, &mem, &length );
+      if (mode == VCSM_SG_LOCK)
+         entry->usr_ptr = entry->status ? NULL : mem;
+      if (entry->status)
+      {
+         failed++;
+         continue;
+      }
+      if ( entry->op == VCSM_SG_OP_NONE || !length )
+         continue;
+
+      ops->s[ops->op_count].invalidate_mode = entry->op;
+      ops->s[ops->op_count].block_count = 1;
+      ops->s[ops->op_count].start_address = mem + entry->offset;
+      ops->s[ops->op_count].block_size = length;
+      ops->s[ops->op_count].inter_block_stride = 0;
+      ops->op_count++;
+
+      if ( entry->op & VCSM_SG_OP_INVALIDATE )
+         invalidated += length;
+      if ( entry->op & VCSM_SG_OP_CLEAN )
+         cleaned += length;
+   }
+
+   rc = vcsm_sg_submit( ops );
+   vcos_free( ops );
+
+   if (rc)
+   {
+      vcos_log_error( "[%s]: [%d]: cache maintenance of %u entries failed, rc %d",
+                      __func__,
+                      getpid(),
+                      count,
+                      rc );
+
+      for ( i = 0; i < count; i++ )
+      {
+         if ( entries[i].status || entries[i].op == VCSM_SG_OP_NONE )
+            continue;
+         entries[i].status = rc;
+         failed++;
+
+         /* Do not leave the older driver holding a lock the caller will
+          * never release, as the entry is reported as failed. */
+         if ( mode == VCSM_SG_LOCK && !using_vc_sm_cma )
+         {
+            vcsm_unlock_hdl_sp( entries[i].handle, 1 );
+            entries[i].usr_ptr = NULL;
+         }
+      }
+      cleaned = invalidated = 0;
+   }
+
+   /* The older driver needs the buffers unlocked once their cache is clean */
+   if ( mode == VCSM_SG_UNLOCK && !using_vc_sm_cma )
+   {
+      for ( i = 0; i < count; i++ )
+      {
+         if (entries[i].status)
+            continue;
+         rc = vcsm_unlock_hdl_sp( entries[i].handle, 1 );
+         if (rc)
+         {
+            entries[i].status = rc;
+            failed++;
+         }
+      }
+   }
+
+   __sync_fetch_and_add( &vcsm_sg_stats_data.requests, 1 );
+   __sync_fetch_and_add( &vcsm_sg_stats_data.entries, count );
+   __sync_fetch_and_add( &vcsm_sg_stats_data.failed, failed );
+   __sync_fetch_and_add( &vcsm_sg_stats_data.bytes_cleaned, cleaned );
+   __sync_fetch_and_add( &vcsm_sg_stats_data.bytes_invalidated, invalidated );
+
+   return failed;
+}
+
+/* Locks a list of buffers, applying the cache operation of each entry.
+*/
+int vcsm_lock_sg( VCSM_SG_ENTRY_T *entries, unsigned int count )
+{
+   return vcsm_sg_run( entries, count, VCSM_SG_LOCK );
+}
+
+/* Unlocks a list of buffers, applying the cache operation of each entry.
+*/
+int vcsm_unlock_sg( VCSM_SG_ENTRY_T *entries, unsigned int count )
+{
+   return vcsm_sg_run( entries, count, VCSM_SG_UNLOCK );
+}
+
+/* Applies the cache operation of each entry of a list.
+*/
+int vcsm_clean_invalid_sg( VCSM_SG_ENTRY_T *entries, unsigned int count )
+{
+   return vcsm_sg_run( entries, count, VCSM_SG_CLEAN_INVALID );
+}
+
+/* Retrieves the totals of the scatter-gather requests.
+*/
+void vcsm_sg_stats( VCSM_SG_STATS_T *stats, int reset )
+{
+   stats->requests = __sync_fetch_and_add( &vcsm_sg_stats_data.requests, 0 );
+   stats->entries = __sync_fetch_and_add( &vcsm_sg_stats_data.entries, 0 );
+   stats->failed = __sync_fetch_and_add( &vcsm_sg_stats_data.failed, 0 );
+   stats->bytes_cleaned = __sync_fetch_and_add( &vcsm_sg_stats_data.bytes_cleaned, 0 );
+   stats->bytes_invalidated = __sync_fetch_and_add( &vcsm_sg_stats_data.bytes_invalidated, 0 );
+
+   if (reset)
+   {
+      __sync_fetch_and_sub( &vcsm_sg_stats_data.requests, stats->requests );
+      __sync_fetch_and_sub( &vcsm_sg_stats_data.entries, stats->entries );
+      __sync_fetch_and_sub( &vcsm_sg_stats_data.failed, stats->failed );
+      __sync_fetch_and_sub( &vcsm_sg_stats_data.bytes_cleaned, stats->bytes_cleaned );
+      __sync_fetch_and_sub( &vcsm_sg_stats_data.bytes_invalidated, stats->bytes_invalidated );
+   }
+}
+
 /* Imports a dmabuf, and binds it to a VCSM handle and MEM_HANDLE_T
 **
 ** Returns:        0 on error
@@ -2203,7 +2782,7 @@ unsigned int vcsm_import_dmabuf( int dmabuf, const char *name )
       {
          memcpy ( import.name, name, 32 );
       }
-      rc = ioctl( vcsm_handle,
+      rc = vcsm_backend->ioctl( vcsm_handle,
                   VC_SM_CMA_IOCTL_MEM_IMPORT_DMABUF,
                   &import );
 
@@ -2234,7 +2813,7 @@ unsigned int vcsm_import_dmabuf( int dmabuf, const char *name )
                          __func__,
                          getpid(),
                          import.handle, import.size );
-            vcsm_free( import.handle );
+            close( import.handle );
             return 0;
          }
 
@@ -2259,11 +2838,32 @@ unsigned int vcsm_import_dmabuf( int dmabuf, const char *name )
                         import.handle );
 
          payload = vcsm_payload_list_get();
+         if (!payload)
+         {
+            vcos_log_error( "[%s]: [%d]: no memory to track hdl %x",
+                         __func__,
+                         getpid(),
+                         import.handle );
+            munmap( usr_ptr, import.size );
+            close( import.handle );
+            return 0;
+         }
          payload->handle = handle;
          payload->fd = import.handle;
          payload->vc_handle = import.vc_handle;
          payload->mem = usr_ptr;
          payload->size = import.size;
+         if (vcsm_payload_list_add(payload))
+         {
+            vcos_log_error( "[%s]: [%d]: no memory to track hdl %x",
+                         __func__,
+                         getpid(),
+                         import.handle );
+            vcsm_payload_list_put(payload);
+            munmap( usr_ptr, import.size );
+            close( import.handle );
+            return 0;
+         }
       }
    }
    else
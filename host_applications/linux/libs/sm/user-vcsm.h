@@ -471,6 +471,60 @@ struct vcsm_user_clean_invalid2_s {
 
 int vcsm_clean_invalid2( struct vcsm_user_clean_invalid2_s *s );
 
+/* Scatter-gather lock, unlock and cache maintenance.
+**
+** Each entry gives a range of a buffer, from 'offset' for 'length' bytes
+** (0 for up to the end of the buffer), and the cache operation to apply to
+** it. The cache operations of all the entries are applied in a single call
+** into the kernel.
+**
+** vcsm_lock_sg locks the buffers and returns their address in 'usr_ptr',
+** then applies the cache operations (usually VCSM_SG_OP_INVALIDATE).
+** vcsm_unlock_sg applies the cache operations (usually VCSM_SG_OP_CLEAN)
+** then unlocks the buffers.
+**
+** Returns:        the number of entries which failed, with the reason in
+**                 their 'status'
+**                 -errno if nothing could be done.
+*/
+typedef enum
+{
+   VCSM_SG_OP_NONE = 0,             // No cache maintenance.
+   VCSM_SG_OP_INVALIDATE,           // Invalidate the range.
+   VCSM_SG_OP_CLEAN,                // Clean the range.
+   VCSM_SG_OP_FLUSH,                // Clean and invalidate the range.
+
+} VCSM_SG_OP_T;
+
+typedef struct
+{
+   unsigned int handle;             // User opaque handle of the buffer.
+   unsigned int offset;             // Start of the range in the buffer.
+   unsigned int length;             // Size of the range, 0 for up to the end.
+   VCSM_SG_OP_T op;                 // Cache operation on the range.
+   void *usr_ptr;                   // Out: address of the buffer (lock only).
+   int status;                      // Out: 0 on success, -errno on error.
+
+} VCSM_SG_ENTRY_T;
+
+typedef struct
+{
+   unsigned int requests;           // Scatter-gather calls.
+   unsigned int entries;            // Entries in those calls.
+   unsigned int failed;             // Entries which failed.
+   unsigned long long bytes_cleaned;
+   unsigned long long bytes_invalidated;
+
+} VCSM_SG_STATS_T;
+
+int vcsm_lock_sg( VCSM_SG_ENTRY_T *entries, unsigned int count );
+int vcsm_unlock_sg( VCSM_SG_ENTRY_T *entries, unsigned int count );
+int vcsm_clean_invalid_sg( VCSM_SG_ENTRY_T *entries, unsigned int count );
+
+/* Retrieves the totals of the scatter-gather calls, optionally resetting them.
+*/
+void vcsm_sg_stats( VCSM_SG_STATS_T *stats, int reset );
+
 unsigned int vcsm_import_dmabuf( int dmabuf, const char *name );
 
 int vcsm_export_dmabuf( unsigned int vcsm_handle );
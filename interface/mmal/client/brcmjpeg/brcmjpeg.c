@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal.h"
 #include "util/mmal_component_wrapper.h"
 #include "util/mmal_util_params.h"
+#include "util/mmal_util_convert.h"
 #include "mmal_logging.h"
 #include "brcmjpeg.h"
 
@@ -860,38 +861,22 @@ static unsigned int brcmjpeg_copy_pixels(uint8_t *out, unsigned int out_size,
    {
       unsigned int width = in_width > out_width ? out_width : in_width;
       unsigned int height = in_height > out_height ? out_height : in_height;
-      uint8_t *y = planes[convert_from ? 0 : 1][0].data;
-      uint8_t *u = planes[convert_from ? 0 : 1][1].data;
-      uint8_t *v = planes[convert_from ? 0 : 1][2].data;
-      uint8_t *yuyv = planes[convert_from ? 1 : 0][0].data;
-      unsigned int y_diff = (convert_from ? out_width : in_width) - width;
-      unsigned int yuyv_diff = ((convert_from ? in_width : out_width) - width) * 2;
-
-      while (height--)
-      {
-         if (convert_from)
-            for (i = width / 2; i; i--)
-            {
-                *y++ = *yuyv++;
-                *u++ = *yuyv++;
-                *y++ = *yuyv++;
-                *v++ = *yuyv++;
-            }
-         else
-            for (i = width / 2; i; i--)
-            {
-                *yuyv++ = *y++;
-                *yuyv++ = *u++;
-                *yuyv++ = *y++;
-                *yuyv++ = *v++;
-            }
+      unsigned int p = convert_from ? 0 : 1;
+      MMAL_CONVERT_PLANES_T i422;
 
-         yuyv += yuyv_diff;
-         y += y_diff;
-         u += y_diff >> 1;
-         v += y_diff >> 1;
+      for (i = 0; i < 3; i++)
+      {
+         i422.data[i] = planes[p][i].data;
+         i422.pitch[i] = planes[p][i].pitch;
       }
 
+      if (convert_from)
+         mmal_convert_yuyv_to_i422(&i422, planes[1][0].data, planes[1][0].pitch * 2,
+            width, height);
+      else
+         mmal_convert_i422_to_yuyv(planes[0][0].data, planes[0][0].pitch * 2, &i422,
+            width, height);
+
       return size;
    }
 
@@ -899,15 +884,9 @@ static unsigned int brcmjpeg_copy_pixels(uint8_t *out, unsigned int out_size,
    {
       unsigned int width = MMAL_MIN(planes[0][i].pitch, planes[1][i].pitch);
       unsigned int height = MMAL_MIN(planes[0][i].height, planes[1][i].height);
-      uint8_t *data_out = planes[0][i].data;
-      uint8_t *data_in = planes[1][i].data;
 
-      while (height--)
-      {
-         memcpy(data_out, data_in, width);
-         data_out += planes[0][i].pitch;
-         data_in += planes[1][i].pitch;
-      }
+      mmal_convert_copy_plane(planes[0][i].data, planes[0][i].pitch,
+         planes[1][i].data, planes[1][i].pitch, width, height);
    }
 
    return size;
@@ -30,6 +30,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "core/mmal_port_private.h"
 #include "mmal_logging.h"
 
+#include <stdio.h>
+
 #define ARTIFICIAL_CAMERA_PORTS_NUM 3
 
 /* Buffering requirements */
@@ -38,13 +40,41 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define DEFAULT_WIDTH 320
 #define DEFAULT_HEIGHT 240
+#define DEFAULT_FRAME_RATE 30
+
+/* Least time between frames when the frame rate is 0 */
+#define UNPACED_FRAME_INTERVAL_US 10000
+
+#define COUNTER_BLOCK_SIZE 8
+#define COUNTER_BITS 32
 
 /*****************************************************************************/
 typedef struct MMAL_PORT_MODULE_T
 {
    MMAL_BUFFER_HEADER_VIDEO_SPECIFIC_T frame;
    unsigned int frame_size;
-   int count;
+
+   /* Layout of the frames */
+   unsigned int width, height;          /**< Visible size */
+   unsigned int aligned_width, aligned_height;
+   unsigned int chroma_offset[2];       /**< Offsets of the first U and V samples */
+   unsigned int chroma_pitch;
+   unsigned int chroma_step;            /**< Distance between 2 U (or V) samples */
+   unsigned int chroma_vsub;            /**< Vertical chroma subsampling */
+
+   /* Pacing */
+   MMAL_RATIONAL_T frame_rate;          /**< 0 to send frames as soon as we get buffers, throttled */
+   MMAL_BOOL_T started;
+   int64_t start_time;
+   int64_t due;                         /**< When the next frame is due */
+   uint32_t frame_index;                /**< Number of the next frame since the port was enabled */
+
+   MMAL_TEST_PATTERN_T pattern;
+   MMAL_BOOL_T frame_counter;
+   uint32_t seed;
+   FILE *replay;                        /**< Raw file the frames are read from, if any */
+
+   MMAL_PARAMETER_STATISTICS_T stats;
 
    MMAL_QUEUE_T *queue;
 
@@ -54,12 +84,258 @@ typedef struct MMAL_COMPONENT_MODULE_T
 {
    MMAL_STATUS_T status;
 
+   VCOS_TIMER_T timer;       /**< Triggers the action when the next frame is due */
+   MMAL_BOOL_T timer_created;
+
 } MMAL_COMPONENT_MODULE_T;
 
 /*****************************************************************************/
+/** Time of a frame, relative to the first one */
+static int64_t artificial_camera_frame_time(MMAL_PORT_MODULE_T *port_module, uint32_t index)
+{
+   return (int64_t)index * 1000000 * port_module->frame_rate.den / port_module->frame_rate.num;
+}
+
+/** Fill a rectangle, in luma pixels, with a colour */
+static void artificial_camera_fill_rect(MMAL_PORT_MODULE_T *port_module, uint8_t *data,
+   unsigned int x, unsigned int y, unsigned int width, unsigned int height,
+   uint8_t luma, uint8_t u, uint8_t v)
+{
+   unsigned int step = port_module->chroma_step;
+   unsigned int i, j;
+
+   for (j = y; j < y + height; j++)
+      memset(data + j * port_module->frame.pitch[0] + x, luma, width);
+
+   for (j = y / port_module->chroma_vsub; j < (y + height) / port_module->chroma_vsub; j++)
+   {
+      uint8_t *row_u = data + port_module->chroma_offset[0] + j * port_module->chroma_pitch;
+      uint8_t *row_v = data + port_module->chroma_offset[1] + j * port_module->chroma_pitch;
+
+      if (step == 1)
+      {
+         memset(row_u + x / 2, u, width / 2);
+         memset(row_v + x / 2, v, width / 2);
+         continue;
+      }
+      for (i = x / 2; i < (x + width) / 2; i++)
+      {
+         row_u[i * step] = u;
+         row_v[i * step] = v;
+      }
+   }
+}
+
+static void artificial_camera_draw_gradient(MMAL_PORT_MODULE_T *port_module, uint8_t *data, uint32_t frame)
+{
+   unsigned int chroma_width = port_module->aligned_width / 2;
+   unsigned int chroma_height = port_module->aligned_height / port_module->chroma_vsub;
+   unsigned int step = port_module->chroma_step;
+   unsigned int i, j;
+
+   for (j = 0; j < port_module->aligned_height; j++)
+   {
+      uint8_t *row = data + j * port_module->frame.pitch[0];
+      uint8_t value = (uint8_t)(j + frame * 2);
+
+      for (i = 0; i < port_module->aligned_width; i++)
+         row[i] = value++;
+   }
+
+   /* U across, V down */
+   for (j = 0; j < chroma_height; j++)
+   {
+      uint8_t *row_u = data + port_module->chroma_offset[0] + j * port_module->chroma_pitch;
+      uint8_t *row_v = data + port_module->chroma_offset[1] + j * port_module->chroma_pitch;
+      uint8_t v = (uint8_t)(j * 255 / chroma_height);
+
+      for (i = 0; i < chroma_width; i++)
+      {
+         row_u[i * step] = (uint8_t)(i * 255 / chroma_width);
+         row_v[i * step] = v;
+      }
+   }
+}
+
+/** Position along a back and forth path of the given length */
+static unsigned int artificial_camera_bounce(uint32_t t, unsigned int length)
+{
+   if (!length)
+      return 0;
+   t %= 2 * length;
+   return t < length ? t : 2 * length - t;
+}
+
+static void artificial_camera_draw_box(MMAL_PORT_MODULE_T *port_module, uint8_t *data, uint32_t frame)
+{
+   unsigned int width = MMAL_MAX(port_module->width / 8, 2) & ~1;
+   unsigned int height = MMAL_MAX(port_module->height / 8, 2) & ~1;
+   unsigned int x = artificial_camera_bounce(frame * 4, port_module->width - width) & ~1;
+   unsigned int y = artificial_camera_bounce(frame * 3, port_module->height - height) & ~1;
+
+   artificial_camera_fill_rect(port_module, data, 0, 0,
+      port_module->aligned_width, port_module->aligned_height, 0x80, 0x80, 0x80);
+   artificial_camera_fill_rect(port_module, data, x, y, width, height, 0x51, 0x5a, 0xf0);
+}
+
+static void artificial_camera_draw_noise(MMAL_PORT_MODULE_T *port_module, uint8_t *data, uint32_t frame)
+{
+   uint32_t state = (port_module->seed ^ (frame * 0x9e3779b9)) | 1;
+   unsigned int i;
+
+   /* xorshift32, so that a frame can be generated again from its number */
+   for (i = 0; i + 4 <= port_module->frame_size; i += 4)
+   {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      memcpy(data + i, &state, 4);
+   }
+}
+
+static void artificial_camera_draw_counter(MMAL_PORT_MODULE_T *port_module, uint8_t *data, uint32_t frame)
+{
+   unsigned int bits = MMAL_MIN(COUNTER_BITS, port_module->aligned_width / COUNTER_BLOCK_SIZE);
+   unsigned int i;
+
+   if (port_module->aligned_height < COUNTER_BLOCK_SIZE)
+      return;
+
+   for (i = 0; i < bits; i++)
+      artificial_camera_fill_rect(port_module, data, i * COUNTER_BLOCK_SIZE, 0,
+         COUNTER_BLOCK_SIZE, COUNTER_BLOCK_SIZE,
+         (frame >> (bits - 1 - i)) & 1 ? 0xeb : 0x10, 0x80, 0x80);
+}
+
+/** Read the visible part of a frame from the replay file */
+static MMAL_BOOL_T artificial_camera_read_frame(MMAL_PORT_MODULE_T *port_module, uint8_t *data)
+{
+   unsigned int chroma_width = (port_module->width + 1) / 2;
+   unsigned int chroma_height = (port_module->height + port_module->chroma_vsub - 1) / port_module->chroma_vsub;
+   unsigned int rows[3], size[3], i, j;
+
+   rows[0] = port_module->height;
+   size[0] = port_module->width;
+   rows[1] = rows[2] = chroma_height;
+   size[1] = size[2] = chroma_width * port_module->chroma_step;
+
+   for (i = 0; i < port_module->frame.planes; i++)
+      for (j = 0; j < rows[i]; j++)
+         if (fread(data + port_module->frame.offset[i] + j * port_module->frame.pitch[i],
+                   1, size[i], port_module->replay) != size[i])
+            return 0;
+   return 1;
+}
+
+/** Fill in a buffer with the next frame */
+static MMAL_STATUS_T artificial_camera_fill_buffer(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer,
+   int64_t now)
+{
+   MMAL_PORT_MODULE_T *port_module = port->priv->module;
+   MMAL_BOOL_T paced = port_module->frame_rate.num && port_module->frame_rate.den;
+   uint32_t frame;
+   int64_t pts;
+   MMAL_STATUS_T status;
+
+   /* Sanity check the buffer size */
+   if (buffer->alloc_size < port_module->frame_size)
+   {
+      LOG_ERROR("buffer too small (%i/%i)",
+                buffer->alloc_size, port_module->frame_size);
+      return MMAL_EINVAL;
+   }
+   status = mmal_buffer_header_mem_lock(buffer);
+   if (status != MMAL_SUCCESS)
+   {
+      LOG_ERROR("invalid buffer (%p, %p)", buffer, buffer->data);
+      return status;
+   }
+
+   if (!port_module->started)
+   {
+      port_module->started = 1;
+      port_module->start_time = now;
+      port_module->frame_index = 0;
+   }
+
+   if (paced)
+   {
+      /* Like a sensor, skip the frames we had no buffer for */
+      frame = (uint32_t)((now - port_module->start_time) * port_module->frame_rate.num /
+                         ((int64_t)1000000 * port_module->frame_rate.den));
+      if (frame > port_module->frame_index)
+      {
+         port_module->stats.frames_skipped += frame - port_module->frame_index;
+         port_module->frame_index = frame;
+      }
+      pts = artificial_camera_frame_time(port_module, port_module->frame_index);
+   }
+   else
+      pts = now - port_module->start_time;
+   frame = port_module->frame_index++;
+   if (paced)
+      port_module->due = port_module->start_time +
+         artificial_camera_frame_time(port_module, port_module->frame_index);
+   else
+      port_module->due = now + UNPACED_FRAME_INTERVAL_US; /* Don't peg the CPU */
+
+   if (port_module->replay)
+   {
+      if (!artificial_camera_read_frame(port_module, buffer->data))
+      {
+         /* Loop back to the start of the file */
+         rewind(port_module->replay);
+         if (!artificial_camera_read_frame(port_module, buffer->data))
+         {
+            LOG_ERROR("can't read a whole frame from the replay file");
+            mmal_buffer_header_mem_unlock(buffer);
+            return MMAL_EIO;
+         }
+      }
+   }
+   else switch (port_module->pattern)
+   {
+   case MMAL_TEST_PATTERN_GRADIENT:
+      artificial_camera_draw_gradient(port_module, buffer->data, frame);
+      break;
+   case MMAL_TEST_PATTERN_MOVING_BOX:
+      artificial_camera_draw_box(port_module, buffer->data, frame);
+      break;
+   case MMAL_TEST_PATTERN_NOISE:
+      artificial_camera_draw_noise(port_module, buffer->data, frame);
+      break;
+   default:
+      memset(buffer->data, 0xff, port_module->frame_size);
+      if (port_module->frame.planes > 1)
+         memset(buffer->data + port_module->frame.offset[1], 0x7f - frame,
+                port_module->frame_size - port_module->frame.offset[1]);
+      break;
+   }
+
+   if (port_module->frame_counter)
+      artificial_camera_draw_counter(port_module, buffer->data, frame);
+
+   buffer->offset = 0;
+   buffer->length = port_module->frame_size;
+   buffer->type->video = port_module->frame;
+   buffer->pts = buffer->dts = pts;
+   buffer->flags = MMAL_BUFFER_HEADER_FLAG_FRAME_END;
+
+   port_module->stats.buffer_count++;
+   port_module->stats.frame_count++;
+   port_module->stats.total_bytes += buffer->length;
+   port_module->stats.maximum_frame_bytes =
+      MMAL_MAX(port_module->stats.maximum_frame_bytes, buffer->length);
+
+   mmal_buffer_header_mem_unlock(buffer);
+   return MMAL_SUCCESS;
+}
+
 static void artificial_camera_do_processing(MMAL_COMPONENT_T *component)
 {
    MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   int64_t now = vcos_getmicrosecs64(), next = 0;
+   MMAL_BOOL_T waiting = 0;
    MMAL_BUFFER_HEADER_T *buffer;
    unsigned int i;
 
@@ -70,55 +346,56 @@ static void artificial_camera_do_processing(MMAL_COMPONENT_T *component)
    for (i = 0; i < component->output_num; i++)
    {
       MMAL_PORT_T *port = component->output[i];
+      MMAL_PORT_MODULE_T *port_module = port->priv->module;
 
-      buffer = mmal_queue_get(port->priv->module->queue);
-      if (!buffer)
-         continue;
-
-      /* Sanity check the buffer size */
-      if (buffer->alloc_size < port->priv->module->frame_size)
-      {
-         LOG_ERROR("buffer too small (%i/%i)",
-                   buffer->alloc_size, port->priv->module->frame_size);
-         module->status = MMAL_EINVAL;
-         mmal_queue_put_back(port->priv->module->queue, buffer);
-         mmal_event_error_send(component, module->status);
-         return;
-      }
-      module->status = mmal_buffer_header_mem_lock(buffer);
-      if (module->status != MMAL_SUCCESS)
+      while ((buffer = mmal_queue_get(port_module->queue)) != NULL)
       {
-         LOG_ERROR("invalid buffer (%p, %p)", buffer, buffer->data);
-         mmal_queue_put_back(port->priv->module->queue, buffer);
-         mmal_event_error_send(component, module->status);
-         return;
+         if (port_module->started && now < port_module->due)
+         {
+            /* Too early, come back when the frame is due */
+            mmal_queue_put_back(port_module->queue, buffer);
+            if (!waiting || port_module->due < next)
+               next = port_module->due;
+            waiting = 1;
+            break;
+         }
+
+         module->status = artificial_camera_fill_buffer(port, buffer, now);
+         if (module->status != MMAL_SUCCESS)
+         {
+            mmal_queue_put_back(port_module->queue, buffer);
+            mmal_event_error_send(component, module->status);
+            return;
+         }
+         mmal_port_buffer_header_callback(port, buffer);
       }
-
-      buffer->offset = 0;
-      buffer->length = port->priv->module->frame_size;
-      buffer->type->video = port->priv->module->frame;
-
-      memset(buffer->data, 0xff, buffer->length);
-      if (buffer->type->video.planes > 1)
-         memset(buffer->data + buffer->type->video.offset[1],
-                0x7f - port->priv->module->count++,
-                buffer->length - buffer->type->video.offset[1]);
-
-      mmal_buffer_header_mem_unlock(buffer);
-      mmal_port_buffer_header_callback(port, buffer);
    }
 
-   vcos_sleep(10); /* Make sure we don't peg all the resources */
+   if (waiting)
+      vcos_timer_set(&module->timer, (VCOS_UNSIGNED)MMAL_MAX((next - now + 999) / 1000, 1));
+}
+
+static void artificial_camera_timer_cb(void *context)
+{
+   mmal_component_action_trigger((MMAL_COMPONENT_T *)context);
 }
 
 /** Destroy a previously created component */
 static MMAL_STATUS_T artificial_camera_component_destroy(MMAL_COMPONENT_T *component)
 {
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
    unsigned int i;
 
+   if (module->timer_created)
+      vcos_timer_delete(&module->timer);
+
    for (i = 0; i < component->output_num; i++)
+   {
       if (component->output[i]->priv->module->queue)
          mmal_queue_destroy(component->output[i]->priv->module->queue);
+      if (component->output[i]->priv->module->replay)
+         fclose(component->output[i]->priv->module->replay);
+   }
 
    if(component->output_num)
       mmal_ports_free(component->output, component->output_num);
@@ -130,23 +407,41 @@ static MMAL_STATUS_T artificial_camera_component_destroy(MMAL_COMPONENT_T *compo
 /** Enable processing on a port */
 static MMAL_STATUS_T artificial_camera_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T cb)
 {
-   MMAL_PARAM_UNUSED(port);
+   MMAL_PORT_MODULE_T *port_module = port->priv->module;
    MMAL_PARAM_UNUSED(cb);
+
+   /* Start again from the first frame */
+   port_module->started = 0;
+   if (port_module->replay)
+      rewind(port_module->replay);
    return MMAL_SUCCESS;
 }
 
 /** Flush a port */
 static MMAL_STATUS_T artificial_camera_port_flush(MMAL_PORT_T *port)
 {
-   MMAL_PARAM_UNUSED(port);
+   MMAL_BUFFER_HEADER_T *buffer;
+
+   /* Flush buffers that our component is holding on to */
+   while ((buffer = mmal_queue_get(port->priv->module->queue)) != NULL)
+      mmal_port_buffer_header_callback(port, buffer);
    return MMAL_SUCCESS;
 }
 
 /** Disable processing on a port */
 static MMAL_STATUS_T artificial_camera_port_disable(MMAL_PORT_T *port)
 {
-   MMAL_PARAM_UNUSED(port);
-   return MMAL_SUCCESS;
+   MMAL_COMPONENT_T *component = port->component;
+   unsigned int i;
+
+   /* Stop the timer once no port needs it */
+   for (i = 0; i < component->output_num; i++)
+      if (component->output[i]->is_enabled)
+         break;
+   if (i == component->output_num)
+      vcos_timer_cancel(&component->priv->module->timer);
+
+   return artificial_camera_port_flush(port);
 }
 
 /** Send a buffer header to a port */
@@ -167,6 +462,10 @@ static MMAL_STATUS_T artificial_camera_port_format_commit(MMAL_PORT_T *port)
    width = (width + 31) & ~31;
    height = (height + 15) & ~15;
 
+   memset(&port_module->frame, 0, sizeof(port_module->frame));
+   port_module->chroma_vsub = 2;
+   port_module->chroma_step = 1;
+
    /* We only support a few formats */
    switch(port->format->encoding)
    {
@@ -178,13 +477,21 @@ static MMAL_STATUS_T artificial_camera_port_format_commit(MMAL_PORT_T *port)
       port_module->frame.pitch[1] = width / 2;
       port_module->frame.offset[2] = port_module->frame.offset[1] + port_module->frame.pitch[1] * height / 2;
       port_module->frame.pitch[2] = width / 2;
+      port_module->chroma_offset[0] = port_module->frame.offset[1];
+      port_module->chroma_offset[1] = port_module->frame.offset[2];
       break;
+   case MMAL_ENCODING_NV12:
    case MMAL_ENCODING_NV21:
       port_module->frame_size = width * height * 3 / 2;
       port_module->frame.planes = 2;
       port_module->frame.pitch[0] = width;
       port_module->frame.offset[1] = port_module->frame.pitch[0] * height;
       port_module->frame.pitch[1] = width;
+      port_module->chroma_step = 2;
+      port_module->chroma_offset[0] = port_module->frame.offset[1] +
+         (port->format->encoding == MMAL_ENCODING_NV21);
+      port_module->chroma_offset[1] = port_module->frame.offset[1] +
+         (port->format->encoding == MMAL_ENCODING_NV12);
       break;
    case MMAL_ENCODING_I422:
       port_module->frame_size = width * height * 2;
@@ -194,11 +501,21 @@ static MMAL_STATUS_T artificial_camera_port_format_commit(MMAL_PORT_T *port)
       port_module->frame.pitch[1] = width / 2;
       port_module->frame.offset[2] = port_module->frame.offset[1] + port_module->frame.pitch[1] * height;
       port_module->frame.pitch[2] = width / 2;
+      port_module->chroma_offset[0] = port_module->frame.offset[1];
+      port_module->chroma_offset[1] = port_module->frame.offset[2];
+      port_module->chroma_vsub = 1;
       break;
    default:
       return MMAL_ENOSYS;
    }
 
+   port_module->width = MMAL_MIN(port->format->es->video.width, width);
+   port_module->height = MMAL_MIN(port->format->es->video.height, height);
+   port_module->aligned_width = width;
+   port_module->aligned_height = height;
+   port_module->chroma_pitch = port_module->frame.pitch[1];
+   port_module->frame_rate = port->format->es->video.frame_rate;
+
    port->buffer_size_min = port->buffer_size_recommended = port_module->frame_size;
    return MMAL_SUCCESS;
 }
@@ -206,9 +523,53 @@ static MMAL_STATUS_T artificial_camera_port_format_commit(MMAL_PORT_T *port)
 /** Set parameter on a port */
 static MMAL_STATUS_T artificial_port_parameter_set(MMAL_PORT_T *port, const MMAL_PARAMETER_HEADER_T *param)
 {
-   MMAL_PARAM_UNUSED(port);
+   MMAL_PORT_MODULE_T *port_module = port->priv->module;
+
    switch (param->id)
    {
+   case MMAL_PARAMETER_TEST_PATTERN:
+      {
+         const MMAL_PARAMETER_TEST_PATTERN_T *pattern = (const MMAL_PARAMETER_TEST_PATTERN_T *)param;
+
+         if (param->size < sizeof(*pattern) || pattern->pattern > MMAL_TEST_PATTERN_NOISE)
+            return MMAL_EINVAL;
+
+         mmal_component_action_lock(port->component);
+         port_module->pattern = pattern->pattern;
+         port_module->frame_counter = pattern->frame_counter;
+         port_module->seed = pattern->seed;
+         mmal_component_action_unlock(port->component);
+      }
+      return MMAL_SUCCESS;
+
+   case MMAL_PARAMETER_URI:
+      {
+         const MMAL_PARAMETER_URI_T *uri = (const MMAL_PARAMETER_URI_T *)param;
+         FILE *replay = NULL;
+
+         /* Raw frames to replay in a loop instead of the test pattern, or an empty
+          * string to go back to the test pattern */
+         if (param->size <= sizeof(*param) ||
+             !memchr(uri->uri, 0, param->size - sizeof(*param)))
+            return MMAL_EINVAL;
+         if (uri->uri[0])
+         {
+            replay = fopen(uri->uri, "rb");
+            if (!replay)
+            {
+               LOG_ERROR("can't open %s", uri->uri);
+               return MMAL_ENOENT;
+            }
+         }
+
+         mmal_component_action_lock(port->component);
+         if (port_module->replay)
+            fclose(port_module->replay);
+         port_module->replay = replay;
+         mmal_component_action_unlock(port->component);
+      }
+      return MMAL_SUCCESS;
+
    default:
       return MMAL_ENOSYS;
    }
@@ -217,9 +578,37 @@ static MMAL_STATUS_T artificial_port_parameter_set(MMAL_PORT_T *port, const MMAL
 /** Get parameter on a port */
 static MMAL_STATUS_T artificial_port_parameter_get(MMAL_PORT_T *port, MMAL_PARAMETER_HEADER_T *param)
 {
-   MMAL_PARAM_UNUSED(port);
+   MMAL_PORT_MODULE_T *port_module = port->priv->module;
+
    switch (param->id)
    {
+   case MMAL_PARAMETER_TEST_PATTERN:
+      {
+         MMAL_PARAMETER_TEST_PATTERN_T *pattern = (MMAL_PARAMETER_TEST_PATTERN_T *)param;
+
+         if (param->size < sizeof(*pattern))
+            return MMAL_EINVAL;
+         pattern->pattern = port_module->pattern;
+         pattern->frame_counter = port_module->frame_counter;
+         pattern->seed = port_module->seed;
+      }
+      return MMAL_SUCCESS;
+
+   case MMAL_PARAMETER_STATISTICS:
+      {
+         MMAL_PARAMETER_STATISTICS_T *stats = (MMAL_PARAMETER_STATISTICS_T *)param;
+         MMAL_PARAMETER_HEADER_T hdr = *param;
+
+         if (param->size < sizeof(*stats))
+            return MMAL_EINVAL;
+
+         mmal_component_action_lock(port->component);
+         *stats = port_module->stats;
+         mmal_component_action_unlock(port->component);
+         stats->hdr = hdr;
+      }
+      return MMAL_SUCCESS;
+
    default:
       return MMAL_ENOSYS;
    }
@@ -260,6 +649,8 @@ static MMAL_STATUS_T mmal_component_create_artificial_camera(const char *name, M
       component->output[i]->format->encoding = MMAL_ENCODING_I420;
       component->output[i]->format->es->video.width = DEFAULT_WIDTH;
       component->output[i]->format->es->video.height = DEFAULT_HEIGHT;
+      component->output[i]->format->es->video.frame_rate.num = DEFAULT_FRAME_RATE;
+      component->output[i]->format->es->video.frame_rate.den = 1;
       component->output[i]->buffer_num_min = OUTPUT_MIN_BUFFER_NUM;
       component->output[i]->buffer_num_recommended = OUTPUT_RECOMMENDED_BUFFER_NUM;
       artificial_camera_port_format_commit(component->output[i]);
@@ -269,6 +660,11 @@ static MMAL_STATUS_T mmal_component_create_artificial_camera(const char *name, M
          goto error;
    }
 
+   if (vcos_timer_create(&component->priv->module->timer, "artificial camera",
+                         artificial_camera_timer_cb, component) != VCOS_SUCCESS)
+      goto error;
+   component->priv->module->timer_created = 1;
+
    status = mmal_component_action_register(component, artificial_camera_do_processing);
    if (status != MMAL_SUCCESS)
       goto error;
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal_logging.h"
 #include "core/mmal_component_private.h"
 #include "core/mmal_port_private.h"
+#include "util/mmal_util_convert.h"
 
 #include <SDL/SDL.h>
 
@@ -205,7 +206,7 @@ static MMAL_BOOL_T sdl_do_processing(MMAL_COMPONENT_T *component)
    MMAL_BUFFER_HEADER_T *buffer;
    uint8_t *src_plane[3];
    uint32_t *src_pitch;
-   unsigned int i, line;
+   unsigned int i;
    MMAL_BOOL_T eos;
    SDL_Rect rect;
 
@@ -262,12 +263,8 @@ static MMAL_BOOL_T sdl_do_processing(MMAL_COMPONENT_T *component)
       uint8_t *dst = module->sdl_overlay->pixels[i];
 
       if(i == 1) {width /= 2; height /= 2;}
-      for(line = 0; line < height; line++)
-      {
-         memcpy(dst, src, width);
-         src += src_pitch[i];
-         dst += module->sdl_overlay->pitches[i];
-      }
+      mmal_convert_copy_plane(dst, module->sdl_overlay->pitches[i], src, src_pitch[i],
+         width, height);
    }
    SDL_UnlockYUVOverlay(module->sdl_overlay);
 
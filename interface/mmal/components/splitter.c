@@ -31,20 +31,43 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal_logging.h"
 
 #define SPLITTER_OUTPUT_PORTS_NUM 4 /* 4 should do for now */
+#define SPLITTER_QUEUE_DEPTH_MAX 16
 
 /*****************************************************************************/
+/** Input buffer held in queued mode until all the outputs have taken or dropped it */
+typedef struct SPLITTER_SLOT_T
+{
+   MMAL_BUFFER_HEADER_T *buffer;
+   unsigned int refs;      /**< Output queues holding the buffer, 0 if the slot is free */
+   int64_t time;           /**< When the input buffer was taken */
+
+} SPLITTER_SLOT_T;
+
 typedef struct MMAL_COMPONENT_MODULE_T
 {
    uint32_t enabled_flags; /**< Flags indicating which output port is enabled */
    uint32_t sent_flags;    /**< Flags indicating which output port we've already sent data to */
    MMAL_BOOL_T error;      /**< Error state */
 
+   MMAL_BOOL_T queued;     /**< Outputs have queues of their own */
+   SPLITTER_SLOT_T slots[SPLITTER_OUTPUT_PORTS_NUM * SPLITTER_QUEUE_DEPTH_MAX];
+
 } MMAL_COMPONENT_MODULE_T;
 
 typedef struct MMAL_PORT_MODULE_T
 {
    MMAL_QUEUE_T *queue; /**< queue for the buffers sent to the ports */
 
+   /* Queued mode, output ports only */
+   MMAL_SPLITTER_POLICY_T policy;
+   uint32_t queue_depth;
+   uint32_t decimation;
+   uint32_t decimation_count;
+   SPLITTER_SLOT_T *pending[SPLITTER_QUEUE_DEPTH_MAX]; /**< Input buffers waiting for the port */
+   unsigned int pending_first, pending_num;
+   MMAL_BOOL_T blocking;   /**< Port is holding back the input */
+   MMAL_PARAMETER_SPLITTER_STATISTICS_T stats;
+
 } MMAL_PORT_MODULE_T;
 
 /*****************************************************************************/
@@ -102,11 +125,56 @@ static MMAL_STATUS_T splitter_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T c
    return MMAL_SUCCESS;
 }
 
+/** Release an output's reference to a held input buffer */
+static void splitter_slot_release(MMAL_COMPONENT_T *component, SPLITTER_SLOT_T *slot)
+{
+   MMAL_BUFFER_HEADER_T *in = slot->buffer;
+
+   if (--slot->refs)
+      return;
+
+   slot->buffer = NULL;
+   in->length = 0; /* Consume the input buffer */
+   mmal_port_buffer_header_callback(component->input[0], in);
+}
+
+/** Drop the oldest input buffer waiting for an output */
+static void splitter_pending_drop(MMAL_PORT_T *port)
+{
+   MMAL_PORT_MODULE_T *port_module = port->priv->module;
+   SPLITTER_SLOT_T *slot = port_module->pending[port_module->pending_first];
+
+   port_module->pending_first = (port_module->pending_first + 1) % SPLITTER_QUEUE_DEPTH_MAX;
+   port_module->pending_num--;
+   splitter_slot_release(port->component, slot);
+}
+
+/** Flush the input buffers waiting for an output */
+static void splitter_pending_flush(MMAL_PORT_T *port)
+{
+   while (port->priv->module->pending_num)
+      splitter_pending_drop(port);
+   port->priv->module->blocking = 0;
+}
+
 /** Flush a port */
 static MMAL_STATUS_T splitter_port_flush(MMAL_PORT_T *port)
 {
+   MMAL_COMPONENT_T *component = port->component;
    MMAL_PORT_MODULE_T *port_module = port->priv->module;
    MMAL_BUFFER_HEADER_T *buffer;
+   unsigned int i;
+
+   /* The input buffers held for the outputs go back with the input ones.
+    * The core holds the action lock while flushing. */
+   if (component->priv->module->queued)
+   {
+      if (port->type == MMAL_PORT_TYPE_INPUT)
+         for (i = 0; i < component->output_num; i++)
+            splitter_pending_flush(component->output[i]);
+      else
+         splitter_pending_flush(port);
+   }
 
    /* Flush buffers that our component is holding on to */
    buffer = mmal_queue_get(port_module->queue);
@@ -125,11 +193,20 @@ static MMAL_STATUS_T splitter_port_flush(MMAL_PORT_T *port)
 /** Disable processing on a port */
 static MMAL_STATUS_T splitter_port_disable(MMAL_PORT_T *port)
 {
+   MMAL_COMPONENT_T *component = port->component;
+   MMAL_STATUS_T status;
+
    if (port->type == MMAL_PORT_TYPE_OUTPUT)
-      port->component->priv->module->enabled_flags &= ~(1<<port->index);
+      component->priv->module->enabled_flags &= ~(1<<port->index);
 
    /* We just need to flush our internal queue */
-   return splitter_port_flush(port);
+   status = splitter_port_flush(port);
+
+   /* The input may have been held back for this output */
+   if (status == MMAL_SUCCESS && component->priv->module->queued &&
+       port->type == MMAL_PORT_TYPE_OUTPUT)
+      mmal_component_action_trigger(component);
+   return status;
 }
 
 /** Send a buffer header to a port */
@@ -157,6 +234,154 @@ static MMAL_STATUS_T splitter_send_output(MMAL_BUFFER_HEADER_T *buffer, MMAL_POR
    return status;
 }
 
+/** Send the input buffers waiting for an output, as long as it has buffer headers */
+static MMAL_STATUS_T splitter_pending_send(MMAL_PORT_T *out_port, MMAL_BOOL_T *progress)
+{
+   MMAL_PORT_MODULE_T *port_module = out_port->priv->module;
+   MMAL_STATUS_T status;
+   SPLITTER_SLOT_T *slot;
+   uint32_t latency;
+
+   while (port_module->pending_num)
+   {
+      slot = port_module->pending[port_module->pending_first];
+      status = splitter_send_output(slot->buffer, out_port);
+      if (status == MMAL_EAGAIN)
+         break;
+      if (status != MMAL_SUCCESS)
+         return status;
+
+      latency = (uint32_t)(vcos_getmicrosecs64() - slot->time);
+      port_module->stats.buffers++;
+      port_module->stats.latency_total += latency;
+      port_module->stats.latency_max = MMAL_MAX(port_module->stats.latency_max, latency);
+      splitter_pending_drop(out_port);
+      *progress = 1;
+   }
+
+   return MMAL_SUCCESS;
+}
+
+/** Find out whether an output has room for an input buffer */
+static MMAL_BOOL_T splitter_output_can_take(MMAL_PORT_T *out_port, MMAL_BUFFER_HEADER_T *in)
+{
+   MMAL_PORT_MODULE_T *port_module = out_port->priv->module;
+   MMAL_BOOL_T keep = in->cmd || (in->flags & MMAL_BUFFER_HEADER_FLAG_EOS);
+
+   if (port_module->pending_num < port_module->queue_depth)
+      return 1;
+   if (keep || port_module->policy == MMAL_SPLITTER_POLICY_BLOCK)
+   {
+      /* Only count the input being held back once */
+      if (!port_module->blocking)
+         port_module->stats.blocked++;
+      port_module->blocking = 1;
+      return 0;
+   }
+   return 1;
+}
+
+/** Queue an input buffer for an output, applying its decimation and policy */
+static void splitter_output_queue(MMAL_PORT_T *out_port, SPLITTER_SLOT_T *slot)
+{
+   MMAL_PORT_MODULE_T *port_module = out_port->priv->module;
+   MMAL_BUFFER_HEADER_T *in = slot->buffer;
+   MMAL_BOOL_T keep = in->cmd || (in->flags & MMAL_BUFFER_HEADER_FLAG_EOS);
+
+   port_module->blocking = 0;
+   if (!keep && port_module->decimation_count++ % port_module->decimation)
+   {
+      port_module->stats.decimated++;
+      return;
+   }
+
+   if (port_module->pending_num == port_module->queue_depth)
+   {
+      port_module->stats.dropped++;
+      if (port_module->policy == MMAL_SPLITTER_POLICY_DROP_NEWEST)
+         return;
+      splitter_pending_drop(out_port);
+   }
+
+   port_module->pending[(port_module->pending_first + port_module->pending_num) %
+                        SPLITTER_QUEUE_DEPTH_MAX] = slot;
+   port_module->pending_num++;
+   port_module->stats.queue_depth_max =
+      MMAL_MAX(port_module->stats.queue_depth_max, port_module->pending_num);
+   slot->refs++;
+}
+
+/** Take an input buffer and queue it for all the outputs */
+static MMAL_BOOL_T splitter_input_take(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_PORT_T *in_port = component->input[0];
+   SPLITTER_SLOT_T *slot = NULL;
+   MMAL_BUFFER_HEADER_T *in;
+   unsigned int i;
+
+   in = mmal_queue_get(in_port->priv->module->queue);
+   if (!in)
+      return 0;
+
+   for (i = 0; i < MMAL_COUNTOF(module->slots) && !slot; i++)
+      if (!module->slots[i].refs)
+         slot = &module->slots[i];
+
+   for (i = 0; i < component->output_num && slot; i++)
+      if ((module->enabled_flags & (1<<i)) &&
+          !splitter_output_can_take(component->output[i], in))
+         slot = NULL;
+
+   if (!slot)
+   {
+      mmal_queue_put_back(in_port->priv->module->queue, in);
+      return 0;
+   }
+
+   /* Hold a reference of our own while queueing so that the buffer
+    * isn't returned before all the outputs have seen it */
+   slot->buffer = in;
+   slot->refs = 1;
+   slot->time = vcos_getmicrosecs64();
+   for (i = 0; i < component->output_num; i++)
+      if (module->enabled_flags & (1<<i))
+         splitter_output_queue(component->output[i], slot);
+   splitter_slot_release(component, slot);
+   return 1;
+}
+
+/** Processing in queued mode */
+static void splitter_do_processing(MMAL_COMPONENT_T *component)
+{
+   MMAL_COMPONENT_MODULE_T *module = component->priv->module;
+   MMAL_STATUS_T status = MMAL_SUCCESS;
+   MMAL_BOOL_T progress = 1;
+   unsigned int i;
+
+   while (progress && !module->error)
+   {
+      progress = 0;
+      for (i = 0; i < component->output_num && status == MMAL_SUCCESS; i++)
+         status = splitter_pending_send(component->output[i], &progress);
+      if (status != MMAL_SUCCESS)
+         break;
+
+      progress |= splitter_input_take(component);
+   }
+
+   if (status == MMAL_SUCCESS)
+      return;
+
+   status = mmal_event_error_send(component, status);
+   if (status != MMAL_SUCCESS)
+   {
+      LOG_ERROR("unable to send an error event buffer (%i)", (int)status);
+      return;
+   }
+   module->error = 1;
+}
+
 /** Send a buffer header to a port */
 static MMAL_STATUS_T splitter_port_send(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
 {
@@ -172,6 +397,12 @@ static MMAL_STATUS_T splitter_port_send(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T
    if (module->error)
       return MMAL_SUCCESS; /* Just do nothing */
 
+   if (module->queued)
+   {
+      mmal_component_action_trigger(component);
+      return MMAL_SUCCESS;
+   }
+
    /* Get input buffer header */
    in_port = component->input[0];
    in = mmal_queue_get(in_port->priv->module->queue);
@@ -272,6 +503,97 @@ static MMAL_STATUS_T splitter_port_parameter_set(MMAL_PORT_T *port, const MMAL_P
       }
       return MMAL_SUCCESS;
 
+   case MMAL_PARAMETER_SPLITTER_OUTPUT:
+      {
+         const MMAL_PARAMETER_SPLITTER_OUTPUT_T *output = (const MMAL_PARAMETER_SPLITTER_OUTPUT_T *)param;
+         MMAL_PORT_MODULE_T *port_module = port->priv->module;
+         MMAL_STATUS_T status;
+
+         if (port->type != MMAL_PORT_TYPE_OUTPUT || param->size < sizeof(*output) ||
+             output->policy > MMAL_SPLITTER_POLICY_DROP_NEWEST ||
+             output->queue_depth > SPLITTER_QUEUE_DEPTH_MAX)
+            return MMAL_EINVAL;
+
+         if (!component->priv->module->queued)
+         {
+            /* Buffers already in the splitter would be lost on the way */
+            if (component->input[0]->is_enabled)
+            {
+               LOG_ERROR("queued mode can only be enabled while the input is disabled");
+               return MMAL_EINVAL;
+            }
+            status = mmal_component_action_register(component, splitter_do_processing);
+            if (status != MMAL_SUCCESS)
+               return status;
+            component->priv->module->queued = 1;
+         }
+
+         mmal_component_action_lock(component);
+         port_module->policy = output->policy;
+         port_module->queue_depth = output->queue_depth ? output->queue_depth : 1;
+         port_module->decimation = output->decimation ? output->decimation : 1;
+         port_module->decimation_count = 0;
+         while (port_module->pending_num > port_module->queue_depth)
+         {
+            port_module->stats.dropped++;
+            splitter_pending_drop(port);
+         }
+         mmal_component_action_unlock(component);
+         mmal_component_action_trigger(component);
+      }
+      return MMAL_SUCCESS;
+
+   default:
+      return MMAL_ENOSYS;
+   }
+}
+
+static MMAL_STATUS_T splitter_port_parameter_get(MMAL_PORT_T *port, MMAL_PARAMETER_HEADER_T *param)
+{
+   MMAL_COMPONENT_T *component = port->component;
+   MMAL_PORT_MODULE_T *port_module = port->priv->module;
+
+   if (port->type != MMAL_PORT_TYPE_OUTPUT)
+      return MMAL_ENOSYS;
+
+   switch (param->id)
+   {
+   case MMAL_PARAMETER_SPLITTER_OUTPUT:
+      {
+         MMAL_PARAMETER_SPLITTER_OUTPUT_T *output = (MMAL_PARAMETER_SPLITTER_OUTPUT_T *)param;
+
+         if (param->size < sizeof(*output))
+            return MMAL_EINVAL;
+         output->policy = port_module->policy;
+         output->queue_depth = port_module->queue_depth;
+         output->decimation = port_module->decimation;
+      }
+      return MMAL_SUCCESS;
+
+   case MMAL_PARAMETER_SPLITTER_STATISTICS:
+      {
+         MMAL_PARAMETER_SPLITTER_STATISTICS_T *stats = (MMAL_PARAMETER_SPLITTER_STATISTICS_T *)param;
+         MMAL_PARAMETER_HEADER_T hdr = *param;
+         MMAL_BOOL_T reset = stats->reset;
+
+         if (param->size < sizeof(*stats))
+            return MMAL_EINVAL;
+         if (!component->priv->module->queued)
+            return MMAL_ENOSYS;
+
+         mmal_component_action_lock(component);
+         *stats = port_module->stats;
+         stats->hdr = hdr;
+         if (reset)
+         {
+            memset(&port_module->stats, 0, sizeof(port_module->stats));
+            port_module->stats.queue_depth_max = port_module->pending_num;
+         }
+         mmal_component_action_unlock(component);
+         stats->reset = reset;
+      }
+      return MMAL_SUCCESS;
+
    default:
       return MMAL_ENOSYS;
    }
@@ -323,12 +645,15 @@ static MMAL_STATUS_T mmal_component_create_splitter(const char *name, MMAL_COMPO
       component->output[i]->priv->pf_send = splitter_port_send;
       component->output[i]->priv->pf_set_format = splitter_port_format_commit;
       component->output[i]->priv->pf_parameter_set = splitter_port_parameter_set;
+      component->output[i]->priv->pf_parameter_get = splitter_port_parameter_get;
       component->output[i]->buffer_num_min = 1;
       component->output[i]->buffer_num_recommended = 0;
       component->output[i]->capabilities = MMAL_PORT_CAPABILITY_PASSTHROUGH;
       component->output[i]->priv->module->queue = mmal_queue_create();
       if(!component->output[i]->priv->module->queue)
          goto error;
+      component->output[i]->priv->module->queue_depth = 1;
+      component->output[i]->priv->module->decimation = 1;
    }
 
    return MMAL_SUCCESS;
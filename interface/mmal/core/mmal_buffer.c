@@ -34,13 +34,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define DEFAULT_COMMAND_SIZE 256 /**< 256 bytes of space for commands */
 #define ALIGN  8
 
-/** Acquire a buffer header */
+/** Acquire a buffer header.
+ * The reference count is updated atomically so that replicated buffer headers
+ * can be acquired and released from several threads without extra locking. */
 void mmal_buffer_header_acquire(MMAL_BUFFER_HEADER_T *header)
 {
 #ifdef ENABLE_MMAL_EXTRA_LOGGING
    LOG_TRACE("%p (%i)", header, (int)header->priv->refcount+1);
 #endif
-   header->priv->refcount++;
+   __atomic_add_fetch(&header->priv->refcount, 1, __ATOMIC_RELAXED);
 }
 
 /** Reset a buffer header */
@@ -60,7 +62,9 @@ void mmal_buffer_header_release(MMAL_BUFFER_HEADER_T *header)
    LOG_TRACE("%p (%i)", header, (int)header->priv->refcount-1);
 #endif
 
-   if(--header->priv->refcount != 0)
+   /* Make sure all the writes done through other references are visible
+    * to whoever ends up recycling the buffer header */
+   if(__atomic_sub_fetch(&header->priv->refcount, 1, __ATOMIC_ACQ_REL) != 0)
       return;
 
    if (header->priv->pf_pre_release)
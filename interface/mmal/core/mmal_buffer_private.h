@@ -49,7 +49,8 @@ typedef struct MMAL_BUFFER_HEADER_PRIVATE_T
                                    during the release callback */
 
    int32_t refcount;          /**< Reference count of the buffer header. When it reaches 0,
-                                   the release callback will be called. */
+                                   the release callback will be called. Only ever accessed
+                                   atomically. */
 
    MMAL_BUFFER_HEADER_T *reference; /**< Reference to another acquired buffer header. */
 
@@ -63,6 +64,9 @@ typedef struct MMAL_BUFFER_HEADER_PRIVATE_T
    void *component_data;      /**< Field reserved for use by the component */
    void *payload_handle;      /**< Field reserved for mmal_buffer_header_mem_lock */
 
+   uint32_t port_time;        /**< Time (us) at which the buffer header was last sent to or
+                                   returned from a port. Used by the core statistics. */
+
    uint8_t driver_area[MMAL_DRIVER_BUFFER_SIZE];
 
 } MMAL_BUFFER_HEADER_PRIVATE_T;
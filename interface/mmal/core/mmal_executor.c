@@ -0,0 +1,350 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "mmal.h"
+#include "core/mmal_executor_private.h"
+#include "mmal_logging.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+/* Maximum number of worker threads in the executor */
+#define MMAL_EXECUTOR_THREADS_MAX 16
+
+/** Definition of the shared executor */
+static struct
+{
+   VCOS_MUTEX_T lock;              /**< Protects everything below */
+   MMAL_BOOL_T enabled;
+   MMAL_BOOL_T quit;
+   uint32_t cpu_mask;
+
+   unsigned int threads_num;
+   VCOS_THREAD_T threads[MMAL_EXECUTOR_THREADS_MAX];
+   VCOS_SEMAPHORE_T work;          /**< Posted once per item added to the run queue */
+
+   MMAL_EXECUTOR_ITEM_T *first;    /**< Run queue */
+   MMAL_EXECUTOR_ITEM_T **last;
+
+   MMAL_COMPONENT_EXECUTOR_STATS_T stats;
+} mmal_executor;
+
+static void mmal_executor_init_once(void)
+{
+   vcos_mutex_create(&mmal_executor.lock, "mmal executor");
+}
+
+static void mmal_executor_init(void)
+{
+   static VCOS_ONCE_T once = VCOS_ONCE_INIT;
+   vcos_init();
+   vcos_once(&once, mmal_executor_init_once);
+}
+
+/** Add an item at the end of the run queue. Executor lock must be held. */
+static void mmal_executor_queue(MMAL_EXECUTOR_ITEM_T *item)
+{
+   item->state = MMAL_EXECUTOR_ITEM_QUEUED;
+   item->next = NULL;
+   *mmal_executor.last = item;
+   mmal_executor.last = &item->next;
+
+   if (++mmal_executor.stats.queue_depth > mmal_executor.stats.queue_depth_max)
+      mmal_executor.stats.queue_depth_max = mmal_executor.stats.queue_depth;
+   vcos_semaphore_post(&mmal_executor.work);
+}
+
+/** Remove the item at the start of the run queue. Executor lock must be held. */
+static MMAL_EXECUTOR_ITEM_T *mmal_executor_dequeue(void)
+{
+   MMAL_EXECUTOR_ITEM_T *item = mmal_executor.first;
+
+   if (!item)
+      return NULL;
+
+   mmal_executor.first = item->next;
+   if (!mmal_executor.first)
+      mmal_executor.last = &mmal_executor.first;
+   mmal_executor.stats.queue_depth--;
+   return item;
+}
+
+static void *mmal_executor_worker(void *arg)
+{
+   MMAL_EXECUTOR_ITEM_T *item;
+   MMAL_PARAM_UNUSED(arg);
+
+#if defined(__linux__)
+   if (mmal_executor.cpu_mask)
+   {
+      cpu_set_t set;
+      unsigned int cpu;
+
+      CPU_ZERO(&set);
+      for (cpu = 0; cpu < 32; cpu++)
+         if (mmal_executor.cpu_mask & (1u << cpu))
+            CPU_SET(cpu, &set);
+      if (sched_setaffinity(0, sizeof(set), &set))
+         LOG_ERROR("failed to set affinity of worker to 0x%x", mmal_executor.cpu_mask);
+   }
+#endif
+
+   while (1)
+   {
+      vcos_semaphore_wait(&mmal_executor.work);
+
+      vcos_mutex_lock(&mmal_executor.lock);
+      if (mmal_executor.quit)
+      {
+         vcos_mutex_unlock(&mmal_executor.lock);
+         break;
+      }
+
+      /* The item might have been deregistered since it was queued */
+      item = mmal_executor_dequeue();
+      if (!item)
+      {
+         vcos_mutex_unlock(&mmal_executor.lock);
+         continue;
+      }
+      item->state = MMAL_EXECUTOR_ITEM_RUNNING;
+      mmal_executor.stats.runs++;
+      vcos_mutex_unlock(&mmal_executor.lock);
+
+      item->pf_run(item->context);
+
+      vcos_mutex_lock(&mmal_executor.lock);
+      if (item->waited)
+      {
+         item->state = MMAL_EXECUTOR_ITEM_IDLE;
+         vcos_semaphore_post(&item->done);
+      }
+      else if (item->pending)
+      {
+         item->pending = 0;
+         mmal_executor_queue(item);
+      }
+      else
+         item->state = MMAL_EXECUTOR_ITEM_IDLE;
+      vcos_mutex_unlock(&mmal_executor.lock);
+   }
+
+   return 0;
+}
+
+/** Start the shared executor */
+MMAL_STATUS_T mmal_component_executor_enable(unsigned int threads, uint32_t cpu_mask)
+{
+   MMAL_STATUS_T status = MMAL_SUCCESS;
+   VCOS_THREAD_ATTR_T attrs;
+   unsigned int i;
+
+   if (!threads || threads > MMAL_EXECUTOR_THREADS_MAX)
+      return MMAL_EINVAL;
+
+   mmal_executor_init();
+   vcos_mutex_lock(&mmal_executor.lock);
+   if (mmal_executor.enabled)
+   {
+      vcos_mutex_unlock(&mmal_executor.lock);
+      return MMAL_EINVAL;
+   }
+
+   if (vcos_semaphore_create(&mmal_executor.work, "mmal executor", 0) != VCOS_SUCCESS)
+   {
+      vcos_mutex_unlock(&mmal_executor.lock);
+      return MMAL_ENOSPC;
+   }
+
+   memset(&mmal_executor.stats, 0, sizeof(mmal_executor.stats));
+   mmal_executor.first = NULL;
+   mmal_executor.last = &mmal_executor.first;
+   mmal_executor.quit = 0;
+   mmal_executor.cpu_mask = cpu_mask;
+
+   vcos_thread_attr_init(&attrs);
+   for (i = 0; i < threads; i++)
+   {
+      if (vcos_thread_create(&mmal_executor.threads[i], "mmal worker", &attrs,
+                             mmal_executor_worker, NULL) != VCOS_SUCCESS)
+      {
+         LOG_ERROR("failed to create worker %u/%u", i, threads);
+         status = MMAL_ENOSPC;
+         break;
+      }
+   }
+   mmal_executor.threads_num = i;
+
+   if (status != MMAL_SUCCESS)
+   {
+      mmal_executor.quit = 1;
+      for (i = 0; i < mmal_executor.threads_num; i++)
+         vcos_semaphore_post(&mmal_executor.work);
+      vcos_mutex_unlock(&mmal_executor.lock);
+      for (i = 0; i < mmal_executor.threads_num; i++)
+         vcos_thread_join(&mmal_executor.threads[i], NULL);
+      vcos_semaphore_delete(&mmal_executor.work);
+      return status;
+   }
+
+   mmal_executor.stats.threads = threads;
+   mmal_executor.enabled = 1;
+   vcos_mutex_unlock(&mmal_executor.lock);
+   return MMAL_SUCCESS;
+}
+
+/** Stop the shared executor */
+MMAL_STATUS_T mmal_component_executor_disable(void)
+{
+   unsigned int i;
+
+   mmal_executor_init();
+   vcos_mutex_lock(&mmal_executor.lock);
+   if (!mmal_executor.enabled || mmal_executor.stats.components)
+   {
+      vcos_mutex_unlock(&mmal_executor.lock);
+      return MMAL_EINVAL;
+   }
+
+   mmal_executor.enabled = 0;
+   mmal_executor.quit = 1;
+   for (i = 0; i < mmal_executor.threads_num; i++)
+      vcos_semaphore_post(&mmal_executor.work);
+   vcos_mutex_unlock(&mmal_executor.lock);
+
+   for (i = 0; i < mmal_executor.threads_num; i++)
+      vcos_thread_join(&mmal_executor.threads[i], NULL);
+   vcos_semaphore_delete(&mmal_executor.work);
+   mmal_executor.threads_num = 0;
+   return MMAL_SUCCESS;
+}
+
+/** Retrieve the statistics of the shared executor */
+MMAL_STATUS_T mmal_component_executor_stats_get(MMAL_COMPONENT_EXECUTOR_STATS_T *stats,
+                                                MMAL_BOOL_T reset)
+{
+   if (!stats)
+      return MMAL_EINVAL;
+
+   mmal_executor_init();
+   vcos_mutex_lock(&mmal_executor.lock);
+   if (!mmal_executor.enabled)
+   {
+      vcos_mutex_unlock(&mmal_executor.lock);
+      return MMAL_ENOSYS;
+   }
+
+   *stats = mmal_executor.stats;
+   if (reset)
+   {
+      mmal_executor.stats.queue_depth_max = mmal_executor.stats.queue_depth;
+      mmal_executor.stats.triggers = 0;
+      mmal_executor.stats.triggers_coalesced = 0;
+      mmal_executor.stats.runs = 0;
+   }
+   vcos_mutex_unlock(&mmal_executor.lock);
+   return MMAL_SUCCESS;
+}
+
+/** Register a work item with the executor */
+MMAL_STATUS_T mmal_executor_item_register(MMAL_EXECUTOR_ITEM_T *item,
+                                          void (*pf_run)(void *context), void *context)
+{
+   mmal_executor_init();
+   vcos_mutex_lock(&mmal_executor.lock);
+   if (!mmal_executor.enabled)
+   {
+      vcos_mutex_unlock(&mmal_executor.lock);
+      return MMAL_ENOSYS;
+   }
+
+   if (vcos_semaphore_create(&item->done, "mmal executor item", 0) != VCOS_SUCCESS)
+   {
+      vcos_mutex_unlock(&mmal_executor.lock);
+      return MMAL_ENOSPC;
+   }
+
+   item->pf_run = pf_run;
+   item->context = context;
+   item->next = NULL;
+   item->state = MMAL_EXECUTOR_ITEM_IDLE;
+   item->pending = 0;
+   item->waited = 0;
+   mmal_executor.stats.components++;
+   vcos_mutex_unlock(&mmal_executor.lock);
+   return MMAL_SUCCESS;
+}
+
+/** Schedule a work item */
+void mmal_executor_item_trigger(MMAL_EXECUTOR_ITEM_T *item)
+{
+   vcos_mutex_lock(&mmal_executor.lock);
+   mmal_executor.stats.triggers++;
+   switch (item->state)
+   {
+   case MMAL_EXECUTOR_ITEM_IDLE:
+      mmal_executor_queue(item);
+      break;
+   case MMAL_EXECUTOR_ITEM_RUNNING:
+      item->pending = 1;
+      /* Fall through */
+   default:
+      mmal_executor.stats.triggers_coalesced++;
+      break;
+   }
+   vcos_mutex_unlock(&mmal_executor.lock);
+}
+
+/** Deregister a work item */
+void mmal_executor_item_deregister(MMAL_EXECUTOR_ITEM_T *item)
+{
+   MMAL_EXECUTOR_ITEM_T **link;
+
+   vcos_mutex_lock(&mmal_executor.lock);
+   if (item->state == MMAL_EXECUTOR_ITEM_QUEUED)
+   {
+      for (link = &mmal_executor.first; *link != item; link = &(*link)->next);
+      *link = item->next;
+      if (mmal_executor.last == &item->next)
+         mmal_executor.last = link;
+      mmal_executor.stats.queue_depth--;
+      item->state = MMAL_EXECUTOR_ITEM_IDLE;
+   }
+   else if (item->state == MMAL_EXECUTOR_ITEM_RUNNING)
+   {
+      item->waited = 1;
+      vcos_mutex_unlock(&mmal_executor.lock);
+      vcos_semaphore_wait(&item->done);
+      vcos_mutex_lock(&mmal_executor.lock);
+   }
+   mmal_executor.stats.components--;
+   vcos_mutex_unlock(&mmal_executor.lock);
+
+   vcos_semaphore_delete(&item->done);
+}
@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MMAL_EXECUTOR_PRIVATE_H
+#define MMAL_EXECUTOR_PRIVATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mmal.h"
+
+/** State of a work item scheduled on the executor */
+typedef enum
+{
+   MMAL_EXECUTOR_ITEM_IDLE = 0,  /**< Not scheduled */
+   MMAL_EXECUTOR_ITEM_QUEUED,    /**< Waiting in the run queue */
+   MMAL_EXECUTOR_ITEM_RUNNING,   /**< Being run by a worker */
+} MMAL_EXECUTOR_ITEM_STATE_T;
+
+/** Work item scheduled on the shared executor.
+ * A work item is never run by more than one worker at a time. Triggering an item
+ * which is already queued is a no-op and triggering it while it is running will
+ * have it run once more afterwards. */
+typedef struct MMAL_EXECUTOR_ITEM_T
+{
+   void (*pf_run)(void *context);       /**< Function run by the worker */
+   void *context;                       /**< Context passed to pf_run */
+
+   /* Private to the executor */
+   struct MMAL_EXECUTOR_ITEM_T *next;   /**< Next item in the run queue */
+   MMAL_EXECUTOR_ITEM_STATE_T state;
+   MMAL_BOOL_T pending;                 /**< Triggered again while running */
+   MMAL_BOOL_T waited;                  /**< Deregistration is waiting for the run to finish */
+   VCOS_SEMAPHORE_T done;               /**< Signalled when a waited run finishes */
+} MMAL_EXECUTOR_ITEM_T;
+
+/** Register a work item with the executor.
+ *
+ * @param item     work item to register.
+ * @param pf_run   function run each time the item is triggered.
+ * @param context  context passed to pf_run.
+ * @return MMAL_SUCCESS, or MMAL_ENOSYS if the executor hasn't been enabled.
+ */
+MMAL_STATUS_T mmal_executor_item_register(MMAL_EXECUTOR_ITEM_T *item,
+                                          void (*pf_run)(void *context), void *context);
+
+/** Schedule a registered work item to be run by one of the workers.
+ *
+ * @param item     work item to schedule.
+ */
+void mmal_executor_item_trigger(MMAL_EXECUTOR_ITEM_T *item);
+
+/** Deregister a work item.
+ * This removes the item from the run queue and waits for it to finish running if
+ * a worker is currently running it.
+ *
+ * @param item     work item to deregister.
+ */
+void mmal_executor_item_deregister(MMAL_EXECUTOR_ITEM_T *item);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MMAL_EXECUTOR_PRIVATE_H */
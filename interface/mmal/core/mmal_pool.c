@@ -30,6 +30,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "core/mmal_buffer_private.h"
 #include "mmal_logging.h"
 
+/** Maximum number of buffer headers in a per-thread cache */
+#define MMAL_POOL_CACHE_SIZE_MAX 32
+
+/** Per-thread cache of free buffer headers */
+typedef struct MMAL_POOL_CACHE_T
+{
+   struct MMAL_POOL_CACHE_T *next;   /**< Next cache belonging to the same pool */
+   unsigned int length;              /**< Number of buffer headers in the cache */
+   MMAL_BUFFER_HEADER_T *header[MMAL_POOL_CACHE_SIZE_MAX];
+} MMAL_POOL_CACHE_T;
+
 /** Definition of a pool */
 typedef struct MMAL_POOL_PRIVATE_T
 {
@@ -47,12 +58,18 @@ typedef struct MMAL_POOL_PRIVATE_T
 
    unsigned int headers_alloc_num; /**< Number of buffer headers allocated as part of the private structure */
 
+   unsigned int cache_size;        /**< Maximum number of buffer headers per thread cache, 0 if disabled */
+   VCOS_TLS_KEY_T cache_key;       /**< Key to the calling thread's cache */
+   VCOS_MUTEX_T cache_lock;        /**< Protects the list of caches */
+   MMAL_POOL_CACHE_T *caches;      /**< List of all the caches created for this pool */
+
 } MMAL_POOL_PRIVATE_T;
 
 #define ROUND_UP(s,align) ((((unsigned long)(s)) & ~((align)-1)) + (align))
 #define ALIGN  8
 
 static void mmal_pool_buffer_header_release(MMAL_BUFFER_HEADER_T *header);
+static void mmal_pool_cache_flush_all(MMAL_POOL_T *pool);
 
 static void *mmal_pool_allocator_default_alloc(void *context, uint32_t size)
 {
@@ -199,6 +216,19 @@ void mmal_pool_destroy(MMAL_POOL_T *pool)
    if (!pool)
       return;
 
+   if (((MMAL_POOL_PRIVATE_T *)pool)->cache_size)
+   {
+      MMAL_POOL_PRIVATE_T *private = (MMAL_POOL_PRIVATE_T *)pool;
+      while (private->caches)
+      {
+         MMAL_POOL_CACHE_T *cache = private->caches;
+         private->caches = cache->next;
+         vcos_free(cache);
+      }
+      vcos_tls_delete(private->cache_key);
+      vcos_mutex_delete(&private->cache_lock);
+   }
+
    /* If the payload_size is non-zero then the buffer header payload
     * must be freed. Otherwise it is the caller's responsibility. */
    for (i = 0; i < pool->headers_num; ++i)
@@ -230,6 +260,7 @@ MMAL_STATUS_T mmal_pool_resize(MMAL_POOL_T *pool, unsigned int headers, uint32_t
       return MMAL_SUCCESS;
 
    /* Remove all the headers from the queue */
+   mmal_pool_cache_flush_all(pool);
    for (i = 0; i < pool->headers_num; i++)
       mmal_queue_get(pool->queue);
 
@@ -272,11 +303,26 @@ static void mmal_pool_buffer_header_release(MMAL_BUFFER_HEADER_T *header)
    MMAL_POOL_PRIVATE_T *private = (MMAL_POOL_PRIVATE_T *)pool;
    MMAL_BOOL_T queue_buffer = 1;
 
-   header->priv->refcount = 1;
+   __atomic_store_n(&header->priv->refcount, 1, __ATOMIC_RELAXED);
    if(private->cb)
       queue_buffer = private->cb(pool, header, private->userdata);
-   if (queue_buffer)
-      mmal_queue_put(pool->queue, header);
+   if (!queue_buffer)
+      return;
+
+   /* Keep the buffer header in the releasing thread's cache if that thread
+    * is a user of the cache and other buffer headers are still available
+    * to threads waiting on the queue */
+   if (private->cache_size)
+   {
+      MMAL_POOL_CACHE_T *cache = vcos_tls_get(private->cache_key);
+      if (cache && cache->length < private->cache_size && mmal_queue_length(pool->queue))
+      {
+         cache->header[cache->length++] = header;
+         return;
+      }
+   }
+
+   mmal_queue_put(pool->queue, header);
 }
 
 /** Set a buffer header release callback to the pool */
@@ -301,3 +347,104 @@ void mmal_pool_pre_release_callback_set(MMAL_POOL_T *pool, MMAL_BH_PRE_RELEASE_C
       header = (MMAL_BUFFER_HEADER_T *)((uint8_t*)header + private->header_size);
    }
 }
+
+/** Enable per-thread caches of free buffer headers */
+MMAL_STATUS_T mmal_pool_cache_enable(MMAL_POOL_T *pool, unsigned int cache_size)
+{
+   MMAL_POOL_PRIVATE_T *private = (MMAL_POOL_PRIVATE_T *)pool;
+
+   if (!pool || private->cache_size || cache_size > MMAL_POOL_CACHE_SIZE_MAX)
+      return MMAL_EINVAL;
+   if (!cache_size)
+      return MMAL_SUCCESS;
+
+   if (vcos_mutex_create(&private->cache_lock, "MMAL pool cache") != VCOS_SUCCESS)
+      return MMAL_ENOSPC;
+   if (vcos_tls_create(&private->cache_key) != VCOS_SUCCESS)
+   {
+      vcos_mutex_delete(&private->cache_lock);
+      return MMAL_ENOSPC;
+   }
+
+   private->caches = NULL;
+   private->cache_size = cache_size;
+   return MMAL_SUCCESS;
+}
+
+/** Get the calling thread's cache, creating it if needed */
+static MMAL_POOL_CACHE_T *mmal_pool_cache_get(MMAL_POOL_PRIVATE_T *private)
+{
+   MMAL_POOL_CACHE_T *cache = vcos_tls_get(private->cache_key);
+
+   if (cache)
+      return cache;
+
+   cache = vcos_calloc(1, sizeof(*cache), "MMAL pool cache");
+   if (!cache)
+      return NULL;
+   if (vcos_tls_set(private->cache_key, cache) != VCOS_SUCCESS)
+   {
+      vcos_free(cache);
+      return NULL;
+   }
+
+   vcos_mutex_lock(&private->cache_lock);
+   cache->next = private->caches;
+   private->caches = cache;
+   vcos_mutex_unlock(&private->cache_lock);
+   return cache;
+}
+
+/** Get a free buffer header from a pool */
+MMAL_BUFFER_HEADER_T *mmal_pool_buffer_get(MMAL_POOL_T *pool)
+{
+   MMAL_POOL_PRIVATE_T *private = (MMAL_POOL_PRIVATE_T *)pool;
+
+   if (!pool)
+      return NULL;
+
+   if (private->cache_size)
+   {
+      MMAL_POOL_CACHE_T *cache = mmal_pool_cache_get(private);
+      if (cache && cache->length)
+         return cache->header[--cache->length];
+   }
+
+   return mmal_queue_get(pool->queue);
+}
+
+/** Put the buffer headers cached by the calling thread back into the queue */
+void mmal_pool_cache_flush(MMAL_POOL_T *pool)
+{
+   MMAL_POOL_PRIVATE_T *private = (MMAL_POOL_PRIVATE_T *)pool;
+   MMAL_POOL_CACHE_T *cache;
+
+   if (!pool || !private->cache_size)
+      return;
+
+   cache = vcos_tls_get(private->cache_key);
+   if (cache && cache->length)
+   {
+      mmal_queue_put_batch(pool->queue, cache->header, cache->length);
+      cache->length = 0;
+   }
+}
+
+/** Put the buffer headers held in all the caches back into the queue.
+ * The pool must not be in use by any other thread. */
+static void mmal_pool_cache_flush_all(MMAL_POOL_T *pool)
+{
+   MMAL_POOL_PRIVATE_T *private = (MMAL_POOL_PRIVATE_T *)pool;
+   MMAL_POOL_CACHE_T *cache;
+
+   if (!private->cache_size)
+      return;
+
+   vcos_mutex_lock(&private->cache_lock);
+   for (cache = private->caches; cache; cache = cache->next)
+   {
+      mmal_queue_put_batch(pool->queue, cache->header, cache->length);
+      cache->length = 0;
+   }
+   vcos_mutex_unlock(&private->cache_lock);
+}
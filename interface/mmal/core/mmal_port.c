@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "util/mmal_util.h"
 #include "core/mmal_component_private.h"
 #include "core/mmal_port_private.h"
+#include "core/mmal_buffer_private.h"
 #include "interface/vcos/vcos.h"
 #include "mmal_logging.h"
 #include "interface/mmal/util/mmal_util.h"
@@ -54,6 +55,29 @@ static MMAL_STATUS_T mmal_port_private_parameter_get(MMAL_PORT_T *port,
 static MMAL_STATUS_T mmal_port_private_parameter_set(MMAL_PORT_T *port,
                                                      const MMAL_PARAMETER_HEADER_T *param);
 
+/** Histogram counters of one thread for one direction of a port. Only the owning
+ * thread writes to the counters so they don't need atomic read-modify-write
+ * operations, readers add up the counters of all the threads. */
+typedef struct MMAL_PORT_HISTOGRAM_COUNTERS_T
+{
+   struct MMAL_PORT_HISTOGRAM_COUNTERS_T *next;
+   VCOS_THREAD_T *thread; /**< Owning thread */
+   uint32_t latency[MMAL_CORE_HISTOGRAM_BUCKETS];
+   uint32_t inter_arrival[MMAL_CORE_HISTOGRAM_BUCKETS];
+   /** Values of the counters at the last reset. Only used by readers, under stats_lock. */
+   uint32_t latency_base[MMAL_CORE_HISTOGRAM_BUCKETS];
+   uint32_t inter_arrival_base[MMAL_CORE_HISTOGRAM_BUCKETS];
+} MMAL_PORT_HISTOGRAM_COUNTERS_T;
+
+/** Latency and inter-arrival histograms for one direction of a port */
+typedef struct MMAL_PORT_HISTOGRAMS_T
+{
+   uint32_t last_time; /**< Time (us) of the last buffer, 0 if none */
+   /** Counters of each thread which sent buffers in this direction. Entries are only
+    * ever added, with atomic operations, and freed with the port. */
+   MMAL_PORT_HISTOGRAM_COUNTERS_T *counters;
+} MMAL_PORT_HISTOGRAMS_T;
+
 /* Define this if you want to log all buffer transfers */
 //#define ENABLE_MMAL_EXTRA_LOGGING
 
@@ -94,6 +118,8 @@ typedef struct MMAL_PORT_PRIVATE_CORE_T
 
    /** Per-port statistics collected directly by the MMAL core */
    MMAL_CORE_PORT_STATISTICS_T stats;
+   /** Per-port histograms collected directly by the MMAL core, indexed by direction */
+   MMAL_PORT_HISTOGRAMS_T histograms[2];
 
    char *name; /**< Port name */
    unsigned int name_size; /** Size of the memory area reserved for the name string */
@@ -116,7 +142,9 @@ static void mmal_port_connected_output_cb(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_
 static MMAL_BOOL_T mmal_port_connected_pool_cb(MMAL_POOL_T *pool, MMAL_BUFFER_HEADER_T *buffer, void *userdata);
 
 static void mmal_port_name_update(MMAL_PORT_T *port);
-static void mmal_port_update_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction);
+static uint32_t mmal_port_buffer_stamp(MMAL_BUFFER_HEADER_T *buffer, uint32_t *stc);
+static void mmal_port_update_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction,
+                                        uint32_t stc, uint32_t buffer_time);
 
 /*****************************************************************************/
 
@@ -227,6 +255,8 @@ MMAL_PORT_T *mmal_port_alloc(MMAL_COMPONENT_T *component, MMAL_PORT_TYPE_T type,
 /** Free a port structure */
 void mmal_port_free(MMAL_PORT_T *port)
 {
+   unsigned int i;
+
    LOG_TRACE("%s at %p", port ? port->name : "<invalid>", port);
 
    if (!port)
@@ -234,6 +264,16 @@ void mmal_port_free(MMAL_PORT_T *port)
 
    vcos_assert(port->format == port->priv->core->format_ptr_copy);
    mmal_format_free(port->priv->core->format_ptr_copy);
+   for (i = 0; i < 2; i++)
+   {
+      MMAL_PORT_HISTOGRAM_COUNTERS_T *counters = port->priv->core->histograms[i].counters;
+      while (counters)
+      {
+         MMAL_PORT_HISTOGRAM_COUNTERS_T *next = counters->next;
+         vcos_free(counters);
+         counters = next;
+      }
+   }
    vcos_mutex_delete(&port->priv->core->connection_lock);
    vcos_mutex_delete(&port->priv->core->stats_lock);
    vcos_semaphore_delete(&port->priv->core->transit_sema);
@@ -710,6 +750,7 @@ MMAL_STATUS_T mmal_port_send_buffer(MMAL_PORT_T *port,
    MMAL_BUFFER_HEADER_T *buffer)
 {
    MMAL_STATUS_T status = MMAL_SUCCESS;
+   uint32_t stc, buffer_time;
 
    if (!port || !port->priv)
    {
@@ -752,6 +793,8 @@ MMAL_STATUS_T mmal_port_send_buffer(MMAL_PORT_T *port,
    /* coverity[lock_order] since transit_sema is not a lock, there is no ordering conflict */
    IN_TRANSIT_INCREMENT(port);
 
+   buffer_time = mmal_port_buffer_stamp(buffer, &stc);
+
    if (port->priv->core->is_paused)
    {
       /* Add buffer to our internal queue */
@@ -772,7 +815,7 @@ MMAL_STATUS_T mmal_port_send_buffer(MMAL_PORT_T *port,
    }
    else
    {
-      mmal_port_update_port_stats(port, MMAL_CORE_STATS_RX);
+      mmal_port_update_port_stats(port, MMAL_CORE_STATS_RX, stc, buffer_time);
    }
 
    UNLOCK_SENDING(port);
@@ -908,7 +951,8 @@ void mmal_port_buffer_header_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *b
 
    if (MMAL_COLLECT_PORT_STATS_ENABLED)
    {
-      mmal_port_update_port_stats(port, MMAL_CORE_STATS_TX);
+      uint32_t stc, buffer_time = mmal_port_buffer_stamp(buffer, &stc);
+      mmal_port_update_port_stats(port, MMAL_CORE_STATS_TX, stc, buffer_time);
    }
 
    port->priv->core->buffer_header_callback(port, buffer);
@@ -1394,6 +1438,7 @@ static MMAL_STATUS_T mmal_port_get_core_stats(MMAL_PORT_T *port, MMAL_PARAMETER_
    MMAL_CORE_STATISTICS_T *stats = &stats_param->stats;
    MMAL_CORE_STATISTICS_T *src_stats;
    MMAL_PORT_PRIVATE_CORE_T *core = port->priv->core;
+
    vcos_mutex_lock(&core->stats_lock);
    switch (stats_param->dir)
    {
@@ -1404,38 +1449,178 @@ static MMAL_STATUS_T mmal_port_get_core_stats(MMAL_PORT_T *port, MMAL_PARAMETER_
       src_stats = &port->priv->core->stats.tx;
       break;
    }
-   *stats = *src_stats;
+   stats->buffer_count = __atomic_load_n(&src_stats->buffer_count, __ATOMIC_RELAXED);
+   stats->first_buffer_time = __atomic_load_n(&src_stats->first_buffer_time, __ATOMIC_RELAXED);
+   stats->last_buffer_time = __atomic_load_n(&src_stats->last_buffer_time, __ATOMIC_RELAXED);
+   stats->max_delay = __atomic_load_n(&src_stats->max_delay, __ATOMIC_RELAXED);
    if (stats_param->reset)
-      memset(src_stats, 0, sizeof(*src_stats));
+   {
+      __atomic_store_n(&src_stats->buffer_count, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&src_stats->first_buffer_time, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&src_stats->last_buffer_time, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&src_stats->max_delay, 0, __ATOMIC_RELAXED);
+   }
    vcos_mutex_unlock(&core->stats_lock);
    return MMAL_SUCCESS;
 }
 
-/** Update the port stats, called per buffer.
+/** Get the histogram bucket a duration falls into */
+static unsigned int mmal_port_histogram_bucket(uint32_t duration)
+{
+   unsigned int bucket = 0;
+
+   while (duration && bucket < MMAL_CORE_HISTOGRAM_BUCKETS - 1)
+   {
+      duration >>= 1;
+      bucket++;
+   }
+   return bucket;
+}
+
+/** Add up the counters of all the threads, optionally resetting them */
+static void mmal_port_histogram_collect(MMAL_PORT_HISTOGRAMS_T *histograms,
+                                        MMAL_CORE_HISTOGRAM_T *latency,
+                                        MMAL_CORE_HISTOGRAM_T *inter_arrival, MMAL_BOOL_T reset)
+{
+   MMAL_PORT_HISTOGRAM_COUNTERS_T *counters;
+   unsigned int i;
+
+   memset(latency, 0, sizeof(*latency));
+   memset(inter_arrival, 0, sizeof(*inter_arrival));
+   for (counters = __atomic_load_n(&histograms->counters, __ATOMIC_ACQUIRE); counters;
+        counters = counters->next)
+   {
+      for (i = 0; i < MMAL_CORE_HISTOGRAM_BUCKETS; i++)
+      {
+         /* The owner may be updating the counters, only ever use a single read of each */
+         uint32_t value = __atomic_load_n(&counters->latency[i], __ATOMIC_RELAXED);
+         latency->bucket[i] += value - counters->latency_base[i];
+         if (reset)
+            counters->latency_base[i] = value;
+
+         value = __atomic_load_n(&counters->inter_arrival[i], __ATOMIC_RELAXED);
+         inter_arrival->bucket[i] += value - counters->inter_arrival_base[i];
+         if (reset)
+            counters->inter_arrival_base[i] = value;
+      }
+   }
+
+   for (i = 0; i < MMAL_CORE_HISTOGRAM_BUCKETS; i++)
+   {
+      latency->count += latency->bucket[i];
+      inter_arrival->count += inter_arrival->bucket[i];
+   }
+}
+
+static MMAL_STATUS_T mmal_port_get_core_histograms(MMAL_PORT_T *port, MMAL_PARAMETER_HEADER_T *param)
+{
+   MMAL_PARAMETER_CORE_HISTOGRAMS_T *histograms_param = (MMAL_PARAMETER_CORE_HISTOGRAMS_T *)param;
+   MMAL_PORT_PRIVATE_CORE_T *core = port->priv->core;
+   MMAL_PORT_HISTOGRAMS_T *histograms;
+
+   if (param->size < sizeof(*histograms_param))
+      return MMAL_EINVAL;
+
+   histograms = &core->histograms[histograms_param->dir == MMAL_CORE_STATS_RX ? 0 : 1];
+   vcos_mutex_lock(&core->stats_lock);
+   mmal_port_histogram_collect(histograms, &histograms_param->latency,
+                               &histograms_param->inter_arrival, histograms_param->reset);
+   if (histograms_param->reset)
+      __atomic_store_n(&histograms->last_time, 0, __ATOMIC_RELAXED);
+   vcos_mutex_unlock(&core->stats_lock);
+   return MMAL_SUCCESS;
+}
+
+/** Get the calling thread's histogram counters, creating them if needed.
+ * The list is short, one entry per thread sending buffers through the port. */
+static MMAL_PORT_HISTOGRAM_COUNTERS_T *mmal_port_histogram_counters(MMAL_PORT_HISTOGRAMS_T *histograms)
+{
+   VCOS_THREAD_T *thread = vcos_thread_current();
+   MMAL_PORT_HISTOGRAM_COUNTERS_T *counters, *head;
+
+   head = __atomic_load_n(&histograms->counters, __ATOMIC_ACQUIRE);
+   for (counters = head; counters; counters = counters->next)
+      if (counters->thread == thread)
+         return counters;
+
+   counters = vcos_calloc(1, sizeof(*counters), "mmal port histogram");
+   if (!counters)
+      return NULL;
+   counters->thread = thread;
+   counters->next = head;
+   while (!__atomic_compare_exchange_n(&histograms->counters, &counters->next, counters, 1,
+                                       __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+   return counters;
+}
+
+/** Count a sample in a histogram owned by the calling thread */
+static inline void mmal_port_histogram_count(uint32_t *histogram, uint32_t duration)
+{
+   uint32_t *bucket = &histogram[mmal_port_histogram_bucket(duration)];
+   __atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+}
+
+/** Record the current time in a buffer header.
+ * This needs to happen before the buffer header is handed over, as it could be
+ * sent back to us straight away.
  *
+ * @param stc returns the current time (us)
+ * @return the time previously recorded in the buffer header, 0 if none
  */
-static void mmal_port_update_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction)
+static uint32_t mmal_port_buffer_stamp(MMAL_BUFFER_HEADER_T *buffer, uint32_t *stc)
+{
+   uint32_t buffer_time = buffer->priv->port_time;
+
+   /* 0 is used to mean 'no time recorded' */
+   *stc = vcos_getmicrosecs();
+   if (!*stc)
+      *stc = 1;
+   buffer->priv->port_time = *stc;
+   return buffer_time;
+}
+
+/** Update the port stats, called per buffer.
+ * This doesn't take any lock. The counters are updated atomically and the histograms
+ * are counted in counters owned by the calling thread.
+ */
+static void mmal_port_update_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR direction,
+                                        uint32_t stc, uint32_t buffer_time)
 {
    MMAL_PORT_PRIVATE_CORE_T *core = port->priv->core;
    MMAL_CORE_STATISTICS_T *stats;
-   unsigned stc = vcos_getmicrosecs();
-
-   vcos_mutex_lock(&core->stats_lock);
+   MMAL_PORT_HISTOGRAMS_T *histograms;
+   MMAL_PORT_HISTOGRAM_COUNTERS_T *counters;
+   uint32_t last, max;
 
    stats = direction == MMAL_CORE_STATS_RX ? &core->stats.rx : &core->stats.tx;
+   histograms = &core->histograms[direction == MMAL_CORE_STATS_RX ? 0 : 1];
+   counters = mmal_port_histogram_counters(histograms);
 
-   stats->buffer_count++;
+   __atomic_add_fetch(&stats->buffer_count, 1, __ATOMIC_RELAXED);
 
-   if (!stats->first_buffer_time)
+   last = 0;
+   if (__atomic_compare_exchange_n(&stats->first_buffer_time, &last, stc, 0,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED))
    {
-      stats->last_buffer_time = stats->first_buffer_time = stc;
+      __atomic_store_n(&stats->last_buffer_time, stc, __ATOMIC_RELAXED);
    }
    else
    {
-      stats->max_delay = vcos_max(stats->max_delay, stc-stats->last_buffer_time);
-      stats->last_buffer_time = stc;
+      last = __atomic_exchange_n(&stats->last_buffer_time, stc, __ATOMIC_RELAXED);
+      max = __atomic_load_n(&stats->max_delay, __ATOMIC_RELAXED);
+      while (last && stc - last > max &&
+             !__atomic_compare_exchange_n(&stats->max_delay, &max, stc - last, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
    }
-   vcos_mutex_unlock(&core->stats_lock);
+
+   last = __atomic_exchange_n(&histograms->last_time, stc, __ATOMIC_RELAXED);
+   if (!counters)
+      return; /* Out of memory, the sample is lost */
+
+   if (last)
+      mmal_port_histogram_count(counters->inter_arrival, stc - last);
+   if (buffer_time)
+      mmal_port_histogram_count(counters->latency, stc - buffer_time);
 }
 
 static MMAL_STATUS_T mmal_port_private_parameter_get(MMAL_PORT_T *port,
@@ -1445,6 +1630,8 @@ static MMAL_STATUS_T mmal_port_private_parameter_get(MMAL_PORT_T *port,
    {
    case MMAL_PARAMETER_CORE_STATISTICS:
       return mmal_port_get_core_stats(port, param);
+   case MMAL_PARAMETER_CORE_HISTOGRAMS:
+      return mmal_port_get_core_histograms(port, param);
    default:
       return MMAL_ENOSYS;
    }
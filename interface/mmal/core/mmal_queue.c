@@ -28,6 +28,29 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal.h"
 #include "mmal_queue.h"
 
+#if defined(__linux__)
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define MMAL_QUEUE_HAVE_FUTEX
+#endif
+
+/** Size of a cache line. Used to keep the producer and consumer indices of
+ * a lock-free queue from sharing a line. */
+#define MMAL_QUEUE_CACHE_LINE 64
+
+/** Slot of the ring used by a lock-free queue.
+ * The sequence number tells producers and consumers whether the slot is
+ * free or filled for the current lap around the ring. */
+typedef struct MMAL_QUEUE_CELL_T
+{
+   uint32_t sequence;
+   MMAL_BUFFER_HEADER_T *buffer;
+} MMAL_QUEUE_CELL_T;
+
 /** Definition of the QUEUE */
 struct MMAL_QUEUE_T
 {
@@ -36,6 +59,20 @@ struct MMAL_QUEUE_T
    MMAL_BUFFER_HEADER_T *first;
    MMAL_BUFFER_HEADER_T **last;
    VCOS_SEMAPHORE_T semaphore;
+
+   /* Lock-free queues only. The list above then only holds the buffer headers
+    * which have been put back, and the semaphore is only used as a wake-up
+    * mechanism on platforms without futexes. */
+   MMAL_QUEUE_CELL_T *cells;   /**< Ring of cells, NULL for a mutex based queue */
+   uint32_t mask;              /**< Number of cells in the ring minus 1 */
+
+   uint8_t pad_enqueue[MMAL_QUEUE_CACHE_LINE];
+   uint32_t enqueue_pos;       /**< Next position to be filled by a producer */
+   uint8_t pad_dequeue[MMAL_QUEUE_CACHE_LINE];
+   uint32_t dequeue_pos;       /**< Next position to be emptied by a consumer */
+   uint8_t pad_wait[MMAL_QUEUE_CACHE_LINE];
+   uint32_t waiters;           /**< Number of consumers about to block on the queue */
+   uint32_t wakeup;            /**< Bumped by producers when waking up consumers */
 };
 
 // Only sanity check if asserts are enabled
@@ -80,18 +117,249 @@ MMAL_QUEUE_T *mmal_queue_create(void)
    queue->length = 0;
    queue->first = 0;
    queue->last = &queue->first;
+   queue->cells = 0;
    mmal_queue_sanity_check(queue, NULL);
    /* gratuitous unlock for coverity */ vcos_mutex_unlock(&queue->lock);
 
    return queue;
 }
 
+/** Create a lock-free QUEUE of MMAL_BUFFER_HEADER_T */
+MMAL_QUEUE_T *mmal_queue_create_lockfree(unsigned int capacity)
+{
+   MMAL_QUEUE_T *queue;
+   unsigned int i, size = 2;
+
+   while (size < capacity && size < (1u << 30))
+      size <<= 1;
+
+   queue = mmal_queue_create();
+   if (!queue) return 0;
+
+   queue->cells = vcos_calloc(size, sizeof(*queue->cells), "MMAL queue cells");
+   if (!queue->cells)
+   {
+      mmal_queue_destroy(queue);
+      return 0;
+   }
+
+   for (i = 0; i < size; i++)
+      queue->cells[i].sequence = i;
+   queue->mask = size - 1;
+   queue->enqueue_pos = queue->dequeue_pos = 0;
+   queue->waiters = queue->wakeup = 0;
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   return queue;
+}
+
+/** Claim and fill up to count consecutive cells of the ring.
+ * A single compare-and-swap reserves the whole batch. */
+static unsigned int mmal_queue_ring_put(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T **buffers,
+   unsigned int count)
+{
+   uint32_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+   unsigned int i, n;
+
+   while (1)
+   {
+      for (n = 0; n < count && n <= queue->mask; n++)
+      {
+         MMAL_QUEUE_CELL_T *cell = &queue->cells[(pos + n) & queue->mask];
+         if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != pos + n)
+            break;
+      }
+
+      if (!n)
+      {
+         MMAL_QUEUE_CELL_T *cell = &queue->cells[pos & queue->mask];
+         int32_t diff = (int32_t)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - pos);
+         if (diff < 0)
+            return 0; /* The ring is full */
+         /* Another producer got there first */
+         pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+         continue;
+      }
+
+      if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + n, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+         break;
+   }
+
+   for (i = 0; i < n; i++)
+   {
+      MMAL_QUEUE_CELL_T *cell = &queue->cells[(pos + i) & queue->mask];
+      cell->buffer = buffers[i];
+      __atomic_store_n(&cell->sequence, pos + i + 1, __ATOMIC_RELEASE);
+   }
+
+   return n;
+}
+
+/** Claim and empty up to max consecutive cells of the ring */
+static unsigned int mmal_queue_ring_get(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T **buffers,
+   unsigned int max)
+{
+   uint32_t pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+   unsigned int i, n;
+
+   while (1)
+   {
+      for (n = 0; n < max && n <= queue->mask; n++)
+      {
+         MMAL_QUEUE_CELL_T *cell = &queue->cells[(pos + n) & queue->mask];
+         if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != pos + n + 1)
+            break;
+      }
+
+      if (!n)
+      {
+         MMAL_QUEUE_CELL_T *cell = &queue->cells[pos & queue->mask];
+         int32_t diff = (int32_t)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (pos + 1));
+         if (diff < 0)
+            return 0; /* The ring is empty */
+         /* Another consumer got there first */
+         pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+         continue;
+      }
+
+      if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + n, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+         break;
+   }
+
+   for (i = 0; i < n; i++)
+   {
+      MMAL_QUEUE_CELL_T *cell = &queue->cells[(pos + i) & queue->mask];
+      buffers[i] = cell->buffer;
+      __atomic_store_n(&cell->sequence, pos + i + queue->mask + 1, __ATOMIC_RELEASE);
+   }
+
+   return n;
+}
+
+/** Wake up consumers blocked on a lock-free QUEUE, if there are any */
+static void mmal_queue_ring_signal(MMAL_QUEUE_T *queue, unsigned int count)
+{
+   uint32_t waiters;
+
+   /* Pairs with the fence in mmal_queue_ring_wait(). Either the waiter sees
+    * our buffers when it checks the queue again, or we see the waiter here. */
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   waiters = __atomic_load_n(&queue->waiters, __ATOMIC_RELAXED);
+   if (!waiters)
+      return;
+
+   if (count > waiters)
+      count = waiters;
+   __atomic_fetch_add(&queue->wakeup, 1, __ATOMIC_SEQ_CST);
+#ifdef MMAL_QUEUE_HAVE_FUTEX
+   syscall(SYS_futex, &queue->wakeup, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#else
+   while (count--)
+      vcos_semaphore_post(&queue->semaphore);
+#endif
+}
+
+/** Get up to max MMAL_BUFFER_HEADER_T from a lock-free QUEUE, starting with
+ * the ones which have been put back */
+static unsigned int mmal_queue_ring_get_batch(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T **buffers,
+   unsigned int max)
+{
+   unsigned int n = 0;
+
+   if (__atomic_load_n(&queue->length, __ATOMIC_ACQUIRE))
+   {
+      vcos_mutex_lock(&queue->lock);
+      while (n < max && queue->first)
+      {
+         buffers[n++] = queue->first;
+         queue->first = queue->first->next;
+         __atomic_fetch_sub(&queue->length, 1, __ATOMIC_RELEASE);
+      }
+      if (!queue->first) queue->last = &queue->first;
+      vcos_mutex_unlock(&queue->lock);
+   }
+
+   if (n < max)
+      n += mmal_queue_ring_get(queue, buffers + n, max - n);
+
+   return n;
+}
+
+/** Wait for a MMAL_BUFFER_HEADER_T from a lock-free QUEUE.
+ * Only goes to the kernel if the queue is empty. */
+static MMAL_BUFFER_HEADER_T *mmal_queue_ring_wait(MMAL_QUEUE_T *queue, int timed, VCOS_UNSIGNED timeout)
+{
+   MMAL_BUFFER_HEADER_T *buffer;
+   uint32_t start = timed ? vcos_getmicrosecs() : 0, wakeup, elapsed;
+
+   while (1)
+   {
+      if (mmal_queue_ring_get_batch(queue, &buffer, 1))
+         return buffer;
+
+      __atomic_fetch_add(&queue->waiters, 1, __ATOMIC_SEQ_CST);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      wakeup = __atomic_load_n(&queue->wakeup, __ATOMIC_SEQ_CST);
+
+      if (mmal_queue_ring_get_batch(queue, &buffer, 1))
+      {
+         __atomic_fetch_sub(&queue->waiters, 1, __ATOMIC_SEQ_CST);
+         return buffer;
+      }
+
+      elapsed = timed ? (vcos_getmicrosecs() - start) / 1000 : 0;
+      if (timed && elapsed >= timeout)
+      {
+         __atomic_fetch_sub(&queue->waiters, 1, __ATOMIC_SEQ_CST);
+         return NULL;
+      }
+
+#ifdef MMAL_QUEUE_HAVE_FUTEX
+      if (timed)
+      {
+         struct timespec ts;
+         ts.tv_sec = (timeout - elapsed) / 1000;
+         ts.tv_nsec = ((timeout - elapsed) % 1000) * 1000000;
+         syscall(SYS_futex, &queue->wakeup, FUTEX_WAIT_PRIVATE, wakeup, &ts, NULL, 0);
+      }
+      else
+         syscall(SYS_futex, &queue->wakeup, FUTEX_WAIT_PRIVATE, wakeup, NULL, NULL, 0);
+#else
+      vcos_unused(wakeup);
+      if (timed)
+         vcos_semaphore_wait_timeout(&queue->semaphore, timeout - elapsed);
+      else
+         vcos_semaphore_wait(&queue->semaphore);
+#endif
+
+      __atomic_fetch_sub(&queue->waiters, 1, __ATOMIC_SEQ_CST);
+   }
+}
+
+/** Give other threads a chance to make room in a full lock-free QUEUE */
+static void mmal_queue_ring_yield(void)
+{
+#ifdef MMAL_QUEUE_HAVE_FUTEX
+   sched_yield();
+#else
+   vcos_sleep(1);
+#endif
+}
+
 /** Put a MMAL_BUFFER_HEADER_T into a QUEUE */
 void mmal_queue_put(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer)
 {
    vcos_assert(queue && buffer);
    if(!queue || !buffer) return;
 
+   if (queue->cells)
+   {
+      mmal_queue_put_batch(queue, &buffer, 1);
+      return;
+   }
+
    vcos_mutex_lock(&queue->lock);
    mmal_queue_sanity_check(queue, buffer);
    queue->length++;
@@ -118,14 +386,55 @@ void mmal_queue_put_back(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer)
 
    vcos_mutex_lock(&queue->lock);
    mmal_queue_sanity_check(queue, buffer);
-   queue->length++;
    buffer->next = queue->first;
    queue->first = buffer;
    if(queue->last == &queue->first) queue->last = &buffer->next;
+   if (queue->cells)
+   {
+      __atomic_fetch_add(&queue->length, 1, __ATOMIC_RELEASE);
+      vcos_mutex_unlock(&queue->lock);
+      mmal_queue_ring_signal(queue, 1);
+      return;
+   }
+   queue->length++;
    vcos_semaphore_post(&queue->semaphore);
    vcos_mutex_unlock(&queue->lock);
 }
 
+/** Put several MMAL_BUFFER_HEADER_T into a QUEUE */
+void mmal_queue_put_batch(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T **buffers, unsigned int count)
+{
+   unsigned int i, n;
+
+   vcos_assert(queue && (buffers || !count));
+   if(!queue || !buffers || !count) return;
+
+   if (queue->cells)
+   {
+      for (i = 0; i < count; i += n)
+      {
+         n = mmal_queue_ring_put(queue, buffers + i, count - i);
+         if (n)
+            mmal_queue_ring_signal(queue, n);
+         else
+            mmal_queue_ring_yield();
+      }
+      return;
+   }
+
+   vcos_mutex_lock(&queue->lock);
+   for (i = 0; i < count; i++)
+   {
+      mmal_queue_sanity_check(queue, buffers[i]);
+      queue->length++;
+      *queue->last = buffers[i];
+      buffers[i]->next = 0;
+      queue->last = &buffers[i]->next;
+      vcos_semaphore_post(&queue->semaphore);
+   }
+   vcos_mutex_unlock(&queue->lock);
+}
+
 
 /** Get a MMAL_BUFFER_HEADER_T from a QUEUE. Semaphore already claimed */
 static MMAL_BUFFER_HEADER_T *mmal_queue_get_core(MMAL_QUEUE_T *queue)
@@ -152,17 +461,59 @@ MMAL_BUFFER_HEADER_T *mmal_queue_get(MMAL_QUEUE_T *queue)
    vcos_assert(queue);
    if(!queue) return 0;
 
+   if (queue->cells)
+   {
+      MMAL_BUFFER_HEADER_T *buffer;
+      return mmal_queue_ring_get_batch(queue, &buffer, 1) ? buffer : NULL;
+   }
+
    if(vcos_semaphore_trywait(&queue->semaphore) != VCOS_SUCCESS)
        return NULL;
 
    return mmal_queue_get_core(queue);
 }
 
+/** Get several MMAL_BUFFER_HEADER_T from a QUEUE. */
+unsigned int mmal_queue_get_batch(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T **buffers, unsigned int max)
+{
+   unsigned int n;
+
+   vcos_assert(queue && (buffers || !max));
+   if(!queue || !buffers) return 0;
+
+   if (queue->cells)
+      return mmal_queue_ring_get_batch(queue, buffers, max);
+
+   /* Claim as many buffers as we can before taking the lock once */
+   for (n = 0; n < max; n++)
+      if (vcos_semaphore_trywait(&queue->semaphore) != VCOS_SUCCESS)
+         break;
+   if (!n)
+      return 0;
+
+   vcos_mutex_lock(&queue->lock);
+   mmal_queue_sanity_check(queue, NULL);
+   for (max = 0; max < n; max++)
+   {
+      buffers[max] = queue->first;
+      vcos_assert(buffers[max] != NULL);
+      queue->first = buffers[max]->next;
+   }
+   if(!queue->first) queue->last = &queue->first;
+   queue->length -= n;
+   vcos_mutex_unlock(&queue->lock);
+
+   return n;
+}
+
 /** Wait for a MMAL_BUFFER_HEADER_T from a QUEUE. */
 MMAL_BUFFER_HEADER_T *mmal_queue_wait(MMAL_QUEUE_T *queue)
 {
 	if(!queue) return 0;
 
+   if (queue->cells)
+      return mmal_queue_ring_wait(queue, 0, 0);
+
    if (vcos_semaphore_wait(&queue->semaphore) != VCOS_SUCCESS)
        return NULL;
 
@@ -174,6 +525,9 @@ MMAL_BUFFER_HEADER_T *mmal_queue_timedwait(MMAL_QUEUE_T *queue, VCOS_UNSIGNED ti
     if (!queue)
         return NULL;
 
+    if (queue->cells)
+        return mmal_queue_ring_wait(queue, 1, timeout);
+
     if (vcos_semaphore_wait_timeout(&queue->semaphore, timeout) != VCOS_SUCCESS)
         return NULL;
 
@@ -185,6 +539,14 @@ unsigned int mmal_queue_length(MMAL_QUEUE_T *queue)
 {
 	if(!queue) return 0;
 
+	if (queue->cells)
+	{
+		uint32_t enqueued = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE);
+		uint32_t dequeued = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE);
+		int32_t diff = (int32_t)(enqueued - dequeued);
+		return __atomic_load_n(&queue->length, __ATOMIC_ACQUIRE) + (diff > 0 ? diff : 0);
+	}
+
 	return queue->length;
 }
 
@@ -192,6 +554,7 @@ unsigned int mmal_queue_length(MMAL_QUEUE_T *queue)
 void mmal_queue_destroy(MMAL_QUEUE_T *queue)
 {
    if(!queue) return;
+   if (queue->cells) vcos_free(queue->cells);
    vcos_mutex_delete(&queue->lock);
    vcos_semaphore_delete(&queue->semaphore);
    vcos_free(queue);
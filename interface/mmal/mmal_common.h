@@ -69,6 +69,19 @@ typedef struct MMAL_CORE_STATISTICS_T
    uint32_t max_delay;           /**< Max delay (us) between buffers, ignoring first few frames */
 } MMAL_CORE_STATISTICS_T;
 
+/** Number of buckets in a MMAL_CORE_HISTOGRAM_T */
+#define MMAL_CORE_HISTOGRAM_BUCKETS 32
+
+/** Log-bucketed histogram of durations collected by the core.
+ * Bucket 0 counts durations of 0us and bucket n counts durations in the
+ * [2^(n-1), 2^n) us range.
+ */
+typedef struct MMAL_CORE_HISTOGRAM_T
+{
+   uint32_t count;                                /**< Total number of samples */
+   uint32_t bucket[MMAL_CORE_HISTOGRAM_BUCKETS];  /**< Number of samples per bucket */
+} MMAL_CORE_HISTOGRAM_T;
+
 /** Statistics collected by the core on all ports, if enabled in the build.
  */
 typedef struct MMAL_CORE_PORT_STATISTICS_T
@@ -139,6 +139,44 @@ MMAL_STATUS_T mmal_component_enable(MMAL_COMPONENT_T *component);
  */
 MMAL_STATUS_T mmal_component_disable(MMAL_COMPONENT_T *component);
 
+/** Statistics of the shared component executor */
+typedef struct MMAL_COMPONENT_EXECUTOR_STATS_T
+{
+   uint32_t threads;             /**< Number of worker threads */
+   uint32_t components;          /**< Number of components currently using the executor */
+   uint32_t queue_depth;         /**< Number of component actions waiting to be run */
+   uint32_t queue_depth_max;     /**< Highest queue_depth seen */
+   uint64_t triggers;            /**< Number of times an action has been triggered */
+   uint64_t triggers_coalesced;  /**< Triggers merged with an action already queued or running */
+   uint64_t runs;                /**< Number of times an action has been run */
+} MMAL_COMPONENT_EXECUTOR_STATS_T;
+
+/** Run the actions of components on a shared pool of worker threads.
+ * By default each component which needs a processing thread gets a dedicated one.
+ * Once the executor is enabled, components created afterwards will have their actions
+ * scheduled on a fixed number of worker threads instead. The action of a given component
+ * is never run by more than one worker at a time.
+ *
+ * @param threads  number of worker threads
+ * @param cpu_mask mask of the CPUs the worker threads can run on, 0 for no restriction
+ * @return MMAL_SUCCESS on success, MMAL_EINVAL if the executor is already enabled
+ */
+MMAL_STATUS_T mmal_component_executor_enable(unsigned int threads, uint32_t cpu_mask);
+
+/** Stop the shared component executor.
+ * Components created afterwards will use dedicated processing threads again.
+ * @return MMAL_SUCCESS on success, MMAL_EINVAL if components are still using the executor
+ */
+MMAL_STATUS_T mmal_component_executor_disable(void);
+
+/** Retrieve the statistics of the shared component executor.
+ * @param stats returned statistics
+ * @param reset reset the counters and queue_depth_max after retrieving them
+ * @return MMAL_SUCCESS on success, MMAL_ENOSYS if the executor isn't enabled
+ */
+MMAL_STATUS_T mmal_component_executor_stats_get(MMAL_COMPONENT_EXECUTOR_STATS_T *stats,
+                                                MMAL_BOOL_T reset);
+
 /* @} */
 
 #ifdef __cplusplus
@@ -74,7 +74,11 @@ enum {
    MMAL_PARAMETER_LOGGING,                /**< Takes a MMAL_PARAMETER_LOGGING_T */
    MMAL_PARAMETER_SYSTEM_TIME,            /**< Takes a MMAL_PARAMETER_UINT64_T */
    MMAL_PARAMETER_NO_IMAGE_PADDING,       /**< Takes a MMAL_PARAMETER_BOOLEAN_T */
-   MMAL_PARAMETER_LOCKSTEP_ENABLE         /**< Takes a MMAL_PARAMETER_BOOLEAN_T */
+   MMAL_PARAMETER_LOCKSTEP_ENABLE,        /**< Takes a MMAL_PARAMETER_BOOLEAN_T */
+   MMAL_PARAMETER_CORE_HISTOGRAMS,        /**< Takes a MMAL_PARAMETER_CORE_HISTOGRAMS_T */
+   MMAL_PARAMETER_SPLITTER_OUTPUT,        /**< Takes a MMAL_PARAMETER_SPLITTER_OUTPUT_T */
+   MMAL_PARAMETER_SPLITTER_STATISTICS,    /**< Takes a MMAL_PARAMETER_SPLITTER_STATISTICS_T */
+   MMAL_PARAMETER_TEST_PATTERN            /**< Takes a MMAL_PARAMETER_TEST_PATTERN_T */
 };
 
 /**@}*/
@@ -167,6 +171,92 @@ typedef struct MMAL_PARAMETER_CORE_STATISTICS_T
    MMAL_CORE_STATISTICS_T stats;    /**< The statistics */
 } MMAL_PARAMETER_CORE_STATISTICS_T;
 
+/** MMAL core latency histograms. These are collected by the core itself.
+ * For the RX direction, the latency is the time between a buffer header leaving
+ * a port (or being created) and it being sent to this port. For the TX direction,
+ * it is the time the buffer header spent in this port.
+ * TX statistics are only collected when the core is built with MMAL_COLLECT_PORT_STATS.
+ * Without them, the RX latency is the round-trip time of the buffer header.
+ */
+typedef struct MMAL_PARAMETER_CORE_HISTOGRAMS_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+   MMAL_CORE_STATS_DIR dir;
+   MMAL_BOOL_T reset;                     /**< Reset to zero after reading */
+   MMAL_CORE_HISTOGRAM_T latency;         /**< Latency of the buffers */
+   MMAL_CORE_HISTOGRAM_T inter_arrival;   /**< Time between consecutive buffers */
+} MMAL_PARAMETER_CORE_HISTOGRAMS_T;
+
+/** What a splitter output does with a buffer it has no room for */
+typedef enum
+{
+   MMAL_SPLITTER_POLICY_BLOCK,            /**< Hold back the input until the output has room */
+   MMAL_SPLITTER_POLICY_DROP_OLDEST,      /**< Drop the oldest buffer waiting for the output */
+   MMAL_SPLITTER_POLICY_DROP_NEWEST,      /**< Drop the new buffer */
+   MMAL_SPLITTER_POLICY_MAX = 0x7fffffff  /* Force 32 bit size for this enum */
+} MMAL_SPLITTER_POLICY_T;
+
+/**
+ * Queueing of the buffers sent to a splitter output port.
+ * Setting this on any output switches the splitter to queued mode, where each
+ * output has a queue of its own for the buffers it hasn't been able to take yet,
+ * so that a slow output only holds back the input if its policy says so. An input
+ * buffer is returned once all the outputs have taken or dropped it. Outputs which
+ * haven't been configured block with a queue depth of 1.
+ * EOS and event buffers are never dropped or decimated.
+ */
+typedef struct MMAL_PARAMETER_SPLITTER_OUTPUT_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   MMAL_SPLITTER_POLICY_T policy;
+   uint32_t queue_depth;   /**< Buffers which can wait for this output, 0 for the default of 1 */
+   uint32_t decimation;    /**< Only send 1 in every N buffers to this output, 0 or 1 for all */
+} MMAL_PARAMETER_SPLITTER_OUTPUT_T;
+
+/**
+ * Statistics of a splitter output port in queued mode.
+ * Latencies are measured from the splitter taking the input buffer to the output
+ * getting it.
+ */
+typedef struct MMAL_PARAMETER_SPLITTER_STATISTICS_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   MMAL_BOOL_T reset;         /**< Reset to zero after reading */
+   uint32_t buffers;          /**< Buffers sent to the output */
+   uint32_t dropped;          /**< Buffers dropped by the policy */
+   uint32_t decimated;        /**< Buffers skipped by decimation */
+   uint32_t blocked;          /**< Times the output held back the input */
+   uint32_t queue_depth_max;  /**< Most buffers seen waiting for the output */
+   uint32_t latency_max;      /**< Microseconds */
+   uint64_t latency_total;    /**< Microseconds, divide by buffers for the mean */
+} MMAL_PARAMETER_SPLITTER_STATISTICS_T;
+
+/** Images generated by test sources */
+typedef enum
+{
+   MMAL_TEST_PATTERN_FLAT,                /**< White, with the chroma changing every frame */
+   MMAL_TEST_PATTERN_GRADIENT,            /**< Diagonal luma gradient scrolling each frame */
+   MMAL_TEST_PATTERN_MOVING_BOX,          /**< Box bouncing around a grey background */
+   MMAL_TEST_PATTERN_NOISE,               /**< Random pixels, the same for a given seed and frame */
+   MMAL_TEST_PATTERN_MAX = 0x7fffffff     /* Force 32 bit size for this enum */
+} MMAL_TEST_PATTERN_T;
+
+/**
+ * Test pattern of a source such as the artificial camera.
+ * The frame counter is drawn along the top left of the image, from the most
+ * significant bit, as a row of 8x8 blocks which are white for 1 and black for 0.
+ */
+typedef struct MMAL_PARAMETER_TEST_PATTERN_T
+{
+   MMAL_PARAMETER_HEADER_T hdr;
+
+   MMAL_TEST_PATTERN_T pattern;
+   MMAL_BOOL_T frame_counter;   /**< Draw the 32 bit frame number into the image */
+   uint32_t seed;               /**< Seed of MMAL_TEST_PATTERN_NOISE */
+} MMAL_PARAMETER_TEST_PATTERN_T;
+
 /**
  * Component memory usage statistics.
  */
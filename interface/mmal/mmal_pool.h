@@ -158,6 +158,39 @@ void mmal_pool_callback_set(MMAL_POOL_T *pool, MMAL_POOL_BH_CB_T cb, void *userd
  */
 void mmal_pool_pre_release_callback_set(MMAL_POOL_T *pool, MMAL_BH_PRE_RELEASE_CB_T cb, void *userdata);
 
+/** Enable per-thread caches of free buffer headers in front of the pool's queue.
+ * Once enabled, a thread which gets its buffer headers with mmal_pool_buffer_get() will
+ * keep up to cache_size of the buffer headers it releases in a private free-list instead of
+ * sending them back through the pool's queue. This avoids contention on the queue when
+ * the same thread keeps recycling buffer headers.
+ *
+ * Buffer headers are only cached while the pool's queue still holds some free buffer headers,
+ * so that threads waiting on the queue don't get starved. A thread should call
+ * mmal_pool_cache_flush() before exiting so that its cached buffer headers go back to the queue.
+ *
+ * This must be called before the pool is in use.
+ *
+ * @param pool       Pointer to the pool
+ * @param cache_size Maximum number of buffer headers cached per thread. 0 disables caching.
+ * @return MMAL_SUCCESS or an error on failure.
+ */
+MMAL_STATUS_T mmal_pool_cache_enable(MMAL_POOL_T *pool, unsigned int cache_size);
+
+/** Get a free buffer header from a pool.
+ * This will first look in the calling thread's cache (see mmal_pool_cache_enable()) and then
+ * in the pool's queue. This doesn't block.
+ *
+ * @param pool     Pointer to the pool
+ * @return Pointer to a buffer header or NULL if none is available.
+ */
+MMAL_BUFFER_HEADER_T *mmal_pool_buffer_get(MMAL_POOL_T *pool);
+
+/** Put the buffer headers cached by the calling thread back into the pool's queue.
+ *
+ * @param pool     Pointer to the pool
+ */
+void mmal_pool_cache_flush(MMAL_POOL_T *pool);
+
 /* @} */
 
 #ifdef __cplusplus
@@ -48,6 +48,21 @@ typedef struct MMAL_QUEUE_T MMAL_QUEUE_T;
  */
 MMAL_QUEUE_T *mmal_queue_create(void);
 
+/** Create a lock-free queue of MMAL_BUFFER_HEADER_T
+ * The queue is a bounded multi-producer, multi-consumer ring. Putting and getting
+ * buffer headers doesn't take a mutex and blocking waits only go to the kernel
+ * when the queue is actually empty.
+ * The capacity is rounded up to a power of 2 and must be large enough to hold
+ * every buffer header that can be in the queue at the same time (e.g. the number
+ * of headers in the pool feeding it). A put on a full queue will yield until
+ * space becomes available.
+ *
+ * @param capacity Maximum number of buffer headers held by the queue
+ *
+ * @return Pointer to the newly created queue or NULL on failure.
+ */
+MMAL_QUEUE_T *mmal_queue_create_lockfree(unsigned int capacity);
+
 /** Put a MMAL_BUFFER_HEADER_T into a queue
  *
  * @param queue  Pointer to a queue
@@ -64,6 +79,26 @@ void mmal_queue_put(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer);
  */
 void mmal_queue_put_back(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T *buffer);
 
+/** Put several MMAL_BUFFER_HEADER_T into a queue in one go.
+ * The buffer headers are queued in array order.
+ *
+ * @param queue   Pointer to a queue
+ * @param buffers Array of pointers to the MMAL_BUFFER_HEADER_T to add to the queue
+ * @param count   Number of entries in the array
+ */
+void mmal_queue_put_batch(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T **buffers, unsigned int count);
+
+/** Get up to a given number of MMAL_BUFFER_HEADER_T from a queue in one go.
+ * This doesn't block.
+ *
+ * @param queue   Pointer to a queue
+ * @param buffers Array receiving the pointers to the dequeued MMAL_BUFFER_HEADER_T
+ * @param max     Size of the array
+ *
+ * @return number of buffer headers dequeued (0 if the queue is empty).
+ */
+unsigned int mmal_queue_get_batch(MMAL_QUEUE_T *queue, MMAL_BUFFER_HEADER_T **buffers, unsigned int max);
+
 /** Get a MMAL_BUFFER_HEADER_T from a queue
  *
  * @param queue  Pointer to a queue
@@ -0,0 +1,311 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Checks the SIMD versions of the pixel conversions against the scalar ones
+ * and measures the throughput of both.
+ *
+ * Each conversion is run with the CPU features disabled and enabled on random
+ * images of awkward sizes and pitches, and the whole of both destination
+ * buffers compared, so writes past the end of lines are caught as well.
+ * Returns non-zero if any of them differ.
+ *
+ * Usage: mmal_bench_convert [iterations] [width] [height] */
+
+#include "mmal.h"
+#include "mmal_encodings.h"
+#include "util/mmal_util_convert.h"
+#include "interface/vcos/vcos.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_PAD 37    /* Extra bytes at the end of each line */
+
+typedef struct BENCH_IMAGE_T
+{
+   MMAL_CONVERT_PLANES_T planes;
+   uint8_t *buffer;
+   size_t size;
+} BENCH_IMAGE_T;
+
+typedef void (*BENCH_CONVERT_T)(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height);
+
+static void bench_bgra_to_rgba(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_bgra_to_rgba(dst->planes.data[0], dst->planes.pitch[0],
+      src->planes.data[0], src->planes.pitch[0], width, height);
+}
+
+static void bench_rgb24_to_rgba(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_rgb24_to_rgba(dst->planes.data[0], dst->planes.pitch[0],
+      src->planes.data[0], src->planes.pitch[0], width, height, 0xff);
+}
+
+static void bench_rgba_to_rgb24(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_rgba_to_rgb24(dst->planes.data[0], dst->planes.pitch[0],
+      src->planes.data[0], src->planes.pitch[0], width, height);
+}
+
+static void bench_i420_to_nv12(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_i420_to_nv12(&dst->planes, &src->planes, width, height);
+}
+
+static void bench_nv12_to_i420(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_nv12_to_i420(&dst->planes, &src->planes, width, height);
+}
+
+static void bench_yuyv_to_i420(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_yuyv_to_i420(&dst->planes, src->planes.data[0], src->planes.pitch[0],
+      width, height);
+}
+
+static void bench_yuyv_to_i422(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_yuyv_to_i422(&dst->planes, src->planes.data[0], src->planes.pitch[0],
+      width, height);
+}
+
+static void bench_i422_to_yuyv(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_i422_to_yuyv(dst->planes.data[0], dst->planes.pitch[0], &src->planes,
+      width, height);
+}
+
+static void bench_yuyv_y(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_extract_y(dst->planes.data[0], dst->planes.pitch[0],
+      src->planes.data[0], src->planes.pitch[0], width, height, MMAL_ENCODING_YUYV);
+}
+
+static void bench_uyvy_y(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_extract_y(dst->planes.data[0], dst->planes.pitch[0],
+      src->planes.data[0], src->planes.pitch[0], width, height, MMAL_ENCODING_UYVY);
+}
+
+static void bench_copy_plane(const BENCH_IMAGE_T *dst, const BENCH_IMAGE_T *src,
+   unsigned int width, unsigned int height)
+{
+   mmal_convert_copy_plane(dst->planes.data[0], dst->planes.pitch[0],
+      src->planes.data[0], src->planes.pitch[0], width, height);
+}
+
+/* Bytes per pixel of each plane of an image, in 1/4 of a byte so that
+ * subsampled chroma can be described */
+typedef struct BENCH_LAYOUT_T
+{
+   unsigned int num;
+   unsigned int width_q[3];    /* Line length, quarters of bytes per pixel */
+   unsigned int half_height;   /* Chroma planes have half the lines */
+} BENCH_LAYOUT_T;
+
+static const BENCH_LAYOUT_T layout_rgba = { 1, {16}, 0 };
+static const BENCH_LAYOUT_T layout_rgb24 = { 1, {12}, 0 };
+static const BENCH_LAYOUT_T layout_422 = { 1, {8}, 0 };
+static const BENCH_LAYOUT_T layout_y = { 1, {4}, 0 };
+static const BENCH_LAYOUT_T layout_i420 = { 3, {4, 2, 2}, 1 };
+static const BENCH_LAYOUT_T layout_nv12 = { 2, {4, 4}, 1 };
+static const BENCH_LAYOUT_T layout_i422 = { 3, {4, 2, 2}, 0 };
+
+static const struct
+{
+   const char *name;
+   BENCH_CONVERT_T convert;
+   const BENCH_LAYOUT_T *src, *dst;
+} bench_tests[] =
+{
+   { "BGRA->RGBA",  bench_bgra_to_rgba,  &layout_rgba,  &layout_rgba },
+   { "RGB24->RGBA", bench_rgb24_to_rgba, &layout_rgb24, &layout_rgba },
+   { "RGBA->RGB24", bench_rgba_to_rgb24, &layout_rgba,  &layout_rgb24 },
+   { "I420->NV12",  bench_i420_to_nv12,  &layout_i420,  &layout_nv12 },
+   { "NV12->I420",  bench_nv12_to_i420,  &layout_nv12,  &layout_i420 },
+   { "YUYV->I420",  bench_yuyv_to_i420,  &layout_422,   &layout_i420 },
+   { "YUYV->I422",  bench_yuyv_to_i422,  &layout_422,   &layout_i422 },
+   { "I422->YUYV",  bench_i422_to_yuyv,  &layout_i422,  &layout_422 },
+   { "YUYV->Y",     bench_yuyv_y,        &layout_422,   &layout_y },
+   { "UYVY->Y",     bench_uyvy_y,        &layout_422,   &layout_y },
+   { "copy plane",  bench_copy_plane,    &layout_y,     &layout_y },
+};
+
+static int bench_image_alloc(BENCH_IMAGE_T *image, const BENCH_LAYOUT_T *layout,
+   unsigned int width, unsigned int height, unsigned int pad)
+{
+   unsigned int i, lines[3];
+   size_t offset = 0;
+
+   memset(image, 0, sizeof(*image));
+   for (i = 0; i < layout->num; i++)
+   {
+      unsigned int w = i ? (width + 1) / 2 * 2 : width;
+      image->planes.pitch[i] = (w * layout->width_q[i] + 3) / 4 + pad;
+      lines[i] = i && layout->half_height ? (height + 1) / 2 : height;
+      image->size += (size_t)image->planes.pitch[i] * lines[i];
+   }
+   image->buffer = malloc(image->size);
+   if (!image->buffer)
+      return -1;
+   for (i = 0; i < layout->num; i++)
+   {
+      image->planes.data[i] = image->buffer + offset;
+      offset += (size_t)image->planes.pitch[i] * lines[i];
+   }
+   return 0;
+}
+
+static void bench_image_fill(BENCH_IMAGE_T *image, uint8_t value, int random)
+{
+   size_t i;
+
+   if (!random)
+   {
+      memset(image->buffer, value, image->size);
+      return;
+   }
+   for (i = 0; i < image->size; i++)
+      image->buffer[i] = (uint8_t)rand();
+}
+
+/* Compare the scalar and SIMD versions of a conversion */
+static int bench_check(unsigned int test, uint32_t features, unsigned int width,
+   unsigned int height, unsigned int pad)
+{
+   BENCH_IMAGE_T src, ref, out;
+   int ret = -1;
+
+   if (bench_image_alloc(&src, bench_tests[test].src, width, height, pad) ||
+       bench_image_alloc(&ref, bench_tests[test].dst, width, height, pad) ||
+       bench_image_alloc(&out, bench_tests[test].dst, width, height, pad))
+      goto end;
+
+   bench_image_fill(&src, 0, 1);
+   bench_image_fill(&ref, 0xa5, 0);
+   bench_image_fill(&out, 0xa5, 0);
+
+   mmal_convert_set_cpu_features(0);
+   bench_tests[test].convert(&ref, &src, width, height);
+   mmal_convert_set_cpu_features(features);
+   bench_tests[test].convert(&out, &src, width, height);
+
+   ret = memcmp(ref.buffer, out.buffer, ref.size) ? 1 : 0;
+   if (ret)
+      printf("%-11s %ux%u pad %u: SIMD and scalar results differ\n",
+             bench_tests[test].name, width, height, pad);
+
+end:
+   free(src.buffer);
+   free(ref.buffer);
+   free(out.buffer);
+   return ret;
+}
+
+static double bench_time(unsigned int test, uint32_t features, unsigned int width,
+   unsigned int height, unsigned int iterations)
+{
+   BENCH_IMAGE_T src, dst;
+   uint64_t start, elapsed;
+   unsigned int i;
+
+   if (bench_image_alloc(&src, bench_tests[test].src, width, height, 0) ||
+       bench_image_alloc(&dst, bench_tests[test].dst, width, height, 0))
+   {
+      free(src.buffer);
+      return 0;
+   }
+   bench_image_fill(&src, 0, 1);
+   bench_image_fill(&dst, 0, 0);
+
+   mmal_convert_set_cpu_features(features);
+   bench_tests[test].convert(&dst, &src, width, height);
+   start = vcos_getmicrosecs64();
+   for (i = 0; i < iterations; i++)
+      bench_tests[test].convert(&dst, &src, width, height);
+   elapsed = vcos_getmicrosecs64() - start;
+
+   free(src.buffer);
+   free(dst.buffer);
+   return elapsed ? (double)width * height * iterations / elapsed : 0; /* Mpixels/s */
+}
+
+int main(int argc, char **argv)
+{
+   static const unsigned int sizes[][2] =
+      { {1, 1}, {2, 2}, {3, 3}, {15, 4}, {17, 5}, {31, 7}, {33, 2}, {64, 3}, {127, 9}, {642, 5} };
+   unsigned int iterations = argc > 1 ? atoi(argv[1]) : 50;
+   unsigned int width = argc > 2 ? atoi(argv[2]) : 1920;
+   unsigned int height = argc > 3 ? atoi(argv[3]) : 1080;
+   unsigned int test, i, pad;
+   uint32_t features;
+   int failed = 0;
+
+   if (!iterations || !width || !height)
+   {
+      fprintf(stderr, "usage: %s [iterations] [width] [height]\n", argv[0]);
+      return -1;
+   }
+
+   vcos_init();
+   features = mmal_convert_cpu_features();
+   printf("CPU features:%s%s%s%s\n", features & MMAL_CONVERT_CPU_SSE2 ? " SSE2" : "",
+          features & MMAL_CONVERT_CPU_SSSE3 ? " SSSE3" : "",
+          features & MMAL_CONVERT_CPU_NEON ? " NEON" : "", features ? "" : " none");
+
+   for (test = 0; test < vcos_countof(bench_tests); test++)
+      for (i = 0; i < vcos_countof(sizes); i++)
+         for (pad = 0; pad <= BENCH_PAD; pad += BENCH_PAD)
+            failed |= bench_check(test, features, sizes[i][0], sizes[i][1], pad) != 0;
+   printf("SIMD results %s the scalar ones\n", failed ? "DIFFER from" : "match");
+
+   printf("%ux%u, Mpixels/s:\n%-11s %10s %10s %8s\n", width, height,
+          "", "scalar", "SIMD", "speedup");
+   for (test = 0; test < vcos_countof(bench_tests); test++)
+   {
+      double scalar = bench_time(test, 0, width, height, iterations);
+      double simd = bench_time(test, features, width, height, iterations);
+      printf("%-11s %10.1f %10.1f %7.2fx\n", bench_tests[test].name, scalar, simd,
+             scalar ? simd / scalar : 0.0);
+   }
+
+   mmal_convert_set_cpu_features(features);
+   vcos_deinit();
+   return failed;
+}
@@ -0,0 +1,173 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Microbenchmark comparing the mutex based and the lock-free MMAL queues.
+ * Producers move buffer headers from a free queue to a work queue and consumers
+ * move them back, so both queues see contention from both sides.
+ *
+ * Usage: mmal_bench_queue [buffers per producer] [batch size] */
+
+#include "mmal.h"
+#include "interface/vcos/vcos.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_HEADERS     256
+#define BENCH_THREADS_MAX 4
+#define BENCH_BATCH_MAX   64
+
+typedef struct BENCH_T
+{
+   MMAL_QUEUE_T *free;
+   MMAL_QUEUE_T *work;
+   unsigned int per_producer;
+   unsigned int batch;
+   unsigned int total;
+   uint32_t consumed;
+} BENCH_T;
+
+static void *bench_producer(void *arg)
+{
+   BENCH_T *bench = (BENCH_T *)arg;
+   MMAL_BUFFER_HEADER_T *buffers[BENCH_BATCH_MAX];
+   unsigned int sent = 0, n;
+
+   while (sent < bench->per_producer)
+   {
+      unsigned int max = vcos_min(bench->batch, bench->per_producer - sent);
+      n = mmal_queue_get_batch(bench->free, buffers, max);
+      if (!n)
+      {
+         buffers[0] = mmal_queue_wait(bench->free);
+         n = 1;
+      }
+      mmal_queue_put_batch(bench->work, buffers, n);
+      sent += n;
+   }
+   return NULL;
+}
+
+static void *bench_consumer(void *arg)
+{
+   BENCH_T *bench = (BENCH_T *)arg;
+   MMAL_BUFFER_HEADER_T *buffers[BENCH_BATCH_MAX];
+   unsigned int n;
+
+   while (__atomic_load_n(&bench->consumed, __ATOMIC_RELAXED) < bench->total)
+   {
+      buffers[0] = mmal_queue_timedwait(bench->work, 10);
+      if (!buffers[0])
+         continue;
+      n = 1 + mmal_queue_get_batch(bench->work, buffers + 1, bench->batch - 1);
+      mmal_queue_put_batch(bench->free, buffers, n);
+      __atomic_fetch_add(&bench->consumed, n, __ATOMIC_RELAXED);
+   }
+   return NULL;
+}
+
+static MMAL_QUEUE_T *bench_queue_create(int lockfree)
+{
+   return lockfree ? mmal_queue_create_lockfree(BENCH_HEADERS) : mmal_queue_create();
+}
+
+static int bench_run(int lockfree, unsigned int threads, unsigned int per_producer,
+   unsigned int batch, MMAL_BUFFER_HEADER_T *headers)
+{
+   VCOS_THREAD_T producers[BENCH_THREADS_MAX], consumers[BENCH_THREADS_MAX];
+   BENCH_T bench;
+   uint64_t start, elapsed;
+   unsigned int i;
+   void *ret;
+
+   bench.free = bench_queue_create(lockfree);
+   bench.work = bench_queue_create(lockfree);
+   if (!bench.free || !bench.work)
+   {
+      fprintf(stderr, "failed to create queues\n");
+      return -1;
+   }
+   bench.per_producer = per_producer;
+   bench.batch = batch;
+   bench.total = per_producer * threads;
+   bench.consumed = 0;
+
+   for (i = 0; i < BENCH_HEADERS; i++)
+      mmal_queue_put(bench.free, &headers[i]);
+
+   start = vcos_getmicrosecs64();
+   for (i = 0; i < threads; i++)
+   {
+      vcos_thread_create(&consumers[i], "bench consumer", NULL, bench_consumer, &bench);
+      vcos_thread_create(&producers[i], "bench producer", NULL, bench_producer, &bench);
+   }
+   for (i = 0; i < threads; i++)
+   {
+      vcos_thread_join(&producers[i], &ret);
+      vcos_thread_join(&consumers[i], &ret);
+   }
+   elapsed = vcos_getmicrosecs64() - start;
+
+   printf("%-9s %ux%u batch %2u: %10.0f buffers/s (%u left in free queue)\n",
+          lockfree ? "lock-free" : "mutex", threads, threads, batch,
+          elapsed ? bench.total * 1000000.0 / elapsed : 0.0,
+          mmal_queue_length(bench.free));
+
+   mmal_queue_destroy(bench.free);
+   mmal_queue_destroy(bench.work);
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   static const unsigned int threads[] = {1, 2, 4};
+   MMAL_BUFFER_HEADER_T *headers;
+   unsigned int per_producer = argc > 1 ? atoi(argv[1]) : 1000000;
+   unsigned int batch = argc > 2 ? atoi(argv[2]) : 1;
+   unsigned int i;
+   int lockfree;
+
+   if (!per_producer || !batch || batch > BENCH_BATCH_MAX)
+   {
+      fprintf(stderr, "usage: %s [buffers per producer] [batch size (1-%i)]\n",
+              argv[0], BENCH_BATCH_MAX);
+      return -1;
+   }
+
+   vcos_init();
+   headers = calloc(BENCH_HEADERS, sizeof(*headers));
+   if (!headers)
+      return -1;
+
+   for (i = 0; i < vcos_countof(threads); i++)
+      for (lockfree = 0; lockfree < 2; lockfree++)
+         if (bench_run(lockfree, threads[i], per_producer / threads[i], batch, headers))
+            return -1;
+
+   free(headers);
+   vcos_deinit();
+   return 0;
+}
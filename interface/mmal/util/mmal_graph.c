@@ -33,10 +33,31 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "mmal_logging.h"
 
 #define GRAPH_CONNECTIONS_MAX 16
+#define GRAPH_WORKERS_MAX 4
 #define PROCESSING_TIME_MAX 20000
 
 /*****************************************************************************/
 
+/** Worker thread processing some of the internal connections */
+typedef struct GRAPH_WORKER_T
+{
+   struct MMAL_COMPONENT_MODULE_T *graph;
+   unsigned int index;
+   VCOS_THREAD_T thread;
+   VCOS_SEMAPHORE_T sema;        /**< informs the worker thread that buffers are available */
+
+} GRAPH_WORKER_T;
+
+/** Scheduling state of an internal connection */
+typedef struct GRAPH_CONNECTION_T
+{
+   MMAL_GRAPH_CONNECTION_SCHEDULING_T scheduling;
+   int64_t pending_since;        /**< when the queue of the connection stopped being empty, 0 if empty */
+   uint32_t served;              /**< value of the graph's served count when last processed */
+   MMAL_GRAPH_CONNECTION_STATS_T stats;
+
+} GRAPH_CONNECTION_T;
+
 /** Private context for our graph.
  * This also acts as a MMAL_COMPONENT_MODULE_T for when components are instantiated from graphs */
 typedef struct MMAL_COMPONENT_MODULE_T
@@ -48,8 +69,11 @@ typedef struct MMAL_COMPONENT_MODULE_T
    unsigned int component_num;
 
    MMAL_CONNECTION_T *connection[GRAPH_CONNECTIONS_MAX];
+   GRAPH_CONNECTION_T connection_sched[GRAPH_CONNECTIONS_MAX];
    unsigned int connection_num;
    unsigned int connection_current;
+   uint32_t served;              /**< number of buffers processed, used to take turns */
+   VCOS_MUTEX_T lock;            /**< protects the scheduling state of the connections */
 
    MMAL_PORT_T *input[GRAPH_CONNECTIONS_MAX];
    unsigned int input_num;
@@ -60,9 +84,10 @@ typedef struct MMAL_COMPONENT_MODULE_T
 
    MMAL_COMPONENT_T *graph_component;
 
-   MMAL_BOOL_T stop_thread;      /**< informs the worker thread to exit */
-   VCOS_THREAD_T thread;         /**< worker thread which processes all internal connections */
-   VCOS_SEMAPHORE_T sema;        /**< informs the worker thread that buffers are available */
+   MMAL_BOOL_T stop_thread;      /**< informs the worker threads to exit */
+   GRAPH_WORKER_T worker[GRAPH_WORKERS_MAX]; /**< worker threads which process the internal connections */
+   unsigned int worker_num;
+   unsigned int worker_started;
 
    MMAL_GRAPH_EVENT_CB event_cb; /**< callback for sending control port events to the client */
    void *event_cb_data;          /**< callback data supplied by the client */
@@ -73,7 +98,8 @@ typedef MMAL_GRAPH_PRIVATE_T MMAL_COMPONENT_MODULE_T;
 
 /*****************************************************************************/
 static MMAL_STATUS_T mmal_component_create_from_graph(const char *name, MMAL_COMPONENT_T *component);
-static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph);
+static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph, GRAPH_WORKER_T *worker);
+static int graph_connection_pending(MMAL_GRAPH_PRIVATE_T *graph, MMAL_CONNECTION_T *connection);
 static void graph_process_buffer(MMAL_GRAPH_PRIVATE_T *graph_private,
    MMAL_CONNECTION_T *connection, MMAL_BUFFER_HEADER_T *buffer);
 
@@ -102,6 +128,7 @@ static void graph_connection_cb(MMAL_CONNECTION_T *connection)
 {
    MMAL_GRAPH_PRIVATE_T *graph = (MMAL_GRAPH_PRIVATE_T *)connection->user_data;
    MMAL_BUFFER_HEADER_T *buffer;
+   int worker;
 
    if (connection->flags == MMAL_CONNECTION_FLAG_DIRECT &&
        (buffer = mmal_queue_get(connection->queue)) != NULL)
@@ -110,23 +137,25 @@ static void graph_connection_cb(MMAL_CONNECTION_T *connection)
       return;
    }
 
-   vcos_semaphore_post(&graph->sema);
+   worker = graph_connection_pending(graph, connection);
+   vcos_semaphore_post(&graph->worker[worker < 0 ? 0 : worker].sema);
 }
 
 /*****************************************************************************/
 static void* graph_worker_thread(void* ctx)
 {
-   MMAL_GRAPH_PRIVATE_T *graph = (MMAL_GRAPH_PRIVATE_T *)ctx;
+   GRAPH_WORKER_T *worker = (GRAPH_WORKER_T *)ctx;
+   MMAL_GRAPH_PRIVATE_T *graph = worker->graph;
 
    while (1)
    {
-      vcos_semaphore_wait(&graph->sema);
+      vcos_semaphore_wait(&worker->sema);
       if (graph->stop_thread)
          break;
-      while(graph_do_processing(graph));
+      while(graph_do_processing(graph, graph->worker_num > 1 ? worker : NULL));
    }
 
-   LOG_TRACE("worker thread exit %p", graph);
+   LOG_TRACE("worker thread %u exit %p", worker->index, graph);
 
    return 0;
 }
@@ -134,15 +163,21 @@ static void* graph_worker_thread(void* ctx)
 /*****************************************************************************/
 static void graph_stop_worker_thread(MMAL_GRAPH_PRIVATE_T *graph)
 {
+   unsigned int i;
+
    graph->stop_thread = MMAL_TRUE;
-   vcos_semaphore_post(&graph->sema);
-   vcos_thread_join(&graph->thread, NULL);
+   for (i = 0; i < graph->worker_started; i++)
+      vcos_semaphore_post(&graph->worker[i].sema);
+   for (i = 0; i < graph->worker_started; i++)
+      vcos_thread_join(&graph->worker[i].thread, NULL);
+   graph->worker_started = 0;
 }
 
 /*****************************************************************************/
 MMAL_STATUS_T mmal_graph_create(MMAL_GRAPH_T **graph, unsigned int userdata_size)
 {
    MMAL_GRAPH_PRIVATE_T *private;
+   unsigned int i;
 
    LOG_TRACE("graph %p, userdata_size %u", graph, userdata_size);
 
@@ -157,13 +192,29 @@ MMAL_STATUS_T mmal_graph_create(MMAL_GRAPH_T **graph, unsigned int userdata_size
    if (userdata_size)
       (*graph)->userdata = (struct MMAL_GRAPH_USERDATA_T *)&private[1];
 
-   if (vcos_semaphore_create(&private->sema, "mmal graph sema", 0) != VCOS_SUCCESS)
+   if (vcos_mutex_create(&private->lock, "mmal graph lock") != VCOS_SUCCESS)
    {
-      LOG_ERROR("failed to create semaphore %p", graph);
+      LOG_ERROR("failed to create lock %p", graph);
       vcos_free(private);
       return MMAL_ENOSPC;
    }
 
+   for (i = 0; i < GRAPH_WORKERS_MAX; i++)
+   {
+      private->worker[i].graph = private;
+      private->worker[i].index = i;
+      if (vcos_semaphore_create(&private->worker[i].sema, "mmal graph sema", 0) != VCOS_SUCCESS)
+      {
+         LOG_ERROR("failed to create semaphore %p", graph);
+         while (i--)
+            vcos_semaphore_delete(&private->worker[i].sema);
+         vcos_mutex_delete(&private->lock);
+         vcos_free(private);
+         return MMAL_ENOSPC;
+      }
+   }
+   private->worker_num = 1;
+
    return MMAL_SUCCESS;
 }
 
@@ -188,7 +239,9 @@ MMAL_STATUS_T mmal_graph_destroy(MMAL_GRAPH_T *graph)
    for (i = 0; i < private->component_num; i++)
       mmal_component_release(private->component[i]);
 
-   vcos_semaphore_delete(&private->sema);
+   for (i = 0; i < GRAPH_WORKERS_MAX; i++)
+      vcos_semaphore_delete(&private->worker[i].sema);
+   vcos_mutex_delete(&private->lock);
 
    vcos_free(graph);
    return MMAL_SUCCESS;
@@ -388,11 +441,17 @@ MMAL_STATUS_T mmal_graph_enable(MMAL_GRAPH_T *graph, MMAL_GRAPH_EVENT_CB cb, voi
 
    LOG_TRACE("graph: %p", graph);
 
-   if (vcos_thread_create(&private->thread, "mmal graph thread", NULL,
-                          graph_worker_thread, private) != VCOS_SUCCESS)
+   private->stop_thread = MMAL_FALSE;
+   for (i = 0; i < private->worker_num; i++)
    {
-      LOG_ERROR("failed to create worker thread %p", graph);
-      return MMAL_ENOSPC;
+      if (vcos_thread_create(&private->worker[i].thread, "mmal graph thread", NULL,
+                             graph_worker_thread, &private->worker[i]) != VCOS_SUCCESS)
+      {
+         LOG_ERROR("failed to create worker thread %p", graph);
+         graph_stop_worker_thread(private);
+         return MMAL_ENOSPC;
+      }
+      private->worker_started++;
    }
 
    private->event_cb = cb;
@@ -420,8 +479,9 @@ MMAL_STATUS_T mmal_graph_enable(MMAL_GRAPH_T *graph, MMAL_GRAPH_EVENT_CB cb, voi
          goto error;
    }
 
-   /* Trigger the worker thread to populate the output ports with empty buffers */
-   vcos_semaphore_post(&private->sema);
+   /* Trigger the worker threads to populate the output ports with empty buffers */
+   for (i = 0; i < private->worker_num; i++)
+      vcos_semaphore_post(&private->worker[i].sema);
    return status;
 
  error:
@@ -451,6 +511,77 @@ MMAL_STATUS_T mmal_graph_disable(MMAL_GRAPH_T *graph)
    return status;
 }
 
+/*****************************************************************************/
+static int graph_connection_index(MMAL_GRAPH_PRIVATE_T *graph, MMAL_CONNECTION_T *connection)
+{
+   unsigned int i;
+
+   for (i = 0; i < graph->connection_num; i++)
+      if (graph->connection[i] == connection)
+         return i;
+   return -1;
+}
+
+/*****************************************************************************/
+MMAL_STATUS_T mmal_graph_connection_scheduling(MMAL_GRAPH_T *graph, MMAL_CONNECTION_T *connection,
+   const MMAL_GRAPH_CONNECTION_SCHEDULING_T *scheduling)
+{
+   MMAL_GRAPH_PRIVATE_T *private = (MMAL_GRAPH_PRIVATE_T *)graph;
+   int index;
+
+   if (!graph || !scheduling)
+      return MMAL_EINVAL;
+
+   LOG_TRACE("graph: %p, connection: %s(%p), priority %i, deadline %u, worker %u", graph,
+             connection ? connection->name : 0, connection, (int)scheduling->priority,
+             (unsigned int)scheduling->deadline, (unsigned int)scheduling->worker);
+
+   index = graph_connection_index(private, connection);
+   if (index < 0)
+      return MMAL_EINVAL;
+
+   vcos_mutex_lock(&private->lock);
+   private->connection_sched[index].scheduling = *scheduling;
+   vcos_mutex_unlock(&private->lock);
+   return MMAL_SUCCESS;
+}
+
+/*****************************************************************************/
+MMAL_STATUS_T mmal_graph_connection_stats(MMAL_GRAPH_T *graph, MMAL_CONNECTION_T *connection,
+   MMAL_GRAPH_CONNECTION_STATS_T *stats, MMAL_BOOL_T reset)
+{
+   MMAL_GRAPH_PRIVATE_T *private = (MMAL_GRAPH_PRIVATE_T *)graph;
+   int index;
+
+   if (!graph || !stats)
+      return MMAL_EINVAL;
+
+   index = graph_connection_index(private, connection);
+   if (index < 0)
+      return MMAL_EINVAL;
+
+   vcos_mutex_lock(&private->lock);
+   *stats = private->connection_sched[index].stats;
+   if (reset)
+      memset(&private->connection_sched[index].stats, 0, sizeof(*stats));
+   vcos_mutex_unlock(&private->lock);
+   return MMAL_SUCCESS;
+}
+
+/*****************************************************************************/
+MMAL_STATUS_T mmal_graph_set_workers(MMAL_GRAPH_T *graph, unsigned int num)
+{
+   MMAL_GRAPH_PRIVATE_T *private = (MMAL_GRAPH_PRIVATE_T *)graph;
+
+   LOG_TRACE("graph: %p, workers: %u", graph, num);
+
+   if (!graph || !num || num > GRAPH_WORKERS_MAX || private->worker_started)
+      return MMAL_EINVAL;
+
+   private->worker_num = num;
+   return MMAL_SUCCESS;
+}
+
 /*****************************************************************************/
 MMAL_STATUS_T mmal_graph_build(MMAL_GRAPH_T *graph,
    const char *name, MMAL_COMPONENT_T **component)
@@ -504,6 +635,7 @@ static void graph_component_connection_cb(MMAL_CONNECTION_T *connection)
       return;
    }
 
+   graph_connection_pending((MMAL_GRAPH_PRIVATE_T *)component->priv->module, connection);
    mmal_component_action_trigger(component);
 }
 
@@ -576,15 +708,112 @@ static void graph_process_buffer(MMAL_GRAPH_PRIVATE_T *graph_private,
 }
 
 /*****************************************************************************/
-static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph_private)
+/** Note that the queue of a connection may have stopped being empty.
+ * The callback also fires when empty buffers are recycled, so the queue is
+ * checked before stamping it as pending.
+ * Returns the worker processing the connection, or -1 if not in the graph. */
+static int graph_connection_pending(MMAL_GRAPH_PRIVATE_T *graph, MMAL_CONNECTION_T *connection)
+{
+   GRAPH_CONNECTION_T *sched;
+   int index = graph_connection_index(graph, connection);
+
+   if (index < 0)
+      return -1;
+
+   sched = &graph->connection_sched[index];
+   vcos_mutex_lock(&graph->lock);
+   if (!sched->pending_since && mmal_queue_length(connection->queue))
+      sched->pending_since = vcos_getmicrosecs64();
+   index = sched->scheduling.worker % graph->worker_num;
+   vcos_mutex_unlock(&graph->lock);
+   return index;
+}
+
+/*****************************************************************************/
+/** Check whether a connection is processed by the given worker (NULL for all) */
+static MMAL_BOOL_T graph_connection_is_worker(MMAL_GRAPH_PRIVATE_T *graph,
+   GRAPH_WORKER_T *worker, unsigned int index)
+{
+   return !worker ||
+      graph->connection_sched[index].scheduling.worker % graph->worker_num == worker->index;
+}
+
+/*****************************************************************************/
+/** Pick the connection to take the next buffer from.
+ * Overdue connections come first, earliest deadline first, then the highest
+ * priority, then the connection which has waited longest for its turn. */
+static int graph_connection_next(MMAL_GRAPH_PRIVATE_T *graph, GRAPH_WORKER_T *worker, int64_t now)
+{
+   GRAPH_CONNECTION_T *best = NULL;
+   MMAL_BOOL_T best_overdue = 0;
+   int best_index = -1;
+   unsigned int i;
+
+   vcos_mutex_lock(&graph->lock);
+   for (i = 0; i < graph->connection_num; i++)
+   {
+      MMAL_CONNECTION_T *connection = graph->connection[i];
+      GRAPH_CONNECTION_T *sched = &graph->connection_sched[i];
+      MMAL_BOOL_T overdue;
+
+      if (connection->flags & (MMAL_CONNECTION_FLAG_TUNNELLING | MMAL_CONNECTION_FLAG_DIRECT))
+         continue; /* Nothing else to do in tunnelling or direct mode */
+      if (!graph_connection_is_worker(graph, worker, i) || !mmal_queue_length(connection->queue))
+         continue;
+
+      if (!sched->pending_since)
+         sched->pending_since = now;
+      overdue = sched->scheduling.deadline &&
+         now - sched->pending_since >= (int64_t)sched->scheduling.deadline;
+
+      if (best)
+      {
+         if (overdue != best_overdue)
+         {
+            if (!overdue)
+               continue;
+         }
+         else if (overdue)
+         {
+            if (sched->pending_since + sched->scheduling.deadline >=
+                best->pending_since + best->scheduling.deadline)
+               continue;
+         }
+         else if (sched->scheduling.priority != best->scheduling.priority)
+         {
+            if (sched->scheduling.priority < best->scheduling.priority)
+               continue;
+         }
+         else if ((int32_t)(sched->served - best->served) >= 0)
+            continue;
+      }
+
+      best = sched;
+      best_overdue = overdue;
+      best_index = i;
+   }
+   vcos_mutex_unlock(&graph->lock);
+
+   return best_index;
+}
+
+/*****************************************************************************/
+static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph_private, GRAPH_WORKER_T *worker)
 {
    MMAL_BUFFER_HEADER_T *buffer;
    MMAL_BOOL_T run_again = 0;
    MMAL_STATUS_T status;
-   unsigned int i, j;
+   int64_t start, begin, end;
+   unsigned int i, j, first;
+   int index;
+
+   /* Several workers can be running this at the same time */
+   vcos_mutex_lock(&graph_private->lock);
+   first = graph_private->connection_current++;
+   vcos_mutex_unlock(&graph_private->lock);
 
    /* Process all the empty buffers first */
-   for (i = 0, j = graph_private->connection_current;
+   for (i = 0, j = first;
         i < graph_private->connection_num; i++, j++)
    {
       MMAL_CONNECTION_T *connection =
@@ -593,6 +822,8 @@ static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph_private)
       if ((connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING) ||
           !connection->pool)
          continue; /* Nothing else to do in tunnelling mode */
+      if (!graph_connection_is_worker(graph_private, worker, j%graph_private->connection_num))
+         continue;
 
       /* Send empty buffers to the output port of the connection */
       while ((buffer = mmal_queue_get(connection->pool->queue)) != NULL)
@@ -611,29 +842,45 @@ static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph_private)
       }
    }
 
-   /* Loop through all the connections */
-   for (i = 0, j = graph_private->connection_current++;
-        i < graph_private->connection_num; i++, j++)
+   /* Send queued buffers to the next component, one at a time so that the
+    * connections can be picked again in order of priority after each buffer.
+    * We also make sure the empty buffers get recycled by having a timeout. */
+   start = end = vcos_getmicrosecs64();
+   while (end - start < PROCESSING_TIME_MAX &&
+          (index = graph_connection_next(graph_private, worker, end)) >= 0)
    {
-      MMAL_CONNECTION_T *connection =
-         graph_private->connection[j%graph_private->connection_num];
-      int64_t duration = vcos_getmicrosecs64();
+      MMAL_CONNECTION_T *connection = graph_private->connection[index];
+      GRAPH_CONNECTION_T *sched = &graph_private->connection_sched[index];
+      uint32_t wait, duration;
 
-      if (connection->flags & MMAL_CONNECTION_FLAG_TUNNELLING)
-         continue; /* Nothing else to do in tunnelling mode */
-      if (connection->flags & MMAL_CONNECTION_FLAG_DIRECT)
-         continue; /* Nothing else to do in direct mode */
-
-      /* Send any queued buffer to the next component.
-       * We also make sure no connection can starve the others by
-       * having a timeout. */
-      while (vcos_getmicrosecs64() - duration < PROCESSING_TIME_MAX &&
-             (buffer = mmal_queue_get(connection->queue)) != NULL)
+      begin = end;
+      buffer = mmal_queue_get(connection->queue);
+      if (buffer)
       {
          run_again = 1;
-
          graph_process_buffer(graph_private, connection, buffer);
       }
+      end = vcos_getmicrosecs64();
+
+      vcos_mutex_lock(&graph_private->lock);
+      wait = (uint32_t)(begin - sched->pending_since);
+      duration = (uint32_t)(end - begin);
+      if (buffer)
+      {
+         sched->stats.buffers++;
+         sched->stats.processing_time += duration;
+         sched->stats.processing_time_max = MMAL_MAX(sched->stats.processing_time_max, duration);
+         sched->stats.wait_time_max = MMAL_MAX(sched->stats.wait_time_max, wait);
+         if (sched->scheduling.deadline && wait > sched->scheduling.deadline)
+            sched->stats.deadline_misses++;
+      }
+      /* The next buffer only starts waiting for its turn once this one is done */
+      if (!mmal_queue_length(connection->queue))
+         sched->pending_since = 0;
+      else if (buffer)
+         sched->pending_since = end;
+      sched->served = ++graph_private->served;
+      vcos_mutex_unlock(&graph_private->lock);
    }
 
    return run_again;
@@ -642,7 +889,7 @@ static MMAL_BOOL_T graph_do_processing(MMAL_GRAPH_PRIVATE_T *graph_private)
 /*****************************************************************************/
 static void graph_do_processing_loop(MMAL_COMPONENT_T *component)
 {
-   while (graph_do_processing((MMAL_GRAPH_PRIVATE_T *)component->priv->module));
+   while (graph_do_processing((MMAL_GRAPH_PRIVATE_T *)component->priv->module, NULL));
 }
 
 /*****************************************************************************/
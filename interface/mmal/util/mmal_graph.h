@@ -91,6 +91,31 @@ typedef struct MMAL_GRAPH_T
 
 } MMAL_GRAPH_T;
 
+/** Scheduling of the buffers going through an internal connection of a graph.
+ * The graph sends buffers on from the connections with the highest priority first,
+ * taking turns between connections of the same priority. A connection whose buffers
+ * have been waiting for longer than its deadline goes ahead of all the others, the
+ * earliest deadline first. */
+typedef struct MMAL_GRAPH_CONNECTION_SCHEDULING_T
+{
+   int32_t priority;    /**< Higher is processed first. Defaults to 0. */
+   uint32_t deadline;   /**< Microseconds its buffers can wait, 0 for no deadline */
+   uint32_t worker;     /**< Worker thread processing the connection, see \ref mmal_graph_set_workers */
+
+} MMAL_GRAPH_CONNECTION_SCHEDULING_T;
+
+/** Statistics of an internal connection of a graph.
+ * Waiting times are measured from when the queue of the connection stops being empty. */
+typedef struct MMAL_GRAPH_CONNECTION_STATS_T
+{
+   uint32_t buffers;             /**< Buffers sent on by the graph */
+   uint64_t processing_time;     /**< Microseconds spent sending them on */
+   uint32_t processing_time_max; /**< Longest time spent sending on a buffer */
+   uint32_t wait_time_max;       /**< Longest time a buffer waited */
+   uint32_t deadline_misses;     /**< Buffers which waited longer than the deadline */
+
+} MMAL_GRAPH_CONNECTION_STATS_T;
+
 /** Create an instance of a graph.
  * The newly created graph will need to be populated by the client.
  *
@@ -171,6 +196,40 @@ MMAL_STATUS_T mmal_graph_new_component(MMAL_GRAPH_T *graph, const char *name,
 MMAL_STATUS_T mmal_graph_new_connection(MMAL_GRAPH_T *graph, MMAL_PORT_T *out, MMAL_PORT_T *in,
    uint32_t flags, MMAL_CONNECTION_T **connection);
 
+/** Set how the buffers of an internal connection of a graph are scheduled.
+ *
+ * @param graph      instance of the graph
+ * @param connection connection of the graph
+ * @param scheduling scheduling parameters of the connection
+ * @return MMAL_SUCCESS on success
+ */
+MMAL_STATUS_T mmal_graph_connection_scheduling(MMAL_GRAPH_T *graph, MMAL_CONNECTION_T *connection,
+   const MMAL_GRAPH_CONNECTION_SCHEDULING_T *scheduling);
+
+/** Get the statistics of an internal connection of a graph.
+ *
+ * @param graph      instance of the graph
+ * @param connection connection of the graph
+ * @param stats      returned statistics
+ * @param reset      reset the statistics after reading them
+ * @return MMAL_SUCCESS on success
+ */
+MMAL_STATUS_T mmal_graph_connection_stats(MMAL_GRAPH_T *graph, MMAL_CONNECTION_T *connection,
+   MMAL_GRAPH_CONNECTION_STATS_T *stats, MMAL_BOOL_T reset);
+
+/** Set the number of worker threads processing the internal connections of a graph.
+ * Each connection is processed by the worker given in its scheduling parameters
+ * (modulo the number of workers), so that independent branches of a graph can run
+ * in parallel. Only one worker is used by default. This must be called before
+ * \ref mmal_graph_enable. It has no effect on components built from the graph,
+ * which process their connections in their action.
+ *
+ * @param graph instance of the graph
+ * @param num   number of worker threads, up to 4
+ * @return MMAL_SUCCESS on success
+ */
+MMAL_STATUS_T mmal_graph_set_workers(MMAL_GRAPH_T *graph, unsigned int num);
+
 /** Definition of the callback used by a graph to send events to the client.
  *
  * @param graph   the graph sending the event
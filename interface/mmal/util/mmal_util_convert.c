@@ -0,0 +1,540 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "interface/mmal/mmal.h"
+#include "interface/mmal/mmal_encodings.h"
+#include "interface/mmal/util/mmal_util_convert.h"
+#include "interface/mmal/util/mmal_util_convert_private.h"
+#include "mmal_logging.h"
+#include "interface/vcos/vcos.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CONVERT_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#endif
+
+#if defined(__linux__) && defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/*****************************************************************************/
+/* SSE2 and SSSE3 kernels. Built with target attributes so that the rest of
+ * the library doesn't require these instruction sets. */
+#ifdef CONVERT_X86
+
+#define SSE2 __attribute__((target("sse2")))
+#define SSSE3 __attribute__((target("ssse3")))
+
+static SSE2 void convert_swap_rb_sse2(uint8_t *dst, const uint8_t *src, unsigned int pixels)
+{
+   const __m128i ag = _mm_set1_epi32((int)0xff00ff00);
+   unsigned int i;
+
+   for (i = 0; i + 4 <= pixels; i += 4)
+   {
+      __m128i p = _mm_loadu_si128((const __m128i *)(src + i * 4));
+      __m128i rb = _mm_andnot_si128(ag, p);
+      rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+      _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_or_si128(_mm_and_si128(p, ag), rb));
+   }
+   mmal_convert_swap_rb_c(dst + i * 4, src + i * 4, pixels - i);
+}
+
+static SSSE3 void convert_rgb24_to_rgba_ssse3(uint8_t *dst, const uint8_t *src,
+   unsigned int pixels, uint8_t alpha)
+{
+   const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+   const __m128i a = _mm_set1_epi32((int)((uint32_t)alpha << 24));
+   unsigned int i;
+
+   /* Each load reads 16 bytes for 4 pixels, stop while that stays in the line */
+   for (i = 0; i + 6 <= pixels; i += 4)
+   {
+      __m128i p = _mm_loadu_si128((const __m128i *)(src + i * 3));
+      _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(p, shuffle), a));
+   }
+   mmal_convert_rgb24_to_rgba_c(dst + i * 4, src + i * 3, pixels - i, alpha);
+}
+
+static SSSE3 void convert_rgba_to_rgb24_ssse3(uint8_t *dst, const uint8_t *src,
+   unsigned int pixels)
+{
+   const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+   unsigned int i;
+
+   /* Each store writes 16 bytes for 4 pixels, the next store or the tail
+    * overwrites the last 4 */
+   for (i = 0; i + 6 <= pixels; i += 4)
+   {
+      __m128i p = _mm_loadu_si128((const __m128i *)(src + i * 4));
+      _mm_storeu_si128((__m128i *)(dst + i * 3), _mm_shuffle_epi8(p, shuffle));
+   }
+   mmal_convert_rgba_to_rgb24_c(dst + i * 3, src + i * 4, pixels - i);
+}
+
+static SSE2 void convert_interleave_sse2(uint8_t *uv, const uint8_t *u, const uint8_t *v,
+   unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      __m128i pu = _mm_loadu_si128((const __m128i *)(u + i));
+      __m128i pv = _mm_loadu_si128((const __m128i *)(v + i));
+      _mm_storeu_si128((__m128i *)(uv + i * 2), _mm_unpacklo_epi8(pu, pv));
+      _mm_storeu_si128((__m128i *)(uv + i * 2 + 16), _mm_unpackhi_epi8(pu, pv));
+   }
+   mmal_convert_interleave_c(uv + i * 2, u + i, v + i, pairs - i);
+}
+
+/* Even and odd bytes of 32 bytes */
+static SSE2 inline __m128i convert_even_sse2(__m128i a, __m128i b)
+{
+   const __m128i mask = _mm_set1_epi16(0x00ff);
+   return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+}
+
+static SSE2 inline __m128i convert_odd_sse2(__m128i a, __m128i b)
+{
+   return _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+static SSE2 void convert_deinterleave_sse2(uint8_t *u, uint8_t *v, const uint8_t *uv,
+   unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      __m128i a = _mm_loadu_si128((const __m128i *)(uv + i * 2));
+      __m128i b = _mm_loadu_si128((const __m128i *)(uv + i * 2 + 16));
+      _mm_storeu_si128((__m128i *)(u + i), convert_even_sse2(a, b));
+      _mm_storeu_si128((__m128i *)(v + i), convert_odd_sse2(a, b));
+   }
+   mmal_convert_deinterleave_c(u + i, v + i, uv + i * 2, pairs - i);
+}
+
+static SSE2 void convert_even_bytes_sse2(uint8_t *dst, const uint8_t *src, unsigned int count)
+{
+   unsigned int i;
+
+   /* Reads 32 bytes for 16 outputs, the last of which is one past the last
+    * byte needed */
+   for (i = 0; i + 16 < count; i += 16)
+   {
+      __m128i a = _mm_loadu_si128((const __m128i *)(src + i * 2));
+      __m128i b = _mm_loadu_si128((const __m128i *)(src + i * 2 + 16));
+      _mm_storeu_si128((__m128i *)(dst + i), convert_even_sse2(a, b));
+   }
+   mmal_convert_even_bytes_c(dst + i, src + i * 2, count - i);
+}
+
+static SSE2 void convert_yuyv_split_sse2(uint8_t *y, uint8_t *u, uint8_t *v,
+   const uint8_t *yuyv, unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      const __m128i *in = (const __m128i *)(yuyv + i * 4);
+      __m128i a = _mm_loadu_si128(in), b = _mm_loadu_si128(in + 1);
+      __m128i c = _mm_loadu_si128(in + 2), d = _mm_loadu_si128(in + 3);
+      __m128i uv0 = convert_odd_sse2(a, b), uv1 = convert_odd_sse2(c, d);
+      _mm_storeu_si128((__m128i *)(y + i * 2), convert_even_sse2(a, b));
+      _mm_storeu_si128((__m128i *)(y + i * 2 + 16), convert_even_sse2(c, d));
+      _mm_storeu_si128((__m128i *)(u + i), convert_even_sse2(uv0, uv1));
+      _mm_storeu_si128((__m128i *)(v + i), convert_odd_sse2(uv0, uv1));
+   }
+   mmal_convert_yuyv_split_c(y + i * 2, u + i, v + i, yuyv + i * 4, pairs - i);
+}
+
+static SSE2 void convert_yuyv_merge_sse2(uint8_t *yuyv, const uint8_t *y, const uint8_t *u,
+   const uint8_t *v, unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      __m128i y0 = _mm_loadu_si128((const __m128i *)(y + i * 2));
+      __m128i y1 = _mm_loadu_si128((const __m128i *)(y + i * 2 + 16));
+      __m128i pu = _mm_loadu_si128((const __m128i *)(u + i));
+      __m128i pv = _mm_loadu_si128((const __m128i *)(v + i));
+      __m128i uv0 = _mm_unpacklo_epi8(pu, pv), uv1 = _mm_unpackhi_epi8(pu, pv);
+      __m128i *out = (__m128i *)(yuyv + i * 4);
+      _mm_storeu_si128(out, _mm_unpacklo_epi8(y0, uv0));
+      _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(y0, uv0));
+      _mm_storeu_si128(out + 2, _mm_unpacklo_epi8(y1, uv1));
+      _mm_storeu_si128(out + 3, _mm_unpackhi_epi8(y1, uv1));
+   }
+   mmal_convert_yuyv_merge_c(yuyv + i * 4, y + i * 2, u + i, v + i, pairs - i);
+}
+
+static SSE2 void convert_yuyv_chroma_sse2(uint8_t *u, uint8_t *v, const uint8_t *line0,
+   const uint8_t *line1, unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      const __m128i *in0 = (const __m128i *)(line0 + i * 4);
+      const __m128i *in1 = (const __m128i *)(line1 + i * 4);
+      __m128i uv0 = _mm_avg_epu8(
+         convert_odd_sse2(_mm_loadu_si128(in0), _mm_loadu_si128(in0 + 1)),
+         convert_odd_sse2(_mm_loadu_si128(in1), _mm_loadu_si128(in1 + 1)));
+      __m128i uv1 = _mm_avg_epu8(
+         convert_odd_sse2(_mm_loadu_si128(in0 + 2), _mm_loadu_si128(in0 + 3)),
+         convert_odd_sse2(_mm_loadu_si128(in1 + 2), _mm_loadu_si128(in1 + 3)));
+      _mm_storeu_si128((__m128i *)(u + i), convert_even_sse2(uv0, uv1));
+      _mm_storeu_si128((__m128i *)(v + i), convert_odd_sse2(uv0, uv1));
+   }
+   mmal_convert_yuyv_chroma_c(u + i, v + i, line0 + i * 4, line1 + i * 4, pairs - i);
+}
+
+#endif /* CONVERT_X86 */
+
+/*****************************************************************************/
+/* Kernel selection */
+
+static void convert_swap_rb(uint8_t *dst, const uint8_t *src, unsigned int pixels)
+{
+   mmal_convert_swap_rb_c(dst, src, pixels);
+}
+
+static void convert_rgb24_to_rgba(uint8_t *dst, const uint8_t *src, unsigned int pixels,
+   uint8_t alpha)
+{
+   mmal_convert_rgb24_to_rgba_c(dst, src, pixels, alpha);
+}
+
+static void convert_rgba_to_rgb24(uint8_t *dst, const uint8_t *src, unsigned int pixels)
+{
+   mmal_convert_rgba_to_rgb24_c(dst, src, pixels);
+}
+
+static void convert_interleave(uint8_t *uv, const uint8_t *u, const uint8_t *v,
+   unsigned int pairs)
+{
+   mmal_convert_interleave_c(uv, u, v, pairs);
+}
+
+static void convert_deinterleave(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int pairs)
+{
+   mmal_convert_deinterleave_c(u, v, uv, pairs);
+}
+
+static void convert_even_bytes(uint8_t *dst, const uint8_t *src, unsigned int count)
+{
+   mmal_convert_even_bytes_c(dst, src, count);
+}
+
+static void convert_yuyv_split(uint8_t *y, uint8_t *u, uint8_t *v, const uint8_t *yuyv,
+   unsigned int pairs)
+{
+   mmal_convert_yuyv_split_c(y, u, v, yuyv, pairs);
+}
+
+static void convert_yuyv_merge(uint8_t *yuyv, const uint8_t *y, const uint8_t *u,
+   const uint8_t *v, unsigned int pairs)
+{
+   mmal_convert_yuyv_merge_c(yuyv, y, u, v, pairs);
+}
+
+static void convert_yuyv_chroma(uint8_t *u, uint8_t *v, const uint8_t *line0,
+   const uint8_t *line1, unsigned int pairs)
+{
+   mmal_convert_yuyv_chroma_c(u, v, line0, line1, pairs);
+}
+
+static const MMAL_CONVERT_KERNELS_T convert_scalar_kernels =
+{
+   convert_swap_rb,
+   convert_rgb24_to_rgba,
+   convert_rgba_to_rgb24,
+   convert_interleave,
+   convert_deinterleave,
+   convert_even_bytes,
+   convert_yuyv_split,
+   convert_yuyv_merge,
+   convert_yuyv_chroma,
+};
+
+static VCOS_ONCE_T convert_once = VCOS_ONCE_INIT;
+static uint32_t convert_available;
+static MMAL_CONVERT_KERNELS_T convert_kernels;
+
+static uint32_t convert_detect(void)
+{
+   uint32_t features = 0;
+   const char *env;
+
+#ifdef CONVERT_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse2"))
+      features |= MMAL_CONVERT_CPU_SSE2;
+   if (__builtin_cpu_supports("ssse3"))
+      features |= MMAL_CONVERT_CPU_SSSE3;
+#endif
+
+   if (mmal_convert_neon_kernels())
+   {
+#if defined(__aarch64__)
+      features |= MMAL_CONVERT_CPU_NEON;
+#elif defined(__linux__) && defined(__arm__)
+      if (getauxval(AT_HWCAP) & HWCAP_NEON)
+         features |= MMAL_CONVERT_CPU_NEON;
+#endif
+   }
+
+   env = getenv("MMAL_CONVERT_CPU");
+   if (env)
+      features &= strtoul(env, NULL, 0);
+   return features;
+}
+
+#define CONVERT_USE(kernels, name) if ((kernels)->name) convert_kernels.name = (kernels)->name
+
+static void convert_select(uint32_t features)
+{
+   const MMAL_CONVERT_KERNELS_T *neon;
+
+   convert_kernels = convert_scalar_kernels;
+
+#ifdef CONVERT_X86
+   if (features & MMAL_CONVERT_CPU_SSE2)
+   {
+      convert_kernels.swap_rb = convert_swap_rb_sse2;
+      convert_kernels.interleave = convert_interleave_sse2;
+      convert_kernels.deinterleave = convert_deinterleave_sse2;
+      convert_kernels.even_bytes = convert_even_bytes_sse2;
+      convert_kernels.yuyv_split = convert_yuyv_split_sse2;
+      convert_kernels.yuyv_merge = convert_yuyv_merge_sse2;
+      convert_kernels.yuyv_chroma = convert_yuyv_chroma_sse2;
+   }
+   if (features & MMAL_CONVERT_CPU_SSSE3)
+   {
+      convert_kernels.rgb24_to_rgba = convert_rgb24_to_rgba_ssse3;
+      convert_kernels.rgba_to_rgb24 = convert_rgba_to_rgb24_ssse3;
+   }
+#endif
+
+   neon = mmal_convert_neon_kernels();
+   if (neon && (features & MMAL_CONVERT_CPU_NEON))
+   {
+      CONVERT_USE(neon, swap_rb);
+      CONVERT_USE(neon, rgb24_to_rgba);
+      CONVERT_USE(neon, rgba_to_rgb24);
+      CONVERT_USE(neon, interleave);
+      CONVERT_USE(neon, deinterleave);
+      CONVERT_USE(neon, even_bytes);
+      CONVERT_USE(neon, yuyv_split);
+      CONVERT_USE(neon, yuyv_merge);
+      CONVERT_USE(neon, yuyv_chroma);
+   }
+
+   LOG_DEBUG("conversion features %x of %x", features, convert_available);
+}
+
+static void convert_init_once(void)
+{
+   convert_available = convert_detect();
+   convert_select(convert_available);
+}
+
+static inline const MMAL_CONVERT_KERNELS_T *convert_get_kernels(void)
+{
+   vcos_once(&convert_once, convert_init_once);
+   return &convert_kernels;
+}
+
+uint32_t mmal_convert_cpu_features(void)
+{
+   vcos_once(&convert_once, convert_init_once);
+   return convert_available;
+}
+
+uint32_t mmal_convert_set_cpu_features(uint32_t features)
+{
+   vcos_once(&convert_once, convert_init_once);
+   features &= convert_available;
+   convert_select(features);
+   return features;
+}
+
+/*****************************************************************************/
+/* Conversions */
+
+void mmal_convert_copy_plane(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height)
+{
+   /* memcpy is already vectorised, just avoid going line by line when the
+    * plane is contiguous in both buffers */
+   if (dst_pitch == width && src_pitch == width)
+   {
+      memcpy(dst, src, (size_t)width * height);
+      return;
+   }
+
+   for (; height; height--, dst += dst_pitch, src += src_pitch)
+      memcpy(dst, src, width);
+}
+
+void mmal_convert_bgra_to_rgba(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+
+   if (dst_pitch == width * 4 && src_pitch == width * 4)
+   {
+      width *= height;
+      height = 1;
+   }
+   for (; height; height--, dst += dst_pitch, src += src_pitch)
+      k->swap_rb(dst, src, width);
+}
+
+void mmal_convert_rgb24_to_rgba(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height,
+   uint8_t alpha)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+
+   for (; height; height--, dst += dst_pitch, src += src_pitch)
+      k->rgb24_to_rgba(dst, src, width, alpha);
+}
+
+void mmal_convert_rgba_to_rgb24(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+
+   for (; height; height--, dst += dst_pitch, src += src_pitch)
+      k->rgba_to_rgb24(dst, src, width);
+}
+
+void mmal_convert_i420_to_nv12(const MMAL_CONVERT_PLANES_T *dst, const MMAL_CONVERT_PLANES_T *src,
+   unsigned int width, unsigned int height)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+   unsigned int cw = (width + 1) / 2, ch = (height + 1) / 2, i;
+
+   mmal_convert_copy_plane(dst->data[0], dst->pitch[0], src->data[0], src->pitch[0], width, height);
+   for (i = 0; i < ch; i++)
+      k->interleave(dst->data[1] + i * dst->pitch[1],
+         src->data[1] + i * src->pitch[1], src->data[2] + i * src->pitch[2], cw);
+}
+
+void mmal_convert_nv12_to_i420(const MMAL_CONVERT_PLANES_T *dst, const MMAL_CONVERT_PLANES_T *src,
+   unsigned int width, unsigned int height)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+   unsigned int cw = (width + 1) / 2, ch = (height + 1) / 2, i;
+
+   mmal_convert_copy_plane(dst->data[0], dst->pitch[0], src->data[0], src->pitch[0], width, height);
+   for (i = 0; i < ch; i++)
+      k->deinterleave(dst->data[1] + i * dst->pitch[1], dst->data[2] + i * dst->pitch[2],
+         src->data[1] + i * src->pitch[1], cw);
+}
+
+void mmal_convert_yuyv_to_i420(const MMAL_CONVERT_PLANES_T *dst,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+   unsigned int i;
+
+   for (i = 0; i < height; i++)
+      k->even_bytes(dst->data[0] + i * dst->pitch[0], src + i * src_pitch, width);
+
+   /* An odd last line has nothing to be averaged with */
+   for (i = 0; i < height; i += 2)
+   {
+      const uint8_t *line0 = src + i * src_pitch;
+      const uint8_t *line1 = i + 1 < height ? line0 + src_pitch : line0;
+      k->yuyv_chroma(dst->data[1] + i / 2 * dst->pitch[1], dst->data[2] + i / 2 * dst->pitch[2],
+         line0, line1, width / 2);
+   }
+}
+
+void mmal_convert_yuyv_to_i422(const MMAL_CONVERT_PLANES_T *dst,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+   unsigned int i;
+
+   for (i = 0; i < height; i++)
+      k->yuyv_split(dst->data[0] + i * dst->pitch[0], dst->data[1] + i * dst->pitch[1],
+         dst->data[2] + i * dst->pitch[2], src + i * src_pitch, width / 2);
+}
+
+void mmal_convert_i422_to_yuyv(uint8_t *dst, unsigned int dst_pitch,
+   const MMAL_CONVERT_PLANES_T *src, unsigned int width, unsigned int height)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+   unsigned int i;
+
+   for (i = 0; i < height; i++)
+      k->yuyv_merge(dst + i * dst_pitch, src->data[0] + i * src->pitch[0],
+         src->data[1] + i * src->pitch[1], src->data[2] + i * src->pitch[2], width / 2);
+}
+
+MMAL_STATUS_T mmal_convert_extract_y(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height,
+   MMAL_FOURCC_T encoding)
+{
+   const MMAL_CONVERT_KERNELS_T *k = convert_get_kernels();
+   unsigned int i;
+
+   switch (encoding)
+   {
+   case MMAL_ENCODING_UYVY:
+   case MMAL_ENCODING_VYUY:
+      src++;
+      /* Fall through */
+   case MMAL_ENCODING_YUYV:
+   case MMAL_ENCODING_YVYU:
+      for (i = 0; i < height; i++)
+         k->even_bytes(dst + i * dst_pitch, src + i * src_pitch, width);
+      return MMAL_SUCCESS;
+
+   case MMAL_ENCODING_I420:
+   case MMAL_ENCODING_YV12:
+   case MMAL_ENCODING_I422:
+   case MMAL_ENCODING_NV12:
+   case MMAL_ENCODING_NV21:
+   case MMAL_ENCODING_I420_SLICE:
+   case MMAL_ENCODING_I422_SLICE:
+      mmal_convert_copy_plane(dst, dst_pitch, src, src_pitch, width, height);
+      return MMAL_SUCCESS;
+
+   default:
+      LOG_ERROR("can't extract luma from %4.4s", (const char *)&encoding);
+      return MMAL_EINVAL;
+   }
+}
@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MMAL_UTIL_CONVERT_H
+#define MMAL_UTIL_CONVERT_H
+
+#include "interface/mmal/mmal_types.h"
+
+/** \defgroup MmalConvertUtilities Pixel Conversion Utility Functions
+ * \ingroup MmalUtilities
+ * Conversions and copies between the pixel layouts used around the camera,
+ * the JPEG helpers and the renderers. Each function has a scalar version and,
+ * where the CPU supports them, SSE2/SSSE3 or NEON versions which are picked
+ * at runtime. All the versions give exactly the same results.
+ *
+ * Pitches are in bytes. Chroma planes of odd sized images are rounded up.
+ * Source and destination must not overlap unless stated otherwise.
+ *
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** CPU features used by the conversion functions */
+#define MMAL_CONVERT_CPU_SSE2  (1 << 0)
+#define MMAL_CONVERT_CPU_SSSE3 (1 << 1)
+#define MMAL_CONVERT_CPU_NEON  (1 << 2)
+
+/** Return the CPU features available to the conversion functions.
+ * Setting MMAL_CONVERT_CPU=0 in the environment disables all of them.
+ */
+uint32_t mmal_convert_cpu_features(void);
+
+/** Restrict the CPU features used by the conversion functions, for instance
+ * to compare the fast versions against the scalar ones. Features which aren't
+ * available are ignored.
+ *
+ * @param features Mask of MMAL_CONVERT_CPU_ features, 0 for scalar only
+ *
+ * @return The features now in use
+ */
+uint32_t mmal_convert_set_cpu_features(uint32_t features);
+
+/** Copy a plane between buffers with different pitches.
+ *
+ * @param width Bytes to copy per line
+ */
+void mmal_convert_copy_plane(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height);
+
+/** Swap the red and blue channels of 32 bits per pixel images, BGRA to RGBA
+ * or RGBA to BGRA. dst may be the same as src to convert in place.
+ */
+void mmal_convert_bgra_to_rgba(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height);
+#define mmal_convert_rgba_to_bgra mmal_convert_bgra_to_rgba
+
+/** Expand 24 bits per pixel to 32 bits per pixel, setting the alpha (or
+ * fourth) byte to alpha. Works for RGB24 to RGBA and BGR24 to BGRA. */
+void mmal_convert_rgb24_to_rgba(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height,
+   uint8_t alpha);
+
+/** Drop the fourth byte of 32 bits per pixel images. Works for RGBA to
+ * RGB24 and BGRA to BGR24. */
+void mmal_convert_rgba_to_rgb24(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height);
+
+/** Planes of a YUV image. Unused planes are ignored. */
+typedef struct MMAL_CONVERT_PLANES_T
+{
+   uint8_t *data[3];       /**< Y, U, V for planar formats. Y, UV for semi-planar ones */
+   unsigned int pitch[3];
+} MMAL_CONVERT_PLANES_T;
+
+/** I420 to NV12, interleaving the chroma planes */
+void mmal_convert_i420_to_nv12(const MMAL_CONVERT_PLANES_T *dst, const MMAL_CONVERT_PLANES_T *src,
+   unsigned int width, unsigned int height);
+
+/** NV12 to I420, de-interleaving the chroma plane */
+void mmal_convert_nv12_to_i420(const MMAL_CONVERT_PLANES_T *dst, const MMAL_CONVERT_PLANES_T *src,
+   unsigned int width, unsigned int height);
+
+/** YUYV to I420. The chroma of each pair of lines is averaged. */
+void mmal_convert_yuyv_to_i420(const MMAL_CONVERT_PLANES_T *dst,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height);
+
+/** YUYV to I422 (planar, chroma subsampled horizontally only) */
+void mmal_convert_yuyv_to_i422(const MMAL_CONVERT_PLANES_T *dst,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height);
+
+/** I422 to YUYV */
+void mmal_convert_i422_to_yuyv(uint8_t *dst, unsigned int dst_pitch,
+   const MMAL_CONVERT_PLANES_T *src, unsigned int width, unsigned int height);
+
+/** Extract the luma of an image into a plane of its own.
+ *
+ * @param encoding YUYV, YVYU, UYVY or VYUY, or any planar or semi-planar
+ *                 format with 8 bits luma first (I420, NV12, ...)
+ *
+ * @return MMAL_EINVAL if the encoding isn't supported
+ */
+MMAL_STATUS_T mmal_convert_extract_y(uint8_t *dst, unsigned int dst_pitch,
+   const uint8_t *src, unsigned int src_pitch, unsigned int width, unsigned int height,
+   MMAL_FOURCC_T encoding);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MMAL_UTIL_CONVERT_H */
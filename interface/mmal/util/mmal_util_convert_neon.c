@@ -0,0 +1,203 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* NEON kernels of the conversion functions. This file is built with NEON
+ * enabled on 32 bits ARM, the rest of the library isn't, so that nothing else
+ * ends up using NEON on CPUs without it. mmal_util_convert.c only calls these
+ * after checking the CPU. */
+
+#include "interface/mmal/util/mmal_util_convert_private.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+static void convert_swap_rb_neon(uint8_t *dst, const uint8_t *src, unsigned int pixels)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pixels; i += 16)
+   {
+      uint8x16x4_t p = vld4q_u8(src + i * 4);
+      uint8x16_t tmp = p.val[0];
+      p.val[0] = p.val[2];
+      p.val[2] = tmp;
+      vst4q_u8(dst + i * 4, p);
+   }
+   mmal_convert_swap_rb_c(dst + i * 4, src + i * 4, pixels - i);
+}
+
+static void convert_rgb24_to_rgba_neon(uint8_t *dst, const uint8_t *src, unsigned int pixels,
+   uint8_t alpha)
+{
+   uint8x16x4_t out;
+   unsigned int i;
+
+   out.val[3] = vdupq_n_u8(alpha);
+   for (i = 0; i + 16 <= pixels; i += 16)
+   {
+      uint8x16x3_t in = vld3q_u8(src + i * 3);
+      out.val[0] = in.val[0];
+      out.val[1] = in.val[1];
+      out.val[2] = in.val[2];
+      vst4q_u8(dst + i * 4, out);
+   }
+   mmal_convert_rgb24_to_rgba_c(dst + i * 4, src + i * 3, pixels - i, alpha);
+}
+
+static void convert_rgba_to_rgb24_neon(uint8_t *dst, const uint8_t *src, unsigned int pixels)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pixels; i += 16)
+   {
+      uint8x16x4_t in = vld4q_u8(src + i * 4);
+      uint8x16x3_t out;
+      out.val[0] = in.val[0];
+      out.val[1] = in.val[1];
+      out.val[2] = in.val[2];
+      vst3q_u8(dst + i * 3, out);
+   }
+   mmal_convert_rgba_to_rgb24_c(dst + i * 3, src + i * 4, pixels - i);
+}
+
+static void convert_interleave_neon(uint8_t *uv, const uint8_t *u, const uint8_t *v,
+   unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      uint8x16x2_t out;
+      out.val[0] = vld1q_u8(u + i);
+      out.val[1] = vld1q_u8(v + i);
+      vst2q_u8(uv + i * 2, out);
+   }
+   mmal_convert_interleave_c(uv + i * 2, u + i, v + i, pairs - i);
+}
+
+static void convert_deinterleave_neon(uint8_t *u, uint8_t *v, const uint8_t *uv,
+   unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      uint8x16x2_t in = vld2q_u8(uv + i * 2);
+      vst1q_u8(u + i, in.val[0]);
+      vst1q_u8(v + i, in.val[1]);
+   }
+   mmal_convert_deinterleave_c(u + i, v + i, uv + i * 2, pairs - i);
+}
+
+static void convert_even_bytes_neon(uint8_t *dst, const uint8_t *src, unsigned int count)
+{
+   unsigned int i;
+
+   /* Reads 32 bytes for 16 outputs, the last of which is one past the last
+    * byte needed */
+   for (i = 0; i + 16 < count; i += 16)
+      vst1q_u8(dst + i, vld2q_u8(src + i * 2).val[0]);
+   mmal_convert_even_bytes_c(dst + i, src + i * 2, count - i);
+}
+
+static void convert_yuyv_split_neon(uint8_t *y, uint8_t *u, uint8_t *v, const uint8_t *yuyv,
+   unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      uint8x16x4_t in = vld4q_u8(yuyv + i * 4);
+      uint8x16x2_t luma;
+      luma.val[0] = in.val[0];
+      luma.val[1] = in.val[2];
+      vst2q_u8(y + i * 2, luma);
+      vst1q_u8(u + i, in.val[1]);
+      vst1q_u8(v + i, in.val[3]);
+   }
+   mmal_convert_yuyv_split_c(y + i * 2, u + i, v + i, yuyv + i * 4, pairs - i);
+}
+
+static void convert_yuyv_merge_neon(uint8_t *yuyv, const uint8_t *y, const uint8_t *u,
+   const uint8_t *v, unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      uint8x16x2_t luma = vld2q_u8(y + i * 2);
+      uint8x16x4_t out;
+      out.val[0] = luma.val[0];
+      out.val[1] = vld1q_u8(u + i);
+      out.val[2] = luma.val[1];
+      out.val[3] = vld1q_u8(v + i);
+      vst4q_u8(yuyv + i * 4, out);
+   }
+   mmal_convert_yuyv_merge_c(yuyv + i * 4, y + i * 2, u + i, v + i, pairs - i);
+}
+
+static void convert_yuyv_chroma_neon(uint8_t *u, uint8_t *v, const uint8_t *line0,
+   const uint8_t *line1, unsigned int pairs)
+{
+   unsigned int i;
+
+   for (i = 0; i + 16 <= pairs; i += 16)
+   {
+      uint8x16x4_t in0 = vld4q_u8(line0 + i * 4);
+      uint8x16x4_t in1 = vld4q_u8(line1 + i * 4);
+      vst1q_u8(u + i, vrhaddq_u8(in0.val[1], in1.val[1]));
+      vst1q_u8(v + i, vrhaddq_u8(in0.val[3], in1.val[3]));
+   }
+   mmal_convert_yuyv_chroma_c(u + i, v + i, line0 + i * 4, line1 + i * 4, pairs - i);
+}
+
+static const MMAL_CONVERT_KERNELS_T convert_neon_kernels =
+{
+   convert_swap_rb_neon,
+   convert_rgb24_to_rgba_neon,
+   convert_rgba_to_rgb24_neon,
+   convert_interleave_neon,
+   convert_deinterleave_neon,
+   convert_even_bytes_neon,
+   convert_yuyv_split_neon,
+   convert_yuyv_merge_neon,
+   convert_yuyv_chroma_neon,
+};
+
+const MMAL_CONVERT_KERNELS_T *mmal_convert_neon_kernels(void)
+{
+   return &convert_neon_kernels;
+}
+
+#else
+
+const MMAL_CONVERT_KERNELS_T *mmal_convert_neon_kernels(void)
+{
+   return NULL;
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MMAL_UTIL_CONVERT_PRIVATE_H
+#define MMAL_UTIL_CONVERT_PRIVATE_H
+
+#include "interface/mmal/mmal_types.h"
+
+/** Per line kernels of the conversion functions. The SIMD versions handle
+ * the bulk of a line and leave the rest to the scalar versions below. */
+typedef struct MMAL_CONVERT_KERNELS_T
+{
+   /** Swap bytes 0 and 2 of each pixel, in place if dst == src */
+   void (*swap_rb)(uint8_t *dst, const uint8_t *src, unsigned int pixels);
+   void (*rgb24_to_rgba)(uint8_t *dst, const uint8_t *src, unsigned int pixels, uint8_t alpha);
+   void (*rgba_to_rgb24)(uint8_t *dst, const uint8_t *src, unsigned int pixels);
+   void (*interleave)(uint8_t *uv, const uint8_t *u, const uint8_t *v, unsigned int pairs);
+   void (*deinterleave)(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int pairs);
+   /** dst[i] = src[2 * i]. Doesn't read past src[2 * count - 2]. */
+   void (*even_bytes)(uint8_t *dst, const uint8_t *src, unsigned int count);
+   void (*yuyv_split)(uint8_t *y, uint8_t *u, uint8_t *v, const uint8_t *yuyv, unsigned int pairs);
+   void (*yuyv_merge)(uint8_t *yuyv, const uint8_t *y, const uint8_t *u, const uint8_t *v,
+      unsigned int pairs);
+   /** Chroma of two YUYV lines, averaged */
+   void (*yuyv_chroma)(uint8_t *u, uint8_t *v, const uint8_t *line0, const uint8_t *line1,
+      unsigned int pairs);
+} MMAL_CONVERT_KERNELS_T;
+
+/** NEON kernels, or NULL if they weren't built in. Entries may be NULL. */
+const MMAL_CONVERT_KERNELS_T *mmal_convert_neon_kernels(void);
+
+static inline void mmal_convert_swap_rb_c(uint8_t *dst, const uint8_t *src, unsigned int pixels)
+{
+   for (; pixels; pixels--, dst += 4, src += 4)
+   {
+      uint8_t r = src[2], b = src[0];
+      dst[0] = r;
+      dst[1] = src[1];
+      dst[2] = b;
+      dst[3] = src[3];
+   }
+}
+
+static inline void mmal_convert_rgb24_to_rgba_c(uint8_t *dst, const uint8_t *src,
+   unsigned int pixels, uint8_t alpha)
+{
+   for (; pixels; pixels--, dst += 4, src += 3)
+   {
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+      dst[3] = alpha;
+   }
+}
+
+static inline void mmal_convert_rgba_to_rgb24_c(uint8_t *dst, const uint8_t *src,
+   unsigned int pixels)
+{
+   for (; pixels; pixels--, dst += 3, src += 4)
+   {
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+   }
+}
+
+static inline void mmal_convert_interleave_c(uint8_t *uv, const uint8_t *u, const uint8_t *v,
+   unsigned int pairs)
+{
+   for (; pairs; pairs--)
+   {
+      *uv++ = *u++;
+      *uv++ = *v++;
+   }
+}
+
+static inline void mmal_convert_deinterleave_c(uint8_t *u, uint8_t *v, const uint8_t *uv,
+   unsigned int pairs)
+{
+   for (; pairs; pairs--)
+   {
+      *u++ = *uv++;
+      *v++ = *uv++;
+   }
+}
+
+static inline void mmal_convert_even_bytes_c(uint8_t *dst, const uint8_t *src, unsigned int count)
+{
+   for (; count; count--, src += 2)
+      *dst++ = *src;
+}
+
+static inline void mmal_convert_yuyv_split_c(uint8_t *y, uint8_t *u, uint8_t *v,
+   const uint8_t *yuyv, unsigned int pairs)
+{
+   for (; pairs; pairs--)
+   {
+      *y++ = *yuyv++;
+      *u++ = *yuyv++;
+      *y++ = *yuyv++;
+      *v++ = *yuyv++;
+   }
+}
+
+static inline void mmal_convert_yuyv_merge_c(uint8_t *yuyv, const uint8_t *y, const uint8_t *u,
+   const uint8_t *v, unsigned int pairs)
+{
+   for (; pairs; pairs--)
+   {
+      *yuyv++ = *y++;
+      *yuyv++ = *u++;
+      *yuyv++ = *y++;
+      *yuyv++ = *v++;
+   }
+}
+
+static inline void mmal_convert_yuyv_chroma_c(uint8_t *u, uint8_t *v, const uint8_t *line0,
+   const uint8_t *line1, unsigned int pairs)
+{
+   for (; pairs; pairs--, line0 += 4, line1 += 4)
+   {
+      *u++ = (line0[1] + line1[1] + 1) >> 1;
+      *v++ = (line0[3] + line1[3] + 1) >> 1;
+   }
+}
+
+#endif /* MMAL_UTIL_CONVERT_PRIVATE_H */
@@ -221,3 +221,49 @@ MMAL_STATUS_T mmal_util_get_core_port_stats(MMAL_PORT_T *port,
       *stats = param.stats;
    return ret;
 }
+
+MMAL_STATUS_T mmal_util_get_core_port_histograms(MMAL_PORT_T *port,
+                                                 MMAL_CORE_STATS_DIR dir,
+                                                 MMAL_BOOL_T reset,
+                                                 MMAL_CORE_HISTOGRAM_T *latency,
+                                                 MMAL_CORE_HISTOGRAM_T *inter_arrival)
+{
+   MMAL_PARAMETER_CORE_HISTOGRAMS_T param;
+   MMAL_STATUS_T ret;
+
+   memset(&param, 0, sizeof(param));
+   param.hdr.id = MMAL_PARAMETER_CORE_HISTOGRAMS;
+   param.hdr.size = sizeof(param);
+   param.dir = dir;
+   param.reset = reset;
+   // coverity[overrun-buffer-val] Structure accessed correctly via size field
+   ret = mmal_port_parameter_get(port, &param.hdr);
+   if (ret != MMAL_SUCCESS)
+      return ret;
+   if (latency)
+      *latency = param.latency;
+   if (inter_arrival)
+      *inter_arrival = param.inter_arrival;
+   return MMAL_SUCCESS;
+}
+
+uint32_t mmal_util_core_histogram_percentile(const MMAL_CORE_HISTOGRAM_T *histogram,
+                                             unsigned int percent)
+{
+   uint64_t target, total = 0;
+   unsigned int i;
+
+   if (!histogram->count)
+      return 0;
+
+   target = ((uint64_t)histogram->count * vcos_min(percent, 100) + 99) / 100;
+   for (i = 0; i < MMAL_CORE_HISTOGRAM_BUCKETS; i++)
+   {
+      total += histogram->bucket[i];
+      if (total >= target)
+         break;
+   }
+   if (i >= MMAL_CORE_HISTOGRAM_BUCKETS - 1)
+      return 0xffffffff;
+   return i ? (1u << i) - 1 : 0;
+}
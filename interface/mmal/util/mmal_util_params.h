@@ -203,6 +203,29 @@ MMAL_STATUS_T mmal_util_camera_use_stc_timestamp(MMAL_PORT_T *port, MMAL_CAMERA_
 MMAL_STATUS_T mmal_util_get_core_port_stats(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR dir, MMAL_BOOL_T reset,
                                             MMAL_CORE_STATISTICS_T *stats);
 
+/** Get the MMAL core latency and inter-arrival histograms for a given port.
+ * Resetting the histograms doesn't require the port to be stopped.
+ *
+ * @param port          port to query
+ * @param dir           port direction
+ * @param reset         reset the histograms as well
+ * @param latency       filled in with the latency histogram (can be NULL)
+ * @param inter_arrival filled in with the inter-arrival histogram (can be NULL)
+ * @return MMAL_SUCCESS or error
+ */
+MMAL_STATUS_T mmal_util_get_core_port_histograms(MMAL_PORT_T *port, MMAL_CORE_STATS_DIR dir,
+                                                 MMAL_BOOL_T reset, MMAL_CORE_HISTOGRAM_T *latency,
+                                                 MMAL_CORE_HISTOGRAM_T *inter_arrival);
+
+/** Get an upper bound for a given percentile of a MMAL core histogram.
+ *
+ * @param histogram histogram to look at
+ * @param percent   percentile to compute (e.g. 99)
+ * @return upper bound (us) of the bucket containing the percentile, 0 if the histogram is empty
+ */
+uint32_t mmal_util_core_histogram_percentile(const MMAL_CORE_HISTOGRAM_T *histogram,
+                                             unsigned int percent);
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,6 +38,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "interface/mmal/core/mmal_buffer_private.h"
 #include "interface/vcos/vcos.h"
 
+/** Bounds on the number of client contexts per port pool magazine */
+#define MMAL_VC_POOL_MAGAZINE_MIN 4
+#define MMAL_VC_POOL_MAGAZINE_MAX 16
+
 /** Private information for MMAL VC components
  */
 
@@ -55,6 +59,16 @@ typedef enum MMAL_PORT_FLUSH_CHECK_T
    PORT_FLUSH_INCOMPATIBLE
 } MMAL_PORT_FLUSH_CHECK_T;
 
+typedef enum MMAL_BATCH_CHECK_T
+{
+   BATCH_NOT_INITIALIZED,
+   BATCH_COMPATIBLE,
+   BATCH_INCOMPATIBLE
+} MMAL_BATCH_CHECK_T;
+
+/** Whether VC understands buffer batch messages, only asked once */
+static MMAL_BATCH_CHECK_T is_vc_batch_compatible = BATCH_NOT_INITIALIZED;
+
 typedef struct MMAL_PORT_MODULE_T
 {
    uint32_t magic;
@@ -72,6 +86,15 @@ typedef struct MMAL_PORT_MODULE_T
    MMAL_BOOL_T sent_data_on_port;
 
    MMAL_PORT_T *connected;           /**< Connected port if any */
+
+   /* Buffers held back to be sent to VC together */
+   MMAL_BOOL_T batch_initialised;
+   VCOS_MUTEX_T batch_lock;
+   VCOS_TIMER_T batch_timer;         /**< Sends a partial batch once it is old enough */
+   unsigned int batch_max;           /**< Batch size, 0 when not batching */
+   unsigned int batch_delay;         /**< Maximum time (ms) a buffer is held back */
+   unsigned int batch_count;
+   MMAL_VC_CLIENT_BUFFER_CONTEXT_T *batch[MMAL_WORKER_BUFFER_BATCH_MAX];
 } MMAL_PORT_MODULE_T;
 
 typedef struct MMAL_COMPONENT_MODULE_T
@@ -92,6 +115,8 @@ typedef struct MMAL_COMPONENT_MODULE_T
  *****************************************************************************/
 static void mmal_vc_do_callback(MMAL_COMPONENT_T *component);
 static MMAL_STATUS_T mmal_vc_port_info_get(MMAL_PORT_T *port);
+static MMAL_STATUS_T mmal_vc_port_send(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer);
+static void mmal_vc_port_batch_flush(MMAL_PORT_T *port);
 
 /*****************************************************************************/
 MMAL_STATUS_T mmal_vc_get_version(uint32_t *major, uint32_t *minor, uint32_t *minimum)
@@ -241,6 +266,14 @@ static MMAL_STATUS_T mmal_vc_port_enable(MMAL_PORT_T *port, MMAL_PORT_BH_CB_T cb
          return MMAL_ENOMEM;
       }
       module->has_pool = 1;
+
+      /* Contexts are allocated by the threads sending buffers and freed by
+       * the VCHIQ callback thread, so let them swap magazines of contexts
+       * rather than take the pool lock for every buffer. */
+      if (port->buffer_num >= 4 * MMAL_VC_POOL_MAGAZINE_MIN &&
+          vcos_blockpool_set_magazines(&module->pool,
+             vcos_min(port->buffer_num / 4, MMAL_VC_POOL_MAGAZINE_MAX)) != VCOS_SUCCESS)
+         LOG_ERROR("failed to enable port pool magazines");
    }
 
    if (module->connected)
@@ -291,6 +324,8 @@ static MMAL_STATUS_T mmal_vc_port_disable(MMAL_PORT_T *port)
    mmal_worker_port_action msg;
    size_t replylen = sizeof(reply);
 
+   mmal_vc_port_batch_flush(port);
+
    msg.component_handle = module->component_handle;
    msg.action = MMAL_WORKER_PORT_ACTION_DISABLE;
    msg.port_handle = module->port_handle;
@@ -403,6 +438,9 @@ static MMAL_STATUS_T mmal_vc_port_flush(MMAL_PORT_T *port)
       the normal flushing mechanism in that case.
     */
 
+   /* Buffers held back for batching were sent before the flush */
+   mmal_vc_port_batch_flush(port);
+
    if (port->priv->module->is_zero_copy || !port->priv->module->sent_data_on_port)
       return mmal_vc_port_flush_normal(port);
 
@@ -524,7 +562,7 @@ static void mmal_vc_do_callback_loop(MMAL_COMPONENT_T *component)
  * a pointer back to our original client side context.
  *
  */
-static void mmal_vc_port_send_callback(mmal_worker_buffer_from_host *msg)
+static MMAL_PORT_T *mmal_vc_port_send_complete(mmal_worker_buffer_from_host *msg)
 {
    MMAL_BUFFER_HEADER_T *buffer;
    MMAL_PORT_T *port;
@@ -543,9 +581,26 @@ static void mmal_vc_port_send_callback(mmal_worker_buffer_from_host *msg)
    /* Queue the callback so it is delivered by the action thread */
    buffer->priv->component_data = (void *)port;
    mmal_queue_put(port->component->priv->module->callback_queue, buffer);
+   return port;
+}
+
+static void mmal_vc_port_send_callback(mmal_worker_buffer_from_host *msg)
+{
+   MMAL_PORT_T *port = mmal_vc_port_send_complete(msg);
    mmal_component_action_trigger(port->component);
 }
 
+/** Called for buffers which came back from the copro in a batch. The action
+ * thread is only woken up after the last one for the component.
+ */
+static void mmal_vc_port_send_callback_batched(mmal_worker_buffer_from_host *msg,
+                                               MMAL_BOOL_T last)
+{
+   MMAL_PORT_T *port = mmal_vc_port_send_complete(msg);
+   if (last)
+      mmal_component_action_trigger(port->component);
+}
+
 static void mmal_vc_port_send_event_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
 {
    /* Queue the event to be delivered by the action thread */
@@ -554,6 +609,169 @@ static void mmal_vc_port_send_event_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEAD
    mmal_component_action_trigger(port->component);
 }
 
+/** Send the buffers held back on a port. Called with the batch lock held.
+  */
+static void mmal_vc_port_batch_send(MMAL_PORT_T *port)
+{
+   MMAL_PORT_MODULE_T *module = port->priv->module;
+   mmal_worker_buffer_from_host *msgs[MMAL_WORKER_BUFFER_BATCH_MAX];
+   MMAL_STATUS_T status;
+   unsigned int i, count = module->batch_count;
+
+   if (!count)
+      return;
+   module->batch_count = 0;
+
+   for (i = 0; i < count; i++)
+      msgs[i] = &module->batch[i]->msg;
+
+   if (count == 1)
+      status = mmal_vc_send_message(mmal_vc_get_client(), &msgs[0]->header, sizeof(*msgs[0]),
+                                    NULL, 0, MMAL_WORKER_BUFFER_FROM_HOST);
+   else
+      status = mmal_vc_send_buffer_batch(mmal_vc_get_client(), msgs, count);
+
+   if (status == MMAL_SUCCESS)
+      return;
+
+   /* The sends were accepted a while ago so the buffers have to come back
+    * through the normal callback path, marked as failed */
+   LOG_ERROR("failed to send batch of %u buffers (%i)", count, status);
+   for (i = 0; i < count; i++)
+   {
+      msgs[i]->buffer_header.length = 0;
+      msgs[i]->buffer_header.flags |= MMAL_BUFFER_HEADER_FLAG_TRANSMISSION_FAILED;
+      mmal_vc_port_send_callback_batched(msgs[i], i + 1 == count);
+   }
+}
+
+/** Send any buffers held back on a port */
+static void mmal_vc_port_batch_flush(MMAL_PORT_T *port)
+{
+   MMAL_PORT_MODULE_T *module = port->priv->module;
+
+   if (!module->batch_initialised)
+      return;
+
+   vcos_mutex_lock(&module->batch_lock);
+   mmal_vc_port_batch_send(port);
+   vcos_mutex_unlock(&module->batch_lock);
+}
+
+static void mmal_vc_port_batch_timer_cb(void *context)
+{
+   /* The timer may have been set for an earlier batch, in which case this one
+    * goes a bit early. That's harmless and re-arming from here isn't allowed. */
+   mmal_vc_port_batch_flush((MMAL_PORT_T *)context);
+}
+
+/** Hold back a buffer to be sent along with others */
+static MMAL_STATUS_T mmal_vc_port_batch_add(MMAL_PORT_T *port,
+   MMAL_VC_CLIENT_BUFFER_CONTEXT_T *client_context)
+{
+   MMAL_PORT_MODULE_T *module = port->priv->module;
+   MMAL_BOOL_T arm_timer = MMAL_FALSE;
+
+   vcos_mutex_lock(&module->batch_lock);
+   module->batch[module->batch_count++] = client_context;
+   if (module->batch_count >= module->batch_max ||
+       (client_context->msg.buffer_header.flags & MMAL_BUFFER_HEADER_FLAG_EOS))
+      mmal_vc_port_batch_send(port);
+   else if (module->batch_count == 1)
+      arm_timer = MMAL_TRUE;
+   vcos_mutex_unlock(&module->batch_lock);
+
+   /* The timer calls us back with its own lock held, so it can't be touched
+    * while holding the batch lock */
+   if (arm_timer)
+      vcos_timer_set(&module->batch_timer, module->batch_delay);
+
+   return MMAL_SUCCESS;
+}
+
+static MMAL_BOOL_T mmal_vc_batch_supported(void)
+{
+   uint32_t major = 0, minor = 0, minimum = 0;
+
+   if (is_vc_batch_compatible != BATCH_NOT_INITIALIZED)
+      return is_vc_batch_compatible == BATCH_COMPATIBLE;
+
+   /* Don't remember a failure to ask, only the answer */
+   if (mmal_vc_get_version(&major, &minor, &minimum) != MMAL_SUCCESS)
+      return MMAL_FALSE;
+
+   if (major > WORKER_VER_MAJOR ||
+       (major == WORKER_VER_MAJOR && minor >= WORKER_VER_MINOR_BATCH))
+   {
+      is_vc_batch_compatible = BATCH_COMPATIBLE;
+   }
+   else
+   {
+      LOG_INFO("MMAL Server %d.%d can't take batches, need %d.%d. Sending buffers one by one",
+               major, minor, WORKER_VER_MAJOR, WORKER_VER_MINOR_BATCH);
+      is_vc_batch_compatible = BATCH_INCOMPATIBLE;
+   }
+   return is_vc_batch_compatible == BATCH_COMPATIBLE;
+}
+
+static void mmal_vc_port_batch_destroy(MMAL_PORT_MODULE_T *module)
+{
+   if (!module->batch_initialised)
+      return;
+
+   vcos_timer_delete(&module->batch_timer);
+   vcos_mutex_delete(&module->batch_lock);
+   module->batch_initialised = MMAL_FALSE;
+   module->batch_max = 0;
+}
+
+MMAL_STATUS_T mmal_vc_port_set_batching(MMAL_PORT_T *port, unsigned int max_buffers,
+   unsigned int max_delay_ms)
+{
+   MMAL_PORT_MODULE_T *module;
+
+   if (!port || port->priv->pf_send != mmal_vc_port_send)
+      return MMAL_EINVAL;
+   module = port->priv->module;
+
+   if (max_buffers > MMAL_WORKER_BUFFER_BATCH_MAX)
+      max_buffers = MMAL_WORKER_BUFFER_BATCH_MAX;
+   if (max_buffers <= 1)
+      max_buffers = 0;
+   else if (!max_delay_ms)
+      return MMAL_EINVAL;
+
+   /* An older VC would drop batch messages, so the port carries on sending
+    * one message per buffer */
+   if (max_buffers && !mmal_vc_batch_supported())
+      return MMAL_ENOSYS;
+
+   if (!module->batch_initialised && max_buffers)
+   {
+      if (vcos_mutex_create(&module->batch_lock, "mmal_vc_batch") != VCOS_SUCCESS)
+         return MMAL_ENOSPC;
+      if (vcos_timer_create(&module->batch_timer, "mmal_vc_batch",
+                            mmal_vc_port_batch_timer_cb, port) != VCOS_SUCCESS)
+      {
+         vcos_mutex_delete(&module->batch_lock);
+         return MMAL_ENOSPC;
+      }
+      module->batch_initialised = MMAL_TRUE;
+   }
+
+   if (!module->batch_initialised)
+      return MMAL_SUCCESS;
+
+   vcos_mutex_lock(&module->batch_lock);
+   if (max_buffers < module->batch_max)
+      mmal_vc_port_batch_send(port);
+   module->batch_max = max_buffers;
+   module->batch_delay = max_delay_ms;
+   vcos_mutex_unlock(&module->batch_lock);
+
+   return MMAL_SUCCESS;
+}
+
 /** Called from the client to send a buffer (empty or full) to
   * the copro.
   */
@@ -611,6 +829,7 @@ static MMAL_STATUS_T mmal_vc_port_send(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *
    client_context->magic = MMAL_MAGIC;
    client_context->buffer = buffer;
    client_context->callback = mmal_vc_port_send_callback;
+   client_context->callback_batched = mmal_vc_port_send_callback_batched;
    client_context->callback_event = NULL;
    client_context->port = port;
 
@@ -687,6 +906,15 @@ static MMAL_STATUS_T mmal_vc_port_send(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *
       msg->buffer_header.offset = 0;
    }
 
+   if (module->batch_max)
+   {
+      /* Buffers which don't need a bulk transfer can go in a batch. Anything
+       * else has to go after whatever is already waiting. */
+      if (!length && msgid == MMAL_WORKER_BUFFER_FROM_HOST)
+         return mmal_vc_port_batch_add(port, client_context);
+      mmal_vc_port_batch_flush(port);
+   }
+
    status = mmal_vc_send_message(mmal_vc_get_client(), &msg->header, sizeof(*msg),
                                  buffer->data + buffer->offset, length,
                                  msgid);
@@ -767,6 +995,7 @@ static MMAL_STATUS_T mmal_vc_component_destroy(MMAL_COMPONENT_T *component)
    mmal_worker_component_destroy msg;
    mmal_worker_reply reply;
    size_t replylen = sizeof(reply);
+   unsigned int i;
 
    vcos_assert(component && component->priv && component->priv->module);
 
@@ -787,6 +1016,9 @@ static MMAL_STATUS_T mmal_vc_component_destroy(MMAL_COMPONENT_T *component)
       goto fail;
    }
 
+   for (i = 0; i < component->priv->module->ports_num; i++)
+      mmal_vc_port_batch_destroy(component->priv->module->ports[i]);
+
    if(component->input_num)
       mmal_ports_free(component->input, component->input_num);
    if(component->output_num)
@@ -159,6 +159,23 @@ MMAL_STATUS_T mmal_vc_release(void);
 MMAL_STATUS_T mmal_vc_get_version(uint32_t *major, uint32_t *minor, uint32_t *minimum);
 MMAL_STATUS_T mmal_vc_get_stats(MMAL_VC_STATS_T *stats, int reset);
 
+/** Send buffers to a VideoCore port in batches.
+ * Buffers which don't need a bulk transfer (zero-copy, empty, or whose payload
+ * fits in the message) are held back and sent together once max_buffers are
+ * waiting, once the oldest has waited for max_delay_ms, or on EOS, flush or
+ * disable. Other buffers are sent straight away, after any already waiting.
+ * Needs a VideoCore which understands MMAL_WORKER_BUFFER_FROM_HOST_BATCH
+ * (worker version 16.2 or later).
+ *
+ * @param port         port of a VideoCore component
+ * @param max_buffers  buffers per batch, 0 or 1 to stop batching
+ * @param max_delay_ms longest a buffer can be held back, must be non-zero
+ * @return MMAL_ENOSYS if VideoCore is too old for batches, in which case the
+ *         port goes on sending one message per buffer
+ */
+MMAL_STATUS_T mmal_vc_port_set_batching(MMAL_PORT_T *port, unsigned int max_buffers,
+   unsigned int max_delay_ms);
+
 /** Return the MMAL core statistics for a given component/port.
  *
  * @param stats         Updated with given port statistics
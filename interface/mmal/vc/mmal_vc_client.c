@@ -273,6 +273,77 @@ error:
    vchiq_release_message(service, vchiq_header);
 }
 
+/** Handle buffers returned by VC as a batch. None of them can involve a bulk
+  * transfer so the whole batch is completed from here.
+  */
+static void mmal_vc_handle_buffer_batch_msg(VCHIQ_HEADER_T *vchiq_header,
+                                            VCHIQ_SERVICE_HANDLE_T service)
+{
+   mmal_worker_buffer_batch *batch = (mmal_worker_buffer_batch *)vchiq_header->data;
+   mmal_worker_buffer_from_host *msgs = (mmal_worker_buffer_from_host *)(batch + 1);
+   unsigned int i, count = batch->count;
+
+   if (!vcos_verify(count <= MMAL_WORKER_BUFFER_BATCH_MAX &&
+                    vchiq_header->size >= sizeof(*batch) + count * sizeof(*msgs)))
+   {
+      LOG_ERROR("invalid batch of %u buffers (%u bytes)", count, vchiq_header->size);
+      vchiq_release_message(service, vchiq_header);
+      return;
+   }
+
+   LOG_TRACE("batch of %u buffers to host", count);
+
+   for (i = 0; i < count; i++)
+   {
+      mmal_worker_buffer_from_host *msg = &msgs[i];
+      MMAL_VC_CLIENT_BUFFER_CONTEXT_T *client_context = msg->drvbuf.client_context;
+      MMAL_BOOL_T last;
+
+      vcos_assert(msg->header.magic == MMAL_MAGIC);
+      vcos_assert(client_context);
+      vcos_assert(client_context->magic == MMAL_MAGIC);
+
+      if (msg->has_reference)
+         mmal_buffer_header_replicate(client_context->buffer,
+                                      msg->drvbuf_ref.client_context->buffer);
+
+      if (!vcos_verify(msg->buffer_header.offset + msg->buffer_header.length <=
+                       client_context->buffer->alloc_size) ||
+          (!msg->is_zero_copy && !msg->payload_in_message &&
+           (msg->buffer_header.length != 0 ||
+            (msg->buffer_header.flags & MMAL_BUFFER_HEADER_FLAG_EOS))) ||
+          !vcos_verify(msg->payload_in_message <= MMAL_VC_SHORT_DATA))
+      {
+         /* Either too big for our buffer or it needed a bulk transfer, which
+          * isn't allowed in a batch */
+         LOG_ERROR("invalid buffer in batch (%u, %u)", msg->buffer_header.length,
+                   msg->payload_in_message);
+         msg->buffer_header.length = 0;
+         msg->buffer_header.flags |= MMAL_BUFFER_HEADER_FLAG_TRANSMISSION_FAILED;
+      }
+      else if (!msg->is_zero_copy && msg->payload_in_message)
+      {
+         MMAL_BUFFER_HEADER_T *dst = client_context->buffer;
+         memcpy(dst->data, msg->short_data, msg->payload_in_message);
+         dst->offset = 0;
+         dst->length = msg->payload_in_message;
+      }
+
+      if (!client_context->callback_batched)
+      {
+         client_context->callback(msg);
+         continue;
+      }
+
+      last = (i + 1 == count) ||
+         !msgs[i + 1].drvbuf.client_context ||
+         msgs[i + 1].drvbuf.client_context->port->component != client_context->port->component;
+      client_context->callback_batched(msg, last);
+   }
+
+   vchiq_release_message(service, vchiq_header);
+}
+
 static MMAL_STATUS_T mmal_vc_use_internal(MMAL_CLIENT_T *client)
 {
    MMAL_STATUS_T status = MMAL_SUCCESS;
@@ -420,6 +491,10 @@ static VCHIQ_STATUS_T mmal_vc_vchiq_callback(VCHIQ_REASON_T reason,
          {
             mmal_vc_handle_event_msg(vchiq_header, service, context);
          }
+         else if (msg->msgid == MMAL_WORKER_BUFFER_TO_HOST_BATCH)
+         {
+            mmal_vc_handle_buffer_batch_msg(vchiq_header, service);
+         }
          else
          {
             MMAL_WAITER_T *waiter = msg->u.waiter;
@@ -679,6 +754,51 @@ MMAL_STATUS_T mmal_vc_send_message(MMAL_CLIENT_T *client,
    return MMAL_EIO;
 }
 
+MMAL_STATUS_T mmal_vc_send_buffer_batch(MMAL_CLIENT_T *client,
+                                        mmal_worker_buffer_from_host **msgs,
+                                        unsigned int count)
+{
+   mmal_worker_buffer_batch batch;
+   VCHIQ_ELEMENT_T elems[1 + MMAL_WORKER_BUFFER_BATCH_MAX];
+   VCHIQ_STATUS_T vst;
+   unsigned int i;
+
+   LOG_TRACE("batch of %u buffers", count);
+   vcos_assert(count <= MMAL_WORKER_BUFFER_BATCH_MAX);
+
+   if (!client->inited)
+   {
+      vcos_assert(0);
+      return MMAL_EINVAL;
+   }
+
+   batch.header.msgid = MMAL_WORKER_BUFFER_FROM_HOST_BATCH;
+   batch.header.magic = MMAL_MAGIC;
+   batch.count = count;
+   batch.dummy = 0;
+   elems[0].data = &batch;
+   elems[0].size = sizeof(batch);
+
+   /* The buffer messages are gathered straight from their client contexts
+    * into the one VCHIQ message */
+   for (i = 0; i < count; i++)
+   {
+      msgs[i]->header.msgid = MMAL_WORKER_BUFFER_FROM_HOST;
+      msgs[i]->header.magic = MMAL_MAGIC;
+      elems[i + 1].data = msgs[i];
+      elems[i + 1].size = sizeof(*msgs[i]);
+   }
+
+   vst = vchiq_queue_message(client->service, elems, count + 1);
+   if (vst != VCHIQ_SUCCESS)
+   {
+      LOG_ERROR("failed");
+      return MMAL_EIO;
+   }
+
+   return MMAL_SUCCESS;
+}
+
 MMAL_STATUS_T mmal_vc_use(void)
 {
    MMAL_STATUS_T status = MMAL_ENOTCONN;
@@ -47,6 +47,11 @@ typedef struct MMAL_VC_CLIENT_BUFFER_CONTEXT_T
    /** Called when VC is done with the buffer */
    void (*callback)(struct mmal_worker_buffer_from_host *);
 
+   /** Called instead of callback for buffers VC returns in a batch. 'last' is
+     * set for the final buffer of a run belonging to the same component, so
+     * that it only needs waking up once. Optional. */
+   void (*callback_batched)(struct mmal_worker_buffer_from_host *, MMAL_BOOL_T last);
+
    /** Called when VC sends an event */
    void (*callback_event)(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *event);
 
@@ -76,5 +81,11 @@ MMAL_STATUS_T mmal_vc_send_message(MMAL_CLIENT_T *client,
                                    uint8_t *data, size_t data_size,
                                    uint32_t msgid);
 
+/** Send several buffer messages, none of which needs a bulk transfer, as a
+  * single MMAL_WORKER_BUFFER_FROM_HOST_BATCH message. */
+MMAL_STATUS_T mmal_vc_send_buffer_batch(MMAL_CLIENT_T *client,
+                                        mmal_worker_buffer_from_host **msgs,
+                                        unsigned int count);
+
 #endif
 
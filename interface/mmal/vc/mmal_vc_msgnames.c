@@ -64,6 +64,8 @@ const char *mmal_msgname(uint32_t id)
       MSGNAME(PORT_FLUSH),
       MSGNAME(HOST_LOG),
       MSGNAME(COMPACT),
+      MSGNAME(BUFFER_FROM_HOST_BATCH),
+      MSGNAME(BUFFER_TO_HOST_BATCH),
       { 0, NULL },
    };
    vcos_static_assert(sizeof(msgnames)/sizeof(msgnames[0]) == MMAL_WORKER_MSG_LAST);
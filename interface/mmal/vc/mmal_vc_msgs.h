@@ -42,9 +42,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* Major version indicates binary backwards compatibility */
 #define WORKER_VER_MAJOR   16
 #define WORKER_VER_MINIMUM 10
-/* Minor version is not used normally.
+/* Minor version is not used normally, other than to tell whether VC knows
+ * about messages added since the major version was last bumped.
  */
-#define WORKER_VER_MINOR   1
+#define WORKER_VER_MINOR   2
+/* First minor version with MMAL_WORKER_BUFFER_FROM_HOST_BATCH and
+ * MMAL_WORKER_BUFFER_TO_HOST_BATCH. VC only returns buffers in a batch
+ * to ports it has been sent batches on. */
+#define WORKER_VER_MINOR_BATCH 2
 #ifndef WORKER_VER_MINIMUM
 #endif
 
@@ -103,6 +108,8 @@ typedef enum {
    MMAL_WORKER_PORT_FLUSH,
    MMAL_WORKER_HOST_LOG,
    MMAL_WORKER_COMPACT,
+   MMAL_WORKER_BUFFER_FROM_HOST_BATCH,
+   MMAL_WORKER_BUFFER_TO_HOST_BATCH,
    MMAL_WORKER_MSG_LAST
 } MMAL_WORKER_CMD_T;
 
@@ -397,6 +404,31 @@ typedef struct mmal_worker_buffer_from_host
 } mmal_worker_buffer_from_host;
 vcos_static_assert(sizeof(mmal_worker_buffer_from_host) <= MMAL_WORKER_MAX_MSG_LEN);
 
+/** Maximum number of buffers carried by a single batch message, and the size
+ * the whole message must fit in (less than a VCHIQ slot).
+ */
+#define MMAL_WORKER_BUFFER_BATCH_MAX 8
+#define MMAL_WORKER_MAX_BATCH_MSG_LEN 4000
+
+/** Several buffers sent to or returned from VC in one message.
+  *
+  * The header is followed by 'count' mmal_worker_buffer_from_host messages,
+  * each of which is handled as if it had been sent on its own. Only buffers
+  * which don't need a bulk transfer (zero-copy, empty or with their payload in
+  * the message) can be part of a batch.
+  *
+  * @sa mmal_vc_port_set_batching()
+  */
+typedef struct mmal_worker_buffer_batch
+{
+   mmal_worker_msg_header header;
+   uint32_t count;
+   uint32_t dummy; /* Keep the buffer messages 64 bit aligned */
+} mmal_worker_buffer_batch;
+vcos_static_assert(sizeof(mmal_worker_buffer_batch) +
+                   MMAL_WORKER_BUFFER_BATCH_MAX * sizeof(mmal_worker_buffer_from_host) <=
+                   MMAL_WORKER_MAX_BATCH_MSG_LEN);
+
 /** Maximum number of event data bytes that can be passed in the message.
  * More than this and the data is passed in a bulk message.
  */
@@ -24,6 +24,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+
 #include "interface/mmal/mmal_logging.h"
 #include "interface/mmal/mmal.h"
 #include "interface/vcos/vcos.h"
@@ -34,21 +35,43 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 # include "user-vcsm.h"
 #endif /* ENABLE_MMAL_VCSM */
 
-#define MMAL_VC_PAYLOAD_ELEM_MAX 512
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/* Payloads are tracked in hash tables keyed both by user address and by
+ * VideoCore handle. The tables are split into stripes, each with its own lock,
+ * so that concurrent lookups on different buffers don't contend. */
+#define MMAL_VC_PAYLOAD_STRIPES 16 /* Must be a power of 2 */
+#define MMAL_VC_PAYLOAD_MIN_BUCKETS 16 /* Per stripe, must be a power of 2 */
 
 typedef struct MMAL_VC_PAYLOAD_ELEM_T
 {
-   struct MMAL_VC_PAYLOAD_ELEM_T *next;
+   struct MMAL_VC_PAYLOAD_ELEM_T *next_mem;    /**< Next in the user address chain */
+   struct MMAL_VC_PAYLOAD_ELEM_T *next_handle; /**< Next in the VC handle chain, also
+                                                    used for the free list */
    void *handle;
    void *vc_handle;
    uint8_t *mem;
-   MMAL_BOOL_T in_use;
 } MMAL_VC_PAYLOAD_ELEM_T;
 
-typedef struct MMAL_VC_PAYLOAD_LIST_T
+typedef struct MMAL_VC_PAYLOAD_STRIPE_T
 {
-   MMAL_VC_PAYLOAD_ELEM_T list[MMAL_VC_PAYLOAD_ELEM_MAX];
    VCOS_MUTEX_T lock;
+   MMAL_VC_PAYLOAD_ELEM_T **by_mem;
+   MMAL_VC_PAYLOAD_ELEM_T **by_handle;
+   unsigned int mem_buckets, mem_count;
+   unsigned int handle_buckets, handle_count;
+} MMAL_VC_PAYLOAD_STRIPE_T;
+
+typedef struct MMAL_VC_PAYLOAD_LIST_T
+{
+   MMAL_VC_PAYLOAD_STRIPE_T stripe[MMAL_VC_PAYLOAD_STRIPES];
+
+   VCOS_MUTEX_T lock;               /**< Protects the fields below */
+   MMAL_VC_PAYLOAD_ELEM_T *free;    /**< Elements which can be re-used */
+   unsigned int in_use;
+   unsigned int capacity;           /**< Maximum elements in use, 0 for no limit */
 } MMAL_VC_PAYLOAD_LIST_T;
 
 static int mmal_vc_shm_initialised;
@@ -56,85 +79,376 @@ static MMAL_VC_PAYLOAD_LIST_T mmal_vc_payload_list;
 static VCOS_ONCE_T once = VCOS_ONCE_INIT;
 static VCOS_MUTEX_T refcount_lock;
 
+static MMAL_VC_SHM_ALLOCATOR_T mmal_vc_shm_allocator;
+
+/*****************************************************************************/
+#ifdef ENABLE_MMAL_VCSM
+static MMAL_STATUS_T mmal_vc_shm_vcsm_init(void *context)
+{
+   MMAL_PARAM_UNUSED(context);
+   if (vcsm_init() != 0)
+   {
+      LOG_ERROR("could not initialize vc shared memory service");
+      return MMAL_EIO;
+   }
+   return MMAL_SUCCESS;
+}
+
+static void mmal_vc_shm_vcsm_exit(void *context)
+{
+   MMAL_PARAM_UNUSED(context);
+   vcsm_exit();
+}
+
+static uint8_t *mmal_vc_shm_vcsm_alloc(void *context, uint32_t size,
+   void **handle, void **vc_handle)
+{
+   unsigned int vcsm_handle = vcsm_malloc_cache(size, VCSM_CACHE_TYPE_HOST, "mmal_vc_port buffer");
+   unsigned int vc_hdl = vcsm_vc_hdl_from_hdl(vcsm_handle);
+   uint8_t *mem = (uint8_t *)vcsm_lock( vcsm_handle );
+   MMAL_PARAM_UNUSED(context);
+
+   if (!mem || !vc_hdl)
+   {
+      LOG_ERROR("could not allocate %i bytes of shared memory (handle %x) - mem %p, vc_hdl %08X",
+                (int)size, vcsm_handle, mem, vc_hdl);
+      if (mem)
+         vcsm_unlock_hdl(vcsm_handle);
+      if (vcsm_handle)
+         vcsm_free(vcsm_handle);
+      return NULL;
+   }
+
+   /* The memory area is automatically mem-locked by vcsm's fault
+    * handler when it is next used. So leave it unlocked until it
+    * is needed.
+    */
+   vcsm_unlock_hdl(vcsm_handle);
+
+   *handle = (void *)(uintptr_t)vcsm_handle;
+   *vc_handle = (void *)(uintptr_t)vc_hdl;
+   return mem;
+}
+
+static void mmal_vc_shm_vcsm_free(void *context, void *handle, uint8_t *mem)
+{
+   MMAL_PARAM_UNUSED(context);
+   MMAL_PARAM_UNUSED(mem);
+   vcsm_free((unsigned int)(uintptr_t)handle);
+}
+
+static MMAL_STATUS_T mmal_vc_shm_vcsm_lock(void *context, void *handle)
+{
+   MMAL_PARAM_UNUSED(context);
+   return vcsm_lock((unsigned int)(uintptr_t)handle) ? MMAL_SUCCESS : MMAL_EIO;
+}
+
+static void mmal_vc_shm_vcsm_unlock(void *context, void *handle, uint8_t *mem)
+{
+   MMAL_PARAM_UNUSED(context);
+   MMAL_PARAM_UNUSED(handle);
+   vcsm_unlock_ptr(mem);
+}
+
+static const MMAL_VC_SHM_ALLOCATOR_T mmal_vc_shm_vcsm_allocator =
+{
+   mmal_vc_shm_vcsm_init, mmal_vc_shm_vcsm_exit,
+   mmal_vc_shm_vcsm_alloc, mmal_vc_shm_vcsm_free,
+   mmal_vc_shm_vcsm_lock, mmal_vc_shm_vcsm_unlock,
+   NULL
+};
+#endif /* ENABLE_MMAL_VCSM */
+
+static const MMAL_VC_SHM_ALLOCATOR_T *mmal_vc_shm_default_allocator(void)
+{
+#ifdef ENABLE_MMAL_VCSM
+   return &mmal_vc_shm_vcsm_allocator;
+#else
+   return NULL;
+#endif
+}
+
+/*****************************************************************************/
 static void mmal_vc_shm_init_once(void)
 {
+   const MMAL_VC_SHM_ALLOCATOR_T *allocator = mmal_vc_shm_default_allocator();
+
    vcos_mutex_create(&refcount_lock, VCOS_FUNCTION);
+   if (allocator)
+      mmal_vc_shm_allocator = *allocator;
+}
+
+static inline unsigned int mmal_vc_payload_hash(const void *key)
+{
+   uint64_t k = (uint64_t)(uintptr_t)key;
+   /* Fold in the high bits so that both page aligned addresses and small
+    * handle values spread out */
+   k = (k ^ (k >> 29)) * UINT64_C(0x9e3779b97f4a7c15);
+   return (unsigned int)(k >> 32);
+}
+
+static MMAL_VC_PAYLOAD_STRIPE_T *mmal_vc_payload_stripe(unsigned int hash)
+{
+   return &mmal_vc_payload_list.stripe[hash & (MMAL_VC_PAYLOAD_STRIPES - 1)];
 }
 
-static void mmal_vc_payload_list_init()
+static MMAL_STATUS_T mmal_vc_payload_list_init()
 {
-   vcos_mutex_create(&mmal_vc_payload_list.lock, "mmal_vc_payload_list");
+   unsigned int i;
+
+   memset(&mmal_vc_payload_list.stripe, 0, sizeof(mmal_vc_payload_list.stripe));
+   if (vcos_mutex_create(&mmal_vc_payload_list.lock, "mmal_vc_payload_list") != VCOS_SUCCESS)
+      return MMAL_ENOSPC;
+   mmal_vc_payload_list.free = NULL;
+   mmal_vc_payload_list.in_use = 0;
+
+   /* The tables start with their minimum size so they can always be
+    * indexed, whether or not they manage to grow later on. Every buffer
+    * goes through them, so init fails without them (user-vcsm allocates
+    * its own tables lazily instead, see vcsm_payload_stripe_reserve). */
+   for (i = 0; i < MMAL_VC_PAYLOAD_STRIPES; i++)
+   {
+      MMAL_VC_PAYLOAD_STRIPE_T *stripe = &mmal_vc_payload_list.stripe[i];
+
+      stripe->by_mem = vcos_calloc(MMAL_VC_PAYLOAD_MIN_BUCKETS, sizeof(*stripe->by_mem),
+                                   "mmal_vc_payload_buckets");
+      stripe->by_handle = vcos_calloc(MMAL_VC_PAYLOAD_MIN_BUCKETS, sizeof(*stripe->by_handle),
+                                      "mmal_vc_payload_buckets");
+      if (!stripe->by_mem || !stripe->by_handle ||
+          vcos_mutex_create(&stripe->lock, "mmal_vc_payload_stripe") != VCOS_SUCCESS)
+      {
+         vcos_free(stripe->by_mem);
+         vcos_free(stripe->by_handle);
+         break;
+      }
+      stripe->mem_buckets = stripe->handle_buckets = MMAL_VC_PAYLOAD_MIN_BUCKETS;
+   }
+   if (i == MMAL_VC_PAYLOAD_STRIPES)
+      return MMAL_SUCCESS;
+
+   while (i--)
+   {
+      vcos_free(mmal_vc_payload_list.stripe[i].by_mem);
+      vcos_free(mmal_vc_payload_list.stripe[i].by_handle);
+      vcos_mutex_delete(&mmal_vc_payload_list.stripe[i].lock);
+   }
+   memset(&mmal_vc_payload_list.stripe, 0, sizeof(mmal_vc_payload_list.stripe));
+   vcos_mutex_delete(&mmal_vc_payload_list.lock);
+   return MMAL_ENOSPC;
 }
 
 static void mmal_vc_payload_list_exit()
 {
+   MMAL_VC_PAYLOAD_ELEM_T *elem;
+   unsigned int i, j;
+
+   if (mmal_vc_payload_list.in_use)
+      LOG_ERROR("%u shared memory buffers still allocated", mmal_vc_payload_list.in_use);
+
+   for (i = 0; i < MMAL_VC_PAYLOAD_STRIPES; i++)
+   {
+      MMAL_VC_PAYLOAD_STRIPE_T *stripe = &mmal_vc_payload_list.stripe[i];
+
+      /* Elements still in use are only reachable from here */
+      for (j = 0; j < stripe->mem_buckets; j++)
+      {
+         while ((elem = stripe->by_mem[j]) != NULL)
+         {
+            stripe->by_mem[j] = elem->next_mem;
+            vcos_free(elem);
+         }
+      }
+      vcos_free(stripe->by_mem);
+      vcos_free(stripe->by_handle);
+      vcos_mutex_delete(&stripe->lock);
+   }
+
+   while ((elem = mmal_vc_payload_list.free) != NULL)
+   {
+      mmal_vc_payload_list.free = elem->next_handle;
+      vcos_free(elem);
+   }
    vcos_mutex_delete(&mmal_vc_payload_list.lock);
 }
 
 static MMAL_VC_PAYLOAD_ELEM_T *mmal_vc_payload_list_get()
 {
-   MMAL_VC_PAYLOAD_ELEM_T *elem = 0;
-   unsigned int i;
+   MMAL_VC_PAYLOAD_ELEM_T *elem = NULL;
 
    vcos_mutex_lock(&mmal_vc_payload_list.lock);
-   for (i = 0; i < MMAL_VC_PAYLOAD_ELEM_MAX; i++)
+   if (!mmal_vc_payload_list.capacity ||
+       mmal_vc_payload_list.in_use < mmal_vc_payload_list.capacity)
    {
-      if (mmal_vc_payload_list.list[i].in_use)
-         continue;
-      elem = &mmal_vc_payload_list.list[i];
-      elem->in_use = 1;
-      break;
+      elem = mmal_vc_payload_list.free;
+      if (elem)
+         mmal_vc_payload_list.free = elem->next_handle;
+      else
+         elem = vcos_malloc(sizeof(*elem), "mmal_vc_payload_elem");
+      if (elem)
+         mmal_vc_payload_list.in_use++;
    }
    vcos_mutex_unlock(&mmal_vc_payload_list.lock);
 
+   if (elem)
+      memset(elem, 0, sizeof(*elem));
    return elem;
 }
 
-static void mmal_vc_payload_list_release(MMAL_VC_PAYLOAD_ELEM_T *elem)
+static void mmal_vc_payload_list_put(MMAL_VC_PAYLOAD_ELEM_T *elem)
 {
    vcos_mutex_lock(&mmal_vc_payload_list.lock);
-   elem->handle = elem->vc_handle = 0;
-   elem->mem = 0;
-   elem->in_use = 0;
+   elem->next_handle = mmal_vc_payload_list.free;
+   mmal_vc_payload_list.free = elem;
+   mmal_vc_payload_list.in_use--;
    vcos_mutex_unlock(&mmal_vc_payload_list.lock);
 }
 
-static MMAL_VC_PAYLOAD_ELEM_T *mmal_vc_payload_list_find_mem(uint8_t *mem)
+/* Double the number of buckets in one of a stripe's tables. Called with the
+ * stripe locked. The tables are allocated at init, so if this fails the old
+ * table stays in use, the chains just get longer. */
+static void mmal_vc_payload_stripe_grow(MMAL_VC_PAYLOAD_ELEM_T ***table,
+   unsigned int *num_buckets, MMAL_BOOL_T by_mem)
 {
-   MMAL_VC_PAYLOAD_ELEM_T *elem = 0;
+   unsigned int new_num = *num_buckets * 2;
+   MMAL_VC_PAYLOAD_ELEM_T **new_table;
    unsigned int i;
 
-   vcos_mutex_lock(&mmal_vc_payload_list.lock);
-   for (i = 0; i < MMAL_VC_PAYLOAD_ELEM_MAX; i++)
+   new_table = vcos_calloc(new_num, sizeof(*new_table), "mmal_vc_payload_buckets");
+   if (!new_table)
+      return;
+
+   for (i = 0; i < *num_buckets; i++)
    {
-      if (!mmal_vc_payload_list.list[i].in_use)
-         continue;
-      if (mmal_vc_payload_list.list[i].mem != mem)
+      MMAL_VC_PAYLOAD_ELEM_T *elem = (*table)[i], *next;
+      for (; elem; elem = next)
+      {
+         unsigned int bucket;
+         if (by_mem)
+         {
+            next = elem->next_mem;
+            bucket = (mmal_vc_payload_hash(elem->mem) / MMAL_VC_PAYLOAD_STRIPES) & (new_num - 1);
+            elem->next_mem = new_table[bucket];
+         }
+         else
+         {
+            next = elem->next_handle;
+            bucket = (mmal_vc_payload_hash(elem->vc_handle) / MMAL_VC_PAYLOAD_STRIPES) & (new_num - 1);
+            elem->next_handle = new_table[bucket];
+         }
+         new_table[bucket] = elem;
+      }
+   }
+
+   vcos_free(*table);
+   *table = new_table;
+   *num_buckets = new_num;
+}
+
+/* Make an element with its handles filled in findable */
+static void mmal_vc_payload_list_add(MMAL_VC_PAYLOAD_ELEM_T *elem)
+{
+   unsigned int hash = mmal_vc_payload_hash(elem->mem);
+   MMAL_VC_PAYLOAD_STRIPE_T *stripe = mmal_vc_payload_stripe(hash);
+   unsigned int bucket;
+
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->mem_count >= stripe->mem_buckets)
+      mmal_vc_payload_stripe_grow(&stripe->by_mem, &stripe->mem_buckets, MMAL_TRUE);
+   bucket = (hash / MMAL_VC_PAYLOAD_STRIPES) & (stripe->mem_buckets - 1);
+   elem->next_mem = stripe->by_mem[bucket];
+   stripe->by_mem[bucket] = elem;
+   stripe->mem_count++;
+   vcos_mutex_unlock(&stripe->lock);
+
+   hash = mmal_vc_payload_hash(elem->vc_handle);
+   stripe = mmal_vc_payload_stripe(hash);
+
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->handle_count >= stripe->handle_buckets)
+      mmal_vc_payload_stripe_grow(&stripe->by_handle, &stripe->handle_buckets, MMAL_FALSE);
+   bucket = (hash / MMAL_VC_PAYLOAD_STRIPES) & (stripe->handle_buckets - 1);
+   elem->next_handle = stripe->by_handle[bucket];
+   stripe->by_handle[bucket] = elem;
+   stripe->handle_count++;
+   vcos_mutex_unlock(&stripe->lock);
+}
+
+/* Find the element for a user address and take it out of both tables */
+static MMAL_VC_PAYLOAD_ELEM_T *mmal_vc_payload_list_remove(uint8_t *mem)
+{
+   unsigned int hash = mmal_vc_payload_hash(mem);
+   MMAL_VC_PAYLOAD_STRIPE_T *stripe = mmal_vc_payload_stripe(hash);
+   MMAL_VC_PAYLOAD_ELEM_T *elem = NULL, **link;
+
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->mem_buckets)
+   {
+      link = &stripe->by_mem[(hash / MMAL_VC_PAYLOAD_STRIPES) & (stripe->mem_buckets - 1)];
+      for (; *link; link = &(*link)->next_mem)
+      {
+         if ((*link)->mem != mem)
+            continue;
+         elem = *link;
+         *link = elem->next_mem;
+         stripe->mem_count--;
+         break;
+      }
+   }
+   vcos_mutex_unlock(&stripe->lock);
+
+   if (!elem)
+      return NULL;
+
+   hash = mmal_vc_payload_hash(elem->vc_handle);
+   stripe = mmal_vc_payload_stripe(hash);
+
+   vcos_mutex_lock(&stripe->lock);
+   link = &stripe->by_handle[(hash / MMAL_VC_PAYLOAD_STRIPES) & (stripe->handle_buckets - 1)];
+   for (; *link; link = &(*link)->next_handle)
+   {
+      if (*link != elem)
          continue;
-      elem = &mmal_vc_payload_list.list[i];
+      *link = elem->next_handle;
+      stripe->handle_count--;
       break;
    }
-   vcos_mutex_unlock(&mmal_vc_payload_list.lock);
+   vcos_mutex_unlock(&stripe->lock);
+
+   return elem;
+}
+
+static MMAL_VC_PAYLOAD_ELEM_T *mmal_vc_payload_list_find_mem(uint8_t *mem)
+{
+   unsigned int hash = mmal_vc_payload_hash(mem);
+   MMAL_VC_PAYLOAD_STRIPE_T *stripe = mmal_vc_payload_stripe(hash);
+   MMAL_VC_PAYLOAD_ELEM_T *elem = NULL;
+
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->mem_buckets)
+   {
+      elem = stripe->by_mem[(hash / MMAL_VC_PAYLOAD_STRIPES) & (stripe->mem_buckets - 1)];
+      while (elem && elem->mem != mem)
+         elem = elem->next_mem;
+   }
+   vcos_mutex_unlock(&stripe->lock);
 
    return elem;
 }
 
 static MMAL_VC_PAYLOAD_ELEM_T *mmal_vc_payload_list_find_handle(uint8_t *mem)
 {
-   MMAL_VC_PAYLOAD_ELEM_T *elem = 0;
-   unsigned int i;
+   unsigned int hash = mmal_vc_payload_hash(mem);
+   MMAL_VC_PAYLOAD_STRIPE_T *stripe = mmal_vc_payload_stripe(hash);
+   MMAL_VC_PAYLOAD_ELEM_T *elem = NULL;
 
-   vcos_mutex_lock(&mmal_vc_payload_list.lock);
-   for (i = 0; i < MMAL_VC_PAYLOAD_ELEM_MAX; i++)
+   vcos_mutex_lock(&stripe->lock);
+   if (stripe->handle_buckets)
    {
-      if (!mmal_vc_payload_list.list[i].in_use)
-         continue;
-      if (mmal_vc_payload_list.list[i].vc_handle != (void *)mem)
-         continue;
-      elem = &mmal_vc_payload_list.list[i];
-      break;
+      elem = stripe->by_handle[(hash / MMAL_VC_PAYLOAD_STRIPES) & (stripe->handle_buckets - 1)];
+      while (elem && elem->vc_handle != (void *)mem)
+         elem = elem->next_handle;
    }
-   vcos_mutex_unlock(&mmal_vc_payload_list.lock);
+   vcos_mutex_unlock(&stripe->lock);
 
    return elem;
 }
@@ -150,23 +464,26 @@ MMAL_STATUS_T mmal_vc_shm_init(void)
    if (mmal_vc_shm_initialised > 1)
       goto unlock;
 
-#ifdef ENABLE_MMAL_VCSM
-   if (vcsm_init() != 0)
+   if (mmal_vc_shm_allocator.init)
    {
-      LOG_ERROR("could not initialize vc shared memory service");
-      ret = MMAL_EIO;
-      goto unlock;
+      ret = mmal_vc_shm_allocator.init(mmal_vc_shm_allocator.context);
+      if (ret != MMAL_SUCCESS)
+         goto unlock;
    }
-#endif /* ENABLE_MMAL_VCSM */
 
-   mmal_vc_payload_list_init();
+   ret = mmal_vc_payload_list_init();
+   if (ret != MMAL_SUCCESS && mmal_vc_shm_allocator.exit)
+      mmal_vc_shm_allocator.exit(mmal_vc_shm_allocator.context);
 unlock:
+   if (ret != MMAL_SUCCESS)
+      mmal_vc_shm_initialised--;
    vcos_mutex_unlock(&refcount_lock);
    return ret;
 }
 
 void mmal_vc_shm_exit(void)
 {
+   vcos_mutex_lock(&refcount_lock);
    if (mmal_vc_shm_initialised <= 0)
       goto unlock;
 
@@ -174,70 +491,85 @@ void mmal_vc_shm_exit(void)
    if (mmal_vc_shm_initialised != 0)
       goto unlock;
 
-#ifdef ENABLE_MMAL_VCSM
-   vcsm_exit();
-#endif
+   if (mmal_vc_shm_allocator.exit)
+      mmal_vc_shm_allocator.exit(mmal_vc_shm_allocator.context);
 
    mmal_vc_payload_list_exit();
 unlock:
    vcos_mutex_unlock(&refcount_lock);
 }
 
+/** Select the allocator providing the shared memory */
+MMAL_STATUS_T mmal_vc_shm_set_allocator(const MMAL_VC_SHM_ALLOCATOR_T *allocator)
+{
+   MMAL_STATUS_T ret = MMAL_SUCCESS;
+   vcos_once(&once, mmal_vc_shm_init_once);
+
+   vcos_mutex_lock(&refcount_lock);
+   if (mmal_vc_shm_initialised)
+   {
+      LOG_ERROR("can't change allocator while the shared memory system is in use");
+      ret = MMAL_EINVAL;
+   }
+   else if (allocator)
+   {
+      mmal_vc_shm_allocator = *allocator;
+   }
+   else
+   {
+      allocator = mmal_vc_shm_default_allocator();
+      if (allocator)
+         mmal_vc_shm_allocator = *allocator;
+      else
+         memset(&mmal_vc_shm_allocator, 0, sizeof(mmal_vc_shm_allocator));
+   }
+   vcos_mutex_unlock(&refcount_lock);
+
+   return ret;
+}
+
+/** Limit the number of shared memory buffers allocated at once */
+void mmal_vc_shm_set_capacity(unsigned int max_buffers)
+{
+   mmal_vc_payload_list.capacity = max_buffers;
+}
+
 /** Allocate a shared memory buffer */
 uint8_t *mmal_vc_shm_alloc(uint32_t size)
 {
-   uint8_t *mem = NULL;
+   MMAL_VC_PAYLOAD_ELEM_T *payload_elem;
 
-   MMAL_VC_PAYLOAD_ELEM_T *payload_elem = mmal_vc_payload_list_get();
+   if (!mmal_vc_shm_allocator.alloc)
+      return NULL;
+
+   payload_elem = mmal_vc_payload_list_get();
    if (!payload_elem)
    {
       LOG_ERROR("could not get a free slot in the payload list");
       return NULL;
    }
 
-#ifdef ENABLE_MMAL_VCSM
-   unsigned int vcsm_handle = vcsm_malloc_cache(size, VCSM_CACHE_TYPE_HOST, "mmal_vc_port buffer");
-   unsigned int vc_handle = vcsm_vc_hdl_from_hdl(vcsm_handle);
-   mem = (uint8_t *)vcsm_lock( vcsm_handle );
-   if (!mem || !vc_handle)
+   payload_elem->mem = mmal_vc_shm_allocator.alloc(mmal_vc_shm_allocator.context, size,
+      &payload_elem->handle, &payload_elem->vc_handle);
+   if (!payload_elem->mem)
    {
-      LOG_ERROR("could not allocate %i bytes of shared memory (handle %x) - mem %p, vc_hdl %08X",
-                (int)size, vcsm_handle, mem, vc_handle);
-      if (mem)
-         vcsm_unlock_hdl(vcsm_handle);
-      if (vcsm_handle)
-         vcsm_free(vcsm_handle);
-      mmal_vc_payload_list_release(payload_elem);
+      mmal_vc_payload_list_put(payload_elem);
       return NULL;
    }
 
-   /* The memory area is automatically mem-locked by vcsm's fault
-    * handler when it is next used. So leave it unlocked until it
-    * is needed.
-    */
-   vcsm_unlock_hdl(vcsm_handle);
-
-   payload_elem->mem = mem;
-   payload_elem->handle = (void *)vcsm_handle;
-   payload_elem->vc_handle = (void *)vc_handle;
-#else /* ENABLE_MMAL_VCSM */
-   MMAL_PARAM_UNUSED(size);
-   mmal_vc_payload_list_release(payload_elem);
-#endif /* ENABLE_MMAL_VCSM */
-
-   return mem;
+   mmal_vc_payload_list_add(payload_elem);
+   return payload_elem->mem;
 }
 
 /** Free a shared memory buffer */
 MMAL_STATUS_T mmal_vc_shm_free(uint8_t *mem)
 {
-   MMAL_VC_PAYLOAD_ELEM_T *payload_elem = mmal_vc_payload_list_find_mem(mem);
+   MMAL_VC_PAYLOAD_ELEM_T *payload_elem = mmal_vc_payload_list_remove(mem);
    if (payload_elem)
    {
-#ifdef ENABLE_MMAL_VCSM
-      vcsm_free((unsigned int)payload_elem->handle);
-#endif /* ENABLE_MMAL_VCSM */
-      mmal_vc_payload_list_release(payload_elem);
+      mmal_vc_shm_allocator.free(mmal_vc_shm_allocator.context, payload_elem->handle,
+         payload_elem->mem);
+      mmal_vc_payload_list_put(payload_elem);
       return MMAL_SUCCESS;
    }
 
@@ -253,11 +585,8 @@ uint8_t *mmal_vc_shm_lock(uint8_t *mem, uint32_t workaround)
 
    if (elem) {
       mem = elem->mem;
-#ifdef ENABLE_MMAL_VCSM
-      void *p = vcsm_lock((unsigned int)elem->handle);
-      if (!p)
+      if (mmal_vc_shm_allocator.lock(mmal_vc_shm_allocator.context, elem->handle) != MMAL_SUCCESS)
          assert(0);
-#endif /* ENABLE_MMAL_VCSM */
    }
 
    return mem;
@@ -274,10 +603,156 @@ uint8_t *mmal_vc_shm_unlock(uint8_t *mem, uint32_t *length, uint32_t workaround)
    {
       *length = 0;
       mem = (uint8_t *)elem->vc_handle;
-#ifdef ENABLE_MMAL_VCSM
-      vcsm_unlock_ptr(elem->mem);
-#endif /* ENABLE_MMAL_VCSM */
+      mmal_vc_shm_allocator.unlock(mmal_vc_shm_allocator.context, elem->handle, elem->mem);
    }
 
    return mem;
 }
+
+/*****************************************************************************/
+/* Allocator standing in for VCSM. Memory comes from mmap, either anonymous or
+ * from a file, and the VideoCore handles are just unique numbers. */
+
+#define MMAL_VC_SHM_EMULATED_HANDLE_BASE 0x40000000
+
+typedef struct MMAL_VC_SHM_EMULATED_T
+{
+   VCOS_MUTEX_T lock;
+   int fd;                 /**< Backing file, -1 for anonymous memory */
+   off_t file_size;
+   uint32_t next_vc_handle;
+   long page_size;
+} MMAL_VC_SHM_EMULATED_T;
+
+typedef struct MMAL_VC_SHM_EMULATED_BLOCK_T
+{
+   uint8_t *mem;
+   size_t size;
+} MMAL_VC_SHM_EMULATED_BLOCK_T;
+
+static uint8_t *mmal_vc_shm_emulated_alloc(void *context, uint32_t size,
+   void **handle, void **vc_handle)
+{
+   MMAL_VC_SHM_EMULATED_T *emu = context;
+   MMAL_VC_SHM_EMULATED_BLOCK_T *block;
+   size_t map_size = (size + emu->page_size - 1) & ~(size_t)(emu->page_size - 1);
+   void *mem;
+
+   block = vcos_malloc(sizeof(*block), "mmal_vc_shm_emulated_block");
+   if (!block)
+      return NULL;
+   if (!map_size)
+      map_size = emu->page_size;
+
+   vcos_mutex_lock(&emu->lock);
+   if (emu->fd >= 0)
+   {
+      /* Blocks are never given back to the file, it only grows */
+      mem = MAP_FAILED;
+      if (ftruncate(emu->fd, emu->file_size + map_size) == 0)
+      {
+         mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, emu->fd, emu->file_size);
+         if (mem != MAP_FAILED)
+            emu->file_size += map_size;
+      }
+   }
+   else
+   {
+      mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   }
+   if (mem != MAP_FAILED)
+      *vc_handle = (void *)(uintptr_t)(emu->next_vc_handle++);
+   vcos_mutex_unlock(&emu->lock);
+
+   if (mem == MAP_FAILED)
+   {
+      LOG_ERROR("could not map %u bytes of emulated shared memory", size);
+      vcos_free(block);
+      return NULL;
+   }
+
+   block->mem = mem;
+   block->size = map_size;
+   *handle = block;
+   return block->mem;
+}
+
+static void mmal_vc_shm_emulated_free(void *context, void *handle, uint8_t *mem)
+{
+   MMAL_VC_SHM_EMULATED_BLOCK_T *block = handle;
+   MMAL_PARAM_UNUSED(context);
+   MMAL_PARAM_UNUSED(mem);
+
+   munmap(block->mem, block->size);
+   vcos_free(block);
+}
+
+static MMAL_STATUS_T mmal_vc_shm_emulated_lock(void *context, void *handle)
+{
+   MMAL_PARAM_UNUSED(context);
+   MMAL_PARAM_UNUSED(handle);
+   return MMAL_SUCCESS;
+}
+
+static void mmal_vc_shm_emulated_unlock(void *context, void *handle, uint8_t *mem)
+{
+   MMAL_PARAM_UNUSED(context);
+   MMAL_PARAM_UNUSED(handle);
+   MMAL_PARAM_UNUSED(mem);
+}
+
+MMAL_STATUS_T mmal_vc_shm_emulated_allocator_create(MMAL_VC_SHM_ALLOCATOR_T *allocator,
+   const char *path)
+{
+   MMAL_VC_SHM_EMULATED_T *emu;
+
+   emu = vcos_calloc(1, sizeof(*emu), "mmal_vc_shm_emulated");
+   if (!emu)
+      return MMAL_ENOMEM;
+
+   emu->fd = -1;
+   emu->next_vc_handle = MMAL_VC_SHM_EMULATED_HANDLE_BASE;
+   emu->page_size = sysconf(_SC_PAGESIZE);
+   if (emu->page_size <= 0)
+      emu->page_size = 4096;
+
+   if (path)
+   {
+      emu->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+      if (emu->fd < 0)
+      {
+         LOG_ERROR("could not open %s", path);
+         vcos_free(emu);
+         return MMAL_EIO;
+      }
+   }
+
+   if (vcos_mutex_create(&emu->lock, "mmal_vc_shm_emulated") != VCOS_SUCCESS)
+   {
+      if (emu->fd >= 0)
+         close(emu->fd);
+      vcos_free(emu);
+      return MMAL_ENOSPC;
+   }
+
+   memset(allocator, 0, sizeof(*allocator));
+   allocator->alloc = mmal_vc_shm_emulated_alloc;
+   allocator->free = mmal_vc_shm_emulated_free;
+   allocator->lock = mmal_vc_shm_emulated_lock;
+   allocator->unlock = mmal_vc_shm_emulated_unlock;
+   allocator->context = emu;
+   return MMAL_SUCCESS;
+}
+
+void mmal_vc_shm_emulated_allocator_destroy(MMAL_VC_SHM_ALLOCATOR_T *allocator)
+{
+   MMAL_VC_SHM_EMULATED_T *emu = allocator->context;
+
+   if (!emu)
+      return;
+   if (emu->fd >= 0)
+      close(emu->fd);
+   vcos_mutex_delete(&emu->lock);
+   vcos_free(emu);
+   allocator->context = NULL;
+}
@@ -57,6 +57,41 @@ uint8_t *mmal_vc_shm_lock(uint8_t *mem, uint32_t workaround);
 /** Unlock a shared memory buffer */
 uint8_t *mmal_vc_shm_unlock(uint8_t *mem, uint32_t *length, uint32_t workaround);
 
+/** Limit the number of shared memory buffers allocated at once.
+  * 0 (the default) means there is no limit. */
+void mmal_vc_shm_set_capacity(unsigned int max_buffers);
+
+/** Provider of the shared memory buffers. By default VCSM is used. */
+typedef struct MMAL_VC_SHM_ALLOCATOR_T
+{
+   /** Called when the shared memory system is initialised (optional) */
+   MMAL_STATUS_T (*init)(void *context);
+   /** Called when the shared memory system is released (optional) */
+   void (*exit)(void *context);
+
+   /** Allocate a buffer, returning its user address and filling in both the
+     * allocator's own handle and the handle VideoCore knows the buffer by */
+   uint8_t *(*alloc)(void *context, uint32_t size, void **handle, void **vc_handle);
+   void (*free)(void *context, void *handle, uint8_t *mem);
+   MMAL_STATUS_T (*lock)(void *context, void *handle);
+   void (*unlock)(void *context, void *handle, uint8_t *mem);
+
+   void *context;
+} MMAL_VC_SHM_ALLOCATOR_T;
+
+/** Select the allocator providing the shared memory. NULL selects the default.
+  * This can only be done while the shared memory system isn't initialised. */
+MMAL_STATUS_T mmal_vc_shm_set_allocator(const MMAL_VC_SHM_ALLOCATOR_T *allocator);
+
+/** Create an allocator which stands in for VCSM when there is no VideoCore,
+  * e.g. for testing. Buffers are mapped from the file at path, or from anonymous
+  * memory if path is NULL, and are given made up VideoCore handles. */
+MMAL_STATUS_T mmal_vc_shm_emulated_allocator_create(MMAL_VC_SHM_ALLOCATOR_T *allocator,
+   const char *path);
+
+/** Release an allocator created by mmal_vc_shm_emulated_allocator_create */
+void mmal_vc_shm_emulated_allocator_destroy(MMAL_VC_SHM_ALLOCATOR_T *allocator);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,329 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Test of batching buffers sent to VideoCore ports, against a fake VC which
+ * reports whichever worker version the test asks for and hands buffers
+ * straight back while counting how they were sent. It checks that:
+ *  - a VC older than batches refuses batching and gets one message per buffer;
+ *  - full batches go as soon as they fill up;
+ *  - an empty EOS buffer, or one needing a bulk transfer, flushes the batch
+ *    waiting and goes in a message of its own after it;
+ *  - a partial batch goes once its oldest buffer has waited long enough;
+ *  - turning batching off sends the batch waiting;
+ *  - buffers always reach VC in the order they were sent. */
+
+#include "interface/mmal/vc/mmal_vc_api.c"
+#include "interface/vcos/test/vcos_test_check.h"
+
+#define TEST_BUFFERS 16
+
+static struct
+{
+   VCOS_MUTEX_T lock;
+   uint32_t minor;
+   unsigned int singles;     /* Buffers sent in a message of their own */
+   unsigned int batches;
+   unsigned int batched;     /* Buffers sent in a batch */
+   int64_t last_pts;
+   unsigned int out_of_order;
+} fake_vc;
+
+static VCOS_SEMAPHORE_T returned;
+
+/*****************************************************************************
+ * Fake VC
+ *****************************************************************************/
+static MMAL_CLIENT_T *fake_client = (MMAL_CLIENT_T *)&fake_vc;
+
+MMAL_CLIENT_T *mmal_vc_get_client(void) { return fake_client; }
+MMAL_STATUS_T mmal_vc_init(void) { return MMAL_SUCCESS; }
+void mmal_vc_deinit(void) {}
+MMAL_STATUS_T mmal_vc_use(void) { return MMAL_SUCCESS; }
+MMAL_STATUS_T mmal_vc_release(void) { return MMAL_SUCCESS; }
+MMAL_STATUS_T mmal_vc_shm_init(void) { return MMAL_SUCCESS; }
+void mmal_vc_shm_exit(void) {}
+uint8_t *mmal_vc_shm_alloc(uint32_t size) { MMAL_PARAM_UNUSED(size); return NULL; }
+MMAL_STATUS_T mmal_vc_shm_free(uint8_t *mem) { MMAL_PARAM_UNUSED(mem); return MMAL_EINVAL; }
+uint8_t *mmal_vc_shm_lock(uint8_t *mem, uint32_t workaround)
+{
+   MMAL_PARAM_UNUSED(workaround);
+   return mem;
+}
+uint8_t *mmal_vc_shm_unlock(uint8_t *mem, uint32_t *length, uint32_t workaround)
+{
+   MMAL_PARAM_UNUSED(length);
+   MMAL_PARAM_UNUSED(workaround);
+   return mem;
+}
+MMAL_OPAQUE_IMAGE_HANDLE_T mmal_vc_opaque_alloc_desc(const char *description)
+{
+   MMAL_PARAM_UNUSED(description);
+   return 0;
+}
+MMAL_STATUS_T mmal_vc_opaque_release(MMAL_OPAQUE_IMAGE_HANDLE_T h)
+{
+   MMAL_PARAM_UNUSED(h);
+   return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_vc_sendwait_message(MMAL_CLIENT_T *client, mmal_worker_msg_header *header,
+   size_t size, uint32_t msgid, void *dest, size_t *destlen, MMAL_BOOL_T send_dummy_bulk)
+{
+   MMAL_PARAM_UNUSED(client);
+   MMAL_PARAM_UNUSED(header);
+   MMAL_PARAM_UNUSED(size);
+   MMAL_PARAM_UNUSED(send_dummy_bulk);
+
+   /* Anything not handled here just succeeds */
+   memset(dest, 0, *destlen);
+
+   if (msgid == MMAL_WORKER_GET_VERSION)
+   {
+      mmal_worker_version *reply = dest;
+      reply->major = WORKER_VER_MAJOR;
+      reply->minor = fake_vc.minor;
+      reply->minimum = WORKER_VER_MINIMUM;
+   }
+   else if (msgid == MMAL_WORKER_COMPONENT_CREATE)
+   {
+      mmal_worker_component_create_reply *reply = dest;
+      reply->component_handle = VCOS_BLOCKPOOL_HANDLE_CREATE(0, 0);
+      reply->input_num = 1;
+   }
+   else if (msgid == MMAL_WORKER_PORT_INFO_GET)
+   {
+      mmal_worker_port_info_get *msg = (mmal_worker_port_info_get *)header;
+      mmal_worker_port_info *reply = dest;
+      reply->port_handle = msg->port_type * 8 + msg->index;
+      reply->port.buffer_num_min = 1;
+      reply->port.buffer_num_recommended = TEST_BUFFERS;
+      reply->port.buffer_num = TEST_BUFFERS;
+   }
+   return MMAL_SUCCESS;
+}
+
+/* Note the order buffers reach VC in, and hand them back. The callbacks free
+ * the client context the message lives in, so they get a copy like they
+ * would from VCHIQ. */
+static void fake_vc_receive(mmal_worker_buffer_from_host *msg)
+{
+   vcos_mutex_lock(&fake_vc.lock);
+   if (msg->buffer_header.pts <= fake_vc.last_pts)
+      fake_vc.out_of_order++;
+   fake_vc.last_pts = msg->buffer_header.pts;
+   vcos_mutex_unlock(&fake_vc.lock);
+}
+
+MMAL_STATUS_T mmal_vc_send_message(MMAL_CLIENT_T *client, mmal_worker_msg_header *header,
+   size_t size, uint8_t *data, size_t data_size, uint32_t msgid)
+{
+   mmal_worker_buffer_from_host msg;
+   MMAL_PARAM_UNUSED(client);
+   MMAL_PARAM_UNUSED(data);
+   MMAL_PARAM_UNUSED(data_size);
+
+   if (msgid != MMAL_WORKER_BUFFER_FROM_HOST && msgid != MMAL_WORKER_BUFFER_FROM_HOST_ZEROLEN)
+      return MMAL_SUCCESS;
+
+   vcos_assert(size == sizeof(msg));
+   msg = *(mmal_worker_buffer_from_host *)header;
+   fake_vc_receive(&msg);
+   __atomic_fetch_add(&fake_vc.singles, 1, __ATOMIC_RELAXED);
+   msg.drvbuf.client_context->callback(&msg);
+   return MMAL_SUCCESS;
+}
+
+MMAL_STATUS_T mmal_vc_send_buffer_batch(MMAL_CLIENT_T *client,
+   mmal_worker_buffer_from_host **msgs, unsigned int count)
+{
+   mmal_worker_buffer_from_host copies[MMAL_WORKER_BUFFER_BATCH_MAX];
+   unsigned int i;
+   MMAL_PARAM_UNUSED(client);
+
+   /* A VC without batch support never answers, so the buffers are lost */
+   if (fake_vc.minor < WORKER_VER_MINOR_BATCH)
+      return MMAL_SUCCESS;
+
+   vcos_assert(count > 1 && count <= MMAL_WORKER_BUFFER_BATCH_MAX);
+   for (i = 0; i < count; i++)
+   {
+      copies[i] = *msgs[i];
+      fake_vc_receive(&copies[i]);
+   }
+   __atomic_fetch_add(&fake_vc.batches, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&fake_vc.batched, count, __ATOMIC_RELAXED);
+
+   for (i = 0; i < count; i++)
+      copies[i].drvbuf.client_context->callback_batched(&copies[i], i + 1 == count);
+   return MMAL_SUCCESS;
+}
+
+/*****************************************************************************
+ * Test
+ *****************************************************************************/
+static void input_port_cb(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buffer)
+{
+   MMAL_PARAM_UNUSED(port);
+   mmal_buffer_header_release(buffer);
+   vcos_semaphore_post(&returned);
+}
+
+static void fake_vc_reset(uint32_t minor)
+{
+   fake_vc.minor = minor;
+   fake_vc.singles = fake_vc.batches = fake_vc.batched = 0;
+}
+
+/* Send count buffers, the last of which gets last_flags and last_length */
+static void send_buffers(MMAL_PORT_T *port, MMAL_POOL_T *pool, unsigned int count,
+   uint32_t last_flags, uint32_t last_length)
+{
+   static int64_t pts;
+   unsigned int i;
+
+   for (i = 0; i < count; i++)
+   {
+      MMAL_BUFFER_HEADER_T *buffer = mmal_queue_get(pool->queue);
+      MMAL_STATUS_T status;
+
+      CHECK(buffer, "ran out of buffers");
+      if (!buffer)
+         return;
+      buffer->pts = ++pts;
+      buffer->length = i + 1 == count ? last_length : 0;
+      buffer->flags = i + 1 == count ? last_flags : 0;
+      status = mmal_port_send_buffer(port, buffer);
+      CHECK(status == MMAL_SUCCESS, "couldn't send buffer (%i)", status);
+   }
+}
+
+static void wait_returned(unsigned int count, const char *what)
+{
+   while (count--)
+   {
+      if (vcos_semaphore_wait_timeout(&returned, 1000) != VCOS_SUCCESS)
+      {
+         printf("FAIL: %s: %u buffers never came back\n", what, count + 1);
+         check_errors++;
+         return;
+      }
+   }
+}
+
+static void check_sent(const char *what, unsigned int singles, unsigned int batches,
+   unsigned int batched)
+{
+   CHECK(fake_vc.singles == singles && fake_vc.batches == batches && fake_vc.batched == batched,
+         "%s: expected %u single, %u batches of %u buffers, got %u, %u of %u", what,
+         singles, batches, batched, fake_vc.singles, fake_vc.batches, fake_vc.batched);
+   fake_vc_reset(fake_vc.minor);
+}
+
+int main(void)
+{
+   MMAL_COMPONENT_T *component;
+   MMAL_POOL_T *pool;
+   MMAL_PORT_T *port;
+   MMAL_STATUS_T status;
+
+   vcos_init();
+   if (vcos_mutex_create(&fake_vc.lock, "fake_vc") != VCOS_SUCCESS ||
+       vcos_semaphore_create(&returned, "returned", 0) != VCOS_SUCCESS)
+      return 1;
+
+   fake_vc_reset(WORKER_VER_MINOR_BATCH - 1);
+   status = mmal_component_create("vc.fake", &component);
+   if (status != MMAL_SUCCESS)
+   {
+      printf("FAIL: couldn't create component (%i)\n", status);
+      return 1;
+   }
+   port = component->input[0];
+   pool = mmal_pool_create(TEST_BUFFERS, 64);
+   if (!pool || mmal_port_enable(port, input_port_cb) != MMAL_SUCCESS ||
+       mmal_component_enable(component) != MMAL_SUCCESS)
+   {
+      printf("FAIL: couldn't set up port\n");
+      return 1;
+   }
+
+   /* A VC from before batches carries on getting one message per buffer */
+   status = mmal_vc_port_set_batching(port, 8, 1000);
+   CHECK(status == MMAL_ENOSYS, "old VC: batching enabled (%i)", status);
+   send_buffers(port, pool, TEST_BUFFERS, 0, 0);
+   wait_returned(TEST_BUFFERS, "old VC");
+   check_sent("old VC", TEST_BUFFERS, 0, 0);
+
+   /* The answer is remembered, so forget it to pretend VC was upgraded */
+   fake_vc_reset(WORKER_VER_MINOR_BATCH);
+   is_vc_batch_compatible = BATCH_NOT_INITIALIZED;
+   status = mmal_vc_port_set_batching(port, 8, 1000);
+   CHECK(status == MMAL_SUCCESS, "couldn't enable batching (%i)", status);
+
+   send_buffers(port, pool, TEST_BUFFERS, 0, 0);
+   wait_returned(TEST_BUFFERS, "full batches");
+   check_sent("full batches", 0, TEST_BUFFERS / 8, TEST_BUFFERS);
+
+   /* Empty EOS buffers go in a message of their own which flushes the batch */
+   send_buffers(port, pool, 3, MMAL_BUFFER_HEADER_FLAG_EOS, 0);
+   wait_returned(3, "EOS");
+   check_sent("EOS", 1, 1, 2);
+
+   /* A buffer with a bulk transfer goes after those already waiting */
+   send_buffers(port, pool, 3, 0, 16);
+   wait_returned(3, "bulk");
+   check_sent("bulk", 1, 1, 2);
+
+   /* Partial batches go once the oldest buffer has waited long enough */
+   status = mmal_vc_port_set_batching(port, 8, 20);
+   CHECK(status == MMAL_SUCCESS, "couldn't change batching (%i)", status);
+   send_buffers(port, pool, 3, 0, 0);
+   CHECK(fake_vc.batched == 0, "partial batch sent early");
+   wait_returned(3, "timeout");
+   check_sent("timeout", 0, 1, 3);
+
+   /* Turning batching off sends what is waiting */
+   send_buffers(port, pool, 2, 0, 0);
+   status = mmal_vc_port_set_batching(port, 0, 0);
+   CHECK(status == MMAL_SUCCESS, "couldn't disable batching (%i)", status);
+   send_buffers(port, pool, 2, 0, 0);
+   wait_returned(4, "disabled");
+   check_sent("disabled", 2, 1, 2);
+
+   CHECK(!fake_vc.out_of_order, "%u buffers reached VC out of order", fake_vc.out_of_order);
+
+   mmal_component_disable(component);
+   mmal_port_disable(port);
+   mmal_component_destroy(component);
+   mmal_pool_destroy(pool);
+   vcos_semaphore_delete(&returned);
+   vcos_mutex_delete(&fake_vc.lock);
+
+   printf("%s\n", check_errors ? "FAILED" : "ok");
+   return check_errors ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+/*
+Copyright (c) 2013, Broadcom Europe Ltd
+All rights reserved.
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Test of the shared memory payload registry, run on the emulated allocator
+ * with anonymous memory and then with a backing file. It allocates enough
+ * buffers for the tables of every stripe to grow several times, checking
+ * that each buffer is found by address and by VideoCore handle through
+ * lock/unlock, frees them in two passes, and checks the capacity limit
+ * rejects allocations without upsetting the buffers already registered.
+ * Bucket allocations are made to fail to check that a failed init leaves
+ * nothing behind and can be retried, and that a failed grow keeps the old
+ * tables in use.
+ *
+ * Usage: mmal_vc_shm_test [buffers] */
+
+#include "interface/vcos/vcos.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Bucket tables which can still be allocated, -1 for no limit */
+static int buckets_left = -1;
+
+static void *test_calloc(size_t num, size_t size, const char *description)
+{
+   if (buckets_left >= 0 && !strcmp(description, "mmal_vc_payload_buckets"))
+   {
+      if (!buckets_left)
+         return NULL;
+      buckets_left--;
+   }
+   return vcos_calloc(num, size, description);
+}
+
+#undef vcos_calloc
+#define vcos_calloc test_calloc
+/* Only the emulated allocator is used, VCSM isn't needed */
+#undef ENABLE_MMAL_VCSM
+#include "interface/mmal/vc/mmal_vc_shm.c"
+#include "interface/vcos/test/vcos_test_check.h"
+
+#define TEST_BUFFER_SIZE 1000
+
+static unsigned int total_buckets(MMAL_BOOL_T by_mem)
+{
+   unsigned int i, total = 0;
+
+   for (i = 0; i < MMAL_VC_PAYLOAD_STRIPES; i++)
+      total += by_mem ? mmal_vc_payload_list.stripe[i].mem_buckets :
+         mmal_vc_payload_list.stripe[i].handle_buckets;
+   return total;
+}
+
+static uint32_t pattern(unsigned int i)
+{
+   return i * 2654435761u;
+}
+
+static uint8_t *alloc_buffer(unsigned int i)
+{
+   uint8_t *mem = mmal_vc_shm_alloc(TEST_BUFFER_SIZE);
+   uint32_t value = pattern(i);
+
+   if (mem)
+   {
+      memcpy(mem, &value, sizeof(value));
+      memcpy(mem + TEST_BUFFER_SIZE - sizeof(value), &value, sizeof(value));
+   }
+   return mem;
+}
+
+/* The buffer must map to a VideoCore handle which maps back to it, and still
+ * hold what was written to it */
+static void check_buffer(uint8_t *mem, unsigned int i)
+{
+   uint32_t length = 1, value;
+   uint8_t *vc_handle = mmal_vc_shm_unlock(mem, &length, 0);
+
+   CHECK(vc_handle != mem && length == 0, "buffer %u (%p) not found by address", i, mem);
+   CHECK(mmal_vc_shm_lock(vc_handle, 0) == mem, "buffer %u not found by handle %p", i, vc_handle);
+   memcpy(&value, mem, sizeof(value));
+   CHECK(value == pattern(i), "buffer %u doesn't start with its pattern", i);
+   memcpy(&value, mem + TEST_BUFFER_SIZE - sizeof(value), sizeof(value));
+   CHECK(value == pattern(i), "buffer %u doesn't end with its pattern", i);
+}
+
+static void check_gone(uint8_t *mem, unsigned int i)
+{
+   uint32_t length = 1;
+
+   CHECK(mmal_vc_shm_unlock(mem, &length, 0) == mem && length == 1,
+         "freed buffer %u still found by address", i);
+   CHECK(mmal_vc_shm_free(mem) == MMAL_EINVAL, "freed buffer %u freed again", i);
+}
+
+static void test_init_failure(void)
+{
+   unsigned int i;
+
+   /* Fail half way through the stripes, then on the very first table */
+   buckets_left = MMAL_VC_PAYLOAD_STRIPES + 3;
+   CHECK(mmal_vc_shm_init() != MMAL_SUCCESS, "init succeeded without its tables");
+   buckets_left = 0;
+   CHECK(mmal_vc_shm_init() != MMAL_SUCCESS, "init succeeded without any table");
+   buckets_left = -1;
+
+   CHECK(mmal_vc_shm_initialised == 0, "failed init left the system initialised");
+   for (i = 0; i < MMAL_VC_PAYLOAD_STRIPES; i++)
+      CHECK(!mmal_vc_payload_list.stripe[i].by_mem && !mmal_vc_payload_list.stripe[i].by_handle &&
+            !mmal_vc_payload_list.stripe[i].mem_buckets,
+            "failed init left stripe %u with tables", i);
+   CHECK(mmal_vc_shm_set_allocator(NULL) == MMAL_SUCCESS,
+         "allocator can't be changed after a failed init");
+}
+
+static void test_registry(const char *name, unsigned int buffers)
+{
+   MMAL_VC_SHM_ALLOCATOR_T allocator;
+   uint8_t **mem, *extra[8], *more;
+   unsigned int i, mem_buckets, handle_buckets;
+   char path[] = "/tmp/mmal_vc_shm_test.XXXXXX";
+   int fd = -1;
+
+   if (!strcmp(name, "file"))
+   {
+      fd = mkstemp(path);
+      CHECK(fd >= 0, "%s: couldn't create a backing file", name);
+      if (fd < 0)
+         return;
+   }
+
+   mem = calloc(buffers, sizeof(*mem));
+   CHECK(mem, "%s: no memory for %u buffers", name, buffers);
+   if (!mem || mmal_vc_shm_emulated_allocator_create(&allocator, fd >= 0 ? path : NULL) != MMAL_SUCCESS ||
+       mmal_vc_shm_set_allocator(&allocator) != MMAL_SUCCESS)
+   {
+      CHECK(0, "%s: couldn't install the emulated allocator", name);
+      goto end;
+   }
+
+   test_init_failure();
+   CHECK(mmal_vc_shm_set_allocator(&allocator) == MMAL_SUCCESS, "%s: allocator refused", name);
+   if (mmal_vc_shm_init() != MMAL_SUCCESS)
+   {
+      CHECK(0, "%s: init failed", name);
+      goto destroy;
+   }
+   CHECK(mmal_vc_shm_set_allocator(NULL) == MMAL_EINVAL,
+         "%s: allocator changed while initialised", name);
+   CHECK(total_buckets(MMAL_TRUE) == MMAL_VC_PAYLOAD_STRIPES * MMAL_VC_PAYLOAD_MIN_BUCKETS,
+         "%s: tables don't start at their minimum size", name);
+
+   /* Enough buffers for every table to grow a few times */
+   for (i = 0; i < buffers; i++)
+   {
+      mem[i] = alloc_buffer(i);
+      CHECK(mem[i], "%s: allocation %u failed", name, i);
+      if (!mem[i])
+         break;
+   }
+   buffers = i;
+   mem_buckets = total_buckets(MMAL_TRUE);
+   handle_buckets = total_buckets(MMAL_FALSE);
+   CHECK(mem_buckets >= buffers && handle_buckets >= buffers,
+         "%s: %u buffers in %u/%u buckets, the tables didn't grow", name, buffers,
+         mem_buckets, handle_buckets);
+   for (i = 0; i < buffers; i++)
+      check_buffer(mem[i], i);
+
+   /* With the tables unable to grow, buffers still go into the old ones */
+   buckets_left = 0;
+   for (i = 0; i < buffers / 2; i++)
+   {
+      more = alloc_buffer(buffers + i);
+      CHECK(more, "%s: allocation failed with the tables full", name);
+      if (!more)
+         break;
+      check_buffer(more, buffers + i);
+      CHECK(mmal_vc_shm_free(more) == MMAL_SUCCESS, "%s: couldn't free a buffer", name);
+   }
+   CHECK(total_buckets(MMAL_TRUE) == mem_buckets && total_buckets(MMAL_FALSE) == handle_buckets,
+         "%s: tables changed size when they couldn't grow", name);
+   buckets_left = -1;
+
+   /* Free every other buffer, the rest must stay findable */
+   for (i = 0; i < buffers; i += 2)
+      CHECK(mmal_vc_shm_free(mem[i]) == MMAL_SUCCESS, "%s: couldn't free buffer %u", name, i);
+   for (i = 0; i < buffers; i++)
+   {
+      if (i & 1)
+         check_buffer(mem[i], i);
+      else
+         check_gone(mem[i], i);
+   }
+
+   /* Capacity counts the buffers already allocated */
+   mmal_vc_shm_set_capacity(buffers / 2 + MMAL_COUNTOF(extra));
+   for (i = 0; i < MMAL_COUNTOF(extra); i++)
+   {
+      extra[i] = alloc_buffer(buffers + i);
+      CHECK(extra[i], "%s: allocation %u under the capacity failed", name, i);
+   }
+   CHECK(!mmal_vc_shm_alloc(TEST_BUFFER_SIZE), "%s: allocation over the capacity succeeded", name);
+   CHECK(!mmal_vc_shm_alloc(TEST_BUFFER_SIZE), "%s: allocation over the capacity succeeded", name);
+   for (i = 1; i < buffers; i += 2)
+      check_buffer(mem[i], i);
+   for (i = 0; i < MMAL_COUNTOF(extra); i++)
+      if (extra[i])
+         check_buffer(extra[i], buffers + i);
+
+   /* Freeing one makes room for one more */
+   if (extra[0])
+      CHECK(mmal_vc_shm_free(extra[0]) == MMAL_SUCCESS, "%s: couldn't free an extra buffer", name);
+   extra[0] = alloc_buffer(buffers);
+   CHECK(extra[0], "%s: allocation after freeing failed", name);
+   CHECK(!mmal_vc_shm_alloc(TEST_BUFFER_SIZE), "%s: allocation over the capacity succeeded", name);
+   mmal_vc_shm_set_capacity(0);
+
+   for (i = 0; i < MMAL_COUNTOF(extra); i++)
+      if (extra[i])
+         CHECK(mmal_vc_shm_free(extra[i]) == MMAL_SUCCESS, "%s: couldn't free an extra buffer", name);
+   for (i = 1; i < buffers; i += 2)
+      CHECK(mmal_vc_shm_free(mem[i]) == MMAL_SUCCESS, "%s: couldn't free buffer %u", name, i);
+   for (i = 0; i < buffers; i++)
+      check_gone(mem[i], i);
+   CHECK(mmal_vc_payload_list.in_use == 0, "%s: %u buffers left", name, mmal_vc_payload_list.in_use);
+
+   printf("%-5s %u buffers, %u/%u buckets: %s\n", name, buffers, mem_buckets, handle_buckets,
+          check_errors ? "FAILED" : "ok");
+   mmal_vc_shm_exit();
+destroy:
+   mmal_vc_shm_set_allocator(NULL);
+   mmal_vc_shm_emulated_allocator_destroy(&allocator);
+end:
+   free(mem);
+   if (fd >= 0)
+   {
+      close(fd);
+      unlink(path);
+   }
+}
+
+int main(int argc, char **argv)
+{
+   unsigned int buffers = argc > 1 ? atoi(argv[1]) : 2000;
+
+   if (!buffers)
+      buffers = 2000;
+
+   vcos_init();
+   test_registry("anon", buffers);
+   test_registry("file", buffers);
+
+   return check_errors ? 1 : 0;
+}
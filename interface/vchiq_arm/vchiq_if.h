@@ -131,6 +131,19 @@ typedef struct vchiq_config_struct {
    short version_min;  /* The minimum compatible version of VCHIQ */
 } VCHIQ_CONFIG_T;
 
+#define VCHIQ_LIB_BATCH_BUCKETS 8
+
+typedef struct vchiq_lib_stats_struct {
+   unsigned int dequeue_ioctls;  /* DEQUEUE_MESSAGE(S) ioctls issued */
+   unsigned int dequeued_msgs;   /* Messages returned by them */
+   unsigned int await_ioctls;    /* AWAIT_COMPLETION ioctls issued */
+   unsigned int completions;     /* Completions returned by them */
+   /* Completions per AWAIT_COMPLETION: [0] 1, [1] 2, [2] 3-4, [3] 5-8, ... */
+   unsigned int completion_batch[VCHIQ_LIB_BATCH_BUCKETS];
+   unsigned int msgbuf_cached;   /* Message buffers reused from a service's cache */
+   unsigned int msgbuf_shared;   /* Message buffers from the shared free list or the heap */
+} VCHIQ_LIB_STATS_T;
+
 typedef struct vchiq_instance_struct *VCHIQ_INSTANCE_T;
 typedef void (*VCHIQ_REMOTE_USE_CALLBACK_T)(void* cb_arg);
 struct pagelist_struct;
@@ -193,6 +206,15 @@ extern VCHIQ_STATUS_T vchiq_dump_phys_mem(VCHIQ_SERVICE_HANDLE_T service,
 extern VCHIQ_STATUS_T vchiq_get_peer_version(VCHIQ_SERVICE_HANDLE_T handle,
       short *peer_version);
 
+/* Up to dequeue_batch messages are fetched from the driver at once for VCHI
+ * services (1, the default, fetches them one at a time). Only set it above 1
+ * for a driver with VCHIQ_IOC_DEQUEUE_MESSAGES, which mainline lacks. The completion thread asks for
+ * between completion_batch_min and completion_batch_max completions at once,
+ * depending on how busy it is; this takes effect on the next connect. */
+extern VCHIQ_STATUS_T vchiq_set_lib_batching(int dequeue_batch,
+      int completion_batch_min, int completion_batch_max);
+extern void vchiq_get_lib_stats(VCHIQ_LIB_STATS_T *stats, int reset);
+
 #ifdef __cplusplus
 }
 #endif
@@ -77,6 +77,20 @@ typedef struct {
    void *buf;
 } VCHIQ_DEQUEUE_MESSAGE_T;
 
+/* Messages are returned one after the other, each a VCHIQ_HEADER_T followed
+ * by the data and padded to VCHIQ_DEQUEUE_MSG_SPACE. The ioctl returns the
+ * number of bytes used. */
+typedef struct {
+   unsigned int handle;
+   int blocking;
+   unsigned int bufsize;
+   void *buf;
+   unsigned int count;        /* Maximum number of messages */
+} VCHIQ_DEQUEUE_MESSAGES_T;
+
+#define VCHIQ_DEQUEUE_MSG_SPACE(size) \
+   ((sizeof(VCHIQ_HEADER_T) + (size) + sizeof(VCHIQ_HEADER_T) - 1) & ~(sizeof(VCHIQ_HEADER_T) - 1))
+
 typedef struct {
    unsigned int config_size;
    VCHIQ_CONFIG_T *pconfig;
@@ -111,6 +125,7 @@ typedef struct {
 #define VCHIQ_IOC_DUMP_PHYS_MEM        _IOW(VCHIQ_IOC_MAGIC,  15, VCHIQ_DUMP_MEM_T)
 #define VCHIQ_IOC_LIB_VERSION          _IO(VCHIQ_IOC_MAGIC,   16)
 #define VCHIQ_IOC_CLOSE_DELIVERED      _IO(VCHIQ_IOC_MAGIC,   17)
-#define VCHIQ_IOC_MAX                  17
+#define VCHIQ_IOC_DEQUEUE_MESSAGES     _IOWR(VCHIQ_IOC_MAGIC, 18, VCHIQ_DEQUEUE_MESSAGES_T)
+#define VCHIQ_IOC_MAX                  18
 
 #endif
@@ -29,10 +29,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "vchiq.h"
 #include "vchiq_cfg.h"
 #include "vchiq_ioctl.h"
+#include "vchiq_loopback.h"
 #include "interface/vchi/vchi.h"
 #include "interface/vchi/common/endian.h"
 #include "interface/vcos/vcos.h"
@@ -40,9 +42,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IS_POWER_2(x) ((x & (x - 1)) == 0)
 #define VCHIQ_MAX_INSTANCE_SERVICES 32
 #define MSGBUF_SIZE (VCHIQ_MAX_MSG_SIZE + sizeof(VCHIQ_HEADER_T))
+#define DEQUEUE_BUF_SIZE (4 * MSGBUF_SIZE)
+/* DEQUEUE_MESSAGES is not in the mainline driver, and a driver with a
+ * different ioctl 18 would misread the request, so batching is opt-in */
+#define DEQUEUE_BATCH_DEFAULT 1
+#define COMPLETION_BATCH_MIN 8
+#define COMPLETION_BATCH_MAX 64
 
 #define RETRY(r,x) do { r = x; } while ((r == -1) && (errno == EINTR))
 
+#define vchiq_ioctl(fd, request, arg) \
+   vchiq_instance.transport->ioctl(fd, request, (uintptr_t)(arg))
+
+#define LIB_STATS_ADD(field, n) __atomic_fetch_add(&vchiq_lib_stats.field, n, __ATOMIC_RELAXED)
+
 #define VCOS_LOG_CATEGORY (&vchiq_lib_log_category)
 
 typedef struct vchiq_service_struct
@@ -56,16 +69,23 @@ typedef struct vchiq_service_struct
    int peek_size;
    int client_id;
    char is_client;
+   VCOS_MUTEX_T mutex;     /* Protects the dequeue buffer */
+   char *dequeue_buf;      /* Messages fetched ahead by DEQUEUE_MESSAGES */
+   int dequeue_pos;
+   int dequeue_end;
+   void *msgbuf_cache;     /* Released message buffers, pushed without a lock */
 } VCHIQ_SERVICE_T;
 
 typedef struct vchiq_service_struct VCHI_SERVICE_T;
 
 struct vchiq_instance_struct
 {
+   const VCHIQ_TRANSPORT_T *transport;
    int fd;
    int initialised;
    int connected;
    int use_close_delivered;
+   int dequeue_batch;      /* 0 if the driver can't dequeue several messages */
    VCOS_THREAD_T completion_thread;
    VCOS_MUTEX_T mutex;
    int used_services;
@@ -80,6 +100,11 @@ static VCOS_LOG_CAT_T vchiq_lib_log_category;
 static VCOS_MUTEX_T vchiq_lib_mutex;
 static void *free_msgbufs;
 static unsigned int handle_seq;
+static const VCHIQ_TRANSPORT_T *vchiq_next_transport;
+static int vchiq_dequeue_batch = DEQUEUE_BATCH_DEFAULT;
+static int vchiq_completion_batch_min = COMPLETION_BATCH_MIN;
+static int vchiq_completion_batch_max = COMPLETION_BATCH_MAX;
+static VCHIQ_LIB_STATS_T vchiq_lib_stats;
 
 vcos_static_assert(IS_POWER_2(VCHIQ_MAX_INSTANCE_SERVICES));
 
@@ -87,8 +112,15 @@ vcos_static_assert(IS_POWER_2(VCHIQ_MAX_INSTANCE_SERVICES));
 static VCHIQ_INSTANCE_T
 vchiq_lib_init(const int dev_vchiq_fd);
 
+static void
+dequeue_discard(VCHIQ_SERVICE_T *service);
+
 static void *completion_thread(void *);
 
+static void *
+completion_alloc_msgbuf(VCHIQ_INSTANCE_T instance,
+   void **cached);
+
 static VCHIQ_STATUS_T
 create_service(VCHIQ_INSTANCE_T instance,
    const VCHIQ_SERVICE_PARAMS_T *params,
@@ -100,6 +132,12 @@ static int
 fill_peek_buf(VCHI_SERVICE_T *service,
    VCHI_FLAGS_T flags);
 
+static int
+dequeue_message(VCHI_SERVICE_T *service,
+   int blocking,
+   void *buf,
+   unsigned int bufsize);
+
 static void *
 alloc_msgbuf(void);
 
@@ -133,6 +171,71 @@ find_service_by_handle(VCHIQ_SERVICE_HANDLE_T handle)
    return service;
 }
 
+/*
+ * Transport
+ */
+
+static int
+dev_vchiq_open(void)
+{
+   return open("/dev/vchiq", O_RDWR);
+}
+
+static int
+dev_vchiq_ioctl(int fd, unsigned int request, uintptr_t arg)
+{
+   return ioctl(fd, request, arg);
+}
+
+static const VCHIQ_TRANSPORT_T dev_vchiq_transport =
+{
+   "/dev/vchiq",
+   dev_vchiq_open,
+   close,
+   dev_vchiq_ioctl
+};
+
+void
+vchiq_set_transport(const VCHIQ_TRANSPORT_T *transport)
+{
+   vchiq_next_transport = transport;
+}
+
+VCHIQ_STATUS_T
+vchiq_set_lib_batching(int dequeue_batch,
+   int completion_batch_min,
+   int completion_batch_max)
+{
+   if ((dequeue_batch < 1) || (completion_batch_min < 1) ||
+       (completion_batch_max > COMPLETION_BATCH_MAX) ||
+       (completion_batch_min > completion_batch_max))
+      return VCHIQ_ERROR;
+
+   vchiq_dequeue_batch = dequeue_batch;
+   vchiq_completion_batch_min = completion_batch_min;
+   vchiq_completion_batch_max = completion_batch_max;
+
+   /* Don't turn batching back on for a driver which can't do it */
+   if (is_valid_instance(&vchiq_instance) && vchiq_instance.dequeue_batch)
+      vchiq_instance.dequeue_batch = dequeue_batch;
+
+   return VCHIQ_SUCCESS;
+}
+
+void
+vchiq_get_lib_stats(VCHIQ_LIB_STATS_T *stats,
+   int reset)
+{
+   unsigned int *src = (unsigned int *)&vchiq_lib_stats;
+   unsigned int *dst = (unsigned int *)stats;
+   unsigned int i;
+
+   /* The counters are updated with atomics from other threads */
+   for (i = 0; i < sizeof(*stats) / sizeof(unsigned int); i++)
+      dst[i] = reset ? __atomic_exchange_n(&src[i], 0, __ATOMIC_RELAXED) :
+         __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
 /*
  * VCHIQ API
  */
@@ -193,13 +296,16 @@ vchiq_shutdown(VCHIQ_INSTANCE_T instance)
       if (instance->connected)
       {
          int ret;
-         RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_SHUTDOWN, 0));
+         RETRY(ret, vchiq_ioctl(instance->fd, VCHIQ_IOC_SHUTDOWN, 0));
          vcos_assert(ret == 0);
          vcos_thread_join(&instance->completion_thread, NULL);
          instance->connected = 0;
       }
 
-      close(instance->fd);
+      for (i = 0; i < instance->used_services; i++)
+         vcos_mutex_delete(&instance->services[i].mutex);
+
+      instance->transport->close(instance->fd);
       instance->fd = -1;
    }
    else if (instance->initialised > 1)
@@ -243,7 +349,7 @@ vchiq_connect(VCHIQ_INSTANCE_T instance)
    if (instance->connected)
       goto out;
 
-   ret = ioctl(instance->fd, VCHIQ_IOC_CONNECT, 0);
+   ret = vchiq_ioctl(instance->fd, VCHIQ_IOC_CONNECT, 0);
    if (ret != 0)
    {
       status = VCHIQ_ERROR;
@@ -340,7 +446,9 @@ vchiq_close_service(VCHIQ_SERVICE_HANDLE_T handle)
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_CLOSE_SERVICE, service->handle));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_CLOSE_SERVICE, service->handle));
+
+   dequeue_discard(service);
 
    if (service->is_client)
       service->lib_handle = VCHIQ_SERVICE_HANDLE_INVALID;
@@ -362,7 +470,9 @@ vchiq_remove_service(VCHIQ_SERVICE_HANDLE_T handle)
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_REMOVE_SERVICE, service->handle));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_REMOVE_SERVICE, service->handle));
+
+   dequeue_discard(service);
 
    service->lib_handle = VCHIQ_SERVICE_HANDLE_INVALID;
 
@@ -389,7 +499,7 @@ vchiq_queue_message(VCHIQ_SERVICE_HANDLE_T handle,
    args.handle = service->handle;
    args.elements = elements;
    args.count = count;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -398,9 +508,20 @@ void
 vchiq_release_message(VCHIQ_SERVICE_HANDLE_T handle,
    VCHIQ_HEADER_T *header)
 {
+   VCHIQ_SERVICE_T *service = handle_to_service(handle);
+   void *head;
+
    vcos_log_trace( "%s handle=%08x, header=%x", __func__, (uint32_t)handle, (uint32_t)header );
 
-   free_msgbuf(header);
+   /* Only the completion thread takes buffers out of the cache, and it
+    * takes the whole list at once, so a plain push is safe. The cache of a
+    * service which has gone away is still scanned, so nothing is lost. */
+   head = __atomic_load_n(&service->msgbuf_cache, __ATOMIC_RELAXED);
+   do
+   {
+      *(void **)header = head;
+   } while (!__atomic_compare_exchange_n(&service->msgbuf_cache, &head, header, 1,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED));
 }
 
 VCHIQ_STATUS_T
@@ -423,7 +544,7 @@ vchiq_queue_bulk_transmit(VCHIQ_SERVICE_HANDLE_T handle,
    args.size = size;
    args.userdata = userdata;
    args.mode = VCHIQ_BULK_MODE_CALLBACK;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -448,7 +569,7 @@ vchiq_queue_bulk_receive(VCHIQ_SERVICE_HANDLE_T handle,
    args.size = size;
    args.userdata = userdata;
    args.mode = VCHIQ_BULK_MODE_CALLBACK;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -502,7 +623,7 @@ vchiq_bulk_transmit(VCHIQ_SERVICE_HANDLE_T handle,
    args.size = size;
    args.userdata = userdata;
    args.mode = mode;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -555,7 +676,7 @@ vchiq_bulk_receive_handle(VCHIQ_SERVICE_HANDLE_T handle,
    args.size = size;
    args.userdata = userdata;
    args.mode = mode;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -568,7 +689,7 @@ vchiq_get_client_id(VCHIQ_SERVICE_HANDLE_T handle)
    if (!service)
       return VCHIQ_ERROR;
 
-   return ioctl(service->fd, VCHIQ_IOC_GET_CLIENT_ID, service->handle);
+   return vchiq_ioctl(service->fd, VCHIQ_IOC_GET_CLIENT_ID, service->handle);
 }
 
 void *
@@ -601,7 +722,7 @@ vchiq_get_config(VCHIQ_INSTANCE_T instance,
    args.config_size = config_size;
    args.pconfig = pconfig;
 
-   RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_GET_CONFIG, &args));
+   RETRY(ret, vchiq_ioctl(instance->fd, VCHIQ_IOC_GET_CONFIG, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -615,7 +736,7 @@ vchiq_use_service( const VCHIQ_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_USE_SERVICE, service->handle));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_USE_SERVICE, service->handle));
    return ret;
 }
 
@@ -628,7 +749,7 @@ vchiq_release_service( const VCHIQ_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_RELEASE_SERVICE, service->handle));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_RELEASE_SERVICE, service->handle));
    return ret;
 }
 
@@ -647,7 +768,7 @@ vchiq_set_service_option(VCHIQ_SERVICE_HANDLE_T handle,
    args.option = option;
    args.value  = value;
 
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_SET_SERVICE_OPTION, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_SET_SERVICE_OPTION, &args));
 
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
@@ -783,7 +904,7 @@ vchi_msg_queue( VCHI_SERVICE_HANDLE_T handle,
    args.handle = service->handle;
    args.elements = &element;
    args.count = 1;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
 
    return ret;
 }
@@ -836,7 +957,7 @@ vchi_bulk_queue_receive( VCHI_SERVICE_HANDLE_T handle,
    args.data = data_dst;
    args.size = data_size;
    args.userdata = bulk_handle;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_RECEIVE, &args));
 
    return ret;
 }
@@ -890,7 +1011,7 @@ vchi_bulk_queue_transmit( VCHI_SERVICE_HANDLE_T handle,
    args.data = (void *)data_src;
    args.size = data_size;
    args.userdata = bulk_handle;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_BULK_TRANSMIT, &args));
 
    return ret;
 }
@@ -917,7 +1038,6 @@ vchi_msg_dequeue( VCHI_SERVICE_HANDLE_T handle,
    VCHI_FLAGS_T flags )
 {
    VCHI_SERVICE_T *service = find_service_by_handle(handle);
-   VCHIQ_DEQUEUE_MESSAGE_T args;
    int ret;
 
    vcos_assert(flags == VCHI_FLAGS_NONE || flags == VCHI_FLAGS_BLOCK_UNTIL_OP_COMPLETE);
@@ -943,11 +1063,8 @@ vchi_msg_dequeue( VCHI_SERVICE_HANDLE_T handle,
    }
    else
    {
-      args.handle = service->handle;
-      args.blocking = (flags == VCHI_FLAGS_BLOCK_UNTIL_OP_COMPLETE);
-      args.bufsize = max_data_size_to_read;
-      args.buf = data;
-      RETRY(ret, ioctl(service->fd, VCHIQ_IOC_DEQUEUE_MESSAGE, &args));
+      ret = dequeue_message(service, (flags == VCHI_FLAGS_BLOCK_UNTIL_OP_COMPLETE),
+         data, max_data_size_to_read);
       if (ret >= 0)
       {
          *actual_msg_size = ret;
@@ -1001,7 +1118,7 @@ vchi_msg_queuev( VCHI_SERVICE_HANDLE_T handle,
    args.handle = service->handle;
    args.elements = (const VCHIQ_ELEMENT_T *)vector;
    args.count = count;
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_QUEUE_MESSAGE, &args));
 
    return ret;
 }
@@ -1222,7 +1339,9 @@ vchi_service_close( const VCHI_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_CLOSE_SERVICE, service->handle));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_CLOSE_SERVICE, service->handle));
+
+   dequeue_discard(service);
 
    if (service->is_client)
       service->lib_handle = VCHIQ_SERVICE_HANDLE_INVALID;
@@ -1239,7 +1358,9 @@ vchi_service_destroy( const VCHI_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_REMOVE_SERVICE, service->handle));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_REMOVE_SERVICE, service->handle));
+
+   dequeue_discard(service);
 
    service->lib_handle = VCHIQ_SERVICE_HANDLE_INVALID;
 
@@ -1313,7 +1434,7 @@ vchi_service_use( const VCHI_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_USE_SERVICE, service->handle));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_USE_SERVICE, service->handle));
    return ret;
 }
 
@@ -1335,7 +1456,7 @@ int32_t vchi_service_release( const VCHI_SERVICE_HANDLE_T handle )
    if (!service)
       return VCHIQ_ERROR;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_RELEASE_SERVICE, service->handle));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_RELEASE_SERVICE, service->handle));
    return ret;
 }
 
@@ -1374,7 +1495,7 @@ int32_t vchi_service_set_option( const VCHI_SERVICE_HANDLE_T handle,
    args.handle = service->handle;
    args.value  = value;
 
-   RETRY(ret, ioctl(service->fd, VCHIQ_IOC_SET_SERVICE_OPTION, &args));
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_SET_SERVICE_OPTION, &args));
 
    return ret;
 }
@@ -1406,7 +1527,7 @@ VCHIQ_STATUS_T vchiq_dump_phys_mem( VCHIQ_SERVICE_HANDLE_T handle,
    dump_mem.virt_addr = ptr;
    dump_mem.num_bytes = num_bytes;
 
-   RETRY(ret,ioctl(service->fd, VCHIQ_IOC_DUMP_PHYS_MEM, &dump_mem));
+   RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_DUMP_PHYS_MEM, &dump_mem));
    return (ret >= 0) ? VCHIQ_SUCCESS : VCHIQ_ERROR;
 }
 
@@ -1439,8 +1560,20 @@ vchiq_lib_init(const int dev_vchiq_fd)
 
    if (instance->initialised == 0)
    {
+      /* A passed in fd is always the driver. Otherwise VCHIQ_LOOPBACK in the
+       * environment can select the emulator if nothing else was chosen. */
+      if (dev_vchiq_fd != -1)
+         instance->transport = &dev_vchiq_transport;
+      else
+      {
+         const char *loopback = getenv("VCHIQ_LOOPBACK");
+         if (!vchiq_next_transport && loopback)
+            vchiq_loopback_enable(loopback);
+         instance->transport = vchiq_next_transport ? vchiq_next_transport : &dev_vchiq_transport;
+      }
+
       instance->fd = dev_vchiq_fd == -1 ?
-         open("/dev/vchiq", O_RDWR) :
+         instance->transport->open() :
          dup(dev_vchiq_fd);
       if (instance->fd >= 0)
       {
@@ -1449,17 +1582,18 @@ vchiq_lib_init(const int dev_vchiq_fd)
          int ret;
          args.config_size = sizeof(config);
          args.pconfig = &config;
-         RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_GET_CONFIG, &args));
+         RETRY(ret, vchiq_ioctl(instance->fd, VCHIQ_IOC_GET_CONFIG, &args));
          if ((ret == 0) && (config.version >= VCHIQ_VERSION_MIN) && (config.version_min <= VCHIQ_VERSION))
          {
             if (config.version >= VCHIQ_VERSION_LIB_VERSION)
             {
-               RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_LIB_VERSION, VCHIQ_VERSION));
+               RETRY(ret, vchiq_ioctl(instance->fd, VCHIQ_IOC_LIB_VERSION, VCHIQ_VERSION));
             }
             if (ret == 0)
             {
                instance->used_services = 0;
                instance->use_close_delivered = (config.version >= VCHIQ_VERSION_CLOSE_DELIVERED);
+               instance->dequeue_batch = vchiq_dequeue_batch;
                vcos_mutex_create(&instance->mutex, "VCHIQ instance");
                instance->initialised = 1;
             }
@@ -1475,7 +1609,7 @@ vchiq_lib_init(const int dev_vchiq_fd)
             {
                vcos_log_error("Very incompatible VCHIQ library - cannot retrieve driver version");
             }
-            close(instance->fd);
+            instance->transport->close(instance->fd);
             instance = NULL;
          }
       }
@@ -1499,8 +1633,12 @@ completion_thread(void *arg)
 {
    VCHIQ_INSTANCE_T instance = (VCHIQ_INSTANCE_T)arg;
    VCHIQ_AWAIT_COMPLETION_T args;
-   VCHIQ_COMPLETION_DATA_T completions[8];
-   void *msgbufs[8];
+   VCHIQ_COMPLETION_DATA_T completions[COMPLETION_BATCH_MAX];
+   void *msgbufs[COMPLETION_BATCH_MAX];
+   void *cached_msgbufs = NULL;
+   unsigned int batch_min = vchiq_completion_batch_min;
+   unsigned int batch_max = vchiq_completion_batch_max;
+   unsigned int batch = batch_min;
 
    static const VCHI_CALLBACK_REASON_T vchiq_reason_to_vchi[] =
    {
@@ -1513,7 +1651,6 @@ completion_thread(void *arg)
       VCHI_CALLBACK_BULK_RECEIVE_ABORTED,  // VCHIQ_BULK_RECEIVE_ABORTED
    };
 
-   args.count = vcos_countof(completions);
    args.buf = completions;
    args.msgbufsize = MSGBUF_SIZE;
    args.msgbufcount = 0;
@@ -1523,9 +1660,9 @@ completion_thread(void *arg)
    {
       int count, i;
 
-      while ((unsigned int)args.msgbufcount < vcos_countof(msgbufs))
+      while (args.msgbufcount < batch)
       {
-         void *msgbuf = alloc_msgbuf();
+         void *msgbuf = completion_alloc_msgbuf(instance, &cached_msgbufs);
          if (msgbuf)
          {
             msgbufs[args.msgbufcount++] = msgbuf;
@@ -1537,11 +1674,25 @@ completion_thread(void *arg)
          }
       }
 
-      RETRY(count, ioctl(instance->fd, VCHIQ_IOC_AWAIT_COMPLETION, &args));
+      args.count = batch;
+      RETRY(count, vchiq_ioctl(instance->fd, VCHIQ_IOC_AWAIT_COMPLETION, &args));
 
       if (count <= 0)
          break;
 
+      LIB_STATS_ADD(await_ioctls, 1);
+      LIB_STATS_ADD(completions, count);
+      for (i = 0; (i < VCHIQ_LIB_BATCH_BUCKETS - 1) && (count > (1 << i)); i++)
+         continue;
+      LIB_STATS_ADD(completion_batch[i], 1);
+
+      /* Ask for more at once while the driver keeps filling the batch, and
+       * fewer (so fewer idle message buffers are held) when it doesn't */
+      if (((unsigned int)count == batch) && (batch < batch_max))
+         batch = vcos_min(batch * 2, batch_max);
+      else if (((unsigned int)count * 4 <= batch) && (batch > batch_min))
+         batch = vcos_max(batch / 2, batch_min);
+
       for (i = 0; i < count; i++)
       {
          VCHIQ_COMPLETION_DATA_T *completion = &completions[i];
@@ -1565,7 +1716,7 @@ completion_thread(void *arg)
              instance->use_close_delivered)
          {
             int ret;
-            RETRY(ret,ioctl(service->fd, VCHIQ_IOC_CLOSE_DELIVERED, service->handle));
+            RETRY(ret,vchiq_ioctl(service->fd, VCHIQ_IOC_CLOSE_DELIVERED, service->handle));
          }
       }
    }
@@ -1576,6 +1727,13 @@ completion_thread(void *arg)
       free_msgbuf(msgbuf);
    }
 
+   while (cached_msgbufs)
+   {
+      void *msgbuf = cached_msgbufs;
+      cached_msgbufs = *(void **)msgbuf;
+      free_msgbuf(msgbuf);
+   }
+
    return NULL;
 }
 
@@ -1635,7 +1793,10 @@ create_service(VCHIQ_INSTANCE_T instance,
    if (!service && (status == VCHIQ_SUCCESS))
    {
       if (instance->used_services < VCHIQ_MAX_INSTANCE_SERVICES)
+      {
          service = &instance->services[instance->used_services++];
+         vcos_mutex_create(&service->mutex, "VCHIQ service");
+      }
       else
          status = VCHIQ_ERROR;
    }
@@ -1663,13 +1824,14 @@ create_service(VCHIQ_INSTANCE_T instance,
       service->peek_size = -1;
       service->peek_buf = NULL;
       service->is_client = is_open;
+      service->dequeue_pos = service->dequeue_end = 0;
 
       args.params = *params;
       args.params.userdata = service;
       args.is_open = is_open;
       args.is_vchi = (params->callback == NULL);
       args.handle = VCHIQ_SERVICE_HANDLE_INVALID; /* OUT parameter */
-      RETRY(ret, ioctl(instance->fd, VCHIQ_IOC_CREATE_SERVICE, &args));
+      RETRY(ret, vchiq_ioctl(instance->fd, VCHIQ_IOC_CREATE_SERVICE, &args));
       if (ret == 0)
          service->handle = args.handle;
       else
@@ -1697,11 +1859,121 @@ create_service(VCHIQ_INSTANCE_T instance,
    return status;
 }
 
+/* Drop any messages fetched ahead, and the buffer holding them, once the
+ * service has been closed. The close wakes a blocked dequeue, so the lock
+ * can be waited for. */
+static void
+dequeue_discard(VCHIQ_SERVICE_T *service)
+{
+   vcos_mutex_lock(&service->mutex);
+   vcos_free(service->dequeue_buf);
+   service->dequeue_buf = NULL;
+   service->dequeue_pos = service->dequeue_end = 0;
+   vcos_mutex_unlock(&service->mutex);
+}
+
+/* Fetch as many messages as are waiting (up to the batch size) into the
+ * service's dequeue buffer, unless some are there already. Returns the next
+ * one, or NULL with errno set. Called with the service mutex held. */
+static VCHIQ_HEADER_T *
+dequeue_fetch(VCHI_SERVICE_T *service,
+   int blocking)
+{
+   if (service->dequeue_pos == service->dequeue_end)
+   {
+      VCHIQ_DEQUEUE_MESSAGES_T args;
+      int ret;
+
+      if (!service->dequeue_buf)
+      {
+         service->dequeue_buf = vcos_malloc(DEQUEUE_BUF_SIZE, "vchiq dequeue");
+         if (!service->dequeue_buf)
+         {
+            errno = ENOMEM;
+            return NULL;
+         }
+      }
+
+      args.handle = service->handle;
+      args.blocking = blocking;
+      args.bufsize = DEQUEUE_BUF_SIZE;
+      args.buf = service->dequeue_buf;
+      args.count = vchiq_instance.dequeue_batch;
+      RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_DEQUEUE_MESSAGES, &args));
+      if (ret <= 0)
+      {
+         if (ret == 0)
+            errno = EWOULDBLOCK;
+         return NULL;
+      }
+
+      LIB_STATS_ADD(dequeue_ioctls, 1);
+      service->dequeue_pos = 0;
+      service->dequeue_end = ret;
+   }
+
+   return (VCHIQ_HEADER_T *)(service->dequeue_buf + service->dequeue_pos);
+}
+
+/* Same as the DEQUEUE_MESSAGE ioctl, but fetching several messages at a time
+ * when the driver can */
+static int
+dequeue_message(VCHI_SERVICE_T *service,
+   int blocking,
+   void *buf,
+   unsigned int bufsize)
+{
+   VCHIQ_DEQUEUE_MESSAGE_T args;
+   int ret;
+
+   vcos_mutex_lock(&service->mutex);
+   if ((vchiq_instance.dequeue_batch > 1) || (service->dequeue_pos != service->dequeue_end))
+   {
+      VCHIQ_HEADER_T *header = dequeue_fetch(service, blocking);
+
+      if (header)
+      {
+         if (header->size > bufsize)
+         {
+            vcos_mutex_unlock(&service->mutex);
+            errno = EMSGSIZE;
+            return -1;
+         }
+         memcpy(buf, header->data, header->size);
+         service->dequeue_pos += VCHIQ_DEQUEUE_MSG_SPACE(header->size);
+         vcos_mutex_unlock(&service->mutex);
+         LIB_STATS_ADD(dequeued_msgs, 1);
+         return header->size;
+      }
+
+      if (errno != ENOTTY)
+      {
+         vcos_mutex_unlock(&service->mutex);
+         return -1;
+      }
+
+      /* The driver doesn't know about DEQUEUE_MESSAGES */
+      vcos_log_info("vchiq_lib: batched dequeue not supported");
+      vchiq_instance.dequeue_batch = 0;
+   }
+   vcos_mutex_unlock(&service->mutex);
+
+   args.handle = service->handle;
+   args.blocking = blocking;
+   args.bufsize = bufsize;
+   args.buf = buf;
+   RETRY(ret, vchiq_ioctl(service->fd, VCHIQ_IOC_DEQUEUE_MESSAGE, &args));
+   LIB_STATS_ADD(dequeue_ioctls, 1);
+   if (ret >= 0)
+      LIB_STATS_ADD(dequeued_msgs, 1);
+
+   return ret;
+}
+
 static int
 fill_peek_buf(VCHI_SERVICE_T *service,
    VCHI_FLAGS_T flags)
 {
-   VCHIQ_DEQUEUE_MESSAGE_T args;
    int ret = 0;
 
    vcos_assert(flags == VCHI_FLAGS_NONE || flags == VCHI_FLAGS_BLOCK_UNTIL_OP_COMPLETE);
@@ -1713,12 +1985,8 @@ fill_peek_buf(VCHI_SERVICE_T *service,
 
       if (service->peek_buf)
       {
-         args.handle = service->handle;
-         args.blocking = (flags == VCHI_FLAGS_BLOCK_UNTIL_OP_COMPLETE);
-         args.bufsize = MSGBUF_SIZE;
-         args.buf = service->peek_buf;
-
-         RETRY(ret, ioctl(service->fd, VCHIQ_IOC_DEQUEUE_MESSAGE, &args));
+         ret = dequeue_message(service, (flags == VCHI_FLAGS_BLOCK_UNTIL_OP_COMPLETE),
+            service->peek_buf, MSGBUF_SIZE);
 
          if (ret >= 0)
          {
@@ -1754,6 +2022,31 @@ alloc_msgbuf(void)
    return msgbuf;
 }
 
+/* Message buffers for the completion thread. Buffers released by clients
+ * are taken back from the service caches first. */
+static void *
+completion_alloc_msgbuf(VCHIQ_INSTANCE_T instance,
+   void **cached)
+{
+   void *msgbuf = *cached;
+   int i;
+
+   /* used_services can grow under the instance mutex, and the caches of
+    * unused services are always empty, so just scan them all */
+   for (i = 0; !msgbuf && (i < VCHIQ_MAX_INSTANCE_SERVICES); i++)
+      msgbuf = __atomic_exchange_n(&instance->services[i].msgbuf_cache, NULL, __ATOMIC_ACQUIRE);
+
+   if (!msgbuf)
+   {
+      LIB_STATS_ADD(msgbuf_shared, 1);
+      return alloc_msgbuf();
+   }
+
+   LIB_STATS_ADD(msgbuf_cached, 1);
+   *cached = *(void **)msgbuf;
+   return msgbuf;
+}
+
 static void
 free_msgbuf(void *buf)
 {
@@ -0,0 +1,1700 @@
+/*
+Copyright (c) 2012-2014, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * In-process emulation of the VCHIQ driver and of the VideoCore side of the
+ * services, plugged in underneath vchiq_lib as a transport. The ioctls are
+ * implemented with the same semantics as the kernel driver for a single
+ * instance: completions are returned by AWAIT_COMPLETION (with messages for
+ * callback services copied into the supplied message buffers), messages for
+ * VCHI services are kept until DEQUEUE_MESSAGE, and bulk transfers complete
+ * with a callback, silently or by blocking the caller depending on the mode.
+ *
+ * Everything sent to the VideoCore goes through a list of events ordered by
+ * the time at which the modelled link delivers it. The "remote" thread pops
+ * events when they are due and calls the service handlers.
+ *
+ * Message quotas aren't modelled, so senders are never held up.
+ *
+ * pthreads is used rather than VCOS since the remote thread needs timed
+ * waits with better than millisecond resolution.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vchiq.h"
+#include "vchiq_cfg.h"
+#include "vchiq_ioctl.h"
+#include "vchiq_loopback.h"
+#include "interface/vcos/vcos.h"
+
+#define VCOS_LOG_CATEGORY (&vchiq_loopback_log_category)
+
+#define LOOPBACK_MAX_SERVICES 64
+#define LOOPBACK_MAX_HANDLERS 32
+
+/* Same numbering as the vchiq_test protocol */
+#define TEST_MSG_ONEWAY 1
+#define TEST_MSG_ASYNC  2
+#define TEST_MSG_SYNC   3
+#define TEST_MSG_CONFIG 4
+#define TEST_MSG_ECHO   5
+#define TEST_CONFIG_ECHO_OFFSET (4 * sizeof(int))
+#define TEST_VERSION    3
+#define TEST_FUNC_FOURCC VCHIQ_MAKE_FOURCC('f','u','n','c')
+#define TEST_FUN2_FOURCC VCHIQ_MAKE_FOURCC('f','u','n','2')
+#define TEST_FUNC_MAX_CLIENTS 2
+
+/* msgid of a remote bulk transmit which aborts the host's receive */
+#define LOOPBACK_BULK_ABORTED (-1)
+
+typedef struct loopback_msg_struct
+{
+   struct loopback_msg_struct *next;
+   VCHIQ_HEADER_T header;             /* Must be last, the data follows */
+} LOOPBACK_MSG_T;
+
+/* A bulk transfer queued by the host */
+typedef struct loopback_bulk_struct
+{
+   struct loopback_bulk_struct *next;
+   void *data;
+   unsigned int size;
+   void *userdata;
+   void *service_userdata;
+   VCHIQ_BULK_MODE_T mode;
+   int done;
+   VCHIQ_REASON_T reason;             /* How it completed */
+} LOOPBACK_BULK_T;
+
+typedef struct loopback_completion_struct
+{
+   struct loopback_completion_struct *next;
+   VCHIQ_REASON_T reason;
+   LOOPBACK_MSG_T *msg;               /* Message for a callback service */
+   struct vchiq_loopback_service_struct *service;
+   unsigned int generation;
+   void *service_userdata;
+   void *bulk_userdata;
+} LOOPBACK_COMPLETION_T;
+
+typedef enum
+{
+   EVENT_MSG_TO_REMOTE,
+   EVENT_BULK_TO_REMOTE,
+   EVENT_MSG_TO_HOST,
+   EVENT_BULK_TO_HOST,
+   EVENT_BULK_SENT                    /* A remote transmit reached a host receive */
+} LOOPBACK_EVENT_TYPE_T;
+
+typedef struct loopback_event_struct
+{
+   struct loopback_event_struct *next;
+   LOOPBACK_EVENT_TYPE_T type;
+   uint64_t due;
+   struct vchiq_loopback_service_struct *service;
+   unsigned int generation;
+   LOOPBACK_MSG_T *msg;
+   LOOPBACK_BULK_T *bulk;
+} LOOPBACK_EVENT_T;
+
+typedef struct
+{
+   const VCHIQ_LOOPBACK_HANDLER_T *handler;
+   void *userdata;
+} LOOPBACK_HANDLER_ENTRY_T;
+
+struct vchiq_loopback_service_struct
+{
+   int in_use;
+   int closed;
+   int opened;                        /* The handler accepted the open */
+   int is_vchi;
+   int fourcc;
+   unsigned int handle;
+   unsigned int generation;
+   void *service_userdata;            /* lib's service, given back in completions */
+   LOOPBACK_HANDLER_ENTRY_T handler;
+   void *state;
+   int callbacks;                     /* Handler calls in progress */
+   int close_pending;                 /* Waiting for the host to see SERVICE_CLOSED */
+   int remote_receives;               /* Receives queued by the remote side */
+
+   LOOPBACK_MSG_T *msg_head, *msg_tail;     /* Messages waiting for DEQUEUE_MESSAGE */
+   int msg_available;                       /* A MESSAGE_AVAILABLE is waiting to be delivered */
+   LOOPBACK_BULK_T *rx_head, *rx_tail;      /* Host receives waiting for data */
+   LOOPBACK_MSG_T *data_head, *data_tail;   /* Remote transmits waiting for a receive */
+   LOOPBACK_BULK_T *tx_head, *tx_tail;      /* Host transmits waiting for a remote receive */
+};
+
+typedef struct
+{
+   uint64_t busy_until;
+} LOOPBACK_LINK_T;
+
+static struct
+{
+   pthread_mutex_t lock;
+   pthread_cond_t host_cond;
+   pthread_cond_t remote_cond;
+   pthread_t remote_thread;
+   int fd;
+   int stopping;
+   int shutdown;
+   int connected;
+
+   VCHIQ_LOOPBACK_CONFIG_T config;
+   LOOPBACK_LINK_T to_remote;
+   LOOPBACK_LINK_T to_host;
+
+   LOOPBACK_EVENT_T *events;
+   LOOPBACK_COMPLETION_T *completion_head, *completion_tail;
+   LOOPBACK_COMPLETION_T *free_completions;
+   unsigned int completion_count;
+
+   struct vchiq_loopback_service_struct services[LOOPBACK_MAX_SERVICES];
+   VCHIQ_LOOPBACK_STATS_T stats;
+} loopback = { PTHREAD_MUTEX_INITIALIZER, .fd = -1 };
+
+static pthread_mutex_t loopback_handlers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct
+{
+   int fourcc;
+   LOOPBACK_HANDLER_ENTRY_T entry;
+} loopback_handlers[LOOPBACK_MAX_HANDLERS];
+static unsigned int loopback_handlers_num;
+static LOOPBACK_HANDLER_ENTRY_T loopback_default_handler;
+
+static VCOS_LOG_CAT_T vchiq_loopback_log_category;
+static int loopback_log_registered;
+
+/*
+ * Helpers, called with the lock held
+ */
+
+static uint64_t
+loopback_now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Work out when a transfer of the given size queued now arrives */
+static uint64_t
+loopback_link_due(LOOPBACK_LINK_T *link, unsigned int size)
+{
+   uint64_t start = loopback_now();
+
+   if (link->busy_until > start)
+      start = link->busy_until;
+   if (loopback.config.bandwidth)
+      start += (uint64_t)size * 1000000 / loopback.config.bandwidth;
+   link->busy_until = start;
+
+   return start + loopback.config.latency_us;
+}
+
+static void
+loopback_event_add(LOOPBACK_EVENT_T *event)
+{
+   LOOPBACK_EVENT_T **pos = &loopback.events;
+
+   /* Events on the same link are queued in order, so the scan is short */
+   while (*pos && (*pos)->due <= event->due)
+      pos = &(*pos)->next;
+   event->next = *pos;
+   *pos = event;
+
+   if (loopback.events == event)
+      pthread_cond_signal(&loopback.remote_cond);
+}
+
+static int
+loopback_event_queue(LOOPBACK_EVENT_TYPE_T type, struct vchiq_loopback_service_struct *service,
+   LOOPBACK_MSG_T *msg, LOOPBACK_BULK_T *bulk, unsigned int size)
+{
+   LOOPBACK_EVENT_T *event = malloc(sizeof(*event));
+
+   if (!event)
+      return -1;
+
+   event->type = type;
+   event->service = service;
+   event->generation = service->generation;
+   event->msg = msg;
+   event->bulk = bulk;
+   event->due = loopback_link_due((type == EVENT_MSG_TO_REMOTE || type == EVENT_BULK_TO_REMOTE ||
+      type == EVENT_BULK_SENT) ? &loopback.to_remote : &loopback.to_host, size);
+   loopback_event_add(event);
+   return 0;
+}
+
+static LOOPBACK_MSG_T *
+loopback_msg_alloc(unsigned int size)
+{
+   LOOPBACK_MSG_T *msg = malloc(sizeof(*msg) + size);
+
+   if (msg)
+   {
+      msg->next = NULL;
+      msg->header.msgid = 0;
+      msg->header.size = size;
+   }
+   return msg;
+}
+
+static void
+loopback_msg_list_free(LOOPBACK_MSG_T **head, LOOPBACK_MSG_T **tail)
+{
+   while (*head)
+   {
+      LOOPBACK_MSG_T *msg = *head;
+      *head = msg->next;
+      free(msg);
+   }
+   *tail = NULL;
+}
+
+static void
+loopback_complete(VCHIQ_REASON_T reason, struct vchiq_loopback_service_struct *service,
+   void *service_userdata, LOOPBACK_MSG_T *msg, void *bulk_userdata)
+{
+   LOOPBACK_COMPLETION_T *completion = loopback.free_completions;
+
+   if (completion)
+      loopback.free_completions = completion->next;
+   else
+      completion = malloc(sizeof(*completion));
+   if (!completion)
+   {
+      vcos_log_error("loopback: dropping completion %d", reason);
+      free(msg);
+      return;
+   }
+
+   completion->next = NULL;
+   completion->reason = reason;
+   completion->msg = msg;
+   completion->service = service;
+   completion->generation = service ? service->generation : 0;
+   completion->service_userdata = service_userdata;
+   completion->bulk_userdata = bulk_userdata;
+
+   if (loopback.completion_tail)
+      loopback.completion_tail->next = completion;
+   else
+      loopback.completion_head = completion;
+   loopback.completion_tail = completion;
+
+   if (++loopback.completion_count > loopback.stats.max_completions)
+      loopback.stats.max_completions = loopback.completion_count;
+
+   pthread_cond_broadcast(&loopback.host_cond);
+}
+
+static void
+loopback_bulk_complete(LOOPBACK_BULK_T *bulk, VCHIQ_REASON_T reason)
+{
+   switch (bulk->mode)
+   {
+   case VCHIQ_BULK_MODE_CALLBACK:
+      loopback_complete(reason, NULL, bulk->service_userdata, NULL, bulk->userdata);
+      free(bulk);
+      break;
+   case VCHIQ_BULK_MODE_BLOCKING:
+      /* The caller is waiting and frees it */
+      bulk->reason = reason;
+      bulk->done = 1;
+      pthread_cond_broadcast(&loopback.host_cond);
+      break;
+   default:
+      free(bulk);
+      break;
+   }
+}
+
+/* Hand remote data to a host receive */
+static void
+loopback_bulk_receive_done(struct vchiq_loopback_service_struct *service,
+   LOOPBACK_BULK_T *bulk, LOOPBACK_MSG_T *data)
+{
+   unsigned int size = vcos_min(bulk->size, data->header.size);
+   int aborted = data->header.msgid == LOOPBACK_BULK_ABORTED;
+
+   if (!aborted)
+   {
+      memcpy(bulk->data, data->header.data, size);
+      loopback.stats.bulks_to_host++;
+      loopback.stats.bulk_bytes_to_host += size;
+      if (bulk->size != size)
+         vcos_log_warn("loopback: service %x received %u bytes into %u byte bulk",
+            service->handle, size, bulk->size);
+   }
+
+   /* The handler may want to know its transmit has completed */
+   if (!service->handler.handler->bulk_sent ||
+       loopback_event_queue(EVENT_BULK_SENT, service, data, NULL, 0))
+      free(data);
+
+   loopback_bulk_complete(bulk, aborted ? VCHIQ_BULK_RECEIVE_ABORTED : VCHIQ_BULK_RECEIVE_DONE);
+}
+
+static struct vchiq_loopback_service_struct *
+loopback_find_service(unsigned int handle)
+{
+   struct vchiq_loopback_service_struct *service =
+      &loopback.services[handle % LOOPBACK_MAX_SERVICES];
+
+   if (!service->in_use || service->handle != handle)
+      return NULL;
+   return service;
+}
+
+static int
+loopback_service_live(struct vchiq_loopback_service_struct *service, unsigned int generation)
+{
+   return service->in_use && !service->closed && service->generation == generation;
+}
+
+/* Drop anything queued on a service which is closing */
+static void
+loopback_service_abort(struct vchiq_loopback_service_struct *service)
+{
+   while (service->rx_head)
+   {
+      LOOPBACK_BULK_T *bulk = service->rx_head;
+      service->rx_head = bulk->next;
+      loopback_bulk_complete(bulk, VCHIQ_BULK_RECEIVE_ABORTED);
+   }
+   service->rx_tail = NULL;
+   while (service->tx_head)
+   {
+      LOOPBACK_BULK_T *bulk = service->tx_head;
+      service->tx_head = bulk->next;
+      loopback_bulk_complete(bulk, VCHIQ_BULK_TRANSMIT_ABORTED);
+   }
+   service->tx_tail = NULL;
+   service->remote_receives = 0;
+   loopback_msg_list_free(&service->data_head, &service->data_tail);
+   loopback_msg_list_free(&service->msg_head, &service->msg_tail);
+   service->msg_available = 0;
+}
+
+/* Call into a handler with the lock dropped */
+#define LOOPBACK_CALL(service, fn, ...)                           \
+   do {                                                           \
+      LOOPBACK_HANDLER_ENTRY_T entry_ = (service)->handler;      \
+      (service)->callbacks++;                                     \
+      pthread_mutex_unlock(&loopback.lock);                       \
+      entry_.handler->fn(service, __VA_ARGS__, entry_.userdata);  \
+      pthread_mutex_lock(&loopback.lock);                         \
+      if (!--(service)->callbacks)                                \
+         pthread_cond_broadcast(&loopback.host_cond);             \
+   } while (0)
+
+static void
+loopback_service_close(struct vchiq_loopback_service_struct *service, int from_remote)
+{
+   if (!service->closed)
+   {
+      service->closed = 1;
+      loopback_service_abort(service);
+
+      /* Let any call into the handler for this service finish first, unless
+       * it is the handler closing the service */
+      while (!from_remote && service->callbacks)
+         pthread_cond_wait(&loopback.host_cond, &loopback.lock);
+
+      if (service->opened && service->handler.handler->close)
+      {
+         LOOPBACK_HANDLER_ENTRY_T entry = service->handler;
+         pthread_mutex_unlock(&loopback.lock);
+         entry.handler->close(service, entry.userdata);
+         pthread_mutex_lock(&loopback.lock);
+      }
+      service->opened = 0;
+   }
+}
+
+static void
+loopback_process_event(LOOPBACK_EVENT_T *event)
+{
+   struct vchiq_loopback_service_struct *service = event->service;
+   int live = loopback_service_live(service, event->generation);
+
+   switch (event->type)
+   {
+   case EVENT_MSG_TO_REMOTE:
+      if (live && service->opened)
+      {
+         loopback.stats.msgs_to_remote++;
+         loopback.stats.msg_bytes_to_remote += event->msg->header.size;
+         LOOPBACK_CALL(service, message, event->msg->header.data, event->msg->header.size);
+      }
+      free(event->msg);
+      break;
+
+   case EVENT_BULK_TO_REMOTE:
+      if (live && service->opened && service->handler.handler->receive_on_request &&
+          !service->remote_receives)
+      {
+         /* Nothing to receive it yet */
+         event->bulk->next = NULL;
+         if (service->tx_tail)
+            service->tx_tail->next = event->bulk;
+         else
+            service->tx_head = event->bulk;
+         service->tx_tail = event->bulk;
+      }
+      else if (live && service->opened)
+      {
+         if (service->handler.handler->receive_on_request)
+            service->remote_receives--;
+         loopback.stats.bulks_to_remote++;
+         loopback.stats.bulk_bytes_to_remote += event->bulk->size;
+         if (service->handler.handler->bulk)
+            LOOPBACK_CALL(service, bulk, event->bulk->data, event->bulk->size);
+         loopback_bulk_complete(event->bulk, VCHIQ_BULK_TRANSMIT_DONE);
+      }
+      else
+      {
+         loopback_bulk_complete(event->bulk, VCHIQ_BULK_TRANSMIT_ABORTED);
+      }
+      break;
+
+   case EVENT_MSG_TO_HOST:
+      if (!live)
+      {
+         free(event->msg);
+         break;
+      }
+      loopback.stats.msgs_to_host++;
+      loopback.stats.msg_bytes_to_host += event->msg->header.size;
+      if (service->is_vchi)
+      {
+         /* VCHI services pick messages up with DEQUEUE_MESSAGE. Only one
+          * MESSAGE_AVAILABLE is outstanding at a time. */
+         if (service->msg_tail)
+            service->msg_tail->next = event->msg;
+         else
+            service->msg_head = event->msg;
+         service->msg_tail = event->msg;
+         pthread_cond_broadcast(&loopback.host_cond);
+
+         if (!service->msg_available)
+         {
+            service->msg_available = 1;
+            loopback_complete(VCHIQ_MESSAGE_AVAILABLE, service, service->service_userdata, NULL, NULL);
+         }
+      }
+      else
+      {
+         loopback_complete(VCHIQ_MESSAGE_AVAILABLE, service, service->service_userdata, event->msg, NULL);
+      }
+      break;
+
+   case EVENT_BULK_TO_HOST:
+      if (!live)
+      {
+         free(event->msg);
+      }
+      else if (service->rx_head)
+      {
+         LOOPBACK_BULK_T *bulk = service->rx_head;
+         if (!(service->rx_head = bulk->next))
+            service->rx_tail = NULL;
+         loopback_bulk_receive_done(service, bulk, event->msg);
+      }
+      else
+      {
+         if (service->data_tail)
+            service->data_tail->next = event->msg;
+         else
+            service->data_head = event->msg;
+         service->data_tail = event->msg;
+      }
+      break;
+
+   case EVENT_BULK_SENT:
+      if (live && service->opened)
+         LOOPBACK_CALL(service, bulk_sent,
+            event->msg->header.msgid == LOOPBACK_BULK_ABORTED ? 0 : event->msg->header.size);
+      free(event->msg);
+      break;
+   }
+
+   free(event);
+}
+
+static void *
+loopback_remote_thread(void *arg)
+{
+   vcos_unused(arg);
+
+   pthread_mutex_lock(&loopback.lock);
+
+   while (!loopback.stopping)
+   {
+      LOOPBACK_EVENT_T *event = loopback.events;
+      uint64_t now;
+
+      if (!event)
+      {
+         pthread_cond_wait(&loopback.remote_cond, &loopback.lock);
+         continue;
+      }
+
+      now = loopback_now();
+      if (event->due > now)
+      {
+         struct timespec ts;
+         ts.tv_sec = event->due / 1000000;
+         ts.tv_nsec = (event->due % 1000000) * 1000;
+         pthread_cond_timedwait(&loopback.remote_cond, &loopback.lock, &ts);
+         continue;
+      }
+
+      loopback.events = event->next;
+      loopback_process_event(event);
+   }
+
+   pthread_mutex_unlock(&loopback.lock);
+   return NULL;
+}
+
+/*
+ * ioctls, called with the lock held
+ */
+
+static int
+loopback_create_service(VCHIQ_CREATE_SERVICE_T *args)
+{
+   LOOPBACK_HANDLER_ENTRY_T entry = { NULL, NULL };
+   struct vchiq_loopback_service_struct *service = NULL;
+   unsigned int i;
+
+   pthread_mutex_lock(&loopback_handlers_lock);
+   for (i = 0; i < loopback_handlers_num; i++)
+   {
+      if (loopback_handlers[i].fourcc == args->params.fourcc)
+      {
+         entry = loopback_handlers[i].entry;
+         break;
+      }
+   }
+   if (i == loopback_handlers_num)
+      entry = loopback_default_handler;
+   pthread_mutex_unlock(&loopback_handlers_lock);
+
+   /* A remote server never connects to a service the host adds */
+   if (!args->is_open && entry.handler && entry.handler->server)
+      entry.handler = NULL;
+
+   if (args->is_open && !loopback.connected)
+   {
+      errno = ENOTCONN;
+      return -1;
+   }
+
+   /* Nobody at the other end to talk to */
+   if (args->is_open && !entry.handler)
+   {
+      errno = ENXIO;
+      return -1;
+   }
+
+   if (args->is_open && entry.handler->version &&
+       (args->params.version < entry.handler->version_min ||
+        args->params.version_min > entry.handler->version))
+   {
+      errno = ECONNREFUSED;
+      return -1;
+   }
+
+   for (i = 0; i < LOOPBACK_MAX_SERVICES; i++)
+   {
+      if (!loopback.services[i].in_use)
+      {
+         service = &loopback.services[i];
+         break;
+      }
+   }
+   if (!service)
+   {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   service->generation++;
+   service->handle = (service->generation * LOOPBACK_MAX_SERVICES) + i;
+   service->in_use = 1;
+   service->closed = 0;
+   service->opened = 0;
+   service->is_vchi = args->is_vchi;
+   service->fourcc = args->params.fourcc;
+   service->service_userdata = args->params.userdata;
+   service->handler = entry;
+   service->state = NULL;
+   service->callbacks = 0;
+   service->close_pending = 0;
+   service->remote_receives = 0;
+
+   if (entry.handler)
+   {
+      int ret = 0;
+
+      if (entry.handler->open)
+      {
+         service->callbacks++;
+         pthread_mutex_unlock(&loopback.lock);
+         ret = entry.handler->open(service, entry.userdata);
+         pthread_mutex_lock(&loopback.lock);
+         service->callbacks--;
+      }
+
+      if (ret)
+      {
+         service->in_use = 0;
+         errno = ECONNREFUSED;
+         return -1;
+      }
+      service->opened = 1;
+
+      /* A server learns about the client connecting */
+      if (!args->is_open)
+         loopback_complete(VCHIQ_SERVICE_OPENED, service, service->service_userdata, NULL, NULL);
+   }
+
+   args->handle = service->handle;
+   return 0;
+}
+
+static int
+loopback_queue_message(VCHIQ_QUEUE_MESSAGE_T *args)
+{
+   struct vchiq_loopback_service_struct *service = loopback_find_service(args->handle);
+   LOOPBACK_MSG_T *msg;
+   unsigned int i, size = 0;
+   char *dst;
+
+   if (!service || service->closed || !service->opened)
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   for (i = 0; i < args->count; i++)
+      size += args->elements[i].size;
+   if (size > VCHIQ_MAX_MSG_SIZE)
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   msg = loopback_msg_alloc(size);
+   if (!msg)
+   {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   for (i = 0, dst = msg->header.data; i < args->count; i++)
+   {
+      memcpy(dst, args->elements[i].data, args->elements[i].size);
+      dst += args->elements[i].size;
+   }
+
+   if (loopback_event_queue(EVENT_MSG_TO_REMOTE, service, msg, NULL, size + sizeof(VCHIQ_HEADER_T)))
+   {
+      free(msg);
+      errno = ENOMEM;
+      return -1;
+   }
+   return 0;
+}
+
+static int
+loopback_queue_bulk(VCHIQ_QUEUE_BULK_TRANSFER_T *args, int transmit)
+{
+   struct vchiq_loopback_service_struct *service = loopback_find_service(args->handle);
+   LOOPBACK_BULK_T *bulk;
+   int ret = 0;
+
+   if (!service || service->closed || !service->opened)
+   {
+      errno = EINVAL;
+      return -1;
+   }
+
+   bulk = calloc(1, sizeof(*bulk));
+   if (!bulk)
+   {
+      errno = ENOMEM;
+      return -1;
+   }
+   bulk->data = args->data;
+   bulk->size = args->size;
+   bulk->userdata = args->userdata;
+   bulk->service_userdata = service->service_userdata;
+   bulk->mode = args->mode;
+
+   if (transmit)
+   {
+      if (loopback_event_queue(EVENT_BULK_TO_REMOTE, service, NULL, bulk, bulk->size))
+      {
+         free(bulk);
+         errno = ENOMEM;
+         return -1;
+      }
+   }
+   else if (service->data_head)
+   {
+      /* The VideoCore side sent it already */
+      LOOPBACK_MSG_T *data = service->data_head;
+      if (!(service->data_head = data->next))
+         service->data_tail = NULL;
+      loopback_bulk_receive_done(service, bulk, data);
+   }
+   else
+   {
+      if (service->rx_tail)
+         service->rx_tail->next = bulk;
+      else
+         service->rx_head = bulk;
+      service->rx_tail = bulk;
+   }
+
+   if (args->mode == VCHIQ_BULK_MODE_BLOCKING)
+   {
+      while (!bulk->done)
+         pthread_cond_wait(&loopback.host_cond, &loopback.lock);
+      if (bulk->reason != VCHIQ_BULK_TRANSMIT_DONE && bulk->reason != VCHIQ_BULK_RECEIVE_DONE)
+      {
+         errno = ECONNABORTED;
+         ret = -1;
+      }
+      free(bulk);
+   }
+
+   return ret;
+}
+
+static int
+loopback_await_completion(VCHIQ_AWAIT_COMPLETION_T *args)
+{
+   unsigned int count = 0;
+
+   while (!loopback.completion_head && !loopback.shutdown)
+      pthread_cond_wait(&loopback.host_cond, &loopback.lock);
+
+   while (loopback.completion_head && count < args->count)
+   {
+      LOOPBACK_COMPLETION_T *completion = loopback.completion_head;
+      VCHIQ_COMPLETION_DATA_T *data = &args->buf[count];
+
+      data->header = NULL;
+      if (completion->msg)
+      {
+         unsigned int size = sizeof(VCHIQ_HEADER_T) + completion->msg->header.size;
+         if (!args->msgbufcount || size > args->msgbufsize)
+            break;
+         data->header = args->msgbufs[--args->msgbufcount];
+         memcpy(data->header, &completion->msg->header, size);
+         free(completion->msg);
+      }
+      else if (completion->reason == VCHIQ_MESSAGE_AVAILABLE &&
+               loopback_service_live(completion->service, completion->generation))
+      {
+         /* The next message for this VCHI service gets a new one */
+         completion->service->msg_available = 0;
+      }
+
+      data->reason = completion->reason;
+      data->service_userdata = completion->service_userdata;
+      data->bulk_userdata = completion->bulk_userdata;
+      count++;
+
+      if (!(loopback.completion_head = completion->next))
+         loopback.completion_tail = NULL;
+      loopback.completion_count--;
+      completion->next = loopback.free_completions;
+      loopback.free_completions = completion;
+   }
+
+   if (count)
+   {
+      loopback.stats.await_calls++;
+      loopback.stats.completions += count;
+   }
+   return count;
+}
+
+/* Wait for a message on a VCHI service. Returns the service or NULL with
+ * errno set. */
+static struct vchiq_loopback_service_struct *
+loopback_dequeue_wait(unsigned int handle, int blocking)
+{
+   struct vchiq_loopback_service_struct *service = loopback_find_service(handle);
+
+   if (!service || !service->is_vchi)
+   {
+      errno = EINVAL;
+      return NULL;
+   }
+
+   while (!service->msg_head && blocking && !service->closed && !loopback.shutdown)
+      pthread_cond_wait(&loopback.host_cond, &loopback.lock);
+
+   if (!service->msg_head)
+   {
+      errno = service->closed ? ENOTCONN : EWOULDBLOCK;
+      return NULL;
+   }
+   return service;
+}
+
+static void
+loopback_dequeue_pop(struct vchiq_loopback_service_struct *service)
+{
+   LOOPBACK_MSG_T *msg = service->msg_head;
+
+   if (!(service->msg_head = msg->next))
+      service->msg_tail = NULL;
+   free(msg);
+}
+
+static int
+loopback_dequeue_message(VCHIQ_DEQUEUE_MESSAGE_T *args)
+{
+   struct vchiq_loopback_service_struct *service =
+      loopback_dequeue_wait(args->handle, args->blocking);
+   int size;
+
+   if (!service)
+      return -1;
+   if (service->msg_head->header.size > args->bufsize)
+   {
+      errno = EMSGSIZE;
+      return -1;
+   }
+
+   size = service->msg_head->header.size;
+   memcpy(args->buf, service->msg_head->header.data, size);
+   loopback_dequeue_pop(service);
+
+   loopback.stats.dequeue_calls++;
+   return size;
+}
+
+static int
+loopback_dequeue_messages(VCHIQ_DEQUEUE_MESSAGES_T *args)
+{
+   struct vchiq_loopback_service_struct *service =
+      loopback_dequeue_wait(args->handle, args->blocking);
+   unsigned int count = 0, pos = 0;
+
+   if (!service)
+      return -1;
+
+   while (service->msg_head && count < args->count)
+   {
+      unsigned int size = service->msg_head->header.size;
+
+      if (pos + VCHIQ_DEQUEUE_MSG_SPACE(size) > args->bufsize)
+         break;
+      memcpy((char *)args->buf + pos, &service->msg_head->header, sizeof(VCHIQ_HEADER_T) + size);
+      pos += VCHIQ_DEQUEUE_MSG_SPACE(size);
+      loopback_dequeue_pop(service);
+      count++;
+   }
+
+   if (!count)
+   {
+      errno = EMSGSIZE;
+      return -1;
+   }
+
+   loopback.stats.dequeue_calls++;
+   return pos;
+}
+
+static int
+loopback_ioctl_locked(unsigned int request, uintptr_t arg)
+{
+   struct vchiq_loopback_service_struct *service;
+
+   switch (request)
+   {
+   case VCHIQ_IOC_CONNECT:
+      loopback.connected = 1;
+      return 0;
+
+   case VCHIQ_IOC_CLOSE_DELIVERED:
+      service = loopback_find_service((unsigned int)arg);
+      if (service && service->close_pending)
+      {
+         service->close_pending = 0;
+         pthread_cond_broadcast(&loopback.host_cond);
+      }
+      return 0;
+
+   case VCHIQ_IOC_LIB_VERSION:
+   case VCHIQ_IOC_USE_SERVICE:
+   case VCHIQ_IOC_RELEASE_SERVICE:
+   case VCHIQ_IOC_DUMP_PHYS_MEM:
+   case VCHIQ_IOC_GET_CLIENT_ID:
+      return 0;
+
+   case VCHIQ_IOC_SET_SERVICE_OPTION:
+   {
+      VCHIQ_SET_SERVICE_OPTION_T *args = (VCHIQ_SET_SERVICE_OPTION_T *)arg;
+
+      /* The options are accepted but have no effect on the loopback */
+      if (!loopback_find_service(args->handle))
+      {
+         errno = EINVAL;
+         return -1;
+      }
+      switch (args->option)
+      {
+      case VCHIQ_SERVICE_OPTION_AUTOCLOSE:
+      case VCHIQ_SERVICE_OPTION_SLOT_QUOTA:
+      case VCHIQ_SERVICE_OPTION_MESSAGE_QUOTA:
+      case VCHIQ_SERVICE_OPTION_SYNCHRONOUS:
+      case VCHIQ_SERVICE_OPTION_TRACE:
+         return 0;
+      default:
+         errno = EINVAL;
+         return -1;
+      }
+   }
+
+   case VCHIQ_IOC_SHUTDOWN:
+      loopback.shutdown = 1;
+      pthread_cond_broadcast(&loopback.host_cond);
+      return 0;
+
+   case VCHIQ_IOC_GET_CONFIG:
+   {
+      VCHIQ_GET_CONFIG_T *args = (VCHIQ_GET_CONFIG_T *)arg;
+      VCHIQ_CONFIG_T config;
+
+      /* Like the driver, refuse a caller expecting more than there is */
+      if (args->config_size > sizeof(config))
+      {
+         errno = EINVAL;
+         return -1;
+      }
+      config.max_msg_size = VCHIQ_MAX_MSG_SIZE;
+      config.bulk_threshold = VCHIQ_MAX_MSG_SIZE;
+      config.max_outstanding_bulks = VCHIQ_NUM_SERVICE_BULKS;
+      config.max_services = LOOPBACK_MAX_SERVICES;
+      config.version = VCHIQ_VERSION;
+      config.version_min = VCHIQ_VERSION_MIN;
+      memcpy(args->pconfig, &config, args->config_size);
+      return 0;
+   }
+
+   case VCHIQ_IOC_CREATE_SERVICE:
+      return loopback_create_service((VCHIQ_CREATE_SERVICE_T *)arg);
+
+   case VCHIQ_IOC_CLOSE_SERVICE:
+   case VCHIQ_IOC_REMOVE_SERVICE:
+   {
+      int was_open;
+
+      service = loopback_find_service((unsigned int)arg);
+      if (!service)
+      {
+         errno = EINVAL;
+         return -1;
+      }
+      was_open = service->opened;
+      loopback_service_close(service, 0);
+
+      /* The host hears about a connected service going, whichever way, and
+       * about any close. Like the driver, the service is kept until the
+       * callback has run so that vchiq_lib can still find it. */
+      if (was_open || request == VCHIQ_IOC_CLOSE_SERVICE)
+      {
+         loopback_complete(VCHIQ_SERVICE_CLOSED, NULL, service->service_userdata, NULL, NULL);
+         service->close_pending = loopback.connected;
+         while (service->close_pending && !loopback.shutdown)
+            pthread_cond_wait(&loopback.host_cond, &loopback.lock);
+         service->close_pending = 0;
+      }
+      service->in_use = 0;
+      return 0;
+   }
+
+   case VCHIQ_IOC_QUEUE_MESSAGE:
+      return loopback_queue_message((VCHIQ_QUEUE_MESSAGE_T *)arg);
+
+   case VCHIQ_IOC_QUEUE_BULK_TRANSMIT:
+   case VCHIQ_IOC_QUEUE_BULK_RECEIVE:
+      return loopback_queue_bulk((VCHIQ_QUEUE_BULK_TRANSFER_T *)arg,
+         request == VCHIQ_IOC_QUEUE_BULK_TRANSMIT);
+
+   case VCHIQ_IOC_AWAIT_COMPLETION:
+      return loopback_await_completion((VCHIQ_AWAIT_COMPLETION_T *)arg);
+
+   case VCHIQ_IOC_DEQUEUE_MESSAGE:
+      return loopback_dequeue_message((VCHIQ_DEQUEUE_MESSAGE_T *)arg);
+
+   case VCHIQ_IOC_DEQUEUE_MESSAGES:
+      return loopback_dequeue_messages((VCHIQ_DEQUEUE_MESSAGES_T *)arg);
+
+   default:
+      errno = ENOTTY;
+      return -1;
+   }
+}
+
+/*
+ * Transport
+ */
+
+static int
+loopback_open(void)
+{
+   pthread_condattr_t attr;
+   int fd;
+
+   pthread_mutex_lock(&loopback.lock);
+   if (loopback.fd >= 0)
+   {
+      pthread_mutex_unlock(&loopback.lock);
+      errno = EBUSY;
+      return -1;
+   }
+
+   /* Something for vchiq_lib to hold on to */
+   fd = open("/dev/null", O_RDWR);
+   if (fd < 0)
+   {
+      pthread_mutex_unlock(&loopback.lock);
+      return -1;
+   }
+
+   pthread_condattr_init(&attr);
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+   pthread_cond_init(&loopback.remote_cond, &attr);
+   pthread_condattr_destroy(&attr);
+   pthread_cond_init(&loopback.host_cond, NULL);
+
+   loopback.stopping = 0;
+   loopback.shutdown = 0;
+   loopback.connected = 0;
+   loopback.to_remote.busy_until = 0;
+   loopback.to_host.busy_until = 0;
+
+   if (pthread_create(&loopback.remote_thread, NULL, loopback_remote_thread, NULL) != 0)
+   {
+      pthread_cond_destroy(&loopback.remote_cond);
+      pthread_cond_destroy(&loopback.host_cond);
+      pthread_mutex_unlock(&loopback.lock);
+      close(fd);
+      errno = ENOMEM;
+      return -1;
+   }
+
+   loopback.fd = fd;
+   pthread_mutex_unlock(&loopback.lock);
+
+   vcos_log_info("loopback: opened, latency %uus, bandwidth %u bytes/s",
+      loopback.config.latency_us, loopback.config.bandwidth);
+   return fd;
+}
+
+static int
+loopback_close(int fd)
+{
+   unsigned int i;
+
+   pthread_mutex_lock(&loopback.lock);
+   if (fd != loopback.fd)
+   {
+      pthread_mutex_unlock(&loopback.lock);
+      errno = EBADF;
+      return -1;
+   }
+   loopback.stopping = 1;
+   pthread_cond_signal(&loopback.remote_cond);
+   pthread_mutex_unlock(&loopback.lock);
+
+   pthread_join(loopback.remote_thread, NULL);
+
+   pthread_mutex_lock(&loopback.lock);
+
+   for (i = 0; i < LOOPBACK_MAX_SERVICES; i++)
+   {
+      if (loopback.services[i].in_use)
+      {
+         loopback_service_close(&loopback.services[i], 0);
+         loopback.services[i].in_use = 0;
+      }
+   }
+
+   while (loopback.events)
+   {
+      LOOPBACK_EVENT_T *event = loopback.events;
+      loopback.events = event->next;
+      if (event->bulk)
+         loopback_bulk_complete(event->bulk, VCHIQ_BULK_TRANSMIT_ABORTED);
+      free(event->msg);
+      free(event);
+   }
+
+   while (loopback.completion_head)
+   {
+      LOOPBACK_COMPLETION_T *completion = loopback.completion_head;
+      loopback.completion_head = completion->next;
+      free(completion->msg);
+      free(completion);
+   }
+   loopback.completion_tail = NULL;
+   loopback.completion_count = 0;
+
+   while (loopback.free_completions)
+   {
+      LOOPBACK_COMPLETION_T *completion = loopback.free_completions;
+      loopback.free_completions = completion->next;
+      free(completion);
+   }
+
+   pthread_cond_destroy(&loopback.remote_cond);
+   pthread_cond_destroy(&loopback.host_cond);
+   loopback.fd = -1;
+   pthread_mutex_unlock(&loopback.lock);
+
+   return close(fd);
+}
+
+static int
+loopback_ioctl(int fd, unsigned int request, uintptr_t arg)
+{
+   int ret;
+
+   pthread_mutex_lock(&loopback.lock);
+   if (fd != loopback.fd)
+   {
+      errno = EBADF;
+      ret = -1;
+   }
+   else
+   {
+      ret = loopback_ioctl_locked(request, arg);
+   }
+   pthread_mutex_unlock(&loopback.lock);
+
+   return ret;
+}
+
+const VCHIQ_TRANSPORT_T vchiq_loopback_transport =
+{
+   "loopback",
+   loopback_open,
+   loopback_close,
+   loopback_ioctl
+};
+
+/*
+ * Built-in handlers
+ */
+
+static void
+echo_message(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size, void *userdata)
+{
+   vcos_unused(userdata);
+   vchiq_loopback_send(service, data, size);
+}
+
+static void
+echo_bulk(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size, void *userdata)
+{
+   vcos_unused(userdata);
+   vchiq_loopback_bulk_send(service, data, size);
+}
+
+const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_echo_handler =
+{
+   NULL, NULL, echo_message, echo_bulk
+};
+
+static void
+sink_message(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size, void *userdata)
+{
+   vcos_unused(service);
+   vcos_unused(data);
+   vcos_unused(size);
+   vcos_unused(userdata);
+}
+
+const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_sink_handler =
+{
+   NULL, NULL, sink_message, NULL
+};
+
+/* The vchiq_test server. The state is whether bulks are echoed. */
+static void
+test_message(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size, void *userdata)
+{
+   static const char ack = 0;
+   int magic;
+
+   vcos_unused(userdata);
+
+   if (size < sizeof(magic))
+      return;
+   memcpy(&magic, data, sizeof(magic));
+
+   switch (magic)
+   {
+   case TEST_MSG_CONFIG:
+      if (size >= TEST_CONFIG_ECHO_OFFSET + sizeof(int))
+      {
+         int echo;
+         memcpy(&echo, (const char *)data + TEST_CONFIG_ECHO_OFFSET, sizeof(echo));
+         vchiq_loopback_set_state(service, echo ? (void *)1 : NULL);
+      }
+      /* fall through */
+   case TEST_MSG_SYNC:
+      /* A one byte reply is a sync point, anything longer is an error string */
+      vchiq_loopback_send(service, &ack, sizeof(ack));
+      break;
+   case TEST_MSG_ASYNC:
+      vchiq_loopback_send(service, NULL, 0);
+      break;
+   case TEST_MSG_ECHO:
+      vchiq_loopback_send(service, data, size);
+      break;
+   default:
+      break;
+   }
+}
+
+static void
+test_bulk(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size, void *userdata)
+{
+   vcos_unused(userdata);
+   if (vchiq_loopback_get_state(service))
+      vchiq_loopback_bulk_send(service, data, size);
+}
+
+const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_test_handler =
+{
+   NULL, NULL, test_message, test_bulk
+};
+
+/* The vchiq_test functional test server, which takes two clients at most. A
+ * message is echoed and lets the server receive one bulk. It answers that
+ * with an aborted transfer followed by two copies of the data, and once the
+ * host has them sends an empty message. The state counts the bulks taken. */
+static int test_func_clients;
+
+static int
+test_func_open(VCHIQ_LOOPBACK_SERVICE_T service, void *userdata)
+{
+   vcos_unused(service);
+   vcos_unused(userdata);
+
+   if (__sync_add_and_fetch(&test_func_clients, 1) > TEST_FUNC_MAX_CLIENTS)
+   {
+      __sync_sub_and_fetch(&test_func_clients, 1);
+      return -1;
+   }
+   return 0;
+}
+
+static void
+test_func_close(VCHIQ_LOOPBACK_SERVICE_T service, void *userdata)
+{
+   vcos_unused(service);
+   vcos_unused(userdata);
+   __sync_sub_and_fetch(&test_func_clients, 1);
+}
+
+static void
+test_func_message(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size,
+   void *userdata)
+{
+   vcos_unused(userdata);
+   vchiq_loopback_send(service, data, size);
+   vchiq_loopback_bulk_receive(service);
+}
+
+static void
+test_func_bulk(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size,
+   void *userdata)
+{
+   char *twice = malloc(2 * size);
+
+   vcos_unused(userdata);
+
+   vchiq_loopback_set_state(service, NULL);
+   vchiq_loopback_bulk_abort(service);
+   if (twice)
+   {
+      memcpy(twice, data, size);
+      memcpy(twice + size, data, size);
+      vchiq_loopback_bulk_send(service, twice, 2 * size);
+      free(twice);
+   }
+}
+
+static void
+test_func_bulk_sent(VCHIQ_LOOPBACK_SERVICE_T service, unsigned int size, void *userdata)
+{
+   uintptr_t taken = (uintptr_t)vchiq_loopback_get_state(service) + 1;
+
+   vcos_unused(size);
+   vcos_unused(userdata);
+
+   vchiq_loopback_set_state(service, (void *)taken);
+   if (taken == 2)
+      vchiq_loopback_send(service, NULL, 0);
+}
+
+const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_func_handler =
+{
+   test_func_open, test_func_close, test_func_message, test_func_bulk, test_func_bulk_sent,
+   TEST_VERSION, TEST_VERSION, 1, 1
+};
+
+/* The vchiq_test bulk data server, which sends every bulk straight back */
+const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_fun2_handler =
+{
+   NULL, NULL, sink_message, echo_bulk
+};
+
+/*
+ * Handler API
+ */
+
+int
+vchiq_loopback_get_fourcc(VCHIQ_LOOPBACK_SERVICE_T service)
+{
+   return service->fourcc;
+}
+
+void
+vchiq_loopback_set_state(VCHIQ_LOOPBACK_SERVICE_T service, void *state)
+{
+   service->state = state;
+}
+
+void *
+vchiq_loopback_get_state(VCHIQ_LOOPBACK_SERVICE_T service)
+{
+   return service->state;
+}
+
+static int
+loopback_send(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size,
+   LOOPBACK_EVENT_TYPE_T type, int msgid)
+{
+   LOOPBACK_MSG_T *msg;
+   int ret = -1;
+
+   if (type == EVENT_MSG_TO_HOST && size > VCHIQ_MAX_MSG_SIZE)
+      return -1;
+
+   msg = loopback_msg_alloc(size);
+   if (!msg)
+      return -1;
+   if (size)
+      memcpy(msg->header.data, data, size);
+   msg->header.msgid = msgid;
+
+   pthread_mutex_lock(&loopback.lock);
+   if (service->in_use && !service->closed)
+      ret = loopback_event_queue(type, service, msg, NULL,
+         type == EVENT_MSG_TO_HOST ? size + sizeof(VCHIQ_HEADER_T) : size);
+   pthread_mutex_unlock(&loopback.lock);
+
+   if (ret)
+      free(msg);
+   return ret;
+}
+
+int
+vchiq_loopback_send(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size)
+{
+   return loopback_send(service, data, size, EVENT_MSG_TO_HOST, 0);
+}
+
+int
+vchiq_loopback_bulk_send(VCHIQ_LOOPBACK_SERVICE_T service, const void *data, unsigned int size)
+{
+   return loopback_send(service, data, size, EVENT_BULK_TO_HOST, 0);
+}
+
+int
+vchiq_loopback_bulk_abort(VCHIQ_LOOPBACK_SERVICE_T service)
+{
+   return loopback_send(service, NULL, 0, EVENT_BULK_TO_HOST, LOOPBACK_BULK_ABORTED);
+}
+
+int
+vchiq_loopback_bulk_receive(VCHIQ_LOOPBACK_SERVICE_T service)
+{
+   int ret = -1;
+
+   pthread_mutex_lock(&loopback.lock);
+   if (service->in_use && !service->closed)
+   {
+      ret = 0;
+      service->remote_receives++;
+
+      /* A transmit which was waiting for this goes now */
+      if (service->tx_head)
+      {
+         LOOPBACK_EVENT_T *event = malloc(sizeof(*event));
+         if (event)
+         {
+            event->type = EVENT_BULK_TO_REMOTE;
+            event->service = service;
+            event->generation = service->generation;
+            event->msg = NULL;
+            event->bulk = service->tx_head;
+            event->due = loopback_now();
+            if (!(service->tx_head = event->bulk->next))
+               service->tx_tail = NULL;
+            loopback_event_add(event);
+         }
+         else
+         {
+            service->remote_receives--;
+            ret = -1;
+         }
+      }
+   }
+   pthread_mutex_unlock(&loopback.lock);
+
+   return ret;
+}
+
+void
+vchiq_loopback_close(VCHIQ_LOOPBACK_SERVICE_T service)
+{
+   pthread_mutex_lock(&loopback.lock);
+   if (service->in_use && !service->closed)
+   {
+      /* The handler knows about it already */
+      service->opened = 0;
+      loopback_service_close(service, 1);
+      loopback_complete(VCHIQ_SERVICE_CLOSED, NULL, service->service_userdata, NULL, NULL);
+   }
+   pthread_mutex_unlock(&loopback.lock);
+}
+
+/*
+ * Configuration
+ */
+
+int
+vchiq_loopback_register(int fourcc, const VCHIQ_LOOPBACK_HANDLER_T *handler, void *userdata)
+{
+   unsigned int i;
+   int ret = 0;
+
+   pthread_mutex_lock(&loopback_handlers_lock);
+
+   for (i = 0; i < loopback_handlers_num; i++)
+      if (loopback_handlers[i].fourcc == fourcc)
+         break;
+
+   if (i == LOOPBACK_MAX_HANDLERS)
+   {
+      ret = -1;
+   }
+   else
+   {
+      loopback_handlers[i].fourcc = fourcc;
+      loopback_handlers[i].entry.handler = handler;
+      loopback_handlers[i].entry.userdata = userdata;
+      if (i == loopback_handlers_num)
+         loopback_handlers_num++;
+   }
+
+   pthread_mutex_unlock(&loopback_handlers_lock);
+   return ret;
+}
+
+void
+vchiq_loopback_set_config(const VCHIQ_LOOPBACK_CONFIG_T *config)
+{
+   pthread_mutex_lock(&loopback.lock);
+   loopback.config = *config;
+   pthread_mutex_unlock(&loopback.lock);
+}
+
+void
+vchiq_loopback_get_config(VCHIQ_LOOPBACK_CONFIG_T *config)
+{
+   pthread_mutex_lock(&loopback.lock);
+   *config = loopback.config;
+   pthread_mutex_unlock(&loopback.lock);
+}
+
+void
+vchiq_loopback_get_stats(VCHIQ_LOOPBACK_STATS_T *stats, int reset)
+{
+   pthread_mutex_lock(&loopback.lock);
+   *stats = loopback.stats;
+   if (reset)
+      memset(&loopback.stats, 0, sizeof(loopback.stats));
+   pthread_mutex_unlock(&loopback.lock);
+}
+
+static int
+loopback_parse_handler(const char *name, const VCHIQ_LOOPBACK_HANDLER_T **handler)
+{
+   if (!strcmp(name, "echo"))
+      *handler = &vchiq_loopback_echo_handler;
+   else if (!strcmp(name, "sink"))
+      *handler = &vchiq_loopback_sink_handler;
+   else if (!strcmp(name, "test"))
+      *handler = &vchiq_loopback_test_handler;
+   else if (!strcmp(name, "reject"))
+      *handler = NULL;
+   else
+      return -1;
+   return 0;
+}
+
+static int
+loopback_load_script(const char *script)
+{
+   VCHIQ_LOOPBACK_CONFIG_T config;
+   char line[256];
+   int line_num = 0, ret = 0;
+   FILE *file = fopen(script, "r");
+
+   if (!file)
+   {
+      vcos_log_error("loopback: can't open script '%s'", script);
+      return -1;
+   }
+
+   vchiq_loopback_get_config(&config);
+
+   while (fgets(line, sizeof(line), file))
+   {
+      const VCHIQ_LOOPBACK_HANDLER_T *handler;
+      char word[32], arg1[32], arg2[32];
+      int n;
+
+      line_num++;
+      n = sscanf(line, "%31s %31s %31s", word, arg1, arg2);
+      if (n <= 0 || word[0] == '#')
+         continue;
+
+      if (!strcmp(word, "latency") && n == 2)
+      {
+         config.latency_us = strtoul(arg1, NULL, 0);
+      }
+      else if (!strcmp(word, "bandwidth") && n == 2)
+      {
+         char *end;
+         unsigned long value = strtoul(arg1, &end, 0);
+         if (*end == 'k' || *end == 'K')
+            value *= 1000;
+         else if (*end == 'M')
+            value *= 1000000;
+         config.bandwidth = value;
+      }
+      else if (!strcmp(word, "service") && n == 3 && strlen(arg1) == 4 &&
+               !loopback_parse_handler(arg2, &handler))
+      {
+         vchiq_loopback_register(VCHIQ_MAKE_FOURCC(arg1[0], arg1[1], arg1[2], arg1[3]),
+            handler, NULL);
+      }
+      else if (!strcmp(word, "default") && n == 2 && !loopback_parse_handler(arg1, &handler))
+      {
+         pthread_mutex_lock(&loopback_handlers_lock);
+         loopback_default_handler.handler = handler;
+         loopback_default_handler.userdata = NULL;
+         pthread_mutex_unlock(&loopback_handlers_lock);
+      }
+      else
+      {
+         vcos_log_error("loopback: %s:%d: can't parse '%s'", script, line_num, word);
+         ret = -1;
+      }
+   }
+
+   fclose(file);
+   vchiq_loopback_set_config(&config);
+   return ret;
+}
+
+static void
+loopback_register_default(int fourcc, const VCHIQ_LOOPBACK_HANDLER_T *handler)
+{
+   unsigned int i;
+
+   pthread_mutex_lock(&loopback_handlers_lock);
+   for (i = 0; i < loopback_handlers_num; i++)
+      if (loopback_handlers[i].fourcc == fourcc)
+         break;
+   pthread_mutex_unlock(&loopback_handlers_lock);
+   if (i == loopback_handlers_num)
+      vchiq_loopback_register(fourcc, handler, NULL);
+}
+
+int
+vchiq_loopback_enable(const char *script)
+{
+   vcos_global_lock();
+   if (!loopback_log_registered)
+   {
+      vcos_log_set_level(&vchiq_loopback_log_category, VCOS_LOG_WARN);
+      vcos_log_register("vchiq_loopback", &vchiq_loopback_log_category);
+      loopback_log_registered = 1;
+   }
+   vcos_global_unlock();
+
+   /* vchiq_test's services, unless they are taken already */
+   loopback_register_default(VCHIQ_MAKE_FOURCC('e','c','h','o'), &vchiq_loopback_test_handler);
+   loopback_register_default(TEST_FUNC_FOURCC, &vchiq_loopback_func_handler);
+   loopback_register_default(TEST_FUN2_FOURCC, &vchiq_loopback_fun2_handler);
+
+   if (script && *script && strcmp(script, "1") && loopback_load_script(script))
+      return -1;
+
+   vchiq_set_transport(&vchiq_loopback_transport);
+   return 0;
+}
@@ -0,0 +1,173 @@
+/*
+Copyright (c) 2012-2014, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VCHIQ_LOOPBACK_H
+#define VCHIQ_LOOPBACK_H
+
+#include <stdint.h>
+#include "vchiq_if.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Transport used by vchiq_lib to reach the driver. The default one opens
+ * /dev/vchiq and uses the real ioctls.
+ */
+
+typedef struct vchiq_transport_struct {
+   const char *name;
+   int (*open)(void);
+   int (*close)(int fd);
+   int (*ioctl)(int fd, unsigned int request, uintptr_t arg);
+} VCHIQ_TRANSPORT_T;
+
+/* Select the transport used by the next vchiq_initialise. NULL selects
+ * /dev/vchiq. Has no effect on an instance which is already open. */
+extern void vchiq_set_transport(const VCHIQ_TRANSPORT_T *transport);
+
+/*
+ * Loopback transport
+ *
+ * Emulates the driver and the VideoCore side in-process so that VCHIQ
+ * clients can be run and timed without the hardware. Messages and bulk
+ * transfers queued by the host are delivered, after the modelled link delay,
+ * to handlers registered per fourcc. Handlers run on a thread of their own
+ * which plays the part of the VideoCore, and reply through
+ * vchiq_loopback_send and vchiq_loopback_bulk_send.
+ *
+ * Setting VCHIQ_LOOPBACK in the environment selects this transport from
+ * vchiq_initialise. Its value, if not empty or "1", names a script:
+ *
+ *    # comment
+ *    latency <us>              one-way delay of every message and bulk
+ *    bandwidth <bytes/s>[k|M]  link bandwidth, 0 for unlimited
+ *    service <fourcc> <handler>
+ *    default <handler>         handler for any other fourcc
+ *
+ * where <handler> is echo, sink, test or reject. By default "echo" is served
+ * by the test handler, which speaks the vchiq_test protocol, "func" and "fun2"
+ * by the servers of vchiq_test's functional test, and everything else is
+ * rejected.
+ */
+
+extern const VCHIQ_TRANSPORT_T vchiq_loopback_transport;
+
+typedef struct vchiq_loopback_service_struct *VCHIQ_LOOPBACK_SERVICE_T;
+
+typedef struct vchiq_loopback_handler_struct {
+   /* The host opened or added the service. Non-zero refuses it. Optional. */
+   int (*open)(VCHIQ_LOOPBACK_SERVICE_T service, void *userdata);
+   /* The host closed or removed the service. Optional. */
+   void (*close)(VCHIQ_LOOPBACK_SERVICE_T service, void *userdata);
+   /* A message from the host. The data is only valid during the call. */
+   void (*message)(VCHIQ_LOOPBACK_SERVICE_T service, const void *data,
+      unsigned int size, void *userdata);
+   /* The data of a bulk transmit from the host. The transmit completes
+    * when this returns. Optional. */
+   void (*bulk)(VCHIQ_LOOPBACK_SERVICE_T service, const void *data,
+      unsigned int size, void *userdata);
+   /* A bulk sent by the handler has been taken by a receive on the host,
+    * size 0 for an abort. Optional. */
+   void (*bulk_sent)(VCHIQ_LOOPBACK_SERVICE_T service, unsigned int size,
+      void *userdata);
+   /* Versions of the VideoCore side. Opens by a host whose range doesn't
+    * overlap are refused. 0 accepts any. */
+   short version;
+   short version_min;
+   /* The VideoCore side only serves, so nothing connects to a service of
+    * this fourcc added by the host. */
+   int server;
+   /* Bulk transmits from the host wait for vchiq_loopback_bulk_receive,
+    * rather than being taken as they arrive. */
+   int receive_on_request;
+} VCHIQ_LOOPBACK_HANDLER_T;
+
+/* Sends everything back */
+extern const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_echo_handler;
+/* Swallows everything */
+extern const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_sink_handler;
+/* Server side of the vchiq_test echo service */
+extern const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_test_handler;
+/* Server side of the vchiq_test functional test services */
+extern const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_func_handler;
+extern const VCHIQ_LOOPBACK_HANDLER_T vchiq_loopback_fun2_handler;
+
+typedef struct vchiq_loopback_config_struct {
+   uint32_t latency_us;    /* One-way delay of every message and bulk */
+   uint32_t bandwidth;     /* Bytes per second in each direction, 0 for unlimited */
+} VCHIQ_LOOPBACK_CONFIG_T;
+
+typedef struct vchiq_loopback_stats_struct {
+   uint32_t msgs_to_remote;
+   uint32_t msgs_to_host;
+   uint64_t msg_bytes_to_remote;
+   uint64_t msg_bytes_to_host;
+   uint32_t bulks_to_remote;
+   uint32_t bulks_to_host;
+   uint64_t bulk_bytes_to_remote;
+   uint64_t bulk_bytes_to_host;
+   uint32_t completions;         /* Completions handed to the completion thread */
+   uint32_t await_calls;         /* AWAIT_COMPLETION calls which returned some */
+   uint32_t dequeue_calls;       /* DEQUEUE_MESSAGE(S) calls which returned messages */
+   uint32_t max_completions;     /* Largest completion backlog seen */
+} VCHIQ_LOOPBACK_STATS_T;
+
+/* Select the loopback transport, optionally loading a script.
+ * Returns 0 on success. */
+extern int vchiq_loopback_enable(const char *script);
+
+/* Register the handler for a fourcc, replacing any existing one. A NULL
+ * handler makes opens of the service fail. */
+extern int vchiq_loopback_register(int fourcc, const VCHIQ_LOOPBACK_HANDLER_T *handler,
+   void *userdata);
+
+extern void vchiq_loopback_set_config(const VCHIQ_LOOPBACK_CONFIG_T *config);
+extern void vchiq_loopback_get_config(VCHIQ_LOOPBACK_CONFIG_T *config);
+extern void vchiq_loopback_get_stats(VCHIQ_LOOPBACK_STATS_T *stats, int reset);
+
+/* For use by handlers */
+extern int vchiq_loopback_get_fourcc(VCHIQ_LOOPBACK_SERVICE_T service);
+extern void vchiq_loopback_set_state(VCHIQ_LOOPBACK_SERVICE_T service, void *state);
+extern void *vchiq_loopback_get_state(VCHIQ_LOOPBACK_SERVICE_T service);
+extern int vchiq_loopback_send(VCHIQ_LOOPBACK_SERVICE_T service,
+   const void *data, unsigned int size);
+extern int vchiq_loopback_bulk_send(VCHIQ_LOOPBACK_SERVICE_T service,
+   const void *data, unsigned int size);
+/* Pair the host's next bulk receive with an aborted transfer */
+extern int vchiq_loopback_bulk_abort(VCHIQ_LOOPBACK_SERVICE_T service);
+/* Take the next bulk transmit from the host, for receive_on_request handlers */
+extern int vchiq_loopback_bulk_receive(VCHIQ_LOOPBACK_SERVICE_T service);
+/* Close the service from the VideoCore side. The close callback isn't called. */
+extern void vchiq_loopback_close(VCHIQ_LOOPBACK_SERVICE_T service);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VCHIQ_LOOPBACK_H */
@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Microbenchmark of VCOS block pool allocation with and without per-thread
+ * magazines. Every thread repeatedly allocates a few blocks and frees them
+ * again, so all threads contend on the same pool.
+ *
+ * Usage: vcos_bench_blockpool [pairs per thread] [blocks held per thread] */
+
+#include "interface/vcos/vcos.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_BLOCKS      256
+#define BENCH_BLOCK_SIZE  64
+#define BENCH_MAGAZINE    16
+#define BENCH_THREADS_MAX 8
+#define BENCH_HELD_MAX    32
+
+typedef struct BENCH_T
+{
+   VCOS_BLOCKPOOL_T pool;
+   unsigned int per_thread;
+   unsigned int held;
+   uint32_t failed;
+} BENCH_T;
+
+static void *bench_thread(void *arg)
+{
+   BENCH_T *bench = (BENCH_T *)arg;
+   void *blocks[BENCH_HELD_MAX];
+   unsigned int done = 0, i;
+
+   while (done < bench->per_thread)
+   {
+      for (i = 0; i < bench->held; i++)
+      {
+         blocks[i] = vcos_blockpool_alloc(&bench->pool);
+         if (!blocks[i])
+            __atomic_fetch_add(&bench->failed, 1, __ATOMIC_RELAXED);
+         else
+            *(unsigned int *)blocks[i] = done;
+      }
+      for (i = 0; i < bench->held; i++)
+         vcos_blockpool_free(blocks[i]);
+      done += bench->held;
+   }
+   return NULL;
+}
+
+static int bench_run(unsigned int magazine, unsigned int threads,
+   unsigned int per_thread, unsigned int held)
+{
+   VCOS_THREAD_T thread[BENCH_THREADS_MAX];
+   BENCH_T bench;
+   uint64_t start, elapsed;
+   unsigned int i;
+   void *ret;
+
+   if (vcos_blockpool_create_on_heap(&bench.pool, BENCH_BLOCKS, BENCH_BLOCK_SIZE,
+          VCOS_BLOCKPOOL_ALIGN_DEFAULT, VCOS_BLOCKPOOL_FLAG_NONE, "bench") != VCOS_SUCCESS ||
+       vcos_blockpool_set_magazines(&bench.pool, magazine) != VCOS_SUCCESS)
+   {
+      fprintf(stderr, "failed to create pool\n");
+      return -1;
+   }
+   bench.per_thread = per_thread;
+   bench.held = held;
+   bench.failed = 0;
+
+   start = vcos_getmicrosecs64();
+   for (i = 0; i < threads; i++)
+      vcos_thread_create(&thread[i], "bench", NULL, bench_thread, &bench);
+   for (i = 0; i < threads; i++)
+      vcos_thread_join(&thread[i], &ret);
+   elapsed = vcos_getmicrosecs64() - start;
+
+   printf("%-9s %u threads held %2u: %10.0f pairs/s (%u failed, %u available)\n",
+          magazine ? "magazines" : "mutex", threads, held,
+          elapsed ? per_thread * threads * 1000000.0 / elapsed : 0.0,
+          bench.failed, vcos_blockpool_available_count(&bench.pool));
+
+   vcos_blockpool_delete(&bench.pool);
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   static const unsigned int threads[] = {1, 2, 4, 8};
+   unsigned int per_thread = argc > 1 ? atoi(argv[1]) : 1000000;
+   unsigned int held = argc > 2 ? atoi(argv[2]) : 1;
+   unsigned int i;
+
+   if (!per_thread || !held || held > BENCH_HELD_MAX)
+   {
+      fprintf(stderr, "usage: %s [pairs per thread] [blocks held per thread (1-%i)]\n",
+              argv[0], BENCH_HELD_MAX);
+      return -1;
+   }
+
+   vcos_init();
+
+   for (i = 0; i < vcos_countof(threads); i++)
+   {
+      if (bench_run(0, threads[i], per_thread, held) ||
+          bench_run(BENCH_MAGAZINE, threads[i], per_thread, held))
+         return -1;
+   }
+
+   vcos_deinit();
+   return 0;
+}
@@ -83,8 +83,6 @@ static void vcos_generic_blockpool_subpool_init(
    VCOS_BLOCKPOOL_HEADER_T *block;
    VCOS_BLOCKPOOL_HEADER_T *end;
 
-   vcos_unused(flags);
-
    vcos_log_trace(
          "%s: pool %p subpool %p mem %p pool_size %d " \
          "num_blocks %d align %d flags %x",
@@ -116,6 +114,7 @@ static void vcos_generic_blockpool_subpool_init(
    subpool->available_blocks = num_blocks;
    subpool->free_list = NULL;
    subpool->owner = pool;
+   subpool->flags = flags;
 
    /* Initialise to a predictable bit pattern unless the pool is so big
     * that the delay would be noticeable. */
@@ -135,6 +134,7 @@ static void vcos_generic_blockpool_subpool_init(
       block = (VCOS_BLOCKPOOL_HEADER_T*)((char*) block + pool->block_size);
    }
 
+   pool->free_subpools |= 1 << (subpool - pool->subpools);
 }
 
 VCOS_STATUS_T vcos_generic_blockpool_init(VCOS_BLOCKPOOL_T *pool,
@@ -192,6 +192,11 @@ VCOS_STATUS_T vcos_generic_blockpool_init(VCOS_BLOCKPOOL_T *pool,
    pool->num_extension_blocks = 0;
    pool->align = align;
    memset(pool->subpools, 0, sizeof(pool->subpools));
+   pool->free_subpools = 0;
+   pool->magazine_size = 0;
+   pool->slots = NULL;
+   pool->full_magazines = NULL;
+   pool->empty_magazines = NULL;
 
    vcos_generic_blockpool_subpool_init(pool, &pool->subpools[0], start,
          pool_size, num_blocks, align, VCOS_BLOCKPOOL_SUBPOOL_FLAG_NONE);
@@ -261,26 +266,48 @@ VCOS_STATUS_T vcos_generic_blockpool_extend(VCOS_BLOCKPOOL_T *pool,
    return VCOS_SUCCESS;
 }
 
-void *vcos_generic_blockpool_alloc(VCOS_BLOCKPOOL_T *pool)
+VCOS_STATUS_T vcos_generic_blockpool_set_magazines(VCOS_BLOCKPOOL_T *pool,
+      VCOS_UNSIGNED magazine_size)
+{
+   VCOS_STATUS_T status;
+   ASSERT_POOL(pool);
+
+   vcos_log_trace("%s: pool %p magazine_size %d",
+         VCOS_FUNCTION, pool, magazine_size);
+
+   /* Magazines may only be set up once */
+   if (pool->magazine_size)
+      return VCOS_EACCESS;
+
+   if (magazine_size > VCOS_BLOCKPOOL_MAGAZINE_SIZE_MAX)
+      return VCOS_EINVAL;
+
+   if (! magazine_size)
+      return VCOS_SUCCESS;
+
+   status = vcos_tls_create(&pool->magazine_key);
+   if (status != VCOS_SUCCESS)
+      return status;
+
+   pool->magazine_size = magazine_size;
+   return VCOS_SUCCESS;
+}
+
+/* Takes a block from the first subpool with free blocks, creating a new
+ * extension subpool if they are all full and extend is set. Called with the
+ * pool mutex held. */
+static VCOS_BLOCKPOOL_HEADER_T *vcos_generic_blockpool_take(
+      VCOS_BLOCKPOOL_T *pool, int extend)
 {
    VCOS_UNSIGNED i;
-   void* ret = NULL;
    VCOS_BLOCKPOOL_SUBPOOL_T *subpool = NULL;
+   VCOS_BLOCKPOOL_HEADER_T* nb;
 
-   ASSERT_POOL(pool);
-   vcos_mutex_lock(&pool->mutex);
+   /* The main pool has the lowest bit so it is preferred */
+   if (pool->free_subpools)
+      subpool = &pool->subpools[__builtin_ctz(pool->free_subpools)];
 
-   /* Starting with the main pool try and find a free block */
-   for (i = 0; i < pool->num_subpools; ++i)
-   {
-      if (pool->subpools[i].start && pool->subpools[i].available_blocks > 0)
-      {
-         subpool = &pool->subpools[i];
-         break; /* Found a subpool with free blocks */
-      }
-   }
-
-   if (! subpool)
+   if (! subpool && extend)
    {
       /* All current subpools are full, try to allocate a new one */
       for (i = 1; i < pool->num_subpools; ++i)
@@ -310,32 +337,229 @@ void *vcos_generic_blockpool_alloc(VCOS_BLOCKPOOL_T *pool)
       }
    }
 
-   if (subpool)
+   if (! subpool)
+      return NULL;
+
+   /* Remove from free list */
+   nb = subpool->free_list;
+   vcos_assert(subpool->free_list);
+   subpool->free_list = nb->owner.next;
+
+   /* Owner is pool so free can be called without passing pool
+    * as a parameter */
+   nb->owner.subpool = subpool;
+
+   if (--(subpool->available_blocks) == 0)
+      pool->free_subpools &= ~(1 << (subpool - pool->subpools));
+
+   vcos_assert((void *) (nb + 1) > subpool->start);
+   vcos_assert((void *) (nb + 1) < subpool->end);
+   return nb;
+}
+
+/* Returns a block to its subpool, freeing the subpool if it is an extension
+ * which is now unused. Called with the pool mutex held. */
+static void vcos_generic_blockpool_put(VCOS_BLOCKPOOL_T *pool,
+      VCOS_BLOCKPOOL_SUBPOOL_T *subpool, VCOS_BLOCKPOOL_HEADER_T *hdr)
+{
+   vcos_assert((unsigned) subpool->available_blocks < subpool->num_blocks);
+
+   /* Change ownership of block to be the free list */
+   hdr->owner.next = subpool->free_list;
+   subpool->free_list = hdr;
+   if (++(subpool->available_blocks) == 1)
+      pool->free_subpools |= 1 << (subpool - pool->subpools);
+
+   if (VCOS_BLOCKPOOL_OVERWRITE_ON_FREE)
+      memset(hdr + 1, 0xBD, pool->block_data_size); /* For debugging */
+
+   if ( (subpool->flags & VCOS_BLOCKPOOL_SUBPOOL_FLAG_EXTENSION) &&
+         subpool->available_blocks == subpool->num_blocks)
    {
-      /* Remove from free list */
-      VCOS_BLOCKPOOL_HEADER_T* nb = subpool->free_list;
+      VCOS_BLOCKPOOL_DEBUG_LOG("%s: freeing subpool %p mem %p", VCOS_FUNCTION,
+            subpool, subpool->mem);
+      /* Free the sub-pool if it was dynamically allocated */
+      vcos_free(subpool->mem);
+      subpool->mem = NULL;
+      subpool->start = NULL;
+      pool->free_subpools &= ~(1 << (subpool - pool->subpools));
+   }
+}
 
-      vcos_assert(subpool->free_list);
-      subpool->free_list = nb->owner.next;
+/* Gets the calling thread's slot, creating it if needed */
+static VCOS_BLOCKPOOL_SLOT_T *vcos_generic_blockpool_slot(
+      VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_BLOCKPOOL_SLOT_T *slot = vcos_tls_get(pool->magazine_key);
 
-      /* Owner is pool so free can be called without passing pool
-       * as a parameter */
-      nb->owner.subpool = subpool;
+   if (slot)
+      return slot;
 
-      ret = nb + 1; /* Return pointer to block data */
-      --(subpool->available_blocks);
+   slot = vcos_calloc(1, sizeof(*slot), "vcos blockpool slot");
+   if (! slot)
+      return NULL;
+   if (vcos_tls_set(pool->magazine_key, slot) != VCOS_SUCCESS)
+   {
+      vcos_free(slot);
+      return NULL;
    }
+
+   vcos_mutex_lock(&pool->mutex);
+   slot->next = pool->slots;
+   pool->slots = slot;
    vcos_mutex_unlock(&pool->mutex);
-   VCOS_BLOCKPOOL_DEBUG_LOG("pool %p subpool %p ret %p", pool, subpool, ret);
+   return slot;
+}
 
-   if (ret)
+/* Gets an empty magazine from the depot or the heap. Called with the pool
+ * mutex held. */
+static VCOS_BLOCKPOOL_MAGAZINE_T *vcos_generic_blockpool_empty_magazine(
+      VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_BLOCKPOOL_MAGAZINE_T *magazine = pool->empty_magazines;
+
+   if (magazine)
    {
-      vcos_assert(ret > subpool->start);
-      vcos_assert(ret < subpool->end);
+      pool->empty_magazines = magazine->next;
+      return magazine;
+   }
+
+   magazine = vcos_malloc(sizeof(*magazine) + (pool->magazine_size - 1) *
+         sizeof(magazine->blocks[0]), "vcos blockpool magazine");
+   if (magazine)
+      magazine->count = 0;
+   return magazine;
+}
+
+/* Puts a magazine which is no longer loaded back into the depot. Called
+ * with the pool mutex held. */
+static void vcos_generic_blockpool_unload(VCOS_BLOCKPOOL_T *pool,
+      VCOS_BLOCKPOOL_MAGAZINE_T *magazine)
+{
+   VCOS_BLOCKPOOL_MAGAZINE_T **depot = magazine->count ?
+      &pool->full_magazines : &pool->empty_magazines;
+
+   magazine->next = *depot;
+   *depot = magazine;
+}
+
+/* Takes a block out of the magazine loaded by another thread. Called with
+ * the pool mutex held, when the depot and the subpools are empty, before
+ * the pool is extended. */
+static VCOS_BLOCKPOOL_HEADER_T *vcos_generic_blockpool_steal(
+      VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_BLOCKPOOL_HEADER_T *hdr = NULL;
+   VCOS_BLOCKPOOL_SLOT_T *slot;
+
+   for (slot = pool->slots; slot && ! hdr; slot = slot->next)
+   {
+      VCOS_BLOCKPOOL_MAGAZINE_T *magazine;
+
+      if (! __atomic_load_n(&slot->loaded, __ATOMIC_RELAXED))
+         continue;
+
+      /* The owner finds its slot empty and falls back to the depot */
+      magazine = __atomic_exchange_n(&slot->loaded, NULL, __ATOMIC_ACQUIRE);
+      if (! magazine)
+         continue;
+
+      if (magazine->count)
+         hdr = magazine->blocks[--magazine->count];
+      vcos_generic_blockpool_unload(pool, magazine);
+   }
+   return hdr;
+}
+
+/* Number of blocks held in magazines. Called with the pool mutex held. */
+static VCOS_UNSIGNED vcos_generic_blockpool_magazine_count(
+      VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_BLOCKPOOL_MAGAZINE_T *magazine;
+   VCOS_BLOCKPOOL_SLOT_T *slot;
+   VCOS_UNSIGNED ret = 0;
+
+   for (magazine = pool->full_magazines; magazine; magazine = magazine->next)
+      ret += magazine->count;
+
+   /* A magazine which is in use by its thread is missed but the count
+    * can't be exact while other threads are using the pool anyway. */
+   for (slot = pool->slots; slot; slot = slot->next)
+   {
+      magazine = __atomic_load_n(&slot->loaded, __ATOMIC_ACQUIRE);
+      if (magazine)
+         ret += __atomic_load_n(&magazine->count, __ATOMIC_RELAXED);
    }
    return ret;
 }
 
+void *vcos_generic_blockpool_alloc(VCOS_BLOCKPOOL_T *pool)
+{
+   VCOS_BLOCKPOOL_HEADER_T *hdr;
+   VCOS_BLOCKPOOL_SLOT_T *slot = NULL;
+   VCOS_BLOCKPOOL_MAGAZINE_T *magazine = NULL;
+
+   ASSERT_POOL(pool);
+
+   if (pool->magazine_size)
+   {
+      /* Only this thread loads its slot and other threads only empty it, so
+       * the exchange reads back this thread's own store and needs no
+       * barrier. The stores loading the slot release the magazine. */
+      slot = vcos_generic_blockpool_slot(pool);
+      magazine = slot ?
+         __atomic_exchange_n(&slot->loaded, NULL, __ATOMIC_RELAXED) : NULL;
+
+      if (magazine && magazine->count)
+      {
+         /* Fast path. Magazines only hold blocks from the main pool. */
+         hdr = magazine->blocks[magazine->count - 1];
+         __atomic_store_n(&magazine->count, magazine->count - 1, __ATOMIC_RELAXED);
+         __atomic_store_n(&slot->loaded, magazine, __ATOMIC_RELEASE);
+
+         hdr->owner.subpool = &pool->subpools[0];
+         VCOS_BLOCKPOOL_DEBUG_LOG("pool %p magazine %p ret %p", pool, magazine, hdr + 1);
+         return hdr + 1;
+      }
+   }
+
+   vcos_mutex_lock(&pool->mutex);
+
+   if (slot && pool->full_magazines)
+   {
+      /* Swap the empty magazine for a full one */
+      VCOS_BLOCKPOOL_MAGAZINE_T *full = pool->full_magazines;
+      pool->full_magazines = full->next;
+      if (magazine)
+         vcos_generic_blockpool_unload(pool, magazine);
+
+      hdr = full->blocks[--full->count];
+      hdr->owner.subpool = &pool->subpools[0];
+      __atomic_store_n(&slot->loaded, full, __ATOMIC_RELEASE);
+   }
+   else
+   {
+      if (magazine)
+         __atomic_store_n(&slot->loaded, magazine, __ATOMIC_RELEASE);
+
+      /* Blocks cached by other threads are used before extending */
+      hdr = vcos_generic_blockpool_take(pool, ! pool->magazine_size);
+      if (! hdr && pool->magazine_size)
+      {
+         hdr = vcos_generic_blockpool_steal(pool);
+         if (hdr)
+            hdr->owner.subpool = &pool->subpools[0];
+         else
+            hdr = vcos_generic_blockpool_take(pool, 1);
+      }
+   }
+
+   vcos_mutex_unlock(&pool->mutex);
+   VCOS_BLOCKPOOL_DEBUG_LOG("pool %p ret %p", pool, hdr ? hdr + 1 : NULL);
+
+   return hdr ? hdr + 1 : NULL;
+}
+
 void *vcos_generic_blockpool_calloc(VCOS_BLOCKPOOL_T *pool)
 {
    void* ret = vcos_generic_blockpool_alloc(pool);
@@ -352,31 +576,56 @@ void vcos_generic_blockpool_free(void *block)
       VCOS_BLOCKPOOL_HEADER_T* hdr = (VCOS_BLOCKPOOL_HEADER_T*) block - 1;
       VCOS_BLOCKPOOL_SUBPOOL_T *subpool = hdr->owner.subpool;
       VCOS_BLOCKPOOL_T *pool = NULL;
+      VCOS_BLOCKPOOL_SLOT_T *slot = NULL;
+      VCOS_BLOCKPOOL_MAGAZINE_T *magazine = NULL;
 
       ASSERT_SUBPOOL(subpool);
       pool = subpool->owner;
       ASSERT_POOL(pool);
 
-      vcos_mutex_lock(&pool->mutex);
-      vcos_assert((unsigned) subpool->available_blocks < subpool->num_blocks);
+      /* Blocks from extension subpools aren't cached so that the subpools
+       * can be released as soon as they are unused */
+      if (pool->magazine_size && subpool == &pool->subpools[0])
+      {
+         slot = vcos_generic_blockpool_slot(pool);
+         magazine = slot ?
+            __atomic_exchange_n(&slot->loaded, NULL, __ATOMIC_RELAXED) : NULL;
 
-      /* Change ownership of block to be the free list */
-      hdr->owner.next = subpool->free_list;
-      subpool->free_list = hdr;
-      ++(subpool->available_blocks);
+         /* Blocks in magazines aren't owned by the subpool so handle
+          * validation sees them as free. */
+         hdr->owner.next = NULL;
+         if (VCOS_BLOCKPOOL_OVERWRITE_ON_FREE)
+            memset(block, 0xBD, pool->block_data_size); /* For debugging */
 
-      if (VCOS_BLOCKPOOL_OVERWRITE_ON_FREE)
-         memset(block, 0xBD, pool->block_data_size); /* For debugging */
+         if (magazine && magazine->count < pool->magazine_size)
+         {
+            /* Fast path */
+            magazine->blocks[magazine->count] = hdr;
+            __atomic_store_n(&magazine->count, magazine->count + 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&slot->loaded, magazine, __ATOMIC_RELEASE);
+            return;
+         }
+      }
+
+      vcos_mutex_lock(&pool->mutex);
+
+      if (slot)
+      {
+         /* Swap the full magazine for an empty one */
+         if (magazine)
+            vcos_generic_blockpool_unload(pool, magazine);
+         magazine = vcos_generic_blockpool_empty_magazine(pool);
+      }
 
-      if ( (subpool->flags & VCOS_BLOCKPOOL_SUBPOOL_FLAG_EXTENSION) &&
-            subpool->available_blocks == subpool->num_blocks)
+      if (magazine)
       {
-         VCOS_BLOCKPOOL_DEBUG_LOG("%s: freeing subpool %p mem %p", VCOS_FUNCTION,
-               subpool, subpool->mem);
-         /* Free the sub-pool if it was dynamically allocated */
-         vcos_free(subpool->mem);
-         subpool->mem = NULL;
-         subpool->start = NULL;
+         magazine->blocks[0] = hdr;
+         magazine->count = 1;
+         __atomic_store_n(&slot->loaded, magazine, __ATOMIC_RELEASE);
+      }
+      else
+      {
+         vcos_generic_blockpool_put(pool, subpool, hdr);
       }
       vcos_mutex_unlock(&pool->mutex);
    }
@@ -400,6 +649,8 @@ VCOS_UNSIGNED vcos_generic_blockpool_available_count(VCOS_BLOCKPOOL_T *pool)
       else
          ret += pool->num_extension_blocks;
    }
+   if (pool->magazine_size)
+      ret += vcos_generic_blockpool_magazine_count(pool);
    vcos_mutex_unlock(&pool->mutex);
    return ret;
 }
@@ -419,6 +670,11 @@ VCOS_UNSIGNED vcos_generic_blockpool_used_count(VCOS_BLOCKPOOL_T *pool)
       if (subpool->start)
          ret += (subpool->num_blocks - subpool->available_blocks);
    }
+   if (pool->magazine_size)
+   {
+      VCOS_UNSIGNED cached = vcos_generic_blockpool_magazine_count(pool);
+      ret = cached < ret ? ret - cached : 0;
+   }
    vcos_mutex_unlock(&pool->mutex);
    return ret;
 }
@@ -450,6 +706,30 @@ void vcos_generic_blockpool_delete(VCOS_BLOCKPOOL_T *pool)
             subpool->start = NULL;
          }
       }
+      if (pool->magazine_size)
+      {
+         VCOS_BLOCKPOOL_MAGAZINE_T *magazine;
+
+         while (pool->slots)
+         {
+            VCOS_BLOCKPOOL_SLOT_T *slot = pool->slots;
+            pool->slots = slot->next;
+            if (slot->loaded)
+               vcos_free(slot->loaded);
+            vcos_free(slot);
+         }
+         while ((magazine = pool->full_magazines) != NULL)
+         {
+            pool->full_magazines = magazine->next;
+            vcos_free(magazine);
+         }
+         while ((magazine = pool->empty_magazines) != NULL)
+         {
+            pool->empty_magazines = magazine->next;
+            vcos_free(magazine);
+         }
+         vcos_tls_delete(pool->magazine_key);
+      }
       vcos_mutex_delete(&pool->mutex);
       memset(pool, 0xBE, sizeof(VCOS_BLOCKPOOL_T)); /* For debugging */
    }
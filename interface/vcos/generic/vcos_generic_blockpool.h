@@ -68,6 +68,7 @@ extern "C" {
 
 #define VCOS_BLOCKPOOL_INVALID_HANDLE 0
 #define VCOS_BLOCKPOOL_ALIGN_DEFAULT sizeof(unsigned long)
+#define VCOS_BLOCKPOOL_MAGAZINE_SIZE_MAX 64
 #define VCOS_BLOCKPOOL_FLAG_NONE 0
 
 typedef struct VCOS_BLOCKPOOL_HEADER_TAG
@@ -102,6 +103,28 @@ typedef struct VCOS_BLOCKPOOL_SUBPOOL_TAG
    uint32_t flags;
 } VCOS_BLOCKPOOL_SUBPOOL_T;
 
+/** A magazine of free blocks. Magazines are loaded into per-thread slots
+ * so that blocks can be allocated and freed without taking the pool mutex.
+ * Full and empty magazines which aren't loaded are kept in the pool's depot.
+ */
+typedef struct VCOS_BLOCKPOOL_MAGAZINE_TAG
+{
+   /* Next magazine in the depot */
+   struct VCOS_BLOCKPOOL_MAGAZINE_TAG *next;
+   /** Number of blocks in the magazine */
+   VCOS_UNSIGNED count;
+   VCOS_BLOCKPOOL_HEADER_T *blocks[1];
+} VCOS_BLOCKPOOL_MAGAZINE_T;
+
+typedef struct VCOS_BLOCKPOOL_SLOT_TAG
+{
+   /* Next slot belonging to the same pool */
+   struct VCOS_BLOCKPOOL_SLOT_TAG *next;
+   /** The magazine loaded by the thread. NULL while the thread is using it
+    * or after another thread has taken it. */
+   VCOS_BLOCKPOOL_MAGAZINE_T *loaded;
+} VCOS_BLOCKPOOL_SLOT_T;
+
 typedef struct VCOS_BLOCKPOOL_TAG
 {
    /** VCOS_BLOCKPOOL_MAGIC */
@@ -127,6 +150,17 @@ typedef struct VCOS_BLOCKPOOL_TAG
     * subpool[index.mem] is null then the subpool entry is valid but
     * "not currently allocated" */
    VCOS_BLOCKPOOL_SUBPOOL_T subpools[VCOS_BLOCKPOOL_MAX_SUBPOOLS];
+   /** Bit n is set if subpool n is allocated and has available blocks */
+   uint32_t free_subpools;
+   /** Number of blocks per magazine, zero if magazines are disabled */
+   VCOS_UNSIGNED magazine_size;
+   /** Key to the calling thread's slot */
+   VCOS_TLS_KEY_T magazine_key;
+   /** All the slots created for this pool */
+   VCOS_BLOCKPOOL_SLOT_T *slots;
+   /** Depot of magazines which aren't loaded */
+   VCOS_BLOCKPOOL_MAGAZINE_T *full_magazines;
+   VCOS_BLOCKPOOL_MAGAZINE_T *empty_magazines;
 } VCOS_BLOCKPOOL_T;
 
 #define VCOS_BLOCKPOOL_ROUND_UP(x,s)   (((x) + ((s) - 1)) & ~((s) - 1))
@@ -178,6 +212,10 @@ VCOSPRE_
    VCOS_STATUS_T VCOSPOST_ vcos_generic_blockpool_extend(VCOS_BLOCKPOOL_T *pool,
          VCOS_UNSIGNED num_extensions, VCOS_UNSIGNED num_blocks);
 
+VCOSPRE_
+   VCOS_STATUS_T VCOSPOST_ vcos_generic_blockpool_set_magazines(
+         VCOS_BLOCKPOOL_T *pool, VCOS_UNSIGNED magazine_size);
+
 VCOSPRE_ void VCOSPOST_ *vcos_generic_blockpool_alloc(VCOS_BLOCKPOOL_T *pool);
 
 VCOSPRE_ void VCOSPOST_ *vcos_generic_blockpool_calloc(VCOS_BLOCKPOOL_T *pool);
@@ -231,6 +269,13 @@ VCOS_INLINE_IMPL
     return vcos_generic_blockpool_extend(pool, num_extensions, num_blocks);
 }
 
+VCOS_INLINE_IMPL
+   VCOS_STATUS_T VCOSPOST_ vcos_blockpool_set_magazines(VCOS_BLOCKPOOL_T *pool,
+         VCOS_UNSIGNED magazine_size)
+{
+    return vcos_generic_blockpool_set_magazines(pool, magazine_size);
+}
+
 VCOS_INLINE_IMPL
 void *vcos_blockpool_alloc(VCOS_BLOCKPOOL_T *pool)
 {
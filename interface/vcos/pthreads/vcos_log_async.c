@@ -0,0 +1,722 @@
+/*
+Copyright (c) 2012, Broadcom Europe Ltd
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/*=============================================================================
+VideoCore OS Abstraction Layer - asynchronous logging back end
+=============================================================================*/
+
+/*
+ * Messages are kept in a single ring buffer shared by all the logging
+ * threads. A thread reserves space for a record by moving the head with a
+ * compare and swap, fills the record in and then commits it by writing its
+ * size. The writer thread takes committed records in order from the tail,
+ * clears the space they used and moves the tail on. A record which doesn't
+ * fit before the end of the buffer is preceded by a padding record.
+ *
+ * Threads only take the lock to wake the writer up, or to wait for space
+ * with VCOS_LOG_ASYNC_BLOCK.
+ */
+
+#include "interface/vcos/vcos.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_ASYNC_RING_SIZE_DEFAULT  (64 * 1024)
+#define LOG_ASYNC_BATCH_SIZE_DEFAULT (16 * 1024)
+#define LOG_ASYNC_WAKE_MS            100
+#define LOG_ASYNC_ARGS_MAX           16
+#define LOG_ASYNC_ALIGN(x)           (((x) + 7) & ~7)
+
+typedef enum
+{
+   LOG_ASYNC_RECORD_PAD,
+   LOG_ASYNC_RECORD_TEXT,                 /* Formatted text follows */
+   LOG_ASYNC_RECORD_BINARY,               /* Format string pointer and arguments follow */
+} LOG_ASYNC_RECORD_TYPE_T;
+
+typedef struct
+{
+   uint32_t size;                         /* Including the header. 0 until committed. */
+   uint16_t type;
+   uint16_t level;
+   const VCOS_LOG_CAT_T *cat;
+} LOG_ASYNC_RECORD_T;
+
+#define LOG_ASYNC_HEADER_SIZE LOG_ASYNC_ALIGN(sizeof(LOG_ASYNC_RECORD_T))
+
+/* Type of the argument taken by a printf conversion */
+typedef enum
+{
+   LOG_ASYNC_ARG_NONE,
+   LOG_ASYNC_ARG_INT,
+   LOG_ASYNC_ARG_LONG,
+   LOG_ASYNC_ARG_LLONG,
+   LOG_ASYNC_ARG_SIZE,
+   LOG_ASYNC_ARG_INTMAX,
+   LOG_ASYNC_ARG_PTRDIFF,
+   LOG_ASYNC_ARG_DOUBLE,
+   LOG_ASYNC_ARG_PTR,
+   LOG_ASYNC_ARG_STRING,
+   LOG_ASYNC_ARG_UNSUPPORTED,
+} LOG_ASYNC_ARG_T;
+
+static struct
+{
+   uint8_t *ring;
+   uint32_t size;
+   uint32_t head;                         /* Next byte to reserve */
+   uint32_t tail;                         /* Oldest byte not consumed by the writer */
+   uint32_t batch_size;
+   VCOS_LOG_ASYNC_POLICY_T policy;
+   int binary;
+
+   pthread_mutex_t lock;
+   pthread_cond_t wake;                   /* Records were committed, or stopping */
+   pthread_cond_t space;                  /* The writer consumed records */
+   pthread_t writer;
+   int running;
+   int quit;
+   uint32_t writer_sleeping;
+   uint32_t waiters;                      /* Threads waiting on space, or flushing */
+   uint32_t users;                        /* Threads in vcos_log_async_vlog */
+   uint32_t dropped_unreported;
+
+   VCOS_LOG_ASYNC_STATS_T stats;
+} log_async = { NULL, 0, 0, 0, 0, VCOS_LOG_ASYNC_DROP, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t log_async_once = PTHREAD_ONCE_INIT;
+static int log_async_init_failed;
+
+#define LOG_ASYNC_STATS_ADD(field, n) __atomic_fetch_add(&log_async.stats.field, n, __ATOMIC_RELAXED)
+
+static void log_async_init(void)
+{
+   pthread_condattr_t attr;
+
+   /* The writer's periodic wake up mustn't depend on the wall clock */
+   if (pthread_condattr_init(&attr) ||
+       pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) ||
+       pthread_cond_init(&log_async.wake, &attr) ||
+       pthread_cond_init(&log_async.space, NULL))
+      log_async_init_failed = 1;
+   else
+      atexit(vcos_log_async_stop);
+   pthread_condattr_destroy(&attr);
+}
+
+/* Parses the next conversion of a printf format, from *fmt which points
+ * at a '%'. Returns the type of its argument and moves *fmt past it. */
+static LOG_ASYNC_ARG_T log_async_parse_conversion(const char **fmt)
+{
+   const char *p = *fmt + 1;
+   int length = 0;   /* 'l' count, or 'z', 'j', 't', 'L' */
+   LOG_ASYNC_ARG_T arg;
+
+   while (*p && strchr("-+ #0", *p))
+      p++;
+   while (*p >= '0' && *p <= '9')
+      p++;
+   if (*p == '.')
+   {
+      p++;
+      while (*p >= '0' && *p <= '9')
+         p++;
+   }
+
+   while (*p && strchr("hlzjtLq", *p))
+   {
+      if (*p == 'l')
+         length = length == 'l' ? 'q' : 'l';
+      else if (*p != 'h')
+         length = *p;
+      p++;
+   }
+
+   switch (*p)
+   {
+   case '%':
+      arg = LOG_ASYNC_ARG_NONE;
+      break;
+   case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+      switch (length)
+      {
+      case 'l': arg = LOG_ASYNC_ARG_LONG; break;
+      case 'q': arg = LOG_ASYNC_ARG_LLONG; break;
+      case 'z': arg = LOG_ASYNC_ARG_SIZE; break;
+      case 'j': arg = LOG_ASYNC_ARG_INTMAX; break;
+      case 't': arg = LOG_ASYNC_ARG_PTRDIFF; break;
+      case 0: arg = LOG_ASYNC_ARG_INT; break;
+      default: arg = LOG_ASYNC_ARG_UNSUPPORTED; break;
+      }
+      break;
+   case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      arg = length ? LOG_ASYNC_ARG_UNSUPPORTED : LOG_ASYNC_ARG_DOUBLE;
+      break;
+   case 'p':
+      arg = LOG_ASYNC_ARG_PTR;
+      break;
+   case 's':
+      arg = length ? LOG_ASYNC_ARG_UNSUPPORTED : LOG_ASYNC_ARG_STRING;
+      break;
+   default:
+      /* '*' width or precision, %n, positional arguments, wide characters */
+      arg = LOG_ASYNC_ARG_UNSUPPORTED;
+      break;
+   }
+
+   *fmt = *p ? p + 1 : p;
+   return arg;
+}
+
+/* Returns the size needed to store the arguments of a format, or 0 if it
+ * can't be stored in binary form. */
+static uint32_t log_async_binary_size(const char *fmt, va_list args)
+{
+   uint32_t size = LOG_ASYNC_ALIGN(sizeof(const char *));
+   unsigned int count = 0;
+
+   while ((fmt = strchr(fmt, '%')) != NULL)
+   {
+      LOG_ASYNC_ARG_T arg = log_async_parse_conversion(&fmt);
+
+      if (arg == LOG_ASYNC_ARG_NONE)
+         continue;
+      if (arg == LOG_ASYNC_ARG_UNSUPPORTED || ++count > LOG_ASYNC_ARGS_MAX)
+         return 0;
+
+      size += sizeof(uint64_t);
+      switch (arg)
+      {
+      case LOG_ASYNC_ARG_INT: (void)va_arg(args, int); break;
+      case LOG_ASYNC_ARG_LONG: (void)va_arg(args, long); break;
+      case LOG_ASYNC_ARG_LLONG: (void)va_arg(args, long long); break;
+      case LOG_ASYNC_ARG_SIZE: (void)va_arg(args, size_t); break;
+      case LOG_ASYNC_ARG_INTMAX: (void)va_arg(args, intmax_t); break;
+      case LOG_ASYNC_ARG_PTRDIFF: (void)va_arg(args, ptrdiff_t); break;
+      case LOG_ASYNC_ARG_DOUBLE: (void)va_arg(args, double); break;
+      case LOG_ASYNC_ARG_PTR: (void)va_arg(args, void *); break;
+      case LOG_ASYNC_ARG_STRING:
+      {
+         const char *s = va_arg(args, const char *);
+         if (s)
+            size += LOG_ASYNC_ALIGN(vcos_min(strlen(s), VCOS_LOG_ASYNC_LINE_MAX));
+         break;
+      }
+      default:
+         break;
+      }
+   }
+
+   return size;
+}
+
+/* Stores the format string and its arguments. Strings are stored as their
+ * length (or -1 for NULL) followed by the characters. */
+static void log_async_binary_store(uint8_t *data, const char *fmt, va_list args)
+{
+   memcpy(data, &fmt, sizeof(fmt));
+   data += LOG_ASYNC_ALIGN(sizeof(const char *));
+
+   while ((fmt = strchr(fmt, '%')) != NULL)
+   {
+      LOG_ASYNC_ARG_T arg = log_async_parse_conversion(&fmt);
+      uint64_t value = 0;
+      double d;
+
+      switch (arg)
+      {
+      case LOG_ASYNC_ARG_NONE: continue;
+      case LOG_ASYNC_ARG_INT: value = (int64_t)va_arg(args, int); break;
+      case LOG_ASYNC_ARG_LONG: value = (int64_t)va_arg(args, long); break;
+      case LOG_ASYNC_ARG_LLONG: value = (int64_t)va_arg(args, long long); break;
+      case LOG_ASYNC_ARG_SIZE: value = (uint64_t)va_arg(args, size_t); break;
+      case LOG_ASYNC_ARG_INTMAX: value = (int64_t)va_arg(args, intmax_t); break;
+      case LOG_ASYNC_ARG_PTRDIFF: value = (int64_t)va_arg(args, ptrdiff_t); break;
+      case LOG_ASYNC_ARG_PTR: value = (uintptr_t)va_arg(args, void *); break;
+      case LOG_ASYNC_ARG_DOUBLE:
+         d = va_arg(args, double);
+         memcpy(&value, &d, sizeof(value));
+         break;
+      case LOG_ASYNC_ARG_STRING:
+      {
+         const char *s = va_arg(args, const char *);
+         uint64_t len = s ? vcos_min(strlen(s), VCOS_LOG_ASYNC_LINE_MAX) : (uint64_t)-1;
+         memcpy(data, &len, sizeof(len));
+         data += sizeof(len);
+         if (s)
+         {
+            memcpy(data, s, len);
+            data += LOG_ASYNC_ALIGN(len);
+         }
+         continue;
+      }
+      default:
+         break;
+      }
+      memcpy(data, &value, sizeof(value));
+      data += sizeof(value);
+   }
+}
+
+/* Formats a binary record. Returns the length of the text. */
+static size_t log_async_binary_format(char *out, size_t out_size, const uint8_t *data)
+{
+   const char *fmt, *conv;
+   char spec[32];
+   size_t len = 0;
+
+   memcpy(&fmt, data, sizeof(fmt));
+   data += LOG_ASYNC_ALIGN(sizeof(const char *));
+
+   while (*fmt && len < out_size - 1)
+   {
+      LOG_ASYNC_ARG_T arg;
+      uint64_t value;
+      double d;
+      int n = 0;
+
+      conv = strchr(fmt, '%');
+      if (!conv)
+         conv = fmt + strlen(fmt);
+      if (conv != fmt)
+      {
+         n = vcos_min((size_t)(conv - fmt), out_size - 1 - len);
+         memcpy(out + len, fmt, n);
+         len += n;
+         fmt = conv;
+         continue;
+      }
+
+      arg = log_async_parse_conversion(&fmt);
+      if (arg == LOG_ASYNC_ARG_NONE)
+      {
+         out[len++] = '%';
+         continue;
+      }
+
+      /* Format each conversion on its own, with the type it expects */
+      n = vcos_min((size_t)(fmt - conv), sizeof(spec) - 1);
+      memcpy(spec, conv, n);
+      spec[n] = '\0';
+      memcpy(&value, data, sizeof(value));
+      data += sizeof(value);
+
+      switch (arg)
+      {
+      case LOG_ASYNC_ARG_INT: n = snprintf(out + len, out_size - len, spec, (int)value); break;
+      case LOG_ASYNC_ARG_LONG: n = snprintf(out + len, out_size - len, spec, (long)value); break;
+      case LOG_ASYNC_ARG_LLONG: n = snprintf(out + len, out_size - len, spec, (long long)value); break;
+      case LOG_ASYNC_ARG_SIZE: n = snprintf(out + len, out_size - len, spec, (size_t)value); break;
+      case LOG_ASYNC_ARG_INTMAX: n = snprintf(out + len, out_size - len, spec, (intmax_t)value); break;
+      case LOG_ASYNC_ARG_PTRDIFF: n = snprintf(out + len, out_size - len, spec, (ptrdiff_t)value); break;
+      case LOG_ASYNC_ARG_PTR: n = snprintf(out + len, out_size - len, spec, (void *)(uintptr_t)value); break;
+      case LOG_ASYNC_ARG_DOUBLE:
+         memcpy(&d, &value, sizeof(d));
+         n = snprintf(out + len, out_size - len, spec, d);
+         break;
+      case LOG_ASYNC_ARG_STRING:
+         if (value == (uint64_t)-1)
+         {
+            n = snprintf(out + len, out_size - len, spec, "(null)");
+         }
+         else
+         {
+            char s[VCOS_LOG_ASYNC_LINE_MAX + 1];
+            memcpy(s, data, (size_t)value);
+            s[value] = '\0';
+            data += LOG_ASYNC_ALIGN(value);
+            n = snprintf(out + len, out_size - len, spec, s);
+         }
+         break;
+      default:
+         break;
+      }
+      if (n > 0)
+         len = vcos_min(len + n, out_size - 1);
+   }
+
+   out[len] = '\0';
+   return len;
+}
+
+/* Reserves a record of the given size. Returns NULL if the ring is full. */
+static LOG_ASYNC_RECORD_T *log_async_reserve(uint32_t size)
+{
+   uint32_t head = __atomic_load_n(&log_async.head, __ATOMIC_RELAXED);
+   uint32_t offset, pad;
+
+   do
+   {
+      uint32_t tail = __atomic_load_n(&log_async.tail, __ATOMIC_ACQUIRE);
+
+      offset = head & (log_async.size - 1);
+      pad = offset + size > log_async.size ? log_async.size - offset : 0;
+      if (head + pad + size - tail > log_async.size)
+         return NULL;
+   } while (!__atomic_compare_exchange_n(&log_async.head, &head, head + pad + size, 1,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+   if (pad)
+   {
+      LOG_ASYNC_RECORD_T *record = (LOG_ASYNC_RECORD_T *)(log_async.ring + offset);
+      record->type = LOG_ASYNC_RECORD_PAD;
+      __atomic_store_n(&record->size, pad, __ATOMIC_RELEASE);
+   }
+
+   return (LOG_ASYNC_RECORD_T *)(log_async.ring + ((head + pad) & (log_async.size - 1)));
+}
+
+static void log_async_commit(LOG_ASYNC_RECORD_T *record, uint32_t size)
+{
+   __atomic_store_n(&record->size, size, __ATOMIC_SEQ_CST);
+
+   if (__atomic_load_n(&log_async.writer_sleeping, __ATOMIC_SEQ_CST))
+   {
+      pthread_mutex_lock(&log_async.lock);
+      __atomic_store_n(&log_async.writer_sleeping, 0, __ATOMIC_SEQ_CST);
+      pthread_cond_signal(&log_async.wake);
+      pthread_mutex_unlock(&log_async.lock);
+   }
+}
+
+/* Reserves a record, waiting for space if the policy says so */
+static LOG_ASYNC_RECORD_T *log_async_reserve_wait(uint32_t size)
+{
+   LOG_ASYNC_RECORD_T *record = log_async_reserve(size);
+
+   if (record || log_async.policy != VCOS_LOG_ASYNC_BLOCK ||
+       pthread_equal(pthread_self(), log_async.writer))
+      return record;
+
+   LOG_ASYNC_STATS_ADD(blocked, 1);
+   pthread_mutex_lock(&log_async.lock);
+   __atomic_fetch_add(&log_async.waiters, 1, __ATOMIC_SEQ_CST);
+   while (!(record = log_async_reserve(size)) && !log_async.quit)
+   {
+      /* Make sure the writer is awake to make space */
+      __atomic_store_n(&log_async.writer_sleeping, 0, __ATOMIC_SEQ_CST);
+      pthread_cond_signal(&log_async.wake);
+      pthread_cond_wait(&log_async.space, &log_async.lock);
+   }
+   __atomic_fetch_sub(&log_async.waiters, 1, __ATOMIC_SEQ_CST);
+   pthread_mutex_unlock(&log_async.lock);
+   return record;
+}
+
+static void vcos_log_async_vlog(const VCOS_LOG_CAT_T *cat, VCOS_LOG_LEVEL_T _level,
+   const char *fmt, va_list args)
+{
+   LOG_ASYNC_RECORD_T *record = NULL;
+   uint32_t size = 0;
+   int binary = 0;
+   va_list ap;
+
+   __atomic_fetch_add(&log_async.users, 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&log_async.quit, __ATOMIC_SEQ_CST))
+   {
+      /* Stopping, so don't touch the ring */
+      __atomic_fetch_sub(&log_async.users, 1, __ATOMIC_SEQ_CST);
+      vcos_vlog_default_impl(cat, _level, fmt, args);
+      return;
+   }
+
+   if (log_async.binary)
+   {
+      va_copy(ap, args);
+      size = log_async_binary_size(fmt, ap);
+      va_end(ap);
+      binary = size != 0;
+   }
+
+   if (binary)
+   {
+      size = LOG_ASYNC_HEADER_SIZE + LOG_ASYNC_ALIGN(size);
+      record = log_async_reserve_wait(size);
+      if (record)
+         log_async_binary_store((uint8_t *)record + LOG_ASYNC_HEADER_SIZE, fmt, args);
+   }
+   else
+   {
+      char text[VCOS_LOG_ASYNC_LINE_MAX];
+      int len = vsnprintf(text, sizeof(text), fmt, args);
+
+      len = len < 0 ? 0 : vcos_min(len, (int)sizeof(text) - 1);
+      size = LOG_ASYNC_HEADER_SIZE + LOG_ASYNC_ALIGN(len + 1);
+      record = log_async_reserve_wait(size);
+      if (record)
+         memcpy((uint8_t *)record + LOG_ASYNC_HEADER_SIZE, text, len + 1);
+   }
+
+   if (record)
+   {
+      record->type = binary ? LOG_ASYNC_RECORD_BINARY : LOG_ASYNC_RECORD_TEXT;
+      record->level = _level;
+      record->cat = cat;
+      log_async_commit(record, size);
+      LOG_ASYNC_STATS_ADD(messages, 1);
+      if (binary)
+         LOG_ASYNC_STATS_ADD(binary, 1);
+   }
+   else
+   {
+      LOG_ASYNC_STATS_ADD(dropped, 1);
+      __atomic_fetch_add(&log_async.dropped_unreported, 1, __ATOMIC_RELAXED);
+   }
+
+   __atomic_fetch_sub(&log_async.users, 1, __ATOMIC_SEQ_CST);
+}
+
+static void log_async_write(char *batch, size_t *len)
+{
+   if (!*len)
+      return;
+   _vcos_log_platform_write(batch, *len);
+   LOG_ASYNC_STATS_ADD(writes, 1);
+   LOG_ASYNC_STATS_ADD(bytes_written, *len);
+   *len = 0;
+}
+
+/* Writes out all the committed records. Returns non-zero if any were found. */
+static int log_async_drain(char *batch)
+{
+   uint32_t tail = log_async.tail;
+   uint32_t used = __atomic_load_n(&log_async.head, __ATOMIC_RELAXED) - tail;
+   uint32_t dropped = __atomic_exchange_n(&log_async.dropped_unreported, 0, __ATOMIC_RELAXED);
+   size_t len = 0;
+   int found = 0;
+
+   if (used > log_async.stats.max_used)
+      log_async.stats.max_used = used;
+
+   if (dropped)
+      len = snprintf(batch, log_async.batch_size, "vcos_log: %u messages dropped\n", dropped);
+
+   for (;;)
+   {
+      LOG_ASYNC_RECORD_T *record = (LOG_ASYNC_RECORD_T *)(log_async.ring + (tail & (log_async.size - 1)));
+      uint32_t size = __atomic_load_n(&record->size, __ATOMIC_ACQUIRE);
+
+      if (!size)
+         break;
+
+      if (record->type != LOG_ASYNC_RECORD_PAD)
+      {
+         const uint8_t *data = (const uint8_t *)record + LOG_ASYNC_HEADER_SIZE;
+
+         /* Leave room for a whole line */
+         if (len + VCOS_LOG_ASYNC_LINE_MAX + 64 > log_async.batch_size)
+            log_async_write(batch, &len);
+
+         if (record->cat->flags.want_prefix)
+            len += snprintf(batch + len, log_async.batch_size - len, "%s: ", record->cat->name);
+         if (record->type == LOG_ASYNC_RECORD_TEXT)
+            len += snprintf(batch + len, log_async.batch_size - len, "%s", (const char *)data);
+         else
+            len += log_async_binary_format(batch + len, VCOS_LOG_ASYNC_LINE_MAX, data);
+         batch[len++] = '\n';
+      }
+
+      /* Clear the space so that it reads as uncommitted when reused */
+      memset(record, 0, size);
+      tail += size;
+      __atomic_store_n(&log_async.tail, tail, __ATOMIC_SEQ_CST);
+      found = 1;
+   }
+
+   log_async_write(batch, &len);
+
+   if (found && __atomic_load_n(&log_async.waiters, __ATOMIC_SEQ_CST))
+   {
+      pthread_mutex_lock(&log_async.lock);
+      pthread_cond_broadcast(&log_async.space);
+      pthread_mutex_unlock(&log_async.lock);
+   }
+   return found;
+}
+
+static void *log_async_writer(void *arg)
+{
+   char *batch = arg;
+
+   for (;;)
+   {
+      if (log_async_drain(batch))
+         continue;
+
+      pthread_mutex_lock(&log_async.lock);
+      if (log_async.quit)
+      {
+         pthread_mutex_unlock(&log_async.lock);
+         break;
+      }
+
+      /* Check again once producers can see we're going to sleep */
+      __atomic_store_n(&log_async.writer_sleeping, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&((LOG_ASYNC_RECORD_T *)(log_async.ring +
+             (log_async.tail & (log_async.size - 1))))->size, __ATOMIC_SEQ_CST) == 0)
+      {
+         struct timespec ts;
+
+         clock_gettime(CLOCK_MONOTONIC, &ts);
+         ts.tv_nsec += LOG_ASYNC_WAKE_MS * 1000000;
+         if (ts.tv_nsec >= 1000000000)
+         {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+         }
+         pthread_cond_timedwait(&log_async.wake, &log_async.lock, &ts);
+      }
+      __atomic_store_n(&log_async.writer_sleeping, 0, __ATOMIC_SEQ_CST);
+
+      /* Wake up anyone waiting in vcos_log_async_flush */
+      pthread_cond_broadcast(&log_async.space);
+      pthread_mutex_unlock(&log_async.lock);
+   }
+
+   log_async_drain(batch);
+   free(batch);
+   return NULL;
+}
+
+VCOS_STATUS_T vcos_log_async_start(const VCOS_LOG_ASYNC_CONFIG_T *config)
+{
+   uint32_t ring_size = config && config->ring_size ? config->ring_size : LOG_ASYNC_RING_SIZE_DEFAULT;
+   uint32_t batch_size = config && config->batch_size ? config->batch_size : LOG_ASYNC_BATCH_SIZE_DEFAULT;
+   uint32_t size = 4096;
+   char *batch;
+   int rc;
+
+   pthread_once(&log_async_once, log_async_init);
+   if (log_async_init_failed)
+      return VCOS_ENOSYS;
+   if (log_async.running)
+      return VCOS_EEXIST;
+
+   while (size < ring_size)
+      size <<= 1;
+   batch_size = vcos_max(batch_size, 2 * VCOS_LOG_ASYNC_LINE_MAX);
+
+   log_async.ring = calloc(1, size);
+   batch = malloc(batch_size);
+   if (!log_async.ring || !batch)
+   {
+      free(log_async.ring);
+      free(batch);
+      log_async.ring = NULL;
+      return VCOS_ENOMEM;
+   }
+
+   log_async.size = size;
+   log_async.head = log_async.tail = 0;
+   log_async.batch_size = batch_size;
+   log_async.policy = config ? config->policy : VCOS_LOG_ASYNC_DROP;
+   log_async.binary = config ? config->binary : 0;
+   log_async.quit = 0;
+   log_async.dropped_unreported = 0;
+   memset(&log_async.stats, 0, sizeof(log_async.stats));
+
+   rc = pthread_create(&log_async.writer, NULL, log_async_writer, batch);
+   if (rc)
+   {
+      free(log_async.ring);
+      free(batch);
+      log_async.ring = NULL;
+      return vcos_pthreads_map_error(rc);
+   }
+
+   log_async.running = 1;
+   vcos_set_vlog_impl(vcos_log_async_vlog);
+   return VCOS_SUCCESS;
+}
+
+void vcos_log_async_flush(void)
+{
+   uint32_t head = __atomic_load_n(&log_async.head, __ATOMIC_SEQ_CST);
+
+   if (!log_async.running || pthread_equal(pthread_self(), log_async.writer))
+      return;
+
+   /* As a waiter, the writer tells us as soon as it has consumed records */
+   pthread_mutex_lock(&log_async.lock);
+   __atomic_fetch_add(&log_async.waiters, 1, __ATOMIC_SEQ_CST);
+   while ((int32_t)(head - __atomic_load_n(&log_async.tail, __ATOMIC_SEQ_CST)) > 0 && !log_async.quit)
+   {
+      __atomic_store_n(&log_async.writer_sleeping, 0, __ATOMIC_SEQ_CST);
+      pthread_cond_signal(&log_async.wake);
+      pthread_cond_wait(&log_async.space, &log_async.lock);
+   }
+   __atomic_fetch_sub(&log_async.waiters, 1, __ATOMIC_SEQ_CST);
+   pthread_mutex_unlock(&log_async.lock);
+}
+
+void vcos_log_async_stop(void)
+{
+   if (!log_async.running)
+      return;
+
+   vcos_set_vlog_impl(NULL);
+
+   /* Let threads which are already logging finish */
+   pthread_mutex_lock(&log_async.lock);
+   __atomic_store_n(&log_async.quit, 1, __ATOMIC_SEQ_CST);
+   pthread_cond_broadcast(&log_async.space);
+   pthread_cond_signal(&log_async.wake);
+   pthread_mutex_unlock(&log_async.lock);
+   while (__atomic_load_n(&log_async.users, __ATOMIC_SEQ_CST))
+      sched_yield();
+
+   pthread_join(log_async.writer, NULL);
+   log_async.running = 0;
+   free(log_async.ring);
+   log_async.ring = NULL;
+}
+
+void vcos_log_async_stats(VCOS_LOG_ASYNC_STATS_T *stats, int reset)
+{
+   uint32_t *src = (uint32_t *)&log_async.stats;
+   uint32_t *dst = (uint32_t *)stats;
+   unsigned int i;
+
+   /* The counters are updated with atomics from the logging threads. The
+    * 32-bit ones run from messages to writes, without the padding which may
+    * follow. */
+   stats->bytes_written = __atomic_load_n(&log_async.stats.bytes_written, __ATOMIC_RELAXED);
+   for (i = 0; i <= offsetof(VCOS_LOG_ASYNC_STATS_T, writes) / sizeof(uint32_t); i++)
+      dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+   stats->max_used = __atomic_load_n(&log_async.stats.max_used, __ATOMIC_RELAXED);
+
+   if (reset)
+   {
+      for (i = 0; i <= offsetof(VCOS_LOG_ASYNC_STATS_T, writes) / sizeof(uint32_t); i++)
+         __atomic_fetch_sub(&src[i], dst[i], __ATOMIC_RELAXED);
+      __atomic_fetch_sub(&log_async.stats.bytes_written, stats->bytes_written, __ATOMIC_RELAXED);
+      __atomic_store_n(&log_async.stats.max_used, 0, __ATOMIC_RELAXED);
+   }
+}
@@ -133,8 +133,28 @@ typedef struct VCOS_TIMER_T
    void (*orig_expiration_routine)(void*);/**< the expiration routine provided by the user of the timer*/
    void *orig_context;                    /**< the context for exp. routine provided by the user*/
 
+   int service;                           /**< non-zero if run by the timer service rather than its own thread*/
+   unsigned int heap_index;               /**< position in the timer service's heap, 0 if not queued*/
+   uint32_t generation;                   /**< incremented whenever the timer is set or cancelled*/
+
 } VCOS_TIMER_T;
 
+/** Firing statistics of the timer service. Latency is the time between
+  * the expiry time and the expiration routine being called. */
+#define VCOS_TIMER_SERVICE_LATENCY_BUCKETS 8
+
+typedef struct VCOS_TIMER_SERVICE_STATS_T
+{
+   uint32_t timers;                       /**< timers currently created in service mode*/
+   uint32_t armed;                        /**< timers currently waiting to expire*/
+   uint32_t max_armed;
+   uint32_t fired;                        /**< expiration routines called*/
+   uint64_t total_latency_us;
+   uint32_t max_latency_us;
+   /** Bucket n counts latencies below (16 << 2n) us, the last one the rest */
+   uint32_t latency[VCOS_TIMER_SERVICE_LATENCY_BUCKETS];
+} VCOS_TIMER_SERVICE_STATS_T;
+
 /** Thread attribute structure. Don't use pthread_attr directly, as
   * the calls can fail, and inits must match deletes.
   */
@@ -692,6 +712,21 @@ void vcos_pthreads_timer_cancel(VCOS_TIMER_T *timer);
 void vcos_pthreads_timer_reset(VCOS_TIMER_T *timer, VCOS_UNSIGNED delay_ms);
 void vcos_pthreads_timer_delete(VCOS_TIMER_T *timer);
 
+/** Select whether timers created from now on run on their own thread (the
+  * default) or are all run by a single timer service thread. The service
+  * keeps armed timers in a heap ordered by CLOCK_MONOTONIC expiry time, so
+  * changes to the wall clock don't affect them. Expiration routines of
+  * service timers run one at a time and should return quickly.
+  *
+  * Setting VCOS_TIMER_SERVICE=1 in the environment enables the service by
+  * default.
+  */
+void vcos_pthreads_timer_service_enable(int enable);
+
+/** Get the statistics of the timer service, optionally resetting the
+  * firing counts and latencies. */
+void vcos_pthreads_timer_service_stats(VCOS_TIMER_SERVICE_STATS_T *stats, int reset);
+
 /** Create a timer.
   *
   * Note that we just cast the expiry function - this assumes that UNSIGNED
@@ -789,6 +824,61 @@ void vcos_legacy_hisr_delete(VCOS_HISR_T *hisr);
 #define  vcos_log_platform_init()               _vcos_log_platform_init()
 VCOSPRE_ void VCOSPOST_             _vcos_log_platform_init(void);
 
+/** Write already formatted log text to the platform's log stream */
+VCOSPRE_ void VCOSPOST_             _vcos_log_platform_write(const char *text, size_t len);
+
+/*
+ * Asynchronous logging
+ *
+ * Log messages are put into a lock-free ring buffer by the logging thread
+ * and written out in batches by a background writer thread, so logging no
+ * longer blocks on the log stream. Category names and levels work as
+ * before. Messages longer than VCOS_LOG_ASYNC_LINE_MAX are truncated.
+ *
+ * Setting VCOS_LOG_ASYNC in the environment to "drop" or "block", optionally
+ * followed by ",binary", starts it from vcos_init.
+ */
+
+#define VCOS_LOG_ASYNC_LINE_MAX 512
+
+/** What to do when the ring buffer is full */
+typedef enum
+{
+   VCOS_LOG_ASYNC_DROP,                   /**< Drop the message and count it */
+   VCOS_LOG_ASYNC_BLOCK,                  /**< Wait for the writer to make space */
+} VCOS_LOG_ASYNC_POLICY_T;
+
+typedef struct VCOS_LOG_ASYNC_CONFIG_T
+{
+   uint32_t ring_size;                    /**< Bytes, rounded up to a power of 2. 0 for the default. */
+   uint32_t batch_size;                   /**< Most bytes of text per write. 0 for the default. */
+   VCOS_LOG_ASYNC_POLICY_T policy;
+   /** Store the format string and the arguments rather than the formatted
+    * text, so that formatting is done by the writer thread. The format
+    * strings must outlive the writer, which is true of string literals.
+    * Messages with conversions which can't be stored are formatted. */
+   int binary;
+} VCOS_LOG_ASYNC_CONFIG_T;
+
+typedef struct VCOS_LOG_ASYNC_STATS_T
+{
+   uint32_t messages;                     /**< Messages put into the ring */
+   uint32_t binary;                       /**< Of which stored in binary form */
+   uint32_t dropped;                      /**< Messages dropped because the ring was full */
+   uint32_t blocked;                      /**< Times a thread waited for space in the ring */
+   uint32_t writes;                       /**< Batches written to the log stream */
+   uint64_t bytes_written;
+   uint32_t max_used;                     /**< Highest ring occupancy seen by the writer, in bytes */
+} VCOS_LOG_ASYNC_STATS_T;
+
+/** Start logging asynchronously. NULL selects the defaults. */
+VCOSPRE_ VCOS_STATUS_T VCOSPOST_    vcos_log_async_start(const VCOS_LOG_ASYNC_CONFIG_T *config);
+/** Write out everything logged so far, then go back to synchronous logging */
+VCOSPRE_ void VCOSPOST_             vcos_log_async_stop(void);
+/** Wait until everything logged so far has been written out */
+VCOSPRE_ void VCOSPOST_             vcos_log_async_flush(void);
+VCOSPRE_ void VCOSPOST_             vcos_log_async_stats(VCOS_LOG_ASYNC_STATS_T *stats, int reset);
+
 VCOS_INLINE_DECL void _vcos_thread_sem_wait(void);
 VCOS_INLINE_DECL void _vcos_thread_sem_post(VCOS_THREAD_T *);
 
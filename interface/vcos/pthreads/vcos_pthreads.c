@@ -318,8 +318,19 @@ void vcos_vlog_default_impl(const VCOS_LOG_CAT_T *cat, VCOS_LOG_LEVEL_T _level,
 #endif
 }
 
+void _vcos_log_platform_write(const char *text, size_t len)
+{
+   if(NULL != log_fhandle)
+   {
+      fwrite(text, 1, len, log_fhandle);
+      fflush(log_fhandle);
+   }
+}
+
 void _vcos_log_platform_init(void)
 {
+   const char *async = getenv("VCOS_LOG_ASYNC");
+
    if(vcos_log_to_file)
    {
       char log_fname[100];
@@ -332,6 +343,16 @@ void _vcos_log_platform_init(void)
    }
    else
       log_fhandle = stderr;
+
+   if (async && *async && !vcos_use_android_log)
+   {
+      VCOS_LOG_ASYNC_CONFIG_T config;
+
+      memset(&config, 0, sizeof(config));
+      config.policy = strncmp(async, "block", 5) ? VCOS_LOG_ASYNC_DROP : VCOS_LOG_ASYNC_BLOCK;
+      config.binary = strstr(async, "binary") != NULL;
+      vcos_log_async_start(&config);
+   }
 }
 
 /* Flags for init/deinit components */
@@ -739,6 +760,329 @@ static void* _timer_thread(void *arg)
    return NULL;
 }
 
+/* Timer service
+ *
+ * Optionally all timers are run by a single thread. Armed timers are kept
+ * in a binary heap ordered by expiry time so setting and cancelling a timer
+ * is O(log n). Expiry times are taken from CLOCK_MONOTONIC, which is why
+ * the service is opt-in (see the note about Bionic above).
+ *
+ * Expiration routines are still called with the timer's own lock held, so
+ * once vcos_timer_cancel() returns the routine won't be called. The lock
+ * order is timer lock then service lock, so the service thread drops its
+ * lock before taking the timer's and uses the timer's generation to detect
+ * a set or cancel which happened in between.
+ *
+ * A routine may delete its own timer. If that was the last timer the
+ * thread can't join itself, so it is left to detach and exit once the
+ * routine returns, unless a new timer is created first.
+ */
+typedef struct
+{
+   pthread_mutex_t lock;                  /* protects everything below */
+   pthread_cond_t changed;                /* the earliest expiry time has changed */
+   pthread_cond_t fired;                  /* the service thread is done with a timer */
+   pthread_t thread;
+   int running;
+   int quit;                              /* TIMER_SERVICE_QUIT_xxx */
+   VCOS_TIMER_T **heap;                   /* 1-based, heap[1] expires first */
+   unsigned int heap_size;
+   unsigned int heap_capacity;
+   VCOS_TIMER_T *firing;                  /* timer the thread is about to call */
+   VCOS_TIMER_SERVICE_STATS_T stats;
+} VCOS_TIMER_SERVICE_T;
+
+/* Values of quit: the thread is joined, or detaches itself */
+#define TIMER_SERVICE_QUIT_JOIN   1
+#define TIMER_SERVICE_QUIT_DETACH 2
+
+static VCOS_TIMER_SERVICE_T timer_service = { PTHREAD_MUTEX_INITIALIZER };
+/* Serialises starting and stopping the service thread */
+static pthread_mutex_t timer_service_users_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t timer_service_once = PTHREAD_ONCE_INIT;
+static int timer_service_enabled;
+static int timer_service_init_failed;
+
+static void _timer_service_init(void)
+{
+   pthread_condattr_t attr;
+   const char *env = getenv("VCOS_TIMER_SERVICE");
+
+   if (env && *env && strcmp(env, "0"))
+      timer_service_enabled = 1;
+
+   if (pthread_condattr_init(&attr) ||
+       pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) ||
+       pthread_cond_init(&timer_service.changed, &attr) ||
+       pthread_cond_init(&timer_service.fired, NULL))
+      timer_service_init_failed = 1;
+   pthread_condattr_destroy(&attr);
+}
+
+static void _timer_heap_place(unsigned int i, VCOS_TIMER_T *timer)
+{
+   timer_service.heap[i] = timer;
+   timer->heap_index = i;
+}
+
+static void _timer_heap_sift_up(unsigned int i)
+{
+   VCOS_TIMER_T *timer = timer_service.heap[i];
+
+   while (i > 1 && _timespec_is_larger(&timer_service.heap[i / 2]->expires, &timer->expires))
+   {
+      _timer_heap_place(i, timer_service.heap[i / 2]);
+      i /= 2;
+   }
+   _timer_heap_place(i, timer);
+}
+
+static void _timer_heap_sift_down(unsigned int i)
+{
+   VCOS_TIMER_T *timer = timer_service.heap[i];
+   unsigned int child;
+
+   while ((child = 2 * i) <= timer_service.heap_size)
+   {
+      if (child < timer_service.heap_size &&
+          _timespec_is_larger(&timer_service.heap[child]->expires,
+                              &timer_service.heap[child + 1]->expires))
+         child++;
+      if (!_timespec_is_larger(&timer->expires, &timer_service.heap[child]->expires))
+         break;
+      _timer_heap_place(i, timer_service.heap[child]);
+      i = child;
+   }
+   _timer_heap_place(i, timer);
+}
+
+static void _timer_heap_remove(VCOS_TIMER_T *timer)
+{
+   unsigned int i = timer->heap_index;
+   VCOS_TIMER_T *last = timer_service.heap[timer_service.heap_size--];
+
+   timer->heap_index = 0;
+   if (last == timer)
+      return;
+
+   _timer_heap_place(i, last);
+   _timer_heap_sift_up(i);
+   _timer_heap_sift_down(last->heap_index);
+}
+
+static void _timer_service_record(struct timespec *expires, struct timespec *now)
+{
+   VCOS_TIMER_SERVICE_STATS_T *stats = &timer_service.stats;
+   int64_t late = (int64_t)(now->tv_sec - expires->tv_sec) * 1000000 +
+      (now->tv_nsec - expires->tv_nsec) / 1000;
+   uint32_t latency = late > 0 ? (late < UINT32_MAX ? (uint32_t)late : UINT32_MAX) : 0;
+   unsigned int bucket = 0;
+
+   while (bucket < VCOS_TIMER_SERVICE_LATENCY_BUCKETS - 1 && latency >= (16u << (2 * bucket)))
+      bucket++;
+
+   stats->fired++;
+   stats->total_latency_us += latency;
+   if (latency > stats->max_latency_us)
+      stats->max_latency_us = latency;
+   stats->latency[bucket]++;
+}
+
+static void* _timer_service_thread(void *arg)
+{
+   (void)arg;
+
+   pthread_mutex_lock(&timer_service.lock);
+   while (!timer_service.quit)
+   {
+      struct timespec now, expires;
+      VCOS_TIMER_T *timer;
+      uint32_t generation;
+
+      /* Wait until the earliest expiry time, or until it changes */
+      if (!timer_service.heap_size)
+      {
+         pthread_cond_wait(&timer_service.changed, &timer_service.lock);
+         continue;
+      }
+
+      timer = timer_service.heap[1];
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (_timespec_is_larger(&timer->expires, &now))
+      {
+         pthread_cond_timedwait(&timer_service.changed, &timer_service.lock, &timer->expires);
+         continue;
+      }
+
+      /* The timer has expired. Take it off the heap and call the
+       * expiration routine with the timer's lock held, unless it was set
+       * again or cancelled before we got the lock.
+       */
+      _timer_heap_remove(timer);
+      timer_service.stats.armed--;
+      expires = timer->expires;
+      generation = timer->generation;
+      timer_service.firing = timer;
+      pthread_mutex_unlock(&timer_service.lock);
+
+      pthread_mutex_lock(&timer->lock);
+      pthread_mutex_lock(&timer_service.lock);
+      if (timer->generation == generation)
+      {
+         _timespec_set_zero(&timer->expires);
+         clock_gettime(CLOCK_MONOTONIC, &now);
+         _timer_service_record(&expires, &now);
+         pthread_mutex_unlock(&timer_service.lock);
+
+         timer->orig_expiration_routine(timer->orig_context);
+
+         pthread_mutex_lock(&timer_service.lock);
+      }
+
+      /* Unless the routine deleted the timer, which released its lock */
+      if (timer_service.firing == timer)
+         pthread_mutex_unlock(&timer->lock);
+      timer_service.firing = NULL;
+      pthread_cond_broadcast(&timer_service.fired);
+   }
+
+   /* The last timer was deleted by its own routine */
+   if (timer_service.quit == TIMER_SERVICE_QUIT_DETACH)
+   {
+      timer_service.running = 0;
+      pthread_detach(pthread_self());
+   }
+   pthread_mutex_unlock(&timer_service.lock);
+
+   return NULL;
+}
+
+/* Register a new service timer, starting the service thread if needed */
+static VCOS_STATUS_T _timer_service_add(void)
+{
+   VCOS_STATUS_T result = VCOS_SUCCESS;
+   int start = 0;
+
+   pthread_mutex_lock(&timer_service_users_lock);
+   pthread_mutex_lock(&timer_service.lock);
+
+   /* Make sure setting a timer never has to grow the heap */
+   if (timer_service.stats.timers + 1 >= timer_service.heap_capacity)
+   {
+      unsigned int capacity = timer_service.heap_capacity ? 2 * timer_service.heap_capacity : 16;
+      VCOS_TIMER_T **heap = realloc(timer_service.heap, capacity * sizeof(*heap));
+      if (heap)
+      {
+         timer_service.heap = heap;
+         timer_service.heap_capacity = capacity;
+      }
+      else
+      {
+         result = VCOS_ENOMEM;
+      }
+   }
+   if (result == VCOS_SUCCESS)
+   {
+      timer_service.stats.timers++;
+
+      /* A thread which was going to detach keeps going instead */
+      start = !timer_service.running;
+      timer_service.quit = 0;
+   }
+
+   pthread_mutex_unlock(&timer_service.lock);
+
+   if (start)
+   {
+      int rc = pthread_create(&timer_service.thread, NULL, _timer_service_thread, NULL);
+
+      pthread_mutex_lock(&timer_service.lock);
+      if (rc == 0)
+      {
+         timer_service.running = 1;
+      }
+      else
+      {
+         result = vcos_pthreads_map_error(rc);
+         timer_service.stats.timers--;
+      }
+      pthread_mutex_unlock(&timer_service.lock);
+   }
+
+   pthread_mutex_unlock(&timer_service_users_lock);
+   return result;
+}
+
+/* Unregister a service timer, stopping the service thread after the last
+ * one. Returns 1 if the timer was deleted by its own expiration routine, in
+ * which case the caller still holds the lock taken by the service thread. */
+static int _timer_service_remove(VCOS_TIMER_T *timer)
+{
+   int stop, self, own = 0;
+
+   pthread_mutex_lock(&timer_service_users_lock);
+   pthread_mutex_lock(&timer_service.lock);
+
+   self = timer_service.running && pthread_equal(pthread_self(), timer_service.thread);
+
+   if (timer->heap_index)
+   {
+      _timer_heap_remove(timer);
+      timer_service.stats.armed--;
+   }
+   timer->generation++;
+
+   /* Don't free the timer under the feet of the service thread. If this is
+    * the service thread, the routine is deleting its own timer. */
+   if (self && timer_service.firing == timer)
+   {
+      timer_service.firing = NULL;
+      own = 1;
+   }
+   while (timer_service.firing == timer)
+      pthread_cond_wait(&timer_service.fired, &timer_service.lock);
+
+   stop = (--timer_service.stats.timers == 0);
+   if (stop)
+   {
+      timer_service.quit = self ? TIMER_SERVICE_QUIT_DETACH : TIMER_SERVICE_QUIT_JOIN;
+      pthread_cond_signal(&timer_service.changed);
+   }
+   pthread_mutex_unlock(&timer_service.lock);
+
+   if (stop && !self)
+   {
+      pthread_join(timer_service.thread, NULL);
+      pthread_mutex_lock(&timer_service.lock);
+      timer_service.running = 0;
+      pthread_mutex_unlock(&timer_service.lock);
+   }
+
+   pthread_mutex_unlock(&timer_service_users_lock);
+   return own;
+}
+
+void vcos_pthreads_timer_service_enable(int enable)
+{
+   pthread_once(&timer_service_once, _timer_service_init);
+   timer_service_enabled = enable;
+}
+
+void vcos_pthreads_timer_service_stats(VCOS_TIMER_SERVICE_STATS_T *stats, int reset)
+{
+   pthread_mutex_lock(&timer_service.lock);
+   *stats = timer_service.stats;
+   if (reset)
+   {
+      timer_service.stats.max_armed = timer_service.stats.armed;
+      timer_service.stats.fired = 0;
+      timer_service.stats.total_latency_us = 0;
+      timer_service.stats.max_latency_us = 0;
+      memset(timer_service.stats.latency, 0, sizeof(timer_service.stats.latency));
+   }
+   pthread_mutex_unlock(&timer_service.lock);
+}
+
 VCOS_STATUS_T vcos_timer_init(void)
 {
    return VCOS_SUCCESS;
@@ -765,6 +1109,9 @@ VCOS_STATUS_T vcos_pthreads_timer_create(VCOS_TIMER_T *timer,
    timer->orig_expiration_routine = expiration_routine;
    timer->orig_context = context;
 
+   pthread_once(&timer_service_once, _timer_service_init);
+   timer->service = timer_service_enabled && !timer_service_init_failed;
+
    /* Create conditional variable for notifying the timer's thread
     * when settings change.
     */
@@ -806,8 +1153,12 @@ VCOS_STATUS_T vcos_pthreads_timer_create(VCOS_TIMER_T *timer,
    if (lock_attr_initialized)
       pthread_mutexattr_destroy(&lock_attr);
 
-   /* Create the underlying thread */
-   if (result == VCOS_SUCCESS)
+   /* Create the underlying thread, or register with the timer service */
+   if (result == VCOS_SUCCESS && timer->service)
+   {
+      result = _timer_service_add();
+   }
+   else if (result == VCOS_SUCCESS)
    {
       int rc = pthread_create(&timer->thread, NULL, _timer_thread, timer);
       if (rc != 0)
@@ -842,6 +1193,39 @@ void vcos_pthreads_timer_set(VCOS_TIMER_T *timer, VCOS_UNSIGNED delay_ms)
 
    pthread_mutex_lock(&timer->lock);
 
+   if (timer->service)
+   {
+      pthread_mutex_lock(&timer_service.lock);
+
+      /* Calculate the new absolute expiry time */
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      timer->expires.tv_sec = delay_ms / MSEC_IN_SEC;
+      timer->expires.tv_nsec = (delay_ms % MSEC_IN_SEC) * NSEC_IN_MSEC;
+      _timespec_add(&timer->expires, &now);
+      timer->generation++;
+
+      if (timer->heap_index)
+      {
+         _timer_heap_sift_up(timer->heap_index);
+         _timer_heap_sift_down(timer->heap_index);
+      }
+      else
+      {
+         _timer_heap_place(++timer_service.heap_size, timer);
+         _timer_heap_sift_up(timer_service.heap_size);
+         if (++timer_service.stats.armed > timer_service.stats.max_armed)
+            timer_service.stats.max_armed = timer_service.stats.armed;
+      }
+
+      /* Only wake up the service thread if it has to wait for less */
+      if (timer_service.heap[1] == timer)
+         pthread_cond_signal(&timer_service.changed);
+
+      pthread_mutex_unlock(&timer_service.lock);
+      pthread_mutex_unlock(&timer->lock);
+      return;
+   }
+
    /* Calculate the new absolute expiry time */
    clock_gettime(CLOCK_REALTIME, &now);
    timer->expires.tv_sec = delay_ms / MSEC_IN_SEC;
@@ -860,8 +1244,23 @@ void vcos_pthreads_timer_cancel(VCOS_TIMER_T *timer)
 
    pthread_mutex_lock(&timer->lock);
 
-   _timespec_set_zero(&timer->expires);
-   pthread_cond_signal(&timer->settings_changed);
+   if (timer->service)
+   {
+      pthread_mutex_lock(&timer_service.lock);
+      if (timer->heap_index)
+      {
+         _timer_heap_remove(timer);
+         timer_service.stats.armed--;
+      }
+      timer->generation++;
+      _timespec_set_zero(&timer->expires);
+      pthread_mutex_unlock(&timer_service.lock);
+   }
+   else
+   {
+      _timespec_set_zero(&timer->expires);
+      pthread_cond_signal(&timer->settings_changed);
+   }
 
    pthread_mutex_unlock(&timer->lock);
 }
@@ -870,6 +1269,17 @@ void vcos_pthreads_timer_delete(VCOS_TIMER_T *timer)
 {
    vcos_assert(timer);
 
+   if (timer->service)
+   {
+      /* Unlike other implementations, service timers may be deleted from
+       * their expiration routine. Release the lock held around the call. */
+      if (_timer_service_remove(timer))
+         pthread_mutex_unlock(&timer->lock);
+      pthread_mutex_destroy(&timer->lock);
+      pthread_cond_destroy(&timer->settings_changed);
+      return;
+   }
+
    pthread_mutex_lock(&timer->lock);
 
    /* Other implementation of this function (e.g. ThreadX)
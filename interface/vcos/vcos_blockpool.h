@@ -165,6 +165,24 @@ VCOS_INLINE_DECL
    VCOS_STATUS_T vcos_blockpool_extend(VCOS_BLOCKPOOL_T *pool,
          VCOS_UNSIGNED num_extensions, VCOS_UNSIGNED num_blocks);
 
+/** May be called once, before the pool is shared between threads, to give
+ * each thread using the pool a magazine of free blocks. Blocks are then
+ * allocated from and freed to the calling thread's magazine without taking
+ * the pool lock, and the lock is only taken to exchange a full or empty
+ * magazine with the pool. Blocks held in magazines count as available and
+ * are taken back from other threads when the pool would otherwise run out.
+ * Blocks from extension subpools always go back to their subpool so that
+ * the subpool can be freed.
+ *
+ * @param magazine_size  The number of blocks per magazine, up to
+ *                       VCOS_BLOCKPOOL_MAGAZINE_SIZE_MAX. Zero leaves
+ *                       magazines disabled.
+ * @return VCOS_SUCCESS if successful.
+ */
+VCOS_INLINE_DECL
+   VCOS_STATUS_T vcos_blockpool_set_magazines(VCOS_BLOCKPOOL_T *pool,
+         VCOS_UNSIGNED magazine_size);
+
 #ifdef __cplusplus
 }
 #endif